@@ -0,0 +1,116 @@
+//bits that every program running the whole sketch on the host needs (lucifer_host, lucifer_sim, lucifer_sweep). Include it
+//after LUCIFER.ino, it uses the sketch's MEMORY.h, CAR.h and setup()/loop().
+#ifndef _HOST_RUN_H_
+#define _HOST_RUN_H_
+
+#include"EEPROM.h"
+#include"SENSORS.h"
+#include"RAW_LOG.h"
+#include"SIMULATOR.h"
+
+//store zero offsets and unit soft iron gains so that setup() takes the "offsets found in memory" path instead of trying
+//to run the calibration ritual against sensors that never move. The sensor models already read in calibrated counts.
+//mag (offsetM then axis_gain) stands in for what an earlier run's MAG_CALIBRATOR left in the EEPROM
+inline void factory_offsets(RAW_LOG_WRITER &recorder, const int16_t *mag = NULL)
+{
+	RAW_OFFSETS_RECORD o;
+	memset(&o, 0, sizeof(o));
+	o.gain[0] = o.gain[1] = o.gain[2] = 1000;
+	int16_t A[3] = {0, 0, 0}, G[3] = {0, 0, 0}, M[3] = {0, 0, 0}, gain[3] = {1000, 1000, 1000};
+	for(int i = 0; mag != NULL && i < 3; i++)
+	{
+		o.M[i] = M[i] = mag[i];
+		o.gain[i] = gain[i] = mag[3 + i];
+	}
+	store_memory(0, A, G, M, 0, gain);
+	EEPROM.write(2, 1); //check_memory() wants the first two cells to differ
+	recorder.write(RAW_OFFSETS, &o, sizeof(o));
+}
+
+//what the sensors hold right now, plus any serial bytes that came in since the last record. does nothing if the log isn't open
+inline void record_sample(RAW_LOG_WRITER &recorder, SENSORS &sensors, uint8_t type)
+{
+	if(!recorder.is_open())
+	{
+		return;
+	}
+	RAW_SAMPLE sample;
+	recorder.drain();
+	sensors.save(sample);
+	recorder.write(type, &sample, sizeof(sample));
+}
+
+//what the controller believes about the car (CAR.h, PARAMS.h), so that the model starts out matched to it
+inline void matched_vehicle(VEHICLE_PARAMS &p)
+{
+	p.wheelbase = WHEELBASE;
+	p.cg_to_front = FR_ratio*WHEELBASE;
+	p.cg_height = CG_HEIGHT;
+	p.yaw_inertia = p.mass*p.cg_to_front*(p.wheelbase - p.cg_to_front);
+	p.mu = DEFAULT_MU;
+	p.steering_gain = STEERING_OPEN_GAIN;
+	p.steering_max = STEERING_MAX;
+	p.esc_offset = THROTTLE_OFFSET;
+	p.esc_range = THROTTLE_RANGE;
+	p.esc_time_constant = THROTTLE_TIME_CONSTANT;
+	p.imu_position = DIST_BW_ACCEL_AXLE;
+	p.flow_position = OP_POS;
+}
+
+//car on the start line, sensors at rest, then setup(). The GPS and GCS stay quiet until the first sim_drive tick
+inline void sim_setup(SIMULATOR &sim, SENSORS &sensors, RAW_LOG_WRITER &recorder, const int16_t *mag = NULL)
+{
+	sensors.attach();
+	sim.start(host_get_micros());
+	factory_offsets(recorder, mag);
+	record_sample(recorder, sensors, RAW_SETUP);
+	setup();
+}
+
+#define SIM_DONE 0    //did the laps
+#define SIM_CRASHED 1
+#define SIM_TIMEOUT 2 //ran out of car time first
+
+//loop() against the simulator until the car has done laps, crashed or used up seconds of car time. after_loop(tick, stamp) is
+//called after every loop(), for traces. returns one of the above
+template<typename F>
+inline int sim_drive(SIMULATOR &sim, SENSORS &sensors, RAW_LOG_WRITER &recorder, uint32_t laps, float seconds, F after_loop)
+{
+	uint32_t start = host_get_micros();
+	long tick = 0;
+	while((host_get_micros() - start)*1e-6f < seconds)
+	{
+		uint32_t stamp = host_get_micros();
+		sim.update(stamp);
+		record_sample(recorder, sensors, RAW_TICK);
+		loop();
+		after_loop(tick, stamp);
+		tick++;
+		if(sim.stats.crashed)
+		{
+			return SIM_CRASHED;
+		}
+		if(sim.stats.laps >= laps)
+		{
+			return SIM_DONE;
+		}
+	}
+	return SIM_TIMEOUT;
+}
+
+//best lap, leaving out the first one (standing start) unless it is the only one. 0 if there are none
+inline float sim_best_lap(const SIM_STATS &stats)
+{
+	float best = 0;
+	for(size_t i = 0; i < stats.lap_times.size(); i++)
+	{
+		float t = stats.lap_times[i];
+		if(i == 1 || (i > 1 && t < best) || stats.lap_times.size() == 1)
+		{
+			best = t;
+		}
+	}
+	return best;
+}
+
+#endif
@@ -0,0 +1,124 @@
+#include"RAW_LOG.h"
+#include<string.h>
+
+RAW_LOG_WRITER::RAW_LOG_WRITER()
+{
+	f = NULL;
+}
+
+RAW_LOG_WRITER::~RAW_LOG_WRITER()
+{
+	close();
+}
+
+bool RAW_LOG_WRITER::open(const char *path)
+{
+	close();
+	f = fopen(path, "wb");
+	if(!f)
+	{
+		return false;
+	}
+	fwrite(RAW_LOG_MAGIC, 1, RAW_LOG_MAGIC_LENGTH, f);
+	return true;
+}
+
+void RAW_LOG_WRITER::close()
+{
+	if(f)
+	{
+		fclose(f);
+		f = NULL;
+	}
+}
+
+void RAW_LOG_WRITER::write(uint8_t type, const void *payload, uint16_t len)
+{
+	if(!f)
+	{
+		return;
+	}
+	RAW_RECORD_HEADER h;
+	h.type = type;
+	h.reserved = 0;
+	h.len = len;
+	fwrite(&h, sizeof(h), 1, f);
+	fwrite(payload, 1, len, f);
+}
+
+void RAW_LOG_WRITER::serial(uint8_t port, const std::vector<uint8_t> &bytes)
+{
+	uint8_t buf[65535];
+	size_t done = 0;
+	while(done < bytes.size())
+	{
+		size_t n = bytes.size() - done;
+		n = n > sizeof(buf) - 1 ? sizeof(buf) - 1 : n;
+		buf[0] = port;
+		memcpy(buf + 1, &bytes[done], n);
+		write(RAW_SERIAL, buf, uint16_t(n + 1));
+		done += n;
+	}
+}
+
+void RAW_LOG_WRITER::drain()
+{
+	HardwareSerial *port[3] = {&Serial, &Serial1, &Serial2};
+	for(int i = 0; i < 3; i++)
+	{
+		if(port[i]->rx_log.size())
+		{
+			serial(uint8_t(i), port[i]->rx_log);
+			port[i]->rx_log.clear();
+		}
+	}
+}
+
+RAW_LOG_READER::RAW_LOG_READER()
+{
+	f = NULL;
+	type = 0;
+}
+
+RAW_LOG_READER::~RAW_LOG_READER()
+{
+	close();
+}
+
+bool RAW_LOG_READER::open(const char *path)
+{
+	close();
+	f = fopen(path, "rb");
+	if(!f)
+	{
+		return false;
+	}
+	char magic[RAW_LOG_MAGIC_LENGTH];
+	if(fread(magic, 1, RAW_LOG_MAGIC_LENGTH, f) != RAW_LOG_MAGIC_LENGTH || memcmp(magic, RAW_LOG_MAGIC, RAW_LOG_MAGIC_LENGTH))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool RAW_LOG_READER::next()
+{
+	RAW_RECORD_HEADER h;
+	if(!f || fread(&h, sizeof(h), 1, f) != 1)
+	{
+		return false;
+	}
+	type = h.type;
+	payload.resize(h.len);
+	return h.len == 0 || fread(&payload[0], 1, h.len, f) == h.len;
+}
+
+void RAW_LOG_READER::close()
+{
+	if(f)
+	{
+		fclose(f);
+		f = NULL;
+	}
+}
@@ -0,0 +1,92 @@
+//raw sensor log : everything the car's code reads from the outside world, tick by tick, so that a run can be played back
+//through the same code later (see lucifer_replay.cpp).
+//
+//file layout : the 8 byte magic, then records. Every record is a RAW_RECORD_HEADER followed by len bytes of payload.
+//	RAW_OFFSETS  the calibration that was in the EEPROM (RAW_OFFSETS_RECORD)
+//	RAW_SETUP    the sensor readings during setup() (RAW_SAMPLE)
+//	RAW_SERIAL   bytes that arrived on a serial port before the next tick, first payload byte is the port (RAW_PORT_*)
+//	RAW_TICK     the sensor readings and receiver pulses for one loop() call (RAW_SAMPLE)
+//All numbers are little endian, which is what both the STM32 and a PC are.
+#ifndef _RAW_LOG_H_
+#define _RAW_LOG_H_
+
+#include"Arduino.h"
+#include<stdint.h>
+#include<stdio.h>
+#include<vector>
+
+#define RAW_LOG_MAGIC "LUCRAW01"
+#define RAW_LOG_MAGIC_LENGTH 8
+
+enum RAW_RECORD_TYPE
+{
+	RAW_OFFSETS = 1,
+	RAW_SETUP = 2,
+	RAW_SERIAL = 3,
+	RAW_TICK = 4
+};
+
+enum RAW_PORT
+{
+	RAW_PORT_GCS = 0,   //Serial
+	RAW_PORT_GPS = 1,   //Serial1
+	RAW_PORT_JEVOIS = 2 //Serial2
+};
+
+#pragma pack(push, 1)
+struct RAW_RECORD_HEADER
+{
+	uint8_t type;
+	uint8_t reserved;
+	uint16_t len;
+};
+
+struct RAW_SAMPLE
+{
+	uint32_t micros;   //virtual clock at the start of the tick
+	int16_t a[3], g[3], t; //MPU9150 raw counts, as they sit in the registers
+	int16_t m[3];      //AK8975 raw counts, in the magnetometer's own axes
+	uint8_t flow[7];   //ADNS3080 motion burst : motion, dx, dy, squal, shutter H, shutter L, max pix
+	uint8_t reserved;
+	int32_t inputs[8]; //receiver pulse widths, what INOUT's interrupt put in input[]
+};
+
+struct RAW_OFFSETS_RECORD
+{
+	int16_t A[3], G[3], M[3], T, gain[3];
+};
+#pragma pack(pop)
+
+class RAW_LOG_WRITER
+{
+public:
+	RAW_LOG_WRITER();
+	~RAW_LOG_WRITER();
+	bool open(const char *path);
+	void close();
+	void write(uint8_t type, const void *payload, uint16_t len);
+	void serial(uint8_t port, const std::vector<uint8_t> &bytes); //split into records of at most 65534 bytes
+	void drain(); //whatever Serial/Serial1/Serial2 logged since the last call (HardwareSerial::log_rx)
+	bool is_open()
+	{
+		return f != NULL;
+	}
+private:
+	FILE *f;
+};
+
+class RAW_LOG_READER
+{
+public:
+	uint8_t type;
+	std::vector<uint8_t> payload;
+	RAW_LOG_READER();
+	~RAW_LOG_READER();
+	bool open(const char *path); //false if the file is missing or isn't a raw log
+	bool next(); //reads the next record into type/payload, false at the end of the file (or on a truncated record)
+	void close();
+private:
+	FILE *f;
+};
+
+#endif
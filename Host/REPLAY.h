@@ -0,0 +1,120 @@
+//what the programs that play a raw log back through the sketch share (lucifer_replay, lucifer_smooth). Include it after
+//LUCIFER.ino, it calls setup()/loop() and the sketch's MEMORY.h.
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include"EEPROM.h"
+#include"SENSORS.h"
+#include"RAW_LOG.h"
+#include<stdio.h>
+#include<string.h>
+#include<vector>
+
+inline void replay_offsets(const RAW_OFFSETS_RECORD &o)
+{
+	int16_t A[3], G[3], M[3], gain[3];
+	for(int i = 0; i < 3; i++)
+	{
+		A[i] = o.A[i];
+		G[i] = o.G[i];
+		M[i] = o.M[i];
+		gain[i] = o.gain[i];
+	}
+	store_memory(0, A, G, M, o.T, gain);
+	EEPROM.write(2, 1);
+}
+
+inline void replay_serial(const std::vector<uint8_t> &payload)
+{
+	HardwareSerial *port[3] = {&Serial, &Serial1, &Serial2};
+	if(payload.size() > 1 && payload[0] < 3)
+	{
+		port[payload[0]]->host_inject(&payload[1], payload.size() - 1);
+	}
+}
+
+//the whole log, setup() at the setup record and loop() for every tick after it. on_tick(tick, stamp) runs after each loop().
+//false if there was no setup record
+template<typename F>
+bool replay_log(RAW_LOG_READER &reader, SENSORS &sensors, F on_tick)
+{
+	sensors.attach();
+	long ticks = 0;
+	bool started = false;
+	RAW_SAMPLE sample;
+	while(reader.next())
+	{
+		if(reader.type == RAW_SERIAL)
+		{
+			replay_serial(reader.payload);
+			continue;
+		}
+		if(reader.payload.size() != sizeof(RAW_SAMPLE) && reader.type != RAW_OFFSETS)
+		{
+			continue;
+		}
+		if(reader.type == RAW_OFFSETS && reader.payload.size() == sizeof(RAW_OFFSETS_RECORD))
+		{
+			RAW_OFFSETS_RECORD o;
+			memcpy(&o, &reader.payload[0], sizeof(o));
+			replay_offsets(o);
+		}
+		else if(reader.type == RAW_SETUP)
+		{
+			memcpy(&sample, &reader.payload[0], sizeof(sample));
+			sensors.load(sample);
+			host_set_micros(sample.micros);
+			setup();
+			started = true;
+		}
+		else if(reader.type == RAW_TICK && started)
+		{
+			memcpy(&sample, &reader.payload[0], sizeof(sample));
+			sensors.load(sample);
+			host_set_micros(sample.micros);
+			loop();
+			on_tick(ticks, sample.micros);
+			ticks++;
+		}
+	}
+	return started;
+}
+
+struct TRUTH_ROW
+{
+	float x, y, yaw, vx; //m, deg counter clockwise from East (STATE's heading), m/s forward
+};
+
+//the simulated car per tick from lucifer_sim --truth, indexed by tick
+inline bool read_truth(const char *path, std::vector<TRUTH_ROW> &truth)
+{
+	FILE *f = fopen(path, "r");
+	if(!f)
+	{
+		return false;
+	}
+	char line[512];
+	if(!fgets(line, sizeof(line), f)) //header
+	{
+		fclose(f);
+		return false;
+	}
+	long tick;
+	unsigned stamp;
+	TRUTH_ROW r;
+	while(fgets(line, sizeof(line), f))
+	{
+		if(sscanf(line, "%ld,%u,%f,%f,%f,%f", &tick, &stamp, &r.x, &r.y, &r.yaw, &r.vx) == 6 && tick >= 0)
+		{
+			if(truth.size() <= size_t(tick))
+			{
+				truth.resize(tick + 1, r);
+			}
+			truth[tick] = r;
+		}
+	}
+	fclose(f);
+	return !truth.empty();
+}
+
+#endif
@@ -0,0 +1,290 @@
+#include"SENSORS.h"
+#include"MPU9150.h"
+#include"OPFLOW.h"
+
+extern volatile int32_t input[8]; //INOUT.cpp, filled by the receiver interrupt on the car
+
+MPU9150_MODEL::MPU9150_MODEL()
+{
+	reg[MPU9150_RA_WHO_AM_I] = MPU_MODEL_WHO_AM_I;
+	aux = NULL;
+	fifo_head = fifo_count = 0;
+	next_sample = 0;
+}
+
+uint8_t MPU9150_MODEL::sensor_register(uint8_t address)
+{
+	//the real master copies slave 0 into EXT_SENS_DATA every MAG_MST_DELAY + 1 samples. The host sets the mag's registers once a
+	//tick at most, so reading them as they are now gives the same numbers
+	uint8_t i = address - MPU9150_RA_EXT_SENS_DATA_00;
+	bool master = (reg[MPU9150_RA_USER_CTRL] & (1 << MPU9150_USERCTRL_I2C_MST_EN_BIT)) != 0;
+	bool slave0 = (reg[MPU9150_RA_I2C_SLV0_CTRL] & 0x80) != 0 && (reg[MPU9150_RA_I2C_SLV0_ADDR] & 0x80) != 0; //enabled, reading
+	if(aux && master && slave0 && address >= MPU9150_RA_EXT_SENS_DATA_00 && i < (reg[MPU9150_RA_I2C_SLV0_CTRL] & 0x0F))
+	{
+		return aux->read(uint8_t(reg[MPU9150_RA_I2C_SLV0_REG] + i));
+	}
+	return reg[address];
+}
+
+void MPU9150_MODEL::fifo_push(uint8_t data)
+{
+	if(fifo_count == MPU_MODEL_FIFO_SIZE)
+	{
+		fifo_head = (fifo_head + 1) % MPU_MODEL_FIFO_SIZE;
+		fifo_count--;
+		reg[MPU9150_RA_INT_STATUS] |= 1 << MPU9150_INTERRUPT_FIFO_OFLOW_BIT;
+	}
+	fifo[(fifo_head + fifo_count) % MPU_MODEL_FIFO_SIZE] = data;
+	fifo_count++;
+}
+
+void MPU9150_MODEL::fifo_fill()
+{
+	uint32_t now = host_get_micros();
+	uint8_t enabled = reg[MPU9150_RA_FIFO_EN];
+	if(!(reg[MPU9150_RA_USER_CTRL] & (1 << MPU9150_USERCTRL_FIFO_EN_BIT)) || enabled == 0)
+	{
+		next_sample = now;
+		return;
+	}
+	uint32_t period = 125*(1 + uint32_t(reg[MPU9150_RA_SMPLRT_DIV])); //8kHz gyro output with the DLPF off
+	if(int32_t(now - next_sample) > int32_t(period*MPU_MODEL_FIFO_SIZE)) //a byte a sample at least, older ones would be gone anyway
+	{
+		next_sample = now - period*MPU_MODEL_FIFO_SIZE;
+	}
+	//every sample is the registers as they are now : register order, accel, temp, gyro, then the slaves
+	uint8_t record[32];
+	uint8_t len = 0;
+	for(uint8_t r = MPU9150_RA_ACCEL_XOUT_H; r <= MPU9150_RA_GYRO_ZOUT_L; r++)
+	{
+		uint8_t bit;
+		if(r < MPU9150_RA_TEMP_OUT_H)
+		{
+			bit = MPU9150_ACCEL_FIFO_EN_BIT;
+		}
+		else if(r < MPU9150_RA_GYRO_XOUT_H)
+		{
+			bit = MPU9150_TEMP_FIFO_EN_BIT;
+		}
+		else
+		{
+			bit = MPU9150_XG_FIFO_EN_BIT - (r - MPU9150_RA_GYRO_XOUT_H)/2; //XG, YG, ZG
+		}
+		if(enabled & (1 << bit))
+		{
+			record[len++] = sensor_register(r);
+		}
+	}
+	if(enabled & (1 << MPU9150_SLV0_FIFO_EN_BIT))
+	{
+		for(uint8_t i = 0; i < (reg[MPU9150_RA_I2C_SLV0_CTRL] & 0x0F); i++)
+		{
+			record[len++] = sensor_register(MPU9150_RA_EXT_SENS_DATA_00 + i);
+		}
+	}
+	while(int32_t(now - next_sample) >= 0)
+	{
+		for(uint8_t i = 0; i < len; i++)
+		{
+			fifo_push(record[i]);
+		}
+		next_sample += period;
+	}
+}
+
+uint8_t MPU9150_MODEL::read(uint8_t address)
+{
+	if(address == MPU9150_RA_FIFO_COUNTH) //the sketch reads H and L in one go
+	{
+		fifo_fill();
+		return uint8_t(fifo_count >> 8);
+	}
+	if(address == MPU9150_RA_FIFO_COUNTL)
+	{
+		return uint8_t(fifo_count);
+	}
+	if(address == MPU9150_RA_FIFO_R_W)
+	{
+		if(fifo_count == 0)
+		{
+			return 0;
+		}
+		uint8_t data = fifo[fifo_head];
+		fifo_head = (fifo_head + 1) % MPU_MODEL_FIFO_SIZE;
+		fifo_count--;
+		return data;
+	}
+	return sensor_register(address);
+}
+
+void MPU9150_MODEL::write(uint8_t address, uint8_t data)
+{
+	if(address == MPU9150_RA_USER_CTRL)
+	{
+		bool was_on = (reg[address] & (1 << MPU9150_USERCTRL_FIFO_EN_BIT)) != 0;
+		if(data & (1 << MPU9150_USERCTRL_FIFO_RESET_BIT) || !was_on)
+		{
+			fifo_head = fifo_count = 0;
+			next_sample = host_get_micros();
+		}
+		data &= ~(1 << MPU9150_USERCTRL_FIFO_RESET_BIT); //clears itself
+	}
+	reg[address] = data;
+}
+
+uint8_t MPU9150_MODEL::next(uint8_t address)
+{
+	return address == MPU9150_RA_FIFO_R_W ? address : uint8_t(address + 1);
+}
+
+void MPU9150_MODEL::set_motion(const int16_t a[3], const int16_t g[3], int16_t t)
+{
+	int16_t raw[7] = {a[0], a[1], a[2], t, g[0], g[1], g[2]};
+	for(int i = 0; i < 7; i++)
+	{
+		reg[MPU9150_RA_ACCEL_XOUT_H + 2*i] = uint8_t(uint16_t(raw[i]) >> 8);
+		reg[MPU9150_RA_ACCEL_XOUT_H + 2*i + 1] = uint8_t(raw[i]);
+	}
+}
+
+void AK8975_MODEL::set_field(const int16_t m[3])
+{
+	for(int i = 0; i < 3; i++)
+	{
+		reg[MPU9150_RA_MAG_XOUT_L + 2*i] = uint8_t(m[i]);
+		reg[MPU9150_RA_MAG_XOUT_L + 2*i + 1] = uint8_t(uint16_t(m[i]) >> 8);
+	}
+}
+
+ADNS3080_MODEL::ADNS3080_MODEL()
+{
+	memset(reg, 0, sizeof(reg));
+	memset(burst, 0, sizeof(burst));
+	reg[ADNS3080_PRODUCT_ID] = ADNS3080_PRODUCT_ID_VALUE;
+	position = -1;
+	address = 0;
+	writing = false;
+}
+
+void ADNS3080_MODEL::select()
+{
+	position = -1;
+}
+
+uint8_t ADNS3080_MODEL::transfer(uint8_t out)
+{
+	if(position < 0)
+	{
+		address = out & 0x7F;
+		writing = (out & 0x80) != 0;
+		position = 0;
+		return 0;
+	}
+	if(writing)
+	{
+		reg[address] = out;
+		position++;
+		return 0;
+	}
+	uint8_t data;
+	if(address == ADNS3080_MOTION_BURST)
+	{
+		data = position < 7 ? burst[position] : 0;
+	}
+	else
+	{
+		data = reg[address];
+	}
+	position++;
+	return data;
+}
+
+void ADNS3080_MODEL::set_motion(bool motion, int8_t dx, int8_t dy, uint8_t squal, uint16_t shutter, uint8_t max_pix)
+{
+	burst[0] = motion ? 0x81 : 0x00; //bit 7 is "motion since last report" on the real chip, bit 0 is what OPFLOW looks at
+	burst[1] = uint8_t(dx);
+	burst[2] = uint8_t(dy);
+	burst[3] = squal;
+	burst[4] = uint8_t(shutter >> 8);
+	burst[5] = uint8_t(shutter);
+	burst[6] = max_pix;
+}
+
+void ADNS3080_MODEL::set_burst(const uint8_t raw[7])
+{
+	memcpy(burst, raw, 7);
+}
+
+uint16_t ubx_frame(uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t len, uint8_t *out)
+{
+	uint8_t CK_A = 0, CK_B = 0;
+	out[0] = 0xB5;
+	out[1] = 0x62;
+	out[2] = cls;
+	out[3] = id;
+	out[4] = uint8_t(len);
+	out[5] = uint8_t(len >> 8);
+	memcpy(out + 6, payload, len);
+	for(uint16_t i = 2; i < len + 6; i++)
+	{
+		CK_A += out[i];
+		CK_B += CK_A;
+	}
+	out[len + 6] = CK_A;
+	out[len + 7] = CK_B;
+	return len + 8;
+}
+
+void SENSORS::attach()
+{
+	Wire.host_attach(MPU_MODEL_ADDRESS, &imu);
+	Wire.host_attach(AK8975_MODEL_ADDRESS, &mag); //for the bypass, the sketch goes through the MPU's master
+	imu.aux = &mag;
+	SPI.host_attach(&flow);
+}
+
+void SENSORS::gps_nav_pvt(const NAV_PVT &pvt)
+{
+	uint8_t frame[sizeof(NAV_PVT) + 8];
+	uint16_t n = ubx_frame(0x01, 0x07, ((const uint8_t*)&pvt) + 4, sizeof(NAV_PVT) - 4, frame);
+	Serial1.host_inject(frame, n);
+}
+
+void SENSORS::set_receiver(const int32_t pulse[8])
+{
+	for(int i = 0; i < 8; i++)
+	{
+		input[i] = pulse[i];
+	}
+}
+
+void SENSORS::load(const RAW_SAMPLE &s)
+{
+	imu.set_motion(s.a, s.g, s.t);
+	mag.set_field(s.m);
+	flow.set_burst(s.flow);
+	set_receiver(s.inputs);
+}
+
+void SENSORS::save(RAW_SAMPLE &s)
+{
+	memset(&s, 0, sizeof(s));
+	s.micros = host_get_micros();
+	int16_t raw[7];
+	for(int i = 0; i < 7; i++)
+	{
+		raw[i] = int16_t(uint16_t(imu.reg[MPU9150_RA_ACCEL_XOUT_H + 2*i]) << 8 | imu.reg[MPU9150_RA_ACCEL_XOUT_H + 2*i + 1]);
+	}
+	for(int i = 0; i < 3; i++)
+	{
+		s.a[i] = raw[i];
+		s.g[i] = raw[4 + i];
+		s.m[i] = int16_t(uint16_t(mag.reg[MPU9150_RA_MAG_XOUT_L + 2*i + 1]) << 8 | mag.reg[MPU9150_RA_MAG_XOUT_L + 2*i]);
+	}
+	s.t = raw[3];
+	memcpy(s.flow, flow.burst, 7);
+	for(int i = 0; i < 8; i++)
+	{
+		s.inputs[i] = input[i];
+	}
+}
@@ -0,0 +1,84 @@
+//register level models of the sensors on the car, for the host build.
+//These don't simulate any physics. They only hold whatever raw values the host puts in them and hand them out the same way the
+//real chips do (same registers, same byte order), so MPU9150.cpp and OPFLOW.cpp run completely unchanged on top of them.
+//
+//usage :
+//	SENSORS sensors;
+//	sensors.attach(); //hooks them up to Wire, SPI
+//	sensors.imu.set_motion(a,g,t); //raw counts
+//	sensors.flow.set_motion(true,dx,dy,squal,shutter,max_pix);
+//	sensors.gps_nav_pvt(pvt); //queue a NAV-PVT frame on Serial1
+//	sensors.load(sample) / sensors.save(sample); //everything at once, in the raw log's format (RAW_LOG.h)
+#ifndef _SENSORS_H_
+#define _SENSORS_H_
+
+#include"Arduino.h"
+#include"Wire.h"
+#include"SPI.h"
+#include"GPS_NAV_PVT.h"
+#include"RAW_LOG.h"
+
+#define MPU_MODEL_ADDRESS 0x68
+#define AK8975_MODEL_ADDRESS 0x0C
+#define MPU_MODEL_WHO_AM_I 0x68
+#define MPU_MODEL_FIFO_SIZE 1024
+
+//the FIFO fills on the virtual clock at the sample rate SMPLRT_DIV sets, every sample a copy of the registers as they are when
+//the sketch looks (FIFO_COUNT). The host sets them once a tick, so the samples of one tick are all the same
+class MPU9150_MODEL : public I2C_REGISTERS
+{
+public:
+	I2C_REGISTERS *aux; //what sits on the MPU's aux bus (the AK8975), for its I2C master
+	MPU9150_MODEL();
+	void set_motion(const int16_t a[3], const int16_t g[3], int16_t t); //raw accel, gyro, temp. big endian, 0x3B onwards.
+	uint8_t read(uint8_t address);
+	void write(uint8_t address, uint8_t data);
+	uint8_t next(uint8_t address); //FIFO_R_W keeps the pointer, a burst from it empties the FIFO
+private:
+	uint8_t fifo[MPU_MODEL_FIFO_SIZE]; //ring
+	uint16_t fifo_head, fifo_count;
+	uint32_t next_sample; //virtual clock
+	uint8_t sensor_register(uint8_t address); //EXT_SENS_DATA is slave 0's registers, when the master is set up to read them
+	void fifo_push(uint8_t data); //the oldest byte goes when it's full, same as the chip
+	void fifo_fill(); //the samples since the last look
+};
+
+class AK8975_MODEL : public I2C_REGISTERS
+{
+public:
+	void set_field(const int16_t m[3]); //raw field in the magnetometer's own axes (X,Y,Z registers). little endian, 0x03 onwards.
+};
+
+class ADNS3080_MODEL : public SPI_DEVICE
+{
+public:
+	uint8_t reg[128];
+	uint8_t burst[7]; //motion, dx, dy, squal, shutter_H, shutter_L, max_pix
+	ADNS3080_MODEL();
+	void select();
+	uint8_t transfer(uint8_t out);
+	void set_motion(bool motion, int8_t dx, int8_t dy, uint8_t squal, uint16_t shutter, uint8_t max_pix);
+	void set_burst(const uint8_t raw[7]);
+private:
+	int16_t position; //-1 when the next byte is the register address
+	uint8_t address;
+	bool writing;
+};
+
+//wraps a payload in a UBX frame (sync, class, id, length, payload, checksum). returns the frame length.
+uint16_t ubx_frame(uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t len, uint8_t *out);
+
+class SENSORS
+{
+public:
+	MPU9150_MODEL imu;
+	AK8975_MODEL mag;
+	ADNS3080_MODEL flow;
+	void attach();
+	void gps_nav_pvt(const NAV_PVT &pvt); //pvt.cls,id,len are ignored, the frame is always 0x01 0x07 92
+	void set_receiver(const int32_t pulse[8]); //receiver pulse widths in us, straight into INOUT's input[]
+	void load(const RAW_SAMPLE &s); //sensor registers and receiver from a raw log sample (s.micros is left to the caller)
+	void save(RAW_SAMPLE &s); //the other way around, s.micros is the virtual clock
+};
+
+#endif
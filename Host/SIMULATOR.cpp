@@ -0,0 +1,670 @@
+#include"SIMULATOR.h"
+#include"MPU9150.h"
+#include"OPFLOW.h"
+#include"PARAMS.h"
+#include"SIDMATH.h"
+#include"ENU.h"
+#include"COMPANION.h"
+
+#define SIM_AIR_DENSITY (float) 1.2f
+#define SIM_TRACK_SAMPLE (float) 0.05f //m between centerline samples
+#define SIM_LOCATE_WINDOW 40 //samples searched around the last match before falling back to the whole track
+#define SIM_MAX_SIDESLIP (float) (45.0f*DEG2RAD) //anything past this at speed is a spin
+#define SIM_FLOW_SHUTTER 0x0200
+#define SIM_FLOW_MAX_PIX 60
+#define SIM_RECEIVER_NULL 1500
+#define SIM_RECEIVER_OFF 1000
+#define SIM_RECEIVER_NO_OBSTACLE 2000 //inputs[7] is the lidar range, 2000 reads as nothing within 4m (see controller::drive)
+
+VEHICLE_PARAMS::VEHICLE_PARAMS()
+{
+	//a 1/10 scale rally car. The geometry and the throttle curve are overwritten with the controller's own numbers by the
+	//simulator tool (CAR.h can only be included once per program), what is left is what the controller doesn't know about.
+	mass = 2.2f;
+	wheelbase = 0.254f;
+	cg_to_front = 0.52f*wheelbase;
+	cg_height = 0.03f;
+	yaw_inertia = mass*cg_to_front*(wheelbase - cg_to_front); //the usual m*a*b estimate
+	mu = 1.0f;
+	cornering_stiffness = 12.0f;
+	steering_gain = 372.0f/25.0f;
+	steering_max = 25.0f;
+	servo_time_constant = 0.03f;
+	servo_rate = 350.0f;
+	esc_offset = THROTTLE_OFFSET;
+	esc_range = THROTTLE_RANGE;
+	speed_curve[0] = A0;
+	speed_curve[1] = A1;
+	speed_curve[2] = A2;
+	speed_curve[3] = A3;
+	esc_time_constant = 0.16f;
+	load_factor = 1.1f;
+	max_power = 150.0f;
+	max_brake = 10.0f;
+	rolling_resistance = 0.02f;
+	drag_area = 0.01f;
+	imu_position = DIST_BW_ACCEL_AXLE;
+	flow_position = OP_POS;
+}
+
+NOISE_PARAMS::NOISE_PARAMS()
+{
+	accel = 0.2f; //mostly vibration, the chip itself is an order of magnitude quieter
+	gyro = 0.2f;
+	gyro_bias[0] = 0.1f;
+	gyro_bias[1] = -0.1f;
+	gyro_bias[2] = 0.3f;
+	mag = 0.5f;
+	for(int i = 0; i < 3; i++)
+	{
+		mag_offset[i] = 0;
+		mag_scale[i] = 1;
+	}
+	gps_position = 0.5f;
+	gps_correlation_time = 10.0f;
+	gps_hacc = 0.8f;
+	gps_velocity = 0.05f;
+	gps_latency = 50000;
+	flow_squal = 100;
+	companion_position = 0.15f;
+	companion_latency = 120000;
+	companion_outliers = 0.05f;
+}
+
+VEHICLE::VEHICLE()
+{
+	reset(0, 0, 0);
+}
+
+void VEHICLE::reset(double x0, double y0, float yaw0)
+{
+	x = x0;
+	y = y0;
+	yaw = yaw0;
+	vx = vy = r = delta = 0;
+	ax = ay = r_dot = 0;
+	throttle_pulse = steering_pulse = 0;
+}
+
+float VEHICLE::sideslip()
+{
+	return atan2f(vy, max(vx, 0.1f));
+}
+
+float VEHICLE::drive_force()
+{
+	if(throttle_pulse < SIM_RECEIVER_OFF - 100) //no pulse, the ESC sits in neutral
+	{
+		return 0;
+	}
+	if(throttle_pulse >= p.esc_offset)
+	{
+		float u = min((throttle_pulse - p.esc_offset)/p.esc_range, 1.0f);
+		float target = (((p.speed_curve[0]*u + p.speed_curve[1])*u + p.speed_curve[2])*u + p.speed_curve[3])/p.load_factor;
+		float force = p.mass*(max(target, 0.0f) - vx)/p.esc_time_constant;
+		force = min(force, p.max_power/max(vx, 0.5f));
+		return max(force, -0.2f*p.mass*GRAVITY); //drag brake when the throttle is lifted
+	}
+	if(throttle_pulse < SIM_RECEIVER_NULL && vx > 0)
+	{
+		return -p.mass*p.max_brake*min((SIM_RECEIVER_NULL - throttle_pulse)/500.0f, 1.0f);
+	}
+	return 0;
+}
+
+//friction circle : whatever the longitudinal force uses up is gone from the lateral grip
+float VEHICLE::tyre(float alpha, float load, float longitudinal)
+{
+	float limit = p.mu*load;
+	float lateral = limit*limit - longitudinal*longitudinal;
+	if(lateral <= 0)
+	{
+		return 0;
+	}
+	lateral = sqrtf(lateral);
+	return lateral*tanhf(p.cornering_stiffness*load*alpha/lateral);
+}
+
+void VEHICLE::step(float h)
+{
+	float a = p.cg_to_front, b = p.wheelbase - p.cg_to_front;
+
+	//servo
+	float target = 0;
+	if(steering_pulse >= SIM_RECEIVER_OFF - 100)
+	{
+		target = constrain((steering_pulse - SIM_RECEIVER_NULL)/p.steering_gain, -p.steering_max, p.steering_max)*DEG2RAD;
+	}
+	float rate = p.servo_rate*DEG2RAD*h;
+	delta += constrain((target - delta)*h/p.servo_time_constant, -rate, rate);
+
+	//load transfer from the last step's acceleration
+	float load_front = max(p.mass*(GRAVITY*b - p.cg_height*ax)/p.wheelbase, 0.0f);
+	float load_rear = max(p.mass*(GRAVITY*a + p.cg_height*ax)/p.wheelbase, 0.0f);
+
+	float drive = drive_force();
+	drive = constrain(drive, -p.mu*load_rear, p.mu*load_rear);
+	float resistance = vx > 0 ? p.rolling_resistance*p.mass*GRAVITY + 0.5f*SIM_AIR_DENSITY*p.drag_area*vx*vx : 0;
+	if(vx <= 0 && drive <= p.rolling_resistance*p.mass*GRAVITY)
+	{
+		//parked
+		vx = vy = r = 0;
+		ax = ay = r_dot = 0;
+		return;
+	}
+
+	float u = max(vx, 0.1f);
+	float alpha_front = delta - atan2f(vy + a*r, u);
+	float alpha_rear = -atan2f(vy - b*r, u);
+	float force_front = tyre(alpha_front, load_front, 0);
+	float force_rear = tyre(alpha_rear, load_rear, drive);
+	float cos_delta = cosf(delta), sin_delta = sinf(delta);
+
+	float last_vx = vx, last_vy = vy, last_r = r;
+	vx += h*((drive - force_front*sin_delta - resistance)/p.mass + vy*r);
+	vy += h*((force_rear + force_front*cos_delta)/p.mass - vx*r);
+	r += h*(a*force_front*cos_delta - b*force_rear)/p.yaw_inertia;
+	vx = max(vx, 0.0f); //the ESC is set up without reverse
+
+	if(vx < SIM_KINEMATIC_SPEED)
+	{
+		//rear axle rolling without slip
+		float w = vx/SIM_KINEMATIC_SPEED;
+		float r_kinematic = vx*tanf(delta)/p.wheelbase;
+		r = w*r + (1 - w)*r_kinematic;
+		vy = w*vy + (1 - w)*b*r_kinematic;
+	}
+
+	ax = (vx - last_vx)/h - last_vy*last_r;
+	ay = (vy - last_vy)/h + last_vx*last_r;
+	r_dot = (r - last_r)/h;
+
+	float cos_yaw = cosf(yaw), sin_yaw = sinf(yaw);
+	x += double(h*(vx*cos_yaw - vy*sin_yaw));
+	y += double(h*(vx*sin_yaw + vy*cos_yaw));
+	yaw += h*r;
+	if(yaw > M_PI)
+	{
+		yaw -= M_2PI;
+	}
+	if(yaw < -M_PI)
+	{
+		yaw += M_2PI;
+	}
+}
+
+void TRACK::sample(float x, float y)
+{
+	cx.push_back(x);
+	cy.push_back(y);
+}
+
+void TRACK::stadium(float straight, float radius, int corner_points)
+{
+	cx.clear();
+	cy.clear();
+	waypoints.clear();
+	last = 0;
+	length = 2*straight + M_2PI*radius;
+
+	int n = max(int(straight/SIM_TRACK_SAMPLE), 1);
+	int m = max(int(M_PI*radius/SIM_TRACK_SAMPLE), 1);
+	for(int i = 0; i < n; i++) //bottom straight, heading east
+	{
+		sample(straight*i/n, 0);
+	}
+	for(int i = 0; i < m; i++) //right hand corner, counter clockwise
+	{
+		float th = -M_PIB2 + M_PI*i/m;
+		sample(straight + radius*cosf(th), radius + radius*sinf(th));
+	}
+	for(int i = 0; i < n; i++) //top straight, heading west
+	{
+		sample(straight - straight*i/n, 2*radius);
+	}
+	for(int i = 0; i < m; i++)
+	{
+		float th = M_PIB2 + M_PI*i/m;
+		sample(radius*cosf(th), radius + radius*sinf(th));
+	}
+
+	TRACK_POINT p;
+	p.X = 0; p.Y = 0; p.slope = 0;
+	waypoints.push_back(p);
+	p.X = straight;
+	waypoints.push_back(p);
+	for(int i = 1; i < corner_points; i++)
+	{
+		float th = -M_PIB2 + M_PI*i/corner_points;
+		p.X = straight + radius*cosf(th);
+		p.Y = radius + radius*sinf(th);
+		p.slope = (th + M_PIB2)*RAD2DEG;
+		waypoints.push_back(p);
+	}
+	p.X = straight; p.Y = 2*radius; p.slope = M_PI_DEG;
+	waypoints.push_back(p);
+	p.X = 0;
+	waypoints.push_back(p);
+	for(int i = 1; i < corner_points; i++)
+	{
+		float th = M_PIB2 + M_PI*i/corner_points;
+		p.X = radius*cosf(th);
+		p.Y = radius + radius*sinf(th);
+		p.slope = (th + M_PIB2)*RAD2DEG - M_2PI_DEG; //-180..0, the GCS sends slopes as int16 hundredths of a degree
+		waypoints.push_back(p);
+	}
+	waypoints.push_back(waypoints[0]);
+}
+
+float TRACK::locate(float x, float y, float &s)
+{
+	size_t n = cx.size();
+	size_t best = last;
+	float best_d = 1e30f;
+	for(int k = -SIM_LOCATE_WINDOW; k <= SIM_LOCATE_WINDOW; k++)
+	{
+		size_t i = (last + n + k) % n;
+		float d = (cx[i] - x)*(cx[i] - x) + (cy[i] - y)*(cy[i] - y);
+		if(d < best_d)
+		{
+			best_d = d;
+			best = i;
+		}
+	}
+	if(best_d > 1.0f) //lost, look everywhere
+	{
+		for(size_t i = 0; i < n; i++)
+		{
+			float d = (cx[i] - x)*(cx[i] - x) + (cy[i] - y)*(cy[i] - y);
+			if(d < best_d)
+			{
+				best_d = d;
+				best = i;
+			}
+		}
+	}
+	last = best;
+	size_t next = (best + 1) % n;
+	float tx = cx[next] - cx[best], ty = cy[next] - cy[best];
+	float tl = sqrtf(tx*tx + ty*ty);
+	tx /= tl;
+	ty /= tl;
+	float dx = x - cx[best], dy = y - cy[best];
+	s = length*float(best)/float(n) + dx*tx + dy*ty;
+	return tx*dy - ty*dx;
+}
+
+SIMULATOR::SIMULATOR(SENSORS &s) : sensors(s), gauss(0.0f, 1.0f)
+{
+	mode = CRUISE;
+	companion = false;
+	crash_distance = 2.0f; //a 4m wide track
+	track.stadium(10.0f, 4.0f, 4);
+	seed(1);
+}
+
+void SIMULATOR::seed(uint32_t n)
+{
+	rng.seed(n);
+	gauss.reset();
+}
+
+float SIMULATOR::noisy(float sigma)
+{
+	return sigma*gauss(rng);
+}
+
+void SIMULATOR::start(uint32_t now)
+{
+	car.reset(track.waypoints[0].X, track.waypoints[0].Y, track.waypoints[0].slope*DEG2RAD);
+	stats.laps = 0;
+	stats.lap_times.clear();
+	stats.cross_track_sum = stats.cross_track_sq = 0;
+	stats.cross_track_max = 0;
+	stats.samples = 0;
+	stats.top_speed = 0;
+	stats.crashed = false;
+	stats.crash_reason = "";
+	start_us = last_us = now;
+	next_pwm = next_gps = next_gcs = next_companion = 0;
+	auto_start = lap_start = 0;
+	flow_carry[0] = flow_carry[1] = 0;
+	gps_error[0] = noisy(noise.gps_position);
+	gps_error[1] = noisy(noise.gps_position);
+	gps_bytes_due = 0;
+	uart_us = now;
+	gps_tx.clear();
+	gps_epochs.clear();
+	companion_fixes.clear();
+	wp_sent = 0;
+	origin_sent = false;
+	running = false;
+	autonomous = false;
+	cross_track = 0;
+	last_s = 0;
+
+	int32_t pulse[8];
+	for(int i = 0; i < 8; i++)
+	{
+		pulse[i] = SIM_RECEIVER_NULL;
+	}
+	pulse[5] = SIM_RECEIVER_OFF; //mode switch : standby if the GCS goes quiet
+	pulse[7] = SIM_RECEIVER_NO_OBSTACLE;
+	sensors.set_receiver(pulse);
+	write_sensors();
+}
+
+void SIMULATOR::update(uint32_t now)
+{
+	if(!running) //first call after setup(), this is when the GPS and GCS come to life
+	{
+		running = true;
+		first_update = now;
+		next_pwm = now;
+		next_gps = now;
+		next_gcs = now;
+		next_companion = now;
+	}
+	float flow[2] = {0, 0};
+	float b = car.p.wheelbase - car.p.cg_to_front;
+	while(int32_t(now - last_us) > 0)
+	{
+		if(int32_t(last_us - next_pwm) >= 0)
+		{
+			car.throttle_pulse = TIMER1_BASE->CCR1;
+			car.steering_pulse = TIMER1_BASE->CCR4;
+			next_pwm += SIM_PWM_FRAME_US;
+		}
+		uint32_t step = min(uint32_t(SIM_STEP_US), now - last_us);
+		float h = step*1e-6f;
+		car.step(h);
+		flow[0] += h*car.vx;
+		flow[1] += h*(car.vy + car.r*(car.p.flow_position - b));
+		last_us += step;
+	}
+	write_sensors();
+
+	//flow counts since the last read, the fractions carry over like they do inside the chip
+	float counts_y = flow[0]/(DEFAULT_CALIB) + flow_carry[1];
+	float counts_x = -flow[1]/(DEFAULT_CALIB) + flow_carry[0];
+	int8_t dy = int8_t(constrain(int(roundf(counts_y)), -127, 127));
+	int8_t dx = int8_t(constrain(int(roundf(counts_x)), -127, 127));
+	flow_carry[1] = counts_y - dy;
+	flow_carry[0] = counts_x - dx;
+	uint8_t squal = uint8_t(constrain(int(noise.flow_squal) + int(noisy(3.0f)), 0, 239));
+	sensors.flow.set_motion(true, dx, dy, squal, SIM_FLOW_SHUTTER, SIM_FLOW_MAX_PIX);
+
+	gps(now);
+	gcs(now);
+	if(companion)
+	{
+		companion_tx(now);
+	}
+	score(now);
+}
+
+void SIMULATOR::write_sensors()
+{
+	float b = car.p.wheelbase - car.p.cg_to_front;
+	float d = car.p.imu_position - b; //accelerometer ahead of the CG
+	float forward = car.ax - d*car.r*car.r;
+	float left = car.ay + d*car.r_dot;
+	int16_t a[3], g[3], m[3];
+	//x right, y forward, gravity already taken out by the offsets (see accel_caliberation)
+	a[0] = int16_t(constrain(roundf((-left + noisy(noise.accel))/ACCEL_SCALING_FACTOR), -32768.0f, 32767.0f));
+	a[1] = int16_t(constrain(roundf((forward + noisy(noise.accel))/ACCEL_SCALING_FACTOR), -32768.0f, 32767.0f));
+	a[2] = int16_t(roundf(noisy(noise.accel)/ACCEL_SCALING_FACTOR));
+	g[0] = int16_t(roundf((noise.gyro_bias[0] + noisy(noise.gyro))/GYRO_SCALING_FACTOR));
+	g[1] = int16_t(roundf((noise.gyro_bias[1] + noisy(noise.gyro))/GYRO_SCALING_FACTOR));
+	g[2] = int16_t(constrain(roundf((car.r*RAD2DEG + noise.gyro_bias[2] + noisy(noise.gyro))/GYRO_SCALING_FACTOR), -32768.0f, 32767.0f));
+	sensors.imu.set_motion(a, g, 0);
+
+	//field in the magnetometer's axes such that tilt_Compensate() comes out at the true yaw (it adds DECLINATION)
+	float psi = car.yaw - DECLINATION*DEG2RAD;
+	float horizontal = HORIZ_EARTH_MAG;
+	m[0] = int16_t(roundf(horizontal*sinf(psi) + noisy(noise.mag))); //mag X register = M[1]
+	m[1] = int16_t(roundf(-horizontal*cosf(psi) + noisy(noise.mag))); //mag Y register = M[0]
+	m[2] = int16_t(roundf(horizontal + noisy(noise.mag))); //45 degree dip
+	for(int i = 0; i < 3; i++)
+	{
+		m[i] = int16_t(roundf(m[i]*noise.mag_scale[i] + noise.mag_offset[i]));
+	}
+	sensors.mag.set_field(m);
+}
+
+//meters East, North of the start line -> lon/lat on the WGS84 ellipsoid, worked out in full rather than with ENU.h so that
+//the sketch's projection is checked against something
+static void sim_lonlat(double x, double y, int32_t &lon, int32_t &lat)
+{
+	double phi0 = SIM_BASE_LATITUDE*M_PI/180.0;
+	double s0 = sin(phi0);
+	double w = 1.0 - WGS84_E2*s0*s0;
+	double phi = phi0 + y*sqrt(w)*w/(WGS84_A*(1.0 - WGS84_E2)); //over the meridian radius at the start line
+	double s = sin(phi);
+	double lambda = x*sqrt(1.0 - WGS84_E2*s*s)/(WGS84_A*cos(phi)); //over the parallel's radius where the car is
+	lat = int32_t(lround(phi*180.0/M_PI*1e7));
+	lon = int32_t(lround((SIM_BASE_LONGITUDE + lambda*180.0/M_PI)*1e7));
+}
+
+void SIMULATOR::gps(uint32_t now)
+{
+	//new epoch : where the car is now, plus the slowly wandering error
+	while(int32_t(now - next_gps) >= 0)
+	{
+		float dt_gps = SIM_GPS_PERIOD_US*1e-6f;
+		float decay = expf(-dt_gps/noise.gps_correlation_time);
+		float drive = noise.gps_position*sqrtf(1 - decay*decay);
+		GPS_EPOCH e;
+		e.due = next_gps + noise.gps_latency;
+		e.itow = (next_gps - start_us)/1000;
+		for(int i = 0; i < 2; i++)
+		{
+			gps_error[i] = decay*gps_error[i] + noisy(drive);
+		}
+		e.x = car.x + gps_error[0];
+		e.y = car.y + gps_error[1];
+		float cos_yaw = cosf(car.yaw), sin_yaw = sinf(car.yaw);
+		e.vx = car.vx*cos_yaw - car.vy*sin_yaw + noisy(noise.gps_velocity);
+		e.vy = car.vx*sin_yaw + car.vy*cos_yaw + noisy(noise.gps_velocity);
+		gps_epochs.push_back(e);
+		next_gps += SIM_GPS_PERIOD_US;
+	}
+	while(gps_epochs.size() && int32_t(now - gps_epochs.front().due) >= 0)
+	{
+		GPS_EPOCH &e = gps_epochs.front();
+		NAV_PVT pvt;
+		memset(&pvt, 0, sizeof(pvt));
+		pvt.iTOW = e.itow;
+		pvt.fixType = 3;
+		pvt.flags = 0x01; //gnssFixOK
+		pvt.numSV = 12;
+		sim_lonlat(e.x, e.y, pvt.lon, pvt.lat);
+		pvt.hAcc = uint32_t(noise.gps_hacc*1e3f);
+		pvt.vAcc = 2*pvt.hAcc;
+		pvt.velN = int32_t(lroundf(e.vy*1e3f));
+		pvt.velE = int32_t(lroundf(e.vx*1e3f));
+		float speed = sqrtf(e.vx*e.vx + e.vy*e.vy);
+		pvt.gSpeed = int32_t(lroundf(speed*1e3f));
+		float course = M_PIB2_DEG - atan2f(e.vy, e.vx)*RAD2DEG; //clockwise from north
+		course += course < 0 ? M_2PI_DEG : 0;
+		pvt.headMot = int32_t(lroundf(course*1e5f));
+		pvt.headVeh = pvt.headMot;
+		pvt.sAcc = uint32_t(max(noise.gps_velocity, 0.05f)*1e3f);
+		pvt.headAcc = uint32_t(speed > 1.0f ? 2e5f : 1.8e7f);
+		pvt.pDOP = 120;
+		uint8_t frame[sizeof(NAV_PVT) + 8];
+		uint16_t n = ubx_frame(0x01, 0x07, ((const uint8_t*)&pvt) + 4, NAV_PVT_LENGTH, frame);
+		gps_tx.insert(gps_tx.end(), frame, frame + n);
+		//and the rest of the epoch, in the order a u-blox sends them
+		NAV_DOP dop;
+		memset(&dop, 0, sizeof(dop));
+		dop.iTOW = e.itow;
+		dop.hDOP = 80;
+		dop.vDOP = 120;
+		dop.pDOP = pvt.pDOP;
+		n = ubx_frame(0x01, 0x04, ((const uint8_t*)&dop) + 4, NAV_DOP_LENGTH, frame);
+		gps_tx.insert(gps_tx.end(), frame, frame + n);
+		NAV_VELNED velned;
+		memset(&velned, 0, sizeof(velned));
+		velned.iTOW = e.itow;
+		velned.velN = int32_t(lroundf(e.vy*1e2f));
+		velned.velE = int32_t(lroundf(e.vx*1e2f));
+		velned.speed = velned.gSpeed = uint32_t(lroundf(speed*1e2f));
+		velned.heading = pvt.headMot;
+		velned.sAcc = (pvt.sAcc + 5)/10;
+		velned.cAcc = pvt.headAcc;
+		n = ubx_frame(0x01, 0x12, ((const uint8_t*)&velned) + 4, NAV_VELNED_LENGTH, frame);
+		gps_tx.insert(gps_tx.end(), frame, frame + n);
+		NAV_STATUS status;
+		memset(&status, 0, sizeof(status));
+		status.iTOW = e.itow;
+		status.gpsFix = pvt.fixType;
+		status.flags = 0x01;
+		n = ubx_frame(0x01, 0x03, ((const uint8_t*)&status) + 4, NAV_STATUS_LENGTH, frame);
+		gps_tx.insert(gps_tx.end(), frame, frame + n);
+		gps_epochs.pop_front();
+	}
+	//the UART only moves GPS_BAUD/10 bytes a second
+	gps_bytes_due += (now - uart_us)*(GPS_BAUD/10.0f)*1e-6f;
+	uart_us = now;
+	uint8_t buf[256];
+	size_t n = 0;
+	while(gps_bytes_due >= 1 && gps_tx.size() && n < sizeof(buf))
+	{
+		buf[n++] = gps_tx.front();
+		gps_tx.pop_front();
+		gps_bytes_due -= 1;
+	}
+	if(!gps_tx.size())
+	{
+		gps_bytes_due = 0; //an idle line doesn't bank time
+	}
+	if(n)
+	{
+		Serial1.host_inject(buf, n);
+	}
+}
+
+void SIMULATOR::gcs_message(uint16_t id, uint8_t msg_mode, int16_t len, const int16_t *payload, int n)
+{
+	//START_SIGN, length, id, mode, payload. All int16, little endian (see GCS::check)
+	uint8_t buf[32];
+	int16_t header[4] = {START_SIGN, len, int16_t(id), msg_mode};
+	int k = 0;
+	for(int i = 0; i < 4 + n; i++)
+	{
+		int16_t v = i < 4 ? header[i] : payload[i - 4];
+		buf[k++] = uint8_t(v);
+		buf[k++] = uint8_t(uint16_t(v) >> 8);
+	}
+	Serial.host_inject(buf, k);
+}
+
+//a STATE_ID message (see JEVOIS::get_data) companion_latency after the frame. Only the noise is drawn when the companion is on,
+//the rest of the run sees the same random numbers with it or without
+void SIMULATOR::companion_tx(uint32_t now)
+{
+	while(int32_t(now - next_companion) >= 0)
+	{
+		COMPANION_FIX f;
+		f.due = next_companion + noise.companion_latency;
+		f.x = float(car.x) + noisy(noise.companion_position);
+		f.y = float(car.y) + noisy(noise.companion_position);
+		if(std::uniform_real_distribution<float>(0, 1)(rng) < noise.companion_outliers)
+		{
+			float a = std::uniform_real_distribution<float>(0, 2*M_PI)(rng);
+			f.x += SIM_COMPANION_OUTLIER*cosf(a);
+			f.y += SIM_COMPANION_OUTLIER*sinf(a);
+		}
+		companion_fixes.push_back(f);
+		next_companion += SIM_COMPANION_PERIOD_US;
+	}
+	while(companion_fixes.size() && int32_t(now - companion_fixes.front().due) >= 0)
+	{
+		COMPANION_FIX &f = companion_fixes.front();
+		int16_t msg[8] = {START_SIGN, JEVOIS_STATE_TIMED_LEN, STATE_ID, mode, int16_t(lroundf(f.x*1e2f)), int16_t(lroundf(f.y*1e2f)),
+			int16_t(noise.companion_latency/1000), int16_t(lroundf(noise.companion_position*1e2f))};
+		uint8_t buf[16];
+		for(int i = 0; i < 8; i++)
+		{
+			buf[2*i] = uint8_t(msg[i]);
+			buf[2*i + 1] = uint8_t(uint16_t(msg[i]) >> 8);
+		}
+		Serial2.host_inject(buf, sizeof(buf));
+		companion_fixes.pop_front();
+	}
+}
+
+//one message every 100ms, GCS::check() reads one message per call at 10Hz
+void SIMULATOR::gcs(uint32_t now)
+{
+	if(int32_t(now - next_gcs) < 0)
+	{
+		return;
+	}
+	next_gcs += SIM_GCS_PERIOD_US;
+	if(!origin_sent)
+	{
+		if(int32_t(now - first_update - SIM_GCS_START_US) < 0)
+		{
+			gcs_message(MODE_ID, MODE_STANDBY, 8, NULL, 0); //heartbeat so that the failsafe stays off
+			return;
+		}
+		gcs_message(SET_ORIGIN_ID, MODE_STANDBY, 8, NULL, 0);
+		origin_sent = true;
+		return;
+	}
+	if(wp_sent < track.waypoints.size())
+	{
+		const TRACK_POINT &p = track.waypoints[wp_sent];
+		int16_t payload[4] = {int16_t(lroundf(p.X*1e2f)), int16_t(lroundf(p.Y*1e2f)), int16_t(lroundf(p.slope*1e2f)), int16_t(wp_sent)};
+		gcs_message(WP_ID, MODE_STANDBY, int16_t(track.waypoints.size()), payload, 4);
+		wp_sent++;
+		return;
+	}
+	if(!autonomous)
+	{
+		autonomous = true;
+		auto_start = lap_start = now;
+	}
+	gcs_message(MODE_ID, mode, 8, NULL, 0);
+}
+
+void SIMULATOR::score(uint32_t now)
+{
+	float s;
+	cross_track = track.locate(float(car.x), float(car.y), s);
+	if(!autonomous)
+	{
+		last_s = s;
+		return;
+	}
+	stats.samples++;
+	stats.cross_track_sum += fabs(cross_track);
+	stats.cross_track_sq += cross_track*cross_track;
+	stats.cross_track_max = max(stats.cross_track_max, fabsf(cross_track));
+	stats.top_speed = max(stats.top_speed, car.vx);
+	if(last_s > 0.75f*track.length && s < 0.25f*track.length && now - lap_start > 1000000)
+	{
+		stats.laps++;
+		stats.lap_times.push_back((now - lap_start)*1e-6f);
+		lap_start = now;
+	}
+	last_s = s;
+
+	if(fabsf(cross_track) > crash_distance)
+	{
+		stats.crashed = true;
+		stats.crash_reason = "left the track";
+	}
+	else if(car.vx > SIM_KINEMATIC_SPEED && fabsf(car.sideslip()) > SIM_MAX_SIDESLIP)
+	{
+		stats.crashed = true;
+		stats.crash_reason = "spun";
+	}
+}
+
+float SIMULATOR::cross_track_rms()
+{
+	return stats.samples ? sqrtf(float(stats.cross_track_sq/stats.samples)) : 0.0f;
+}
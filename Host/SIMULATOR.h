@@ -0,0 +1,187 @@
+//closed loop simulator for the host build. A dynamic bicycle model of the car drives the sensor models in SENSORS.h, the sketch
+//reads them, plans with trajectory, drives with controller and writes the ESC/servo pulses, which go back into the model.
+//
+//vehicle : planar dynamic bicycle (states x, y, yaw, vx, vy, yaw rate) with
+//	- a friction circle per axle. The rear axle drives and brakes (like the car), so its longitudinal force eats into its lateral grip.
+//	- load transfer between the axles from the CG height, same geometry the controller assumes (WHEELBASE, FR_ratio, CG_HEIGHT).
+//	- ESC : pulses are only picked up every 20ms frame (INOUT's CYCLE). Above esc_offset the motor pulls towards the speed on the
+//	  speed curve with a first order lag, power limited. Below THROTTLENULL it brakes the rear wheels.
+//	- servo : first order lag plus a slew rate limit.
+//	- below ~1 m/s it blends into the kinematic model, the dynamic one is singular at standstill.
+//
+//sensors : everything goes out in raw counts in the axes the sketch expects (see MPU9150.cpp/OPFLOW.cpp for the conventions),
+//with white noise, a constant gyro bias and a slowly wandering GPS error. The GPS sends NAV-PVT, NAV-DOP, NAV-VELNED and
+//NAV-STATUS at 10Hz, late by gps_latency, and the bytes trickle in at GPS_BAUD like they would over the UART.
+//
+//companion (off unless asked for) : cone localization on the JeVois, a position in the waypoints' frame every 100ms on Serial2
+//(STATE_ID, with its age and error), companion_latency after the frame it came from. Now and then a cone is taken for another
+//one and the position is off by a few meters, that is what the car's gate is for.
+//
+//gcs : the simulator also plays the ground station. After a couple of seconds it resets the origin (SET_ORIGIN_ID), uploads the
+//track's waypoints (WP_ID, one per 100ms) and then keeps asking for the autonomous mode it was given, once every 100ms.
+//
+//world frame : x east, y north, yaw counter clockwise from east, same as STATE.h's X, Y and heading.
+#ifndef _SIMULATOR_H_
+#define _SIMULATOR_H_
+
+#include"Arduino.h"
+#include"SENSORS.h"
+#include<random>
+#include<deque>
+#include<vector>
+
+#define SIM_STEP_US 250 //physics step
+#define SIM_PWM_FRAME_US 20000 //the ESC and servo only see a new pulse this often
+#define SIM_GPS_PERIOD_US 100000
+#define SIM_GCS_PERIOD_US 100000
+#define SIM_COMPANION_PERIOD_US 100000
+#define SIM_COMPANION_OUTLIER (float) 3.0f //m, how far off a position is when the wrong cone was picked
+#define SIM_GCS_START_US 2000000 //time after setup() when the GCS resets the origin and starts sending waypoints
+#define SIM_KINEMATIC_SPEED (float) 1.0f //below this the model blends into the kinematic bicycle
+#define SIM_BASE_LATITUDE (double) 28.6139 //start line, somewhere in Delhi (the mag model in MPU9150.cpp was tuned there)
+#define SIM_BASE_LONGITUDE (double) 77.2090
+
+struct VEHICLE_PARAMS
+{
+	float mass, yaw_inertia;                 //kg, kg m^2
+	float wheelbase, cg_to_front, cg_height; //m
+	float mu;                                //tyre/surface friction coefficient
+	float cornering_stiffness;               //lateral force per unit load per radian of slip angle
+	float steering_gain, steering_max;       //servo pulse us per degree of wheel angle, degrees at full lock
+	float servo_time_constant, servo_rate;   //s, deg/s
+	float esc_offset, esc_range;             //pulse where the car starts moving, pulse range to the top of the speed curve
+	float speed_curve[4];                    //steady state speed for a normalized throttle x, a[0]x^3 + a[1]x^2 + a[2]x + a[3]
+	float esc_time_constant;                 //s, how fast the motor gets to the speed the throttle asks for
+	float load_factor;                       //speed curve is divided by this. The controller learns it as feedback_factor
+	float max_power;                         //W at the wheels
+	float max_brake;                         //m/s^2 with the brake pulse at 1000us
+	float rolling_resistance, drag_area;     //Crr, Cd*A in m^2
+	float imu_position, flow_position;       //m ahead of the rear axle
+	VEHICLE_PARAMS();
+};
+
+struct NOISE_PARAMS
+{
+	float accel, gyro;           //white noise, m/s^2 and deg/s
+	float gyro_bias[3];          //deg/s
+	float mag;                   //counts
+	float mag_offset[3];         //counts, hard iron on the mag's X, Y, Z registers (the car's factory offsets don't know about it)
+	float mag_scale[3];          //soft iron, the same registers
+	float gps_position;          //m, standard deviation of the wandering error
+	float gps_correlation_time;  //s
+	float gps_hacc;              //m, what the receiver claims (hAcc)
+	float gps_velocity;          //m/s white noise
+	uint32_t gps_latency;        //us between the epoch and the first byte of its message
+	uint8_t flow_squal;          //ADNS3080 surface quality
+	float companion_position;    //m white noise on the companion's positions, it also claims this as its error
+	uint32_t companion_latency;  //us between the frame and its message
+	float companion_outliers;    //share of the companion's positions that are off by SIM_COMPANION_OUTLIER
+	NOISE_PARAMS();
+};
+
+class VEHICLE
+{
+public:
+	VEHICLE_PARAMS p;
+	double x, y;
+	float yaw;            //rad
+	float vx, vy, r;      //body frame (forward, left), rad/s
+	float delta;          //front wheel angle, rad
+	float ax, ay, r_dot;  //body frame acceleration at the CG, excluding gravity
+	float throttle_pulse, steering_pulse; //what the ESC and servo are acting on
+	VEHICLE();
+	void reset(double x0, double y0, float yaw0);
+	void step(float h);
+	float sideslip(); //rad
+private:
+	float drive_force();
+	float tyre(float alpha, float load, float longitudinal);
+};
+
+struct TRACK_POINT
+{
+	float X, Y, slope; //m, degrees (what the GCS sends)
+};
+
+//closed circuit. The centerline is sampled every few cm for the cross track error, the waypoints are what the car gets.
+class TRACK
+{
+public:
+	std::vector<float> cx, cy; //centerline
+	std::vector<TRACK_POINT> waypoints; //last one repeats the first so that the sketch treats it as a circuit
+	float length;
+	void stadium(float straight, float radius, int corner_points); //two straights joined by half circles, counter clockwise
+	float locate(float x, float y, float &s); //cross track error (left of the centerline is positive) and distance along the track
+private:
+	size_t last;
+	void sample(float x, float y);
+};
+
+struct SIM_STATS
+{
+	uint32_t laps;
+	std::vector<float> lap_times; //s, the first one includes the standing start
+	double cross_track_sum, cross_track_sq;
+	float cross_track_max;
+	uint32_t samples;
+	float top_speed;
+	bool crashed;
+	const char *crash_reason;
+};
+
+class SIMULATOR
+{
+public:
+	VEHICLE car;
+	TRACK track;
+	NOISE_PARAMS noise;
+	SIM_STATS stats;
+	uint8_t mode;        //autonomous mode the GCS asks for once the waypoints are up (CRUISE or LUDICROUS)
+	float crash_distance; //m off the centerline that counts as leaving the track
+	float cross_track;   //latest
+	bool autonomous;     //the GCS has asked for mode
+	bool companion;      //play the companion computer too
+
+	SIMULATOR(SENSORS &s);
+	void seed(uint32_t n);
+	void start(uint32_t now); //car on the first waypoint pointing down the track, sensors at rest. call before setup()
+	void update(uint32_t now); //physics up to now, then sensor registers, GPS and GCS bytes for the coming loop()
+	float cross_track_rms();
+
+private:
+	SENSORS &sensors;
+	std::mt19937 rng;
+	std::normal_distribution<float> gauss;
+	uint32_t start_us, first_update, last_us, next_pwm, next_gps, next_gcs, next_companion, auto_start, lap_start;
+	float flow_carry[2];
+	float gps_error[2];
+	float gps_bytes_due;
+	uint32_t uart_us;
+	std::deque<uint8_t> gps_tx;
+	struct GPS_EPOCH
+	{
+		uint32_t due, itow;
+		double x, y;
+		float vx, vy;
+	};
+	std::deque<GPS_EPOCH> gps_epochs;
+	struct COMPANION_FIX
+	{
+		uint32_t due;
+		float x, y;
+	};
+	std::deque<COMPANION_FIX> companion_fixes;
+	size_t wp_sent;
+	bool running, origin_sent;
+	float last_s;
+
+	float noisy(float sigma);
+	void write_sensors();
+	void gps(uint32_t now);
+	void gcs(uint32_t now);
+	void companion_tx(uint32_t now);
+	void gcs_message(uint16_t id, uint8_t msg_mode, int16_t len, const int16_t *payload, int n);
+	void score(uint32_t now);
+};
+
+#endif
@@ -0,0 +1,21 @@
+//per tick trace of the car's state, written by lucifer_host and lucifer_replay so that two runs can be compared with diff.
+//Include it after LUCIFER.ino, it reads the sketch's globals. Floats go out with %.9g, which round trips a float exactly, so two
+//traces are byte for byte identical only if every value is bit for bit identical.
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include<stdio.h>
+
+inline void trace_header(FILE *f)
+{
+	fprintf(f, "tick,micros,X,Y,heading,Velocity,mh,roll,pitch,V,OF_X,OF_Y,CCR1,CCR4,MODE\n");
+}
+
+inline void trace_row(FILE *f, long tick, uint32_t stamp)
+{
+	fprintf(f, "%ld,%u,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%u,%u,%d\n", tick, stamp, car.X, car.Y, car.heading,
+		car.Velocity, marg.mh, marg.roll, marg.pitch, marg.V, opticalFlow.X, opticalFlow.Y, uint32_t(TIMER1_BASE->CCR1),
+		uint32_t(TIMER1_BASE->CCR4), MODE);
+}
+
+#endif
@@ -0,0 +1,106 @@
+#include"TUNABLES.h"
+#include"Arduino.h"
+#include"PARAMS.h"
+#include"OPFLOW.h"
+
+//CAR.h can only be included once per program, these are its LPF_GAIN_10/C1_10
+#define DRIVER_LPF_GAIN_DEFAULT (float) 1.0f/7.31375
+#define DRIVER_LPF_C1_DEFAULT (float) 0.726542
+
+static const char *const names[TUNABLE_COUNT] = {"future_time", "path_width", "the_ratio", "wp_circle", "opflow_lpf_hz",
+	"driver_lpf_hz"};
+
+TUNABLES tunables;
+
+TUNABLES::TUNABLES()
+{
+	future_time = FUTURE_TIME_DEFAULT;
+	path_width = PATH_WIDTH_DEFAULT;
+	the_ratio = THE_RATIO_DEFAULT;
+	wp_circle = WP_CIRCLE_DEFAULT;
+	opflow_lpf_gain = LPF_GAIN_OPFLOW_DEFAULT;
+	opflow_lpf_c1 = C1_OPFLOW_DEFAULT;
+	driver_lpf_gain = DRIVER_LPF_GAIN_DEFAULT;
+	driver_lpf_c1 = DRIVER_LPF_C1_DEFAULT;
+}
+
+//bilinear first order LPF : K = tan(pi*fc/fs), gain = K/(1+K), c1 = (1-K)/(1+K)
+static void lpf_from_cutoff(float hz, float &gain, float &c1)
+{
+	float K = tanf(M_PI*hz/LOOP_FREQUENCY);
+	gain = K/(1 + K);
+	c1 = (1 - K)/(1 + K);
+}
+
+static float lpf_cutoff(float gain)
+{
+	float K = gain/(1 - gain);
+	return atanf(K)*LOOP_FREQUENCY/M_PI;
+}
+
+const char *TUNABLES::name(int i)
+{
+	return names[i];
+}
+
+bool TUNABLES::set(const char *name, float value)
+{
+	if(!strcmp(name, "future_time"))
+	{
+		future_time = value;
+	}
+	else if(!strcmp(name, "path_width"))
+	{
+		path_width = value;
+	}
+	else if(!strcmp(name, "the_ratio"))
+	{
+		the_ratio = value;
+	}
+	else if(!strcmp(name, "wp_circle"))
+	{
+		wp_circle = value;
+	}
+	else if(!strcmp(name, "opflow_lpf_hz") && value > 0 && value < LOOP_FREQUENCY*0.5f)
+	{
+		lpf_from_cutoff(value, opflow_lpf_gain, opflow_lpf_c1);
+	}
+	else if(!strcmp(name, "driver_lpf_hz") && value > 0 && value < LOOP_FREQUENCY*0.5f)
+	{
+		lpf_from_cutoff(value, driver_lpf_gain, driver_lpf_c1);
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+float TUNABLES::get(const char *name)
+{
+	if(!strcmp(name, "future_time"))
+	{
+		return future_time;
+	}
+	if(!strcmp(name, "path_width"))
+	{
+		return path_width;
+	}
+	if(!strcmp(name, "the_ratio"))
+	{
+		return the_ratio;
+	}
+	if(!strcmp(name, "wp_circle"))
+	{
+		return wp_circle;
+	}
+	if(!strcmp(name, "opflow_lpf_hz"))
+	{
+		return lpf_cutoff(opflow_lpf_gain);
+	}
+	if(!strcmp(name, "driver_lpf_hz"))
+	{
+		return lpf_cutoff(driver_lpf_gain);
+	}
+	return NAN;
+}
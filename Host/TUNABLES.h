@@ -0,0 +1,41 @@
+//runtime values for the constants that PARAMS.h marks as "possible culprit" (plus THE_RATIO) and for the optical flow and driver
+//low pass filters (OPFLOW.h, CAR.h). Only builds with PARAM_SWEEP (lucifer_sweep) see this file, the car and the other host
+//tools keep the plain #defines. Everything starts out at the #define's value.
+//
+//the filters are the usual bilinear first order LPF (y = gain*(x + x_prev) + c1*y_prev), set by their cutoff in Hz at the rate
+//they are actually called at (LOOP_FREQUENCY for both). The defaults come out at 50Hz for the flow and 20Hz for the driver.
+//
+//note that a sweep build is not bit for bit the car's build even at the defaults : x*(float)1/3.41421 divides in double,
+//x*tunables.opflow_lpf_gain doesn't.
+#ifndef _TUNABLES_H_
+#define _TUNABLES_H_
+
+#define TUNABLE_COUNT 6
+
+struct TUNABLES
+{
+	float future_time;  //s, how far ahead the trajectory looks for the curvature
+	float path_width;   //m
+	float the_ratio;    //control point distance/waypoint spacing for the bezier curve
+	float wp_circle;    //m, a waypoint counts as reached inside this radius
+	float opflow_lpf_gain, opflow_lpf_c1;
+	float driver_lpf_gain, driver_lpf_c1; //controller::filter (La, Ha)
+
+	TUNABLES();
+	bool set(const char *name, float value); //false if there is no such name
+	float get(const char *name);
+	static const char *name(int i); //0..TUNABLE_COUNT-1
+};
+
+extern TUNABLES tunables;
+
+#define FUTURE_TIME tunables.future_time
+#define PATH_WIDTH tunables.path_width
+#define THE_RATIO tunables.the_ratio
+#define WP_CIRCLE tunables.wp_circle
+#define LPF_GAIN_OPFLOW tunables.opflow_lpf_gain
+#define C1_OPFLOW tunables.opflow_lpf_c1
+#define LPF_GAIN_10 tunables.driver_lpf_gain
+#define C1_10 tunables.driver_lpf_c1
+
+#endif
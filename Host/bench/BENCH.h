@@ -0,0 +1,199 @@
+//tiny benchmark harness for the host build.
+//Each case is timed in batches on the workstation clock (the batch size grows until a batch takes a few ms), the best batch wins.
+//While a case runs, the HAL's virtual clock and bus counters keep going, so we also get how long the code *blocks* on the car
+//(delays, busy waits) and how many I2C/SPI bytes it moves per call. Those cost the same on the car no matter how fast the PC is.
+//
+//Cortex-M3 estimate : the code comments carry timings measured on the car (STM32F103 @128MHz) or on the old pro mini
+//(16MHz AVR, which the comments convert with a factor of 13.85). The cases marked as anchors give a host->M3 scale factor
+//(geometric mean of documented/host), every case is then estimated as
+//	host time * scale + blocking time + bus time
+//The bytes that libmaple's I2C interrupt moves on its own (I2C_QUEUE.h) are listed as irq B and left out of the bus time, the
+//CPU doesn't wait for them.
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include"Arduino.h"
+#include"Wire.h"
+#include"SPI.h"
+#include<chrono>
+#include<vector>
+#include<string>
+
+#define BENCH_M3_CLOCK_MHZ (double) 128.0
+#define BENCH_PRO_MINI_FACTOR (double) 13.85 //pro mini us -> STM32 us, same factor as the comments use
+#define BENCH_I2C_US_PER_BYTE (double) (9.0/0.4) //400kHz, 8 bits + ack
+#define BENCH_I2C_US_PER_TRANSACTION (double) (2*9.0/0.4) //start + address byte + stop, roughly
+#define BENCH_SPI_US_PER_BYTE (double) (8.0/1.0) //1MHz (see spiSettings in OPFLOW.cpp)
+#define BENCH_MIN_BATCH_NS (double) 5e6
+#define BENCH_REPEATS 5
+
+//moves the virtual clock forward without it counting as blocking time (for code that only runs every so many ms)
+static uint32_t bench_skipped_us = 0;
+inline void bench_skip_micros(uint32_t us)
+{
+	host_advance_micros(us);
+	bench_skipped_us += us;
+}
+
+enum BENCH_PLATFORM
+{
+	DOC_NONE,
+	DOC_STM32,   //documented figure measured on the car
+	DOC_PRO_MINI //documented figure measured on the pro mini
+};
+
+struct BENCH_RESULT
+{
+	std::string name;
+	double ns_per_call;     //host
+	double block_us;        //virtual clock time that passed per call (delays, waits)
+	double i2c_bytes, i2c_transactions, spi_bytes; //per call
+	double irq_bytes;       //per call, queued I2C reads (not in the estimate)
+	double documented_us;   //STM32 equivalent of the figure in the code comments, 0 if there is none
+	bool anchor;            //used to calibrate the host->M3 scale
+	bool in_cycle;          //runs every 2500us cycle in loop(), counted against dt_micros
+	double m3_us;           //filled in by calibrate()
+};
+
+class BENCH
+{
+public:
+	std::vector<BENCH_RESULT> results;
+	double scale; //M3 us per host ns
+	const char *filter;
+
+	BENCH()
+	{
+		scale = 0;
+		filter = NULL;
+	}
+
+	//fn is called with the iteration number so that it can walk through a table of inputs
+	template<typename F>
+	void run(const char *name, double documented_us, BENCH_PLATFORM platform, bool anchor, bool in_cycle, F fn)
+	{
+		if(filter && !strstr(name, filter))
+		{
+			return;
+		}
+		BENCH_RESULT r;
+		r.name = name;
+		r.documented_us = platform == DOC_PRO_MINI ? documented_us/BENCH_PRO_MINI_FACTOR : documented_us;
+		if(platform == DOC_NONE)
+		{
+			r.documented_us = 0;
+		}
+		r.anchor = anchor && platform != DOC_NONE;
+		r.in_cycle = in_cycle;
+
+		//find a batch size that takes long enough to time
+		long batch = 1;
+		long n = 0;
+		for(;;)
+		{
+			double ns = time_batch(fn, n, batch);
+			n += batch;
+			if(ns > BENCH_MIN_BATCH_NS || batch > (1L << 24))
+			{
+				break;
+			}
+			batch *= 2;
+		}
+
+		double best = 1e300;
+		uint32_t t0 = micros();
+		uint32_t skipped = bench_skipped_us;
+		uint32_t i2c_b = Wire.bytes, i2c_t = Wire.transactions, spi_b = SPI.bytes, irq_b = Wire.irq_bytes;
+		long counted = 0;
+		for(int k = 0; k < BENCH_REPEATS; k++)
+		{
+			double ns = time_batch(fn, n, batch);
+			n += batch;
+			counted += batch;
+			best = ns < best ? ns : best;
+		}
+		double calls = double(counted);
+		r.ns_per_call = best/double(batch);
+		r.block_us = double(uint32_t(micros() - t0) - (bench_skipped_us - skipped))/calls;
+		r.i2c_bytes = double(Wire.bytes - i2c_b)/calls;
+		r.i2c_transactions = double(Wire.transactions - i2c_t)/calls;
+		r.spi_bytes = double(SPI.bytes - spi_b)/calls;
+		r.irq_bytes = double(Wire.irq_bytes - irq_b)/calls;
+		//every micros()/millis() call moves the virtual clock by HOST_CLOCK_STEP_US. That isn't blocking, take it back out
+		//as far as we can tell (anything below a microsecond is noise anyway).
+		if(r.block_us < 1.0)
+		{
+			r.block_us = 0;
+		}
+		r.m3_us = 0;
+		results.push_back(r);
+	}
+
+	double bus_us(const BENCH_RESULT &r)
+	{
+		return r.i2c_bytes*BENCH_I2C_US_PER_BYTE + r.i2c_transactions*BENCH_I2C_US_PER_TRANSACTION + r.spi_bytes*BENCH_SPI_US_PER_BYTE;
+	}
+
+	void calibrate()
+	{
+		double log_sum = 0;
+		int n = 0;
+		for(size_t i = 0; i < results.size(); i++)
+		{
+			BENCH_RESULT &r = results[i];
+			double compute_us = r.documented_us - r.block_us - bus_us(r);
+			if(r.anchor && compute_us > 0 && r.ns_per_call > 0)
+			{
+				log_sum += log(compute_us/r.ns_per_call);
+				n++;
+			}
+		}
+		scale = n ? exp(log_sum/n) : 0;
+		for(size_t i = 0; i < results.size(); i++)
+		{
+			BENCH_RESULT &r = results[i];
+			r.m3_us = r.ns_per_call*scale + r.block_us + bus_us(r);
+		}
+	}
+
+	//prints the table and returns the estimated time of everything that runs in every cycle
+	double report(FILE *f)
+	{
+		double cycle_us = 0;
+		fprintf(f, "%-36s %10s %9s %8s %8s %8s %10s %10s %7s\n", "function", "host ns", "block us", "i2c B", "irq B", "spi B", "M3 est us", "doc us",
+			"est/doc");
+		for(size_t i = 0; i < results.size(); i++)
+		{
+			BENCH_RESULT &r = results[i];
+			char doc[16] = "-", ratio[16] = "-";
+			if(r.documented_us > 0)
+			{
+				snprintf(doc, sizeof(doc), "%.1f", r.documented_us);
+				snprintf(ratio, sizeof(ratio), "%.2f", r.m3_us/r.documented_us);
+			}
+			fprintf(f, "%-36s %10.1f %9.1f %8.1f %8.1f %8.1f %10.1f %10s %7s%s%s\n", r.name.c_str(), r.ns_per_call, r.block_us, r.i2c_bytes,
+				r.irq_bytes, r.spi_bytes, r.m3_us, doc, ratio, r.anchor ? " A" : "", r.in_cycle ? " C" : "");
+			if(r.in_cycle)
+			{
+				cycle_us += r.m3_us;
+			}
+		}
+		fprintf(f, "\nscale : %.4f M3 us per host ns (%.0f M3 cycles per host ns), A = calibration anchor, C = runs every cycle\n",
+			scale, scale*BENCH_M3_CLOCK_MHZ);
+		return cycle_us;
+	}
+
+private:
+	template<typename F>
+	double time_batch(F &fn, long start, long batch)
+	{
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		for(long i = 0; i < batch; i++)
+		{
+			fn(start + i);
+		}
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+	}
+};
+
+#endif
@@ -0,0 +1,90 @@
+//the recorded-looking drive that lucifer_bench and lucifer_opcount feed the code with : the car going around a 13m circle at
+//4m/s, 400 samples a second, with a bit of noise on every sensor and the next waypoint a quarter lap ahead.
+#ifndef _DRIVE_H_
+#define _DRIVE_H_
+
+#include"Arduino.h"
+#include"SIDMATH.h"
+
+#define BENCH_SAMPLES 8192 //one lap of the circle, 20.48 s at 400Hz
+#define BENCH_RADIUS (float) 13.0f
+#define BENCH_SPEED (float) 4.0f
+#define BENCH_ORIGIN_LAT (double) 12.9716
+#define BENCH_ORIGIN_LON (double) 77.5946
+
+struct DRIVE_SAMPLE
+{
+	double lon, lat;
+	int32_t gps_lon, gps_lat; //the same in 1e-7 deg, like NAV-PVT
+	float X, Y, heading, yawRate, V, Ax, Ay;
+	float gps_V, gps_head;
+	float OF_X, OF_Y, OF_V_X, OF_V_Y;
+	float mh; //the heading as marg and STATE have it : degrees from X (East), counterclockwise. heading above is a compass bearing
+	float flow_X, flow_Y; //what opticalFlow.X, Y would be : the cycle's movement sideways and forward
+	float dest_X, dest_Y, dest_slope;
+	int16_t raw_a[3], raw_g[3], raw_m[3];
+	int8_t flow_dx, flow_dy;
+};
+
+static DRIVE_SAMPLE drive[BENCH_SAMPLES];
+static float noise(uint32_t &seed)
+{
+	seed = seed*1664525u + 1013904223u;
+	return float(int32_t(seed >> 8) - (1 << 23))/float(1 << 23); //[-1,1)
+}
+
+static void make_drive()
+{
+	uint32_t seed = 0x5eed;
+	float w = BENCH_SPEED/BENCH_RADIUS;
+	for(int i = 0; i < BENCH_SAMPLES; i++)
+	{
+		DRIVE_SAMPLE &s = drive[i];
+		float th = M_2PI*float(i)/float(BENCH_SAMPLES);
+		s.X = BENCH_RADIUS*sinf(th);
+		s.Y = BENCH_RADIUS*(1.0f - cosf(th));
+		s.heading = fmodf(90.0f - th*RAD2DEG + 360.0f, 360.0f);
+		s.yawRate = w*RAD2DEG + 0.5f*noise(seed);
+		s.V = BENCH_SPEED + 0.05f*noise(seed);
+		s.Ax = -BENCH_SPEED*w + 0.3f*noise(seed); //centripetal
+		s.Ay = 0.3f*noise(seed);
+		s.lat = BENCH_ORIGIN_LAT + double(s.Y + 0.5f*noise(seed))*METER2DEG;
+		s.lon = BENCH_ORIGIN_LON + double(s.X + 0.5f*noise(seed))*METER2DEG;
+		s.gps_lat = int32_t(lround(s.lat*1e7));
+		s.gps_lon = int32_t(lround(s.lon*1e7));
+		s.gps_V = BENCH_SPEED + 0.1f*noise(seed);
+		s.gps_head = s.heading + 2.0f*noise(seed);
+		s.OF_X = s.X + 0.02f*noise(seed);
+		s.OF_Y = s.Y + 0.02f*noise(seed);
+		s.OF_V_X = 0.05f*noise(seed);
+		s.OF_V_Y = BENCH_SPEED + 0.05f*noise(seed);
+		s.mh = fmodf(th*RAD2DEG + 0.5f*noise(seed) + 360.0f, 360.0f);
+		s.flow_X = s.OF_V_X*dt;
+		s.flow_Y = s.OF_V_Y*dt;
+		//next waypoint a quarter lap ahead, tangent to the circle
+		float th2 = th + 0.5f*M_PIB2;
+		s.dest_X = BENCH_RADIUS*sinf(th2);
+		s.dest_Y = BENCH_RADIUS*(1.0f - cosf(th2));
+		s.dest_slope = fmodf(90.0f - th2*RAD2DEG + 360.0f, 360.0f);
+		for(int j = 0; j < 3; j++)
+		{
+			s.raw_a[j] = int16_t(200.0f*noise(seed));
+			s.raw_g[j] = int16_t(50.0f*noise(seed));
+			s.raw_m[j] = int16_t(8.0f*noise(seed));
+		}
+		s.raw_a[0] += int16_t(s.Ax*(16384.0f/GRAVITY)/4.0f); //±8g range (see MPU9150::initialize)
+		s.raw_g[2] += int16_t(w*RAD2DEG*16.4f);              //±2000dps range
+		s.raw_m[0] += int16_t(60.0f*cosf(th));
+		s.raw_m[1] += int16_t(-60.0f*sinf(th));
+		s.raw_m[2] += -40;
+		s.flow_dx = int8_t(4.0f*noise(seed));
+		s.flow_dy = int8_t(20.0f + 4.0f*noise(seed));
+	}
+}
+
+static const DRIVE_SAMPLE &sample(long i)
+{
+	return drive[i & (BENCH_SAMPLES - 1)];
+}
+
+#endif
@@ -0,0 +1,118 @@
+//the cases that compare MATRIX.h against the hand written scalar updates, shared by lucifer_bench (float and FIX16, timed) and
+//lucifer_opcount (OP_FLOAT, counted). Include after DRIVE.h.
+//
+//	scalar gps fusion     what STATE_SCALAR::state_update does with a fix : one gain per axis, X and Y apart
+//	Matrix gps fusion     the same update through kalman_update() with a 2x2 P, so the price of the general code shows
+//	Matrix EKF predict    a 5 state car (X, Y, V, heading, gyro bias) : the jacobian and F P F' + Q, every cycle
+//	Matrix EKF correct    the same car taking a gps fix (X, Y) with the Joseph form update, 10Hz
+#ifndef _MATRIX_BENCH_H_
+#define _MATRIX_BENCH_H_
+
+#include"MATRIX.h"
+
+#define MATRIX_BENCH_HDOP 1.2f
+
+template<typename T>
+struct SCALAR_FUSION
+{
+	T X, Y, P_X, P_Y;
+
+	void init()
+	{
+		X = Y = T(0);
+		P_X = P_Y = T(1);
+	}
+
+	void update(const DRIVE_SAMPLE &s)
+	{
+		P_X += T(0.01f); //what the cycles since the last fix added
+		P_Y += T(0.01f);
+		T gx = P_X/(P_X + T(MATRIX_BENCH_HDOP));
+		T gy = P_Y/(P_Y + T(MATRIX_BENCH_HDOP));
+		X += gx*(T(s.X) - X);
+		Y += gy*(T(s.Y) - Y);
+		P_X *= (T(1) - gx);
+		P_Y *= (T(1) - gy);
+	}
+};
+
+template<typename T>
+struct MATRIX_FUSION
+{
+	Matrix<2, 1, T> x;
+	Matrix<2, 2, T> P, Q, R, H;
+
+	void init()
+	{
+		x.zero();
+		P.identity();
+		Q.identity();
+		Q *= T(0.01f);
+		R.identity();
+		R *= T(MATRIX_BENCH_HDOP);
+		H.identity();
+	}
+
+	void update(const DRIVE_SAMPLE &s)
+	{
+		P += Q;
+		Matrix<2, 1, T> y;
+		y(0, 0) = T(s.X) - x(0, 0);
+		y(1, 0) = T(s.Y) - x(1, 0);
+		kalman_update(x, P, H, R, y);
+	}
+};
+
+//X, Y, V, heading (rad), gyro bias (rad/s)
+template<typename T>
+struct MATRIX_EKF
+{
+	Matrix<5, 1, T> x;
+	Matrix<5, 5, T> P, Q;
+	Matrix<2, 5, T> H;
+	Matrix<2, 2, T> R;
+
+	void init()
+	{
+		x.zero();
+		P.identity();
+		Q.zero();
+		Q(0, 0) = Q(1, 1) = T(1e-4f);
+		Q(2, 2) = T(1e-3f);
+		Q(3, 3) = T(1e-5f);
+		Q(4, 4) = T(1e-8f);
+		H.zero();
+		H(0, 0) = H(1, 1) = T(1);
+		R.identity();
+		R *= T(MATRIX_BENCH_HDOP);
+	}
+
+	void predict(const DRIVE_SAMPLE &s)
+	{
+		float c = cosf(s.heading*DEG2RAD), sn = sinf(s.heading*DEG2RAD); //the car has these from the AHRS already
+		T dt_ = T(dt);
+		T V = x(2, 0);
+		x(0, 0) += V*T(c)*dt_;
+		x(1, 0) += V*T(sn)*dt_;
+		x(2, 0) += T(s.Ay)*dt_;
+		x(3, 0) += (T(s.yawRate*DEG2RAD) - x(4, 0))*dt_;
+		Matrix<5, 5, T> J; //jacobian of the motion. Not F, Arduino.h has an F() macro
+		J.identity();
+		J(0, 2) = T(c)*dt_;
+		J(0, 3) = -V*T(sn)*dt_;
+		J(1, 2) = T(sn)*dt_;
+		J(1, 3) = V*T(c)*dt_;
+		J(3, 4) = -dt_;
+		P = propagate_covariance(J, P, Q);
+	}
+
+	void correct(const DRIVE_SAMPLE &s)
+	{
+		Matrix<2, 1, T> y;
+		y(0, 0) = T(s.X) - x(0, 0);
+		y(1, 0) = T(s.Y) - x(1, 0);
+		kalman_update(x, P, H, R, y);
+	}
+};
+
+#endif
@@ -0,0 +1,337 @@
+//operation counting numbers for the host build. The STM32F103 has no FPU, so every float operation is a call into the soft
+//float library and a function costs roughly (number of operations) x (price of each). OPNUM<float>/OPNUM<double> behave like
+//float/double but count every multiply, add, divide, compare, sqrt, trig call and float<->double conversion they do, and
+//lucifer_opcount compiles SIDMATH, STATE, CAR and TRAJECTORY with float and double #defined to them:
+//
+//	#include everything else first (Arduino.h, INOUT.h, <...>)
+//	#include"OPCOUNT.h"
+//	#define float OP_FLOAT
+//	#define double OP_DOUBLE
+//	#include"SIDMATH.h" ...
+//	#undef float
+//	#undef double
+//
+//what is counted :
+//	- arithmetic and compares between two counted numbers, or a counted number and a plain one. Plain numbers are taken to be
+//	  constants, so mixing in an int or a float costs nothing extra. Mixing a float with a double (a 0.5 instead of a 0.5f, or
+//	  DEG2METER) promotes it like the compiler would : one f2d, then a double operation.
+//	- double -> float when a double result lands in a float.
+//	- sqrt/sqrtf and the trig/exp family. fabs is a bit clear and costs nothing.
+//what is not : float <-> int conversions, unary minus, loads and stores, the function calls themselves.
+#ifndef _OPCOUNT_H_
+#define _OPCOUNT_H_
+
+#include<stdint.h>
+#include<string.h>
+#include<math.h>
+#include<type_traits>
+
+//LUCIFER.ino's header comment, measured on the STM32 @128MHz
+#define OPCOUNT_MUL_US (double) 0.61
+#define OPCOUNT_ADD_US (double) 0.481
+#define OPCOUNT_DIV_US (double) 2.14
+//estimates : a soft float compare is about half an add, sqrtf is about three divides, the trig price comes out of anglecalcy's
+//documented 215us on the pro mini (= 15.5us on the STM32, one atan2f and a few adds). Soft double costs ~1.5x soft float for
+//mul/add/compare and ~2x for divide, sqrt and trig (libgcc's routines loop over twice the mantissa).
+#define OPCOUNT_CMP_US (double) 0.25
+#define OPCOUNT_SQRT_US (double) 6.4
+#define OPCOUNT_TRIG_US (double) 14.0
+#define OPCOUNT_F2D_US (double) 0.2
+#define OPCOUNT_D2F_US (double) 0.25
+#define OPCOUNT_DOUBLE_FACTOR (double) 1.5
+#define OPCOUNT_DOUBLE_SLOW_FACTOR (double) 2.0
+
+enum OPCOUNT_OP
+{
+	OPC_MUL,
+	OPC_ADD, //and subtract
+	OPC_DIV,
+	OPC_CMP,
+	OPC_SQRT,
+	OPC_TRIG,
+	OPC_ARITH_OPS,
+	OPC_F2D = 2*OPC_ARITH_OPS, //float ops come first, then the same for double, then the conversions
+	OPC_D2F,
+	OPC_NUM_OPS
+};
+
+struct OPCOUNT_TALLY
+{
+	uint64_t n[OPC_NUM_OPS];
+
+	void clear()
+	{
+		memset(n, 0, sizeof(n));
+	}
+
+	static double price(int op)
+	{
+		static const double base[OPC_ARITH_OPS] = {OPCOUNT_MUL_US, OPCOUNT_ADD_US, OPCOUNT_DIV_US, OPCOUNT_CMP_US, OPCOUNT_SQRT_US,
+			OPCOUNT_TRIG_US};
+		if(op == OPC_F2D)
+		{
+			return OPCOUNT_F2D_US;
+		}
+		if(op == OPC_D2F)
+		{
+			return OPCOUNT_D2F_US;
+		}
+		if(op < OPC_ARITH_OPS)
+		{
+			return base[op];
+		}
+		op -= OPC_ARITH_OPS;
+		return base[op]*(op == OPC_DIV || op == OPC_SQRT || op == OPC_TRIG ? OPCOUNT_DOUBLE_SLOW_FACTOR : OPCOUNT_DOUBLE_FACTOR);
+	}
+
+	double us() const
+	{
+		double t = 0;
+		for(int i = 0; i < OPC_NUM_OPS; i++)
+		{
+			t += n[i]*price(i);
+		}
+		return t;
+	}
+};
+
+inline OPCOUNT_TALLY &opcount()
+{
+	static OPCOUNT_TALLY tally;
+	return tally;
+}
+
+template<typename T>
+inline void opcount_hit(int op)
+{
+	opcount().n[op + (std::is_same<T, double>::value ? OPC_ARITH_OPS : 0)]++;
+}
+
+template<typename T>
+class OPNUM
+{
+public:
+	T v;
+
+	OPNUM() = default;
+
+	//constants and plain variables
+	template<typename A, typename std::enable_if<std::is_arithmetic<A>::value, int>::type = 0>
+	OPNUM(A x) : v(T(x))
+	{
+	}
+
+	template<typename U>
+	OPNUM(OPNUM<U> x) : v(T(x.v))
+	{
+		if(std::is_same<T, float>::value && std::is_same<U, double>::value)
+		{
+			opcount().n[OPC_D2F]++;
+		}
+		if(std::is_same<T, double>::value && std::is_same<U, float>::value)
+		{
+			opcount().n[OPC_F2D]++;
+		}
+	}
+
+	//explicit to float/double, otherwise "x < 1 ? x : 1e2" has two ways to go and doesn't compile. To ints it has to be implicit
+	//(throttle = inputs[2];)
+	template<typename A, typename std::enable_if<std::is_floating_point<A>::value, int>::type = 0>
+	explicit operator A() const
+	{
+		return A(v);
+	}
+
+	template<typename A, typename std::enable_if<std::is_integral<A>::value, int>::type = 0>
+	operator A() const
+	{
+		return A(v);
+	}
+
+	OPNUM operator-() const
+	{
+		return OPNUM(-v);
+	}
+
+	OPNUM operator+() const
+	{
+		return *this;
+	}
+
+	template<typename B> OPNUM &operator+=(B b);
+	template<typename B> OPNUM &operator-=(B b);
+	template<typename B> OPNUM &operator*=(B b);
+	template<typename B> OPNUM &operator/=(B b);
+};
+
+static_assert(sizeof(OPNUM<float>) == sizeof(float), "fast_sqrt reads the bits of a float through a pointer");
+
+typedef OPNUM<float> OP_FLOAT;
+typedef OPNUM<double> OP_DOUBLE;
+
+//what T op U comes out as in C++ (float*int -> float, float*double -> double)
+template<typename T, typename U>
+struct opnum_result
+{
+	typedef decltype(T()*U()) type;
+};
+
+template<typename T> struct opnum_plain
+{
+	typedef T type;
+};
+
+template<typename T> struct opnum_plain<OPNUM<T> >
+{
+	typedef T type;
+};
+
+//an operand on its way into an operation of type R. only a counted float getting promoted costs anything
+template<typename R, typename A>
+inline R opnum_arg(A x)
+{
+	return R(x);
+}
+
+template<typename R, typename T>
+inline R opnum_arg(OPNUM<T> x)
+{
+	if(std::is_same<R, double>::value && std::is_same<T, float>::value)
+	{
+		opcount().n[OPC_F2D]++;
+	}
+	return R(x.v);
+}
+
+template<bool ok, typename T, typename U>
+struct opnum_result_if
+{
+	typedef void type;
+};
+
+template<typename T, typename U>
+struct opnum_result_if<true, T, U>
+{
+	typedef typename opnum_result<T, U>::type type;
+};
+
+//the operators below are templates on both sides so that OP_FLOAT*OP_DOUBLE, OP_FLOAT*0.5 and 2*OP_FLOAT all find an exact
+//match. They only exist when one side is counted and the other is counted or arithmetic (iterators etc. stay out of it)
+template<typename A, typename B>
+struct opnum_binary
+{
+	static const bool ok = (!std::is_same<typename opnum_plain<A>::type, A>::value ||
+		!std::is_same<typename opnum_plain<B>::type, B>::value) &&
+		std::is_arithmetic<typename opnum_plain<A>::type>::value && std::is_arithmetic<typename opnum_plain<B>::type>::value;
+	typedef typename opnum_result_if<ok, typename opnum_plain<A>::type, typename opnum_plain<B>::type>::type R;
+};
+
+#define OPCOUNT_ARITHMETIC(SYM, OP) \
+template<typename A, typename B, typename std::enable_if<opnum_binary<A, B>::ok, int>::type = 0> \
+inline OPNUM<typename opnum_binary<A, B>::R> operator SYM(A a, B b) \
+{ \
+	typedef typename opnum_binary<A, B>::R R; \
+	R x = opnum_arg<R>(a), y = opnum_arg<R>(b); \
+	opcount_hit<R>(OP); \
+	return OPNUM<R>(x SYM y); \
+}
+
+#define OPCOUNT_COMPARE(SYM) \
+template<typename A, typename B, typename std::enable_if<opnum_binary<A, B>::ok, int>::type = 0> \
+inline bool operator SYM(A a, B b) \
+{ \
+	typedef typename opnum_binary<A, B>::R R; \
+	R x = opnum_arg<R>(a), y = opnum_arg<R>(b); \
+	opcount_hit<R>(OPC_CMP); \
+	return x SYM y; \
+}
+
+OPCOUNT_ARITHMETIC(*, OPC_MUL)
+OPCOUNT_ARITHMETIC(+, OPC_ADD)
+OPCOUNT_ARITHMETIC(-, OPC_ADD)
+OPCOUNT_ARITHMETIC(/, OPC_DIV)
+OPCOUNT_COMPARE(<)
+OPCOUNT_COMPARE(>)
+OPCOUNT_COMPARE(<=)
+OPCOUNT_COMPARE(>=)
+OPCOUNT_COMPARE(==)
+OPCOUNT_COMPARE(!=)
+
+template<typename T> template<typename B> inline OPNUM<T> &OPNUM<T>::operator+=(B b)
+{
+	return *this = OPNUM<T>(*this + b);
+}
+
+template<typename T> template<typename B> inline OPNUM<T> &OPNUM<T>::operator-=(B b)
+{
+	return *this = OPNUM<T>(*this - b);
+}
+
+template<typename T> template<typename B> inline OPNUM<T> &OPNUM<T>::operator*=(B b)
+{
+	return *this = OPNUM<T>(*this*b);
+}
+
+template<typename T> template<typename B> inline OPNUM<T> &OPNUM<T>::operator/=(B b)
+{
+	return *this = OPNUM<T>(*this/b);
+}
+
+//math.h. the float versions take OP_FLOAT, the double ones OP_DOUBLE (a float passed to them gets promoted, like in C)
+#define OPCOUNT_FUNCTION(NAME, T, OP) \
+inline OPNUM<T> NAME(OPNUM<T> x) \
+{ \
+	opcount_hit<T>(OP); \
+	return OPNUM<T>(T(::NAME(x.v))); \
+}
+
+#define OPCOUNT_FUNCTION2(NAME, T, OP) \
+inline OPNUM<T> NAME(OPNUM<T> y, OPNUM<T> x) \
+{ \
+	opcount_hit<T>(OP); \
+	return OPNUM<T>(T(::NAME(y.v, x.v))); \
+}
+
+OPCOUNT_FUNCTION(sqrtf, float, OPC_SQRT)
+OPCOUNT_FUNCTION(sinf, float, OPC_TRIG)
+OPCOUNT_FUNCTION(cosf, float, OPC_TRIG)
+OPCOUNT_FUNCTION(tanf, float, OPC_TRIG)
+OPCOUNT_FUNCTION(asinf, float, OPC_TRIG)
+OPCOUNT_FUNCTION(acosf, float, OPC_TRIG)
+OPCOUNT_FUNCTION(atanf, float, OPC_TRIG)
+OPCOUNT_FUNCTION(expf, float, OPC_TRIG)
+OPCOUNT_FUNCTION2(atan2f, float, OPC_TRIG)
+OPCOUNT_FUNCTION2(powf, float, OPC_TRIG)
+OPCOUNT_FUNCTION(sqrt, double, OPC_SQRT)
+OPCOUNT_FUNCTION(sin, double, OPC_TRIG)
+OPCOUNT_FUNCTION(cos, double, OPC_TRIG)
+OPCOUNT_FUNCTION(tan, double, OPC_TRIG)
+OPCOUNT_FUNCTION(asin, double, OPC_TRIG)
+OPCOUNT_FUNCTION(acos, double, OPC_TRIG)
+OPCOUNT_FUNCTION(atan, double, OPC_TRIG)
+OPCOUNT_FUNCTION(exp, double, OPC_TRIG)
+OPCOUNT_FUNCTION2(atan2, double, OPC_TRIG)
+OPCOUNT_FUNCTION2(pow, double, OPC_TRIG)
+
+inline OP_FLOAT fabs(OP_FLOAT x)
+{
+	return OP_FLOAT(::fabsf(x.v));
+}
+
+inline OP_FLOAT fabsf(OP_FLOAT x)
+{
+	return OP_FLOAT(::fabsf(x.v));
+}
+
+inline OP_DOUBLE fabs(OP_DOUBLE x)
+{
+	return OP_DOUBLE(::fabs(x.v));
+}
+
+inline long lroundf(OP_FLOAT x) //the 0.5 added before the truncation
+{
+	opcount_hit<float>(OPC_ADD);
+	return ::lroundf(x.v);
+}
+
+#endif
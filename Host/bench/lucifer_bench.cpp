@@ -0,0 +1,403 @@
+//microbenchmarks for the functions that have a hand measured time in their comments (SIDMATH, TRAJECTORY, CAR, STATE, MPU9150,
+//OPFLOW). Everything is compiled from Libraries/ unchanged and fed with a recorded-looking drive: the car going around a 13m
+//circle at 4m/s, 400 samples a second, with a bit of noise on every sensor. See BENCH.h for how the numbers are worked out.
+//
+//usage : lucifer_bench [filter] [--check]
+//	filter  only run the cases whose name contains this string
+//	--check exit with 1 if the estimated time of the per-cycle work doesn't fit in dt_micros (for CI)
+#include"Arduino.h"
+#include"Wire.h"
+#include"SPI.h"
+#include"SENSORS.h"
+#include"BENCH.h"
+#include"DRIVE.h"
+
+#include"MPU9150.h"
+#include"OPFLOW.h"
+#include"GPS_NAV_PVT.h"
+#include"SIDMATH.h"
+#include"STATE.h"
+#include"STATE_SCALAR.h"
+#include"CAR.h"
+#include"PARAMS.h"
+#include"TRAJECTORY.h"
+#include"FIX16.h"
+#include"MATRIX_BENCH.h"
+
+float Kalman(float gpscord,float gpsError,float estimate,uint8_t trustInEstimate); //SIDMATH.h declares it as gpsOpFlowKalman
+
+static volatile float sink; //keeps the optimizer from throwing the work away
+
+SENSORS sensors;
+MPU9150 marg;
+MPU9150 marg_queued; //same sensor, read through the I2C queue like the car does
+I2C_QUEUE i2c_bus;
+MPU9150 marg_quat; //and with the quaternion AHRS instead of the Euler update
+I2C_QUEUE i2c_bus_quat;
+OPFLOW opticalFlow;
+GPS gps;
+STATE car;
+STATE_SCALAR car_scalar;
+trajectory track;
+controller control;
+SCALAR_FUSION<float> scalar_fusion;
+MATRIX_FUSION<float> matrix_fusion;
+MATRIX_EKF<float> ekf;
+MATRIX_EKF<FIX16> ekf_fix16;
+
+static void feed_sensors(const DRIVE_SAMPLE &s)
+{
+	int16_t a[3] = {s.raw_a[0], s.raw_a[1], s.raw_a[2]};
+	int16_t g[3] = {s.raw_g[0], s.raw_g[1], s.raw_g[2]};
+	int16_t m[3] = {s.raw_m[0], s.raw_m[1], s.raw_m[2]};
+	sensors.imu.set_motion(a, g, 0);
+	sensors.mag.set_field(m);
+	sensors.flow.set_motion(true, s.flow_dx, s.flow_dy, 100, 0x0200, 60);
+}
+
+static void scalar_update(long i, bool gps_tick)
+{
+	const DRIVE_SAMPLE &s = sample(i);
+	float model[3] = {s.V, 0.2f, BENCH_RADIUS};
+	car_scalar.state_update(s.gps_lon, s.gps_lat, gps_tick, 0.055f, 1.2f, s.gps_V, 0.3f, s.gps_head, 1.5f,
+							s.mh, 0.5f, s.yawRate, 0.01f, s.Ay, s.V, 0.05f,
+							s.flow_X, s.flow_Y, s.OF_V_X, s.OF_V_Y, 0.05f, 0.05f, model);
+	sink = car_scalar.X;
+}
+
+//what imu_task hands STATE for sample i
+static void predict(long i)
+{
+	const DRIVE_SAMPLE &s = sample(i);
+	STATE_MOTION m = {s.mh, 0.5f, s.Ay, s.V, s.flow_X, s.flow_Y, true, BENCH_RADIUS};
+	car.predict(m);
+	sink = car.X;
+}
+
+static void correct_flow(long i)
+{
+	const DRIVE_SAMPLE &s = sample(i);
+	STATE_FLOW f = {s.OF_V_X, s.OF_V_Y, 0.05f};
+	car.correct_flow(f);
+	sink = car.X;
+}
+
+static void correct_gps(long i)
+{
+	const DRIVE_SAMPLE &s = sample(i);
+	STATE_GPS g = {s.gps_lon, s.gps_lat, 0.055f, 1.2f, s.gps_V, 0.3f, 0.8f, true};
+	car.correct_gps(g);
+	sink = car.X;
+}
+
+//a fix's X correction waiting for the next predict(), without timing what correct_gps() took to get there
+static void fix_pending(long i)
+{
+	const DRIVE_SAMPLE &s = sample(i);
+	car.recall(0.055f, car.fix);
+	car.gps_X = s.X - drive[0].X;
+	car.gps_Y = s.Y - drive[0].Y;
+	car.fix_r = 1.44f;
+	car.fix_pending = FIX_X;
+}
+
+//a cone localization fix from the companion, in the frame car.initialize() put the origin in, 200ms old
+static void correct_companion(long i)
+{
+	const DRIVE_SAMPLE &s = sample(i);
+	STATE_COMPANION c = {s.X - drive[0].X, s.Y - drive[0].Y, 0.2f, 0.3f};
+	car.correct_companion(c);
+	sink = car.X;
+}
+
+static void register_cases(BENCH &bench)
+{
+	//SIDMATH
+	bench.run("SIDMATH fast_sqrt", 0, DOC_NONE, false, false, [](long i)
+	{
+		sink = fast_sqrt(1.0f + float(i & 1023));
+	});
+	bench.run("SIDMATH distancecalcy (deg)", 70, DOC_PRO_MINI, false, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		sink = distancecalcy(float(s.lat - BENCH_ORIGIN_LAT), 0.0f, float(s.lon - BENCH_ORIGIN_LON), 0.0f, 1);
+	});
+	bench.run("SIDMATH anglecalcy", 215, DOC_PRO_MINI, true, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		sink = anglecalcy(s.X, s.dest_X, s.Y, s.dest_Y);
+	});
+	bench.run("SIDMATH my_cos", 50, DOC_PRO_MINI, false, false, [](long i)
+	{
+		sink = my_cos(sample(i).heading*DEG2RAD);
+	});
+	bench.run("SIDMATH my_sin", 57, DOC_PRO_MINI, false, false, [](long i)
+	{
+		sink = my_sin(sample(i).heading*DEG2RAD);
+	});
+	bench.run("SIDMATH depress", 74.5, DOC_PRO_MINI, true, false, [](long i)
+	{
+		sink = depress(sample(i).Ax, 0.5f);
+	});
+	bench.run("SIDMATH Kalman", 95, DOC_PRO_MINI, true, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		sink = Kalman(s.X, 1.2f, s.OF_X, uint8_t(50 + (i & 63)));
+	});
+
+	//TRAJECTORY
+	bench.run("trajectory::get_Intermediate_Points", 248, DOC_PRO_MINI, true, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		track.get_Intermediate_Points(s.heading, s.dest_slope, s.X, s.dest_X, s.Y, s.dest_Y);
+		sink = track.int1[0];
+	});
+	bench.run("trajectory::get_T", 255, DOC_PRO_MINI, true, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		track.get_Intermediate_Points(s.heading, s.dest_slope, s.X, s.dest_X, s.Y, s.dest_Y);
+		track.get_T(s.V, s.X, s.Y, track.int1[0], track.int1[1], track.int2[0], track.int2[1], s.dest_X, s.dest_Y, FUTURE_TIME);
+		sink = track.t;
+	});
+	bench.run("trajectory::get_Curvature", 246.3, DOC_STM32, true, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		track.get_Curvature(s.X, s.Y, track.int1[0], track.int1[1], track.int2[0], track.int2[1], s.dest_X, s.dest_Y, s.V);
+		sink = track.C[1];
+	});
+	bench.run("trajectory::calculate_Curvatures", 0, DOC_NONE, false, true, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		track.calculate_Curvatures(s.V, s.X, s.Y, s.heading, s.dest_X, s.dest_Y, s.dest_slope);
+		sink = track.C[0];
+	});
+
+	//ENU
+	bench.run("ENU::project", 0, DOC_NONE, false, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		float X, Y;
+		car.frame.project(s.gps_lon, s.gps_lat, X, Y);
+		sink = X + Y;
+	});
+	bench.run("ENU::unproject", 0, DOC_NONE, false, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		int32_t lon, lat;
+		car.frame.unproject(s.X, s.Y, lon, lat);
+		sink = float(lon - lat);
+	});
+
+	//STATE
+	bench.run("STATE::predict", 0, DOC_NONE, false, false, [](long i)
+	{
+		predict(i);
+	});
+	bench.run("STATE::predict (a fix's correction)", 0, DOC_NONE, false, false, [](long i)
+	{
+		fix_pending(i);
+		predict(i);
+	});
+	bench.run("STATE::correct_flow", 0, DOC_NONE, false, false, [](long i)
+	{
+		car.fix_cycle = false;
+		correct_flow(i);
+	});
+	bench.run("STATE::correct_gps", 0, DOC_NONE, false, false, [](long i) //the checks, the corrections are in the next predict()s
+	{
+		correct_gps(i);
+		car.fix_pending = 0;
+	});
+	bench.run("STATE tick with a fix", 0, DOC_NONE, false, false, [](long i) //the flow's correction and the fix's checks
+	{
+		predict(i);
+		correct_flow(i);
+		correct_gps(i);
+		car.fix_pending = 0;
+	});
+	bench.run("STATE tick with a fix's correction", 0, DOC_NONE, false, true, [](long i) //the worst tick, the flow's is left out then
+	{
+		fix_pending(i);
+		predict(i);
+		correct_flow(i);
+	});
+	bench.run("STATE::correct_companion", 0, DOC_NONE, false, false, [](long i) //telemetry_task, 10Hz
+	{
+		correct_companion(i);
+	});
+	bench.run("STATE cycle (gps at 10Hz)", 0, DOC_NONE, false, false, [](long i)
+	{
+		predict(i);
+		correct_flow(i);
+		if((i % 40) == 0)
+		{
+			correct_gps(i);
+		}
+	});
+	bench.run("STATE_SCALAR::state_update", 60.61, DOC_STM32, true, false, [](long i)
+	{
+		scalar_update(i, (i % 40) == 0);
+	});
+	bench.run("STATE_SCALAR::state_update (gps tick)", 0, DOC_NONE, false, false, [](long i) //22 cycles to do again
+	{
+		scalar_update(i, true);
+	});
+
+	//MATRIX against the scalar code it would replace. The FIX16 cases only show that it runs : the PC has an FPU and the M3
+	//doesn't, so the scale fitted to soft float says nothing about integer math. lucifer_opcount has the float op counts that
+	//FIX16 turns into single cycle integer multiplies and adds (the divides stay expensive, they are 64 bit)
+	bench.run("scalar gps fusion (STATE)", 0, DOC_NONE, false, false, [](long i)
+	{
+		scalar_fusion.update(sample(i));
+		sink = scalar_fusion.X;
+	});
+	bench.run("Matrix<2,2> gps fusion", 0, DOC_NONE, false, false, [](long i)
+	{
+		matrix_fusion.update(sample(i));
+		sink = matrix_fusion.x(0, 0);
+	});
+	bench.run("Matrix<5,5> EKF predict", 0, DOC_NONE, false, false, [](long i)
+	{
+		ekf.predict(sample(i));
+		sink = ekf.x(0, 0);
+	});
+	bench.run("Matrix<5,5> EKF correct (2 meas)", 0, DOC_NONE, false, false, [](long i)
+	{
+		ekf.correct(sample(i));
+		sink = ekf.x(0, 0);
+	});
+	bench.run("Matrix<5,5,FIX16> EKF predict", 0, DOC_NONE, false, false, [](long i)
+	{
+		ekf_fix16.predict(sample(i));
+		sink = float(ekf_fix16.x(0, 0));
+	});
+	bench.run("Matrix<5,5,FIX16> EKF correct", 0, DOC_NONE, false, false, [](long i)
+	{
+		ekf_fix16.correct(sample(i));
+		sink = float(ekf_fix16.x(0, 0));
+	});
+
+	//CAR
+	bench.run("controller::feedback", 0, DOC_NONE, false, true, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		float model[3];
+		control.feedback(s.V, 0.05f, 0.05f);
+		control.get_model(model);
+		sink = model[0];
+	});
+	bench.run("controller::driver", 140, DOC_STM32, false, true, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		float inputs[8] = {1500, 1500, 1500, 1500, 1500, 1700, 1500, 2000};
+		bench_skip_micros(uint32_t((CONTROL_TIME)*1000)); //the driver only runs every CONTROL_TIME ms, make every call count
+		control.driver(track.C, 5.0f, s.V, 0.0f, s.yawRate, s.Ax, s.Ay, CRUISE, inputs);
+		sink = float(TIMER1_BASE->CCR1);
+	});
+
+	//MPU9150 (includes the I2C traffic to the register model)
+	bench.run("MPU9150::tilt_Compensate", 800, DOC_PRO_MINI, true, false, [](long i)
+	{
+		float p = 2.0f*DEG2RAD*sample(i).Ax, r = 2.0f*DEG2RAD*sample(i).Ay;
+		sink = marg.tilt_Compensate(cosf(p), cosf(r), sinf(p), sinf(r));
+	});
+	bench.run("MPU9150::compute_All", 570, DOC_STM32, false, false, [](long i)
+	{
+		feed_sensors(sample(i));
+		bench_skip_micros(dt_micros); //so that the 100Hz mag read happens as often as it does on the car
+		marg.compute_All();
+		sink = marg.mh;
+	});
+	bench.run("MPU9150::compute_All (queued)", 0, DOC_NONE, false, true, [](long i)
+	{
+		feed_sensors(sample(i));
+		bench_skip_micros(dt_micros);
+		marg_queued.compute_All();
+		marg_queued.poll(); //imu_rx, later in the tick
+		sink = marg_queued.mh;
+	});
+	bench.run("MPU9150::compute_All (quaternion)", 0, DOC_NONE, false, false, [](long i)
+	{
+		feed_sensors(sample(i));
+		bench_skip_micros(dt_micros);
+		marg_quat.compute_All();
+		marg_quat.poll();
+		sink = marg_quat.mh;
+	});
+	bench.run("MPU9150::mag_Update", 0, DOC_NONE, false, false, [](long)
+	{
+		marg.mag_Update(); //the mag's 6 bytes out of EXT_SENS_DATA and the heading correction
+
+		sink = marg.mh;
+	});
+	bench.run("MPU9150::Velocity_Update", 0, DOC_NONE, false, true, [](long i)
+	{
+		float V = sample(i).V;
+		marg.Velocity_Update(V, 0.05f, 0.0f);
+		sink = marg.V;
+	});
+
+	//OPFLOW (includes the SPI traffic and the 75us waits)
+	bench.run("OPFLOW::updateOpticalFlow", 150, DOC_STM32, false, true, [](long i)
+	{
+		feed_sensors(sample(i));
+		marg.get_Rotations(opticalFlow.omega);
+		opticalFlow.updateOpticalFlow();
+		sink = opticalFlow.X;
+	});
+
+	//GPS with no new frame, which is what 39 cycles out of 40 look like (the framing itself runs in the background, see UBX.h)
+	bench.run("GPS::localizer (idle)", 12, DOC_STM32, false, true, [](long i)
+	{
+		gps.localizer();
+		sink = gps.tick;
+	});
+}
+
+int main(int argc, char **argv)
+{
+	BENCH bench;
+	bool check = false;
+	for(int i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "--check"))
+		{
+			check = true;
+		}
+		else
+		{
+			bench.filter = argv[i];
+		}
+	}
+
+	make_drive();
+	scalar_fusion.init();
+	matrix_fusion.init();
+	ekf.init();
+	ekf_fix16.init();
+	sensors.attach();
+	feed_sensors(drive[0]);
+	SPI.begin();
+	Wire.begin();
+	Wire.setClock(400000);
+	marg.initialize();
+	marg_queued.setBus(&i2c_bus);
+	marg_quat.setAHRS(MPU_AHRS_QUATERNION);
+	marg_quat.setBus(&i2c_bus_quat);
+	opticalFlow.initialize();
+	opticalFlow.caliberation(ride_height, 0.0f);
+	car.initialize(drive[0].gps_lon, drive[0].gps_lat, 1.2, drive[0].mh, BENCH_SPEED, 0);
+	car_scalar.initialize(drive[0].gps_lon, drive[0].gps_lat, 1.2, drive[0].mh, BENCH_SPEED, 0);
+	track.get_Intermediate_Points(drive[0].heading, drive[0].dest_slope, drive[0].X, drive[0].dest_X, drive[0].Y, drive[0].dest_Y);
+
+	register_cases(bench);
+	bench.calibrate();
+	double cycle_us = bench.report(stdout);
+	printf("per-cycle work (C) : %.1f us estimated out of dt_micros = %d us (%.0f%%)\n", cycle_us, int(dt_micros), 100.0*cycle_us/dt_micros);
+	if(check && cycle_us > dt_micros)
+	{
+		printf("over budget\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,195 @@
+//how far STATE::correct_past() is from doing delayed measurements properly. The EKF is run over lucifer_bench's drive (DRIVE.h)
+//three times with the same inputs : the flow every 4th cycle, a gps fix every 40 cycles arriving 55ms after its epoch and a
+//companion position every 40 cycles arriving 200ms after its image, both with a bit of noise on them
+//	car      the way the sketch does it : each one against the history, corrected into the estimate now by correct_past()
+//	replay   each one put in at its own epoch : back to a copy of the filter from then, the measurement, and every cycle since
+//	         run again with the same inputs (and the measurements that have come in since, at their epochs). That is what
+//	         correct_past() stands in for, the STM32 can't afford up to 120 predicts in a tick
+//	current  each one taken as if it was of the estimate now, no history at all. How much the history buys, for scale
+//and the car's and current's estimates are compared with the replay's at every cycle.
+//
+//usage : lucifer_delay [--check]
+//	--check exit with 1 if the car's position is further from the replay's than DELAY_MAX_RMS (for CI)
+#include"Arduino.h"
+#include"PARAMS.h"
+#include"SIDMATH.h"
+#include"STATE.h"
+#include"DRIVE.h"
+#include<vector>
+
+#define DELAY_CYCLES (BENCH_SAMPLES*2) //2 laps
+#define DELAY_WARMUP 400 //cycles before the differences are counted, the filters are still settling from initialize()
+#define DELAY_GPS_PERIOD 40
+#define DELAY_GPS_AGE (float) 0.055f
+#define DELAY_COMPANION_PERIOD 40
+#define DELAY_COMPANION_OFFSET 20 //cycles after the fixes
+#define DELAY_COMPANION_AGE (float) 0.2f
+#define DELAY_MAX_RMS (float) 0.05f //m
+
+struct DELAYED //a measurement, when it came in and the cycle it is of
+{
+	long arrival, epoch;
+	bool gps;
+	STATE_GPS g;
+	STATE_COMPANION c;
+};
+
+struct DIFF
+{
+	long n;
+	double pos2, pos_max, v2, head2;
+
+	void add(const STATE &a, const STATE &b)
+	{
+		double dx = a.X - b.X, dy = a.Y - b.Y, d2 = dx*dx + dy*dy;
+		double dv = a.Velocity - b.Velocity, dh = STATE::wrap_180(a.heading - b.heading);
+		n++;
+		pos2 += d2;
+		pos_max = max(pos_max, sqrt(d2));
+		v2 += dv*dv;
+		head2 += dh*dh;
+	}
+
+	float position() const
+	{
+		return n ? float(sqrt(pos2/n)) : 0;
+	}
+};
+
+static STATE car, replay, current;
+static STATE snap[STATE_HISTORY + 1]; //replay at the end of the last cycles, before what came in for them. static, STATE is too big for some stacks
+static std::vector<DELAYED> measurements;
+
+static long cycles_back(float age)
+{
+	return long(uint32_t(age*LOOP_FREQUENCY + 0.5f)); //same rounding as STATE::recall()
+}
+
+//what imu_task hands STATE for cycle i. marg's speed starts from the filter's own, the way Velocity_Update() feeds it back
+static void step(STATE &f, long i)
+{
+	const DRIVE_SAMPLE &s = sample(i);
+	STATE_MOTION m = {s.mh, 0.5f, s.Ay, f.Velocity + (s.Ay - f.AccBias)*dt, s.flow_X, s.flow_Y, true, BENCH_RADIUS};
+	f.predict(m);
+	if(i%4 == 0)
+	{
+		STATE_FLOW fl = {s.OF_V_X, s.OF_V_Y, 0.05f};
+		f.correct_flow(fl);
+	}
+}
+
+static void apply(STATE &f, const DELAYED &d, float age)
+{
+	if(d.gps)
+	{
+		STATE_GPS g = d.g;
+		g.age = age;
+		f.correct_gps(g);
+	}
+	else
+	{
+		STATE_COMPANION c = d.c;
+		c.age = age;
+		f.correct_companion(c);
+	}
+}
+
+static STATE &snapshot(long i)
+{
+	return snap[i%(STATE_HISTORY + 1)];
+}
+
+//the measurements that have come in by cycle now and are of cycle i
+static void apply_epoch(STATE &f, long i, long now)
+{
+	for(size_t k = 0; k < measurements.size(); k++)
+	{
+		if(measurements[k].epoch == i && measurements[k].arrival <= now)
+		{
+			apply(f, measurements[k], 0);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	bool check = argc > 1 && !strcmp(argv[1], "--check");
+	make_drive();
+	uint32_t seed = 0xde1a;
+	for(long i = cycles_back(DELAY_COMPANION_AGE) + 1; i < DELAY_CYCLES; i++) //none from before initialize()
+	{
+		if(i%DELAY_GPS_PERIOD == 0)
+		{
+			long back = cycles_back(DELAY_GPS_AGE);
+			const DRIVE_SAMPLE &e = sample(i - back);
+			DELAYED d = {i, i - back, true};
+			STATE_GPS g = {e.gps_lon, e.gps_lat, DELAY_GPS_AGE, 0.8f, e.gps_V, 0.3f, 0.9f, true};
+			d.g = g;
+			measurements.push_back(d);
+		}
+		if(i%DELAY_COMPANION_PERIOD == DELAY_COMPANION_OFFSET)
+		{
+			long back = cycles_back(DELAY_COMPANION_AGE);
+			const DRIVE_SAMPLE &e = sample(i - back);
+			DELAYED d = {i, i - back, false};
+			STATE_COMPANION c = {e.X - drive[0].X + 0.1f*noise(seed), e.Y - drive[0].Y + 0.1f*noise(seed), DELAY_COMPANION_AGE, 0.3f};
+			d.c = c;
+			measurements.push_back(d);
+		}
+	}
+
+	car.initialize(drive[0].gps_lon, drive[0].gps_lat, 0.8f, drive[0].mh, BENCH_SPEED, 0);
+	current = car;
+	replay = car;
+	snapshot(0) = replay;
+	DIFF car_replay = {}, current_replay = {};
+	size_t next = 0;
+	for(long i = 1; i < DELAY_CYCLES; i++)
+	{
+		step(car, i);
+		step(current, i);
+		step(replay, i);
+		snapshot(i) = replay;
+		while(next < measurements.size() && measurements[next].arrival == i)
+		{
+			const DELAYED &d = measurements[next++];
+			apply(car, d, d.gps ? DELAY_GPS_AGE : DELAY_COMPANION_AGE);
+			apply(current, d, 0);
+			//back to the epoch and forward again, with everything that has come in by now
+			replay = snapshot(d.epoch);
+			apply_epoch(replay, d.epoch, i);
+			for(long j = d.epoch + 1; j <= i; j++)
+			{
+				step(replay, j);
+				snapshot(j) = replay;
+				apply_epoch(replay, j, i);
+			}
+		}
+		if(i >= DELAY_WARMUP)
+		{
+			car_replay.add(car, replay);
+			current_replay.add(current, replay);
+		}
+	}
+
+	int fixes = 0;
+	for(size_t k = 0; k < measurements.size(); k++)
+	{
+		fixes += measurements[k].gps;
+	}
+	printf("%ld cycles, %d fixes %.0fms late, %d companion positions %.0fms late\n", car_replay.n, fixes, DELAY_GPS_AGE*1e3f,
+		   int(measurements.size()) - fixes, DELAY_COMPANION_AGE*1e3f);
+	printf("against the replay   position rms   max      speed rms  heading rms\n");
+	printf("car (correct_past)   %8.4f m   %6.4f m   %6.4f     %6.3f deg\n", car_replay.position(), car_replay.pos_max,
+		   sqrt(car_replay.v2/car_replay.n), sqrt(car_replay.head2/car_replay.n));
+	printf("current (no history) %8.4f m   %6.4f m   %6.4f     %6.3f deg\n", current_replay.position(), current_replay.pos_max,
+		   sqrt(current_replay.v2/current_replay.n), sqrt(current_replay.head2/current_replay.n));
+	printf("P's position sigma : car %.4f m, replay %.4f m\n", sqrt(car.P(EKF_X, EKF_X) + car.P(EKF_Y, EKF_Y)),
+		   sqrt(replay.P(EKF_X, EKF_X) + replay.P(EKF_Y, EKF_Y)));
+	if(check && !(car_replay.position() <= DELAY_MAX_RMS))
+	{
+		printf("car is more than %.3f m rms from the replay\n", DELAY_MAX_RMS);
+		return 1;
+	}
+	return 0;
+}
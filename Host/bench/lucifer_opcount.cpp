@@ -0,0 +1,470 @@
+//counts the soft float operations in SIDMATH, STATE, CAR and TRAJECTORY and turns them into a cycle cost on the STM32F103.
+//The four modules are compiled right here with float and double #defined to OPNUM (see OPCOUNT.h), fed with the same drive as
+//lucifer_bench, and every case reports what one call does on average : multiplies, adds, divides, compares, sqrts, trig calls
+//and float<->double conversions, and what that costs at the prices in OPCOUNT.h.
+//
+//unlike lucifer_bench this doesn't depend on how fast the PC is, so the numbers are the same on every machine and CI can hold
+//the per-cycle work to them. It only sees float math : the I2C/SPI traffic of MPU9150 and OPFLOW, the GPS parsing and the
+//integer work are not in here (lucifer_bench has those).
+//
+//usage : lucifer_opcount [filter] [--check]
+//	filter  only run the cases whose name contains this string
+//	--check exit with 1 if the predicted per-cycle work doesn't fit in dt_micros (for CI)
+#include"Arduino.h"
+#include"Wire.h"
+#include"SPI.h"
+#include"INOUT.h"
+#include"PARAMS.h"
+#include"BENCH.h"
+#include"OPCOUNT.h"
+
+#define float OP_FLOAT
+#define double OP_DOUBLE
+#include"SIDMATH.h"
+#include"SIDMATH.cpp"
+#include"STATE.h"
+#include"STATE_SCALAR.h"
+#include"CAR.h"
+#include"TRAJECTORY.h"
+#include"AHRS.h"
+#include"MAG_CALIBRATOR.h"
+float Kalman(float gpscord,float gpsError,float estimate,uint8_t trustInEstimate); //SIDMATH.h declares it as gpsOpFlowKalman
+#undef float
+#undef double
+
+#include"DRIVE.h"
+#include"MATRIX_BENCH.h"
+
+static volatile float sink; //keeps the optimizer from throwing the work away
+
+STATE car;
+STATE_SCALAR car_scalar;
+trajectory track;
+controller control;
+SCALAR_FUSION<OP_FLOAT> scalar_fusion;
+MATRIX_FUSION<OP_FLOAT> matrix_fusion;
+MATRIX_EKF<OP_FLOAT> ekf;
+AHRS_QUATERNION quat;
+MAG_CALIBRATOR mag_cal;
+OP_FLOAT euler[3]; //roll, pitch, mh
+
+struct OPCOUNT_RESULT
+{
+	const char *name;
+	double calls[OPC_NUM_OPS]; //per call
+	double us;                 //predicted STM32 time per call
+	double documented_us;      //STM32 equivalent of the figure in the code comments, 0 if there is none
+	bool in_cycle;             //runs in the worst tick (imu_task + control_task), counted against dt_micros
+};
+
+static std::vector<OPCOUNT_RESULT> results;
+
+static void scalar_update(long i, bool gps_tick)
+{
+	const DRIVE_SAMPLE &s = sample(i);
+	OP_FLOAT model[3] = {s.V, 0.2f, BENCH_RADIUS};
+	car_scalar.state_update(s.gps_lon, s.gps_lat, gps_tick, 0.055f, 1.2f, s.gps_V, 0.3f, s.gps_head, 1.5f,
+							s.mh, 0.5f, s.yawRate, 0.01f, s.Ay, s.V, 0.05f,
+							s.flow_X, s.flow_Y, s.OF_V_X, s.OF_V_Y, 0.05f, 0.05f, model);
+	sink = float(car_scalar.X);
+}
+
+//what imu_task hands STATE for sample i
+static void predict(long i)
+{
+	const DRIVE_SAMPLE &s = sample(i);
+	STATE_MOTION m = {s.mh, 0.5f, s.Ay, s.V, s.flow_X, s.flow_Y, true, BENCH_RADIUS};
+	car.predict(m);
+	sink = float(car.X);
+}
+
+static void correct_flow(long i)
+{
+	const DRIVE_SAMPLE &s = sample(i);
+	STATE_FLOW f = {s.OF_V_X, s.OF_V_Y, 0.05f};
+	car.correct_flow(f);
+	sink = float(car.X);
+}
+
+static void correct_gps(long i)
+{
+	const DRIVE_SAMPLE &s = sample(i);
+	STATE_GPS g = {s.gps_lon, s.gps_lat, 0.055f, 1.2f, s.gps_V, 0.3f, 0.8f, true};
+	car.correct_gps(g);
+	sink = float(car.X);
+}
+
+//a fix's X correction waiting for the next predict(), without counting what correct_gps() took to get there
+static void fix_pending(long i)
+{
+	const DRIVE_SAMPLE &s = sample(i);
+	car.recall(0.055f, car.fix);
+	car.gps_X = s.X - drive[0].X;
+	car.gps_Y = s.Y - drive[0].Y;
+	car.fix_r = 1.44f;
+	car.fix_pending = FIX_X;
+}
+
+//a cone localization fix from the companion, in the frame car.initialize() put the origin in, 200ms old
+static void correct_companion(long i)
+{
+	const DRIVE_SAMPLE &s = sample(i);
+	STATE_COMPANION c = {s.X - drive[0].X, s.Y - drive[0].Y, 0.2f, 0.3f};
+	car.correct_companion(c);
+	sink = float(car.X);
+}
+static const char *filter = NULL;
+
+//one pass over the drive, fn is called with the sample number
+template<typename F>
+static void run(const char *name, double documented_us, BENCH_PLATFORM platform, bool in_cycle, F fn)
+{
+	if(filter && !strstr(name, filter))
+	{
+		return;
+	}
+	opcount().clear();
+	for(long i = 0; i < BENCH_SAMPLES; i++)
+	{
+		fn(i);
+	}
+	OPCOUNT_RESULT r;
+	r.name = name;
+	for(int op = 0; op < OPC_NUM_OPS; op++)
+	{
+		r.calls[op] = double(opcount().n[op])/BENCH_SAMPLES;
+	}
+	r.us = opcount().us()/BENCH_SAMPLES;
+	r.documented_us = platform == DOC_PRO_MINI ? documented_us/BENCH_PRO_MINI_FACTOR : documented_us;
+	r.in_cycle = in_cycle;
+	results.push_back(r);
+}
+
+static void register_cases()
+{
+	//SIDMATH
+	run("SIDMATH fast_sqrt", 0, DOC_NONE, false, [](long i)
+	{
+		sink = float(fast_sqrt(OP_FLOAT(1.0f + float(i & 1023))));
+	});
+	run("SIDMATH distancecalcy (deg)", 70, DOC_PRO_MINI, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		sink = float(distancecalcy(float(s.lat - BENCH_ORIGIN_LAT), 0.0f, float(s.lon - BENCH_ORIGIN_LON), 0.0f, 1));
+	});
+	run("SIDMATH anglecalcy", 215, DOC_PRO_MINI, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		sink = float(anglecalcy(s.X, s.dest_X, s.Y, s.dest_Y));
+	});
+	run("SIDMATH my_cos", 50, DOC_PRO_MINI, false, [](long i)
+	{
+		sink = float(my_cos(OP_FLOAT(sample(i).heading*DEG2RAD)));
+	});
+	run("SIDMATH my_sin", 57, DOC_PRO_MINI, false, [](long i)
+	{
+		sink = float(my_sin(OP_FLOAT(sample(i).heading*DEG2RAD)));
+	});
+	run("SIDMATH my_atan2", 0, DOC_NONE, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		sink = float(my_atan2(OP_FLOAT(s.dest_Y - s.Y), OP_FLOAT(s.dest_X - s.X)));
+	});
+	run("SIDMATH depress", 74.5, DOC_PRO_MINI, false, [](long i)
+	{
+		sink = float(depress(sample(i).Ax, 0.5f));
+	});
+	run("SIDMATH Kalman", 95, DOC_PRO_MINI, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		sink = float(Kalman(s.X, 1.2f, s.OF_X, uint8_t(50 + (i & 63))));
+	});
+
+	//TRAJECTORY
+	run("trajectory::get_Intermediate_Points", 248, DOC_PRO_MINI, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		track.get_Intermediate_Points(s.heading, s.dest_slope, s.X, s.dest_X, s.Y, s.dest_Y);
+		sink = float(track.int1[0]);
+	});
+	run("trajectory::get_T", 255, DOC_PRO_MINI, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		OPCOUNT_TALLY keep = opcount(); //only get_T counts
+		track.get_Intermediate_Points(s.heading, s.dest_slope, s.X, s.dest_X, s.Y, s.dest_Y);
+		opcount() = keep;
+		track.get_T(s.V, s.X, s.Y, track.int1[0], track.int1[1], track.int2[0], track.int2[1], s.dest_X, s.dest_Y, FUTURE_TIME);
+		sink = float(track.t);
+	});
+	run("trajectory::get_Curvature", 246.3, DOC_STM32, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		track.get_Curvature(s.X, s.Y, track.int1[0], track.int1[1], track.int2[0], track.int2[1], s.dest_X, s.dest_Y, s.V);
+		sink = float(track.C[1]);
+	});
+	run("trajectory::calculate_Curvatures", 0, DOC_NONE, true, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		track.calculate_Curvatures(s.V, s.X, s.Y, s.heading, s.dest_X, s.dest_Y, s.dest_slope);
+		sink = float(track.C[0]);
+	});
+
+	//ENU
+	run("ENU::project", 0, DOC_NONE, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		OP_FLOAT X, Y;
+		car.frame.project(s.gps_lon, s.gps_lat, X, Y);
+		sink = float(X + Y);
+	});
+	run("ENU::unproject", 0, DOC_NONE, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		int32_t lon, lat;
+		car.frame.unproject(s.X, s.Y, lon, lat);
+		sink = float(lon - lat);
+	});
+
+	//STATE
+	run("STATE::predict", 0, DOC_NONE, false, [](long i)
+	{
+		predict(i);
+	});
+	run("STATE::predict (a fix's correction)", 0, DOC_NONE, false, [](long i)
+	{
+		fix_pending(i);
+		predict(i);
+	});
+	run("STATE::correct_flow", 0, DOC_NONE, false, [](long i)
+	{
+		car.fix_cycle = false;
+		correct_flow(i);
+	});
+	run("STATE::correct_gps", 0, DOC_NONE, false, [](long i) //the checks, the corrections are in the next predict()s
+	{
+		correct_gps(i);
+		car.fix_pending = 0;
+	});
+	run("STATE tick with a fix", 0, DOC_NONE, false, [](long i) //the flow's correction and the fix's checks
+	{
+		predict(i);
+		correct_flow(i);
+		correct_gps(i);
+		car.fix_pending = 0;
+	});
+	run("STATE tick with a fix's correction", 0, DOC_NONE, true, [](long i) //the worst tick, the flow's is left out then
+	{
+		fix_pending(i);
+		predict(i);
+		correct_flow(i);
+	});
+	run("STATE::correct_companion", 0, DOC_NONE, false, [](long i) //telemetry_task, 10Hz
+	{
+		correct_companion(i);
+	});
+	run("STATE cycle (gps at 10Hz)", 0, DOC_NONE, false, [](long i) //what imu_task does on average
+	{
+		predict(i);
+		correct_flow(i);
+		if((i % 40) == 0)
+		{
+			correct_gps(i);
+		}
+	});
+	run("STATE_SCALAR::state_update", 60.61, DOC_STM32, false, [](long i)
+	{
+		scalar_update(i, (i % 40) == 0);
+	});
+	run("STATE_SCALAR::state_update (gps tick)", 0, DOC_NONE, false, [](long i) //a fix 55ms old, 22 cycles to do again
+	{
+		scalar_update(i, true);
+	});
+
+	//AHRS : MPU9150::compute_All's attitude, the Euler update's lines and what setAHRS(MPU_AHRS_QUATERNION) runs instead,
+	//both without the I2C and with the accelerometer fully trusted
+	run("Euler AHRS cycle", 0, DOC_NONE, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		OP_FLOAT &roll = euler[0], &pitch = euler[1], &mh = euler[2];
+		OP_FLOAT d_Yaw_Radians = s.yawRate*dt*DEG2RAD, k = 0.005f;
+		roll += -pitch*d_Yaw_Radians;
+		OP_FLOAT cosRoll = cosf(roll*DEG2RAD), _sinRoll = -sinf(roll*DEG2RAD);
+		pitch += dt*(-s.yawRate*_sinRoll) + roll*d_Yaw_Radians;
+		OP_FLOAT cosPitch = cosf(pitch*DEG2RAD), _sinPitch = -sinf(pitch*DEG2RAD);
+		mh += dt*(s.yawRate*cosRoll);
+		pitch = (1 - k)*pitch + k*RAD2DEG*my_asin(s.Ay*G_INVERSE);
+		roll = (1 - k)*roll - k*RAD2DEG*my_asin(s.Ax*G_INVERSE);
+		if(mh >= M_2PI_DEG)
+		{
+			mh -= M_2PI_DEG;
+		}
+		if(mh < 0.0f)
+		{
+			mh += M_2PI_DEG;
+		}
+		sink = float(cosPitch + _sinPitch + mh);
+	});
+	run("AHRS_QUATERNION cycle", 0, DOC_NONE, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		OP_FLOAT w[3] = {0.0f, 0.0f, OP_FLOAT(DEG2RAD*s.yawRate)}, f[3] = {s.Ax, s.Ay, GRAVITY}, bias[3] = {0.0f, 0.0f, 0.0f}, up[3];
+		quat.update(w, f, 1.0f, bias, dt);
+		quat.up(up);
+		OP_FLOAT c = fast_sqrt(1.0f - up[0]*up[0]) + fast_sqrt(1.0f - up[1]*up[1]); //cosRoll, cosPitch
+		OP_FLOAT &mh = euler[2];
+		mh += RAD2DEG*dt*(w[0]*up[0] + w[1]*up[1] + w[2]*up[2]);
+		if(mh >= M_2PI_DEG)
+		{
+			mh -= M_2PI_DEG;
+		}
+		if(mh < 0.0f)
+		{
+			mh += M_2PI_DEG;
+		}
+		sink = float(c + mh);
+	});
+	run("AHRS_QUATERNION angles (with the mag, 100Hz)", 0, DOC_NONE, false, [](long i)
+	{
+		OP_FLOAT up[3];
+		quat.up(up);
+		sink = float(my_asin(up[0]) + my_asin(up[1]) + quat.heading());
+	});
+	run("MAG_CALIBRATOR fit (all its steps)", 0, DOC_NONE, false, [](long i)
+	{
+		for(int k = 0; k < MAG_CAL_SAMPLES; k++) //a turn's worth of samples off a shifted, squashed circle
+		{
+			float psi = float(k*(M_2PI_DEG/MAG_CAL_SAMPLES) + (i & 7));
+			int16_t m[3] = {int16_t(52*sinf(psi*DEG2RAD) + 3), int16_t(-47*cosf(psi*DEG2RAD) - 2), int16_t(49 + (k & 1))};
+			mag_cal.add(m, OP_FLOAT(psi));
+		}
+		mag_cal.step();
+		while(mag_cal.state() != MAG_CAL_COLLECT)
+		{
+			mag_cal.step();
+		}
+		sink = float(mag_cal.gain[0]);
+	});
+
+	//MATRIX against the scalar code it would replace
+	run("scalar gps fusion (STATE)", 0, DOC_NONE, false, [](long i)
+	{
+		scalar_fusion.update(sample(i));
+		sink = float(scalar_fusion.X);
+	});
+	run("Matrix<2,2> gps fusion", 0, DOC_NONE, false, [](long i)
+	{
+		matrix_fusion.update(sample(i));
+		sink = float(matrix_fusion.x(0, 0));
+	});
+	run("Matrix<5,5> EKF predict", 0, DOC_NONE, false, [](long i)
+	{
+		ekf.predict(sample(i));
+		sink = float(ekf.x(0, 0));
+	});
+	run("Matrix<5,5> EKF correct (2 meas)", 0, DOC_NONE, false, [](long i)
+	{
+		ekf.correct(sample(i));
+		sink = float(ekf.x(0, 0));
+	});
+
+	//CAR
+	run("controller::feedback", 0, DOC_NONE, true, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		OP_FLOAT model[3];
+		control.feedback(s.V, 0.05f, 0.05f);
+		control.get_model(model);
+		sink = float(model[0]);
+	});
+	run("controller::filter", 0, DOC_NONE, true, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		control.filter(s.yawRate, s.Ax, s.Ay);
+		sink = float(control.Ha);
+	});
+	run("controller::drive", 0, DOC_NONE, true, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		OP_FLOAT inputs[8] = {1500, 1500, 1500, 1500, 1500, 1700, 1500, 2000};
+		control.drive(track.C, 5.0f, s.V, 0.0f, s.yawRate, s.Ax, s.Ay, CRUISE, inputs);
+		sink = float(TIMER1_BASE->CCR1);
+	});
+	run("controller::driver (filter + drive)", 140, DOC_STM32, false, [](long i)
+	{
+		const DRIVE_SAMPLE &s = sample(i);
+		OP_FLOAT inputs[8] = {1500, 1500, 1500, 1500, 1500, 1700, 1500, 2000};
+		host_advance_micros(uint32_t((CONTROL_TIME)*1000)); //the driver only runs every CONTROL_TIME ms, make every call count
+		control.driver(track.C, 5.0f, s.V, 0.0f, s.yawRate, s.Ax, s.Ay, CRUISE, inputs);
+		sink = float(TIMER1_BASE->CCR1);
+	});
+}
+
+static void report(FILE *f)
+{
+	fprintf(f, "%-36s %7s %7s %6s %6s %5s %5s %7s %7s %9s %9s\n", "case (ops per call)", "mul", "add", "div", "cmp", "sqrt",
+		"trig", "of dbl", "f<->d", "pred us", "doc us");
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		const OPCOUNT_RESULT &r = results[i];
+		double ops[OPC_ARITH_OPS], dbl = 0;
+		for(int op = 0; op < OPC_ARITH_OPS; op++)
+		{
+			ops[op] = r.calls[op] + r.calls[op + OPC_ARITH_OPS];
+			dbl += r.calls[op + OPC_ARITH_OPS];
+		}
+		fprintf(f, "%-36s %7.1f %7.1f %6.1f %6.1f %5.1f %5.1f %7.1f %7.1f %9.1f ", r.name, ops[OPC_MUL], ops[OPC_ADD],
+			ops[OPC_DIV], ops[OPC_CMP], ops[OPC_SQRT], ops[OPC_TRIG], dbl, r.calls[OPC_F2D] + r.calls[OPC_D2F], r.us);
+		if(r.documented_us > 0)
+		{
+			fprintf(f, "%9.1f\n", r.documented_us);
+		}
+		else
+		{
+			fprintf(f, "%9s\n", "-");
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	bool check = false;
+	for(int i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "--check"))
+		{
+			check = true;
+		}
+		else
+		{
+			filter = argv[i];
+		}
+	}
+
+	make_drive();
+	scalar_fusion.init();
+	matrix_fusion.init();
+	ekf.init();
+	car.initialize(drive[0].gps_lon, drive[0].gps_lat, 1.2, drive[0].mh, BENCH_SPEED, 0);
+	car_scalar.initialize(drive[0].gps_lon, drive[0].gps_lat, 1.2, drive[0].mh, BENCH_SPEED, 0);
+	track.get_Intermediate_Points(drive[0].heading, drive[0].dest_slope, drive[0].X, drive[0].dest_X, drive[0].Y, drive[0].dest_Y);
+
+	register_cases();
+	report(stdout);
+
+	double cycle_us = 0;
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		if(results[i].in_cycle)
+		{
+			cycle_us += results[i].us;
+		}
+	}
+	printf("per-cycle float work (worst tick, imu_task + control_task) : %.1f us predicted out of dt_micros = %d us (%.0f%%)\n",
+		cycle_us, int(dt_micros), 100.0*cycle_us/dt_micros);
+	if(check && cycle_us > dt_micros)
+	{
+		printf("over budget\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,297 @@
+#include"Arduino.h"
+#include<chrono>
+
+static bool realtime = false;
+static uint32_t virtual_micros = 0;
+static std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+static uint8_t pin_state[HOST_NUM_PINS];
+
+timer_reg_map host_timer1, host_timer2, host_timer3, host_timer4;
+gpio_reg_map host_gpioa, host_gpiob, host_gpioc;
+
+static usart_reg_map usart_regs[3];
+static usart_dev usarts[3] = {{&usart_regs[0]}, {&usart_regs[1]}, {&usart_regs[2]}};
+usart_dev *USART1 = &usarts[0], *USART2 = &usarts[1], *USART3 = &usarts[2];
+static dma_dev dma1;
+dma_dev *DMA1 = &dma1;
+
+HardwareSerial Serial; //USB
+HardwareSerial Serial1(USART1);
+HardwareSerial Serial2(USART2);
+
+HardwareTimer Timer1, Timer2, Timer3, Timer4;
+
+uint32_t micros()
+{
+	if(realtime)
+	{
+		return uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count());
+	}
+	virtual_micros += HOST_CLOCK_STEP_US;
+	return virtual_micros;
+}
+
+uint32_t millis()
+{
+	return micros()/1000;
+}
+
+void delayMicroseconds(uint32_t us)
+{
+	if(realtime)
+	{
+		uint32_t start = micros();
+		while(micros() - start < us);
+		return;
+	}
+	virtual_micros += us;
+}
+
+void delay(uint32_t ms)
+{
+	delayMicroseconds(ms*1000);
+}
+
+void host_set_realtime(bool rt)
+{
+	realtime = rt;
+	epoch = std::chrono::steady_clock::now() - std::chrono::microseconds(virtual_micros);
+}
+
+void host_set_micros(uint32_t t)
+{
+	virtual_micros = t;
+}
+
+uint32_t host_get_micros()
+{
+	return virtual_micros;
+}
+
+void host_advance_micros(uint32_t us)
+{
+	virtual_micros += us;
+}
+
+void pinMode(uint8_t pin, WiringPinMode mode)
+{
+	(void)pin;
+	(void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+	if(pin < HOST_NUM_PINS)
+	{
+		pin_state[pin] = value;
+	}
+}
+
+uint8_t digitalRead(uint8_t pin)
+{
+	return pin < HOST_NUM_PINS ? pin_state[pin] : LOW;
+}
+
+void dma_init(dma_dev *dev)
+{
+	(void)dev; //turns the clock on, on the chip
+}
+
+void dma_setup_transfer(dma_dev *dev, dma_channel channel, volatile void *peripheral_address, dma_xfer_size peripheral_size,
+	volatile void *memory_address, dma_xfer_size memory_size, uint32_t mode)
+{
+	(void)peripheral_size;
+	(void)memory_size;
+	host_dma_channel &c = dev->channel[channel - 1];
+	c.CCR = mode;
+	c.periph = peripheral_address;
+	c.mem = memory_address;
+}
+
+void dma_set_num_transfers(dma_dev *dev, dma_channel channel, uint16_t num_transfers)
+{
+	host_dma_channel &c = dev->channel[channel - 1];
+	c.CNDTR = c.reload = num_transfers;
+}
+
+void dma_enable(dma_dev *dev, dma_channel channel)
+{
+	dev->channel[channel - 1].CCR |= DMA_CCR_EN;
+}
+
+void dma_disable(dma_dev *dev, dma_channel channel)
+{
+	dev->channel[channel - 1].CCR &= ~DMA_CCR_EN;
+}
+
+uint16_t dma_get_count(dma_dev *dev, dma_channel channel)
+{
+	return uint16_t(dev->channel[channel - 1].CNDTR);
+}
+
+//bytes arriving on a USART with DMA reception turned on. 8 bit transfers into incrementing memory, that's all the car does
+static void dma_receive(usart_dev *dev, const uint8_t *buf, size_t len)
+{
+	for(int i = 0; i < 7; i++)
+	{
+		host_dma_channel &c = DMA1->channel[i];
+		if(!(c.CCR & DMA_CCR_EN) || c.periph != &dev->regs->DR)
+		{
+			continue;
+		}
+		volatile uint8_t *mem = (volatile uint8_t*)c.mem;
+		for(size_t k = 0; k < len && c.CNDTR; k++)
+		{
+			mem[c.reload - c.CNDTR] = buf[k];
+			c.CNDTR--;
+			if(!c.CNDTR && (c.CCR & DMA_CIRC_MODE))
+			{
+				c.CNDTR = c.reload;
+			}
+		}
+		return;
+	}
+}
+
+HardwareSerial::HardwareSerial(usart_dev *usart)
+{
+	dev = usart;
+	baud = 0;
+	capture = false;
+	log_rx = false;
+}
+
+void HardwareSerial::begin(uint32_t baud_rate)
+{
+	baud = baud_rate;
+}
+
+void HardwareSerial::end()
+{
+	baud = 0;
+}
+
+int HardwareSerial::available()
+{
+	return int(rx.size());
+}
+
+int HardwareSerial::read()
+{
+	if(rx.empty())
+	{
+		return -1;
+	}
+	int c = rx.front();
+	rx.pop_front();
+	return c;
+}
+
+int HardwareSerial::peek()
+{
+	return rx.empty() ? -1 : rx.front();
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+	if(capture)
+	{
+		tx.push_back(c);
+	}
+	return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t len)
+{
+	for(size_t i = 0; i < len; i++)
+	{
+		write(buf[i]);
+	}
+	return len;
+}
+
+void HardwareSerial::flush()
+{
+}
+
+size_t HardwareSerial::print(const char *s)
+{
+	return write((const uint8_t*)s, strlen(s));
+}
+
+size_t HardwareSerial::print(int32_t n, int base)
+{
+	char buf[34];
+	snprintf(buf, sizeof(buf), base == HEX ? "%X" : "%d", n);
+	return print(buf);
+}
+
+size_t HardwareSerial::print(double n, int digits)
+{
+	char buf[48];
+	snprintf(buf, sizeof(buf), "%.*f", digits, n);
+	return print(buf);
+}
+
+size_t HardwareSerial::println(const char *s)
+{
+	return print(s) + print("\r\n");
+}
+
+size_t HardwareSerial::println(int32_t n, int base)
+{
+	return print(n, base) + print("\r\n");
+}
+
+size_t HardwareSerial::println(double n, int digits)
+{
+	return print(n, digits) + print("\r\n");
+}
+
+void HardwareSerial::host_inject(const uint8_t *buf, size_t len)
+{
+	if(log_rx)
+	{
+		rx_log.insert(rx_log.end(), buf, buf + len);
+	}
+	if(dev && (dev->regs->CR3 & USART_CR3_DMAR))
+	{
+		dma_receive(dev, buf, len);
+		return;
+	}
+	rx.insert(rx.end(), buf, buf + len);
+}
+
+void HardwareSerial::host_clear()
+{
+	rx.clear();
+	tx.clear();
+}
+
+HardwareTimer::HardwareTimer()
+{
+	for(int i = 0; i < 4; i++)
+	{
+		compare_handler[i] = NULL;
+	}
+}
+
+void HardwareTimer::attachCompare1Interrupt(voidFuncPtr handler)
+{
+	compare_handler[0] = handler;
+}
+
+void HardwareTimer::attachCompare2Interrupt(voidFuncPtr handler)
+{
+	compare_handler[1] = handler;
+}
+
+void HardwareTimer::attachCompare3Interrupt(voidFuncPtr handler)
+{
+	compare_handler[2] = handler;
+}
+
+void HardwareTimer::attachCompare4Interrupt(voidFuncPtr handler)
+{
+	compare_handler[3] = handler;
+}
@@ -0,0 +1,258 @@
+//host (linux) stand-in for the STM32 arduino core. Only the parts that Libraries/ and LUCIFER.ino actually touch are here.
+//The idea is that the car's code compiles unchanged against this header and the host program decides what the "hardware" does.
+//
+//time : millis()/micros() run off a virtual clock by default. Every call advances the clock by HOST_CLOCK_STEP_US and every
+//delay() jumps the clock forward, so the busy wait at the end of loop() ends after ~2500 calls instead of 2500 real microseconds
+//and the whole thing stays deterministic (same inputs -> same outputs, every time). host_set_realtime(true) switches to the
+//workstation's monotonic clock for when you actually want wall-clock numbers.
+//
+//serial : Serial, Serial1, Serial2 have an rx queue that the host fills with host_inject() and a tx buffer that is only kept if
+//capture is turned on (otherwise a 10 minute run would eat all your RAM with telemetry). With log_rx on, everything injected is
+//also copied to rx_log so that a recorder can put it in the raw log. Serial1/Serial2 sit on USART1/USART2, and a DMA1 channel
+//reading from one of those takes its bytes instead of the rx queue.
+//
+//timers : TIMER1/2/4 and GPIOA are plain structs. INOUT writes the ESC/servo pulse widths into TIMER1 CCR1/CCR4 and the host
+//reads them back from there.
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_
+
+#include<stdint.h>
+#include<stddef.h>
+#include<stdlib.h>
+#include<stdio.h>
+#include<string.h>
+#include<math.h>
+#include<type_traits>
+#include<deque>
+#include<vector>
+
+//glibc defines __always_inline as "__inline __attribute__((always_inline))", SIDMATH already says inline so gcc complains about
+//a duplicate inline. The arm toolchain's version is just the attribute, so that is what we use here.
+#ifdef __always_inline
+#undef __always_inline
+#endif
+#define __always_inline __attribute__((__always_inline__))
+
+#ifndef ARDUINO
+#define ARDUINO 10808 //the IDE passes this on the command line, so does CMakeLists.txt. I2Cdev uses it to pick the Wire read()/write() path
+#endif
+#define HOST_HAL 1
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef int8_t int8;
+typedef int16_t int16;
+typedef int32_t int32;
+typedef void (*voidFuncPtr)(void);
+
+#define HIGH 0x1
+#define LOW 0x0
+#define LSBFIRST 0
+#define MSBFIRST 1
+#define DEC 10
+#define HEX 16
+
+enum WiringPinMode
+{
+	OUTPUT,
+	OUTPUT_OPEN_DRAIN,
+	INPUT,
+	INPUT_ANALOG,
+	INPUT_PULLUP,
+	INPUT_PULLDOWN,
+	INPUT_FLOATING,
+	PWM,
+	PWM_OPEN_DRAIN
+};
+
+enum
+{
+	PA0, PA1, PA2, PA3, PA4, PA5, PA6, PA7, PA8, PA9, PA10, PA11, PA12, PA13, PA14, PA15,
+	PB0, PB1, PB2, PB3, PB4, PB5, PB6, PB7, PB8, PB9, PB10, PB11, PB12, PB13, PB14, PB15,
+	PC13, PC14, PC15,
+	HOST_NUM_PINS
+};
+
+//the arm core has min/max as macros, which works with mixed types (min(int16_t,int), max(float,double) all show up in the code).
+//macros would wreck <algorithm>, so these templates do the same thing using the common type of both arguments.
+template<typename A, typename B>
+inline typename std::common_type<A,B>::type min(A a, B b)
+{
+	return (a < b) ? a : b;
+}
+
+template<typename A, typename B>
+inline typename std::common_type<A,B>::type max(A a, B b)
+{
+	return (a > b) ? a : b;
+}
+
+template<typename A, typename L, typename H>
+inline A constrain(A x, L low, H high)
+{
+	return x < low ? A(low) : (x > high ? A(high) : x);
+}
+
+#define HOST_CLOCK_STEP_US 1 //how far the virtual clock moves every time someone looks at it
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, WiringPinMode mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+uint8_t digitalRead(uint8_t pin);
+
+//host side controls for the clock
+void host_set_realtime(bool realtime);
+void host_set_micros(uint32_t t);
+uint32_t host_get_micros(); //look at the virtual clock without moving it
+void host_advance_micros(uint32_t us);
+
+//libmaple USART and DMA (usart.h, dma_f1.h), only what the GPS receiver uses. A DMA channel that is set up on a USART's DR,
+//with USART_CR3_DMAR set, gets that port's bytes written straight into its memory as they are injected (and counts CNDTR
+//down like the chip does) instead of them going to the rx queue. No channel enabled means the bytes are lost, also like the chip.
+struct usart_reg_map
+{
+	volatile uint32_t SR, DR, BRR, CR1, CR2, CR3, GTPR;
+};
+
+struct usart_dev
+{
+	usart_reg_map *regs;
+};
+
+extern usart_dev *USART1, *USART2, *USART3;
+
+#define USART_CR1_IDLEIE (1U << 4)
+#define USART_CR1_RXNEIE (1U << 5)
+#define USART_CR3_DMAR (1U << 6)
+
+enum dma_channel
+{
+	DMA_CH1 = 1, DMA_CH2, DMA_CH3, DMA_CH4, DMA_CH5, DMA_CH6, DMA_CH7
+};
+
+enum dma_xfer_size
+{
+	DMA_SIZE_8BITS = 0,
+	DMA_SIZE_16BITS = 1,
+	DMA_SIZE_32BITS = 2
+};
+
+#define DMA_CCR_EN (1U << 0)
+#define DMA_CIRC_MODE (1U << 5)
+#define DMA_MINC_MODE (1U << 7)
+
+struct host_dma_channel
+{
+	volatile uint32_t CCR, CNDTR;
+	volatile void *periph, *mem; //CPAR/CMAR. pointers, a PC's addresses don't fit in 32 bits
+	uint16_t reload; //dma_set_num_transfers(), CNDTR goes back to it in circular mode
+};
+
+struct dma_dev
+{
+	host_dma_channel channel[7];
+};
+
+extern dma_dev *DMA1;
+
+void dma_init(dma_dev *dev);
+void dma_setup_transfer(dma_dev *dev, dma_channel channel, volatile void *peripheral_address, dma_xfer_size peripheral_size,
+	volatile void *memory_address, dma_xfer_size memory_size, uint32_t mode);
+void dma_set_num_transfers(dma_dev *dev, dma_channel channel, uint16_t num_transfers);
+void dma_enable(dma_dev *dev, dma_channel channel);
+void dma_disable(dma_dev *dev, dma_channel channel);
+uint16_t dma_get_count(dma_dev *dev, dma_channel channel);
+
+class HardwareSerial
+{
+public:
+	usart_dev *dev; //NULL for the USB port
+	uint32_t baud;
+	bool capture; //keep what the car writes so that the host can decode it
+	bool log_rx; //keep a copy of what the host injects, for the raw log (see RAW_LOG.h)
+	std::vector<uint8_t> rx_log;
+	std::deque<uint8_t> rx;
+	std::vector<uint8_t> tx;
+
+	HardwareSerial(usart_dev *usart = NULL);
+	void begin(uint32_t baud_rate);
+	void end();
+	int available();
+	int read();
+	int peek();
+	size_t write(uint8_t c);
+	size_t write(const uint8_t *buf, size_t len);
+	void flush();
+	usart_dev *c_dev()
+	{
+		return dev;
+	}
+
+	size_t print(const char *s);
+	size_t print(int32_t n, int base = DEC);
+	size_t print(double n, int digits = 2);
+	size_t println(const char *s = "");
+	size_t println(int32_t n, int base = DEC);
+	size_t println(double n, int digits = 2);
+
+	//host side
+	void host_inject(const uint8_t *buf, size_t len);
+	void host_clear();
+};
+
+extern HardwareSerial Serial;  //GCS
+extern HardwareSerial Serial1; //GPS
+extern HardwareSerial Serial2; //JEVOIS
+
+//libmaple register maps. Only the layout matters, nothing happens when you write to them.
+struct timer_reg_map
+{
+	volatile uint32_t CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR, RCR, CCR1, CCR2, CCR3, CCR4, BDTR, DCR, DMAR;
+};
+
+struct gpio_reg_map
+{
+	volatile uint32_t CRL, CRH, IDR, ODR, BSRR, BRR, LCKR;
+};
+
+extern timer_reg_map host_timer1, host_timer2, host_timer3, host_timer4;
+extern gpio_reg_map host_gpioa, host_gpiob, host_gpioc;
+
+#define TIMER1_BASE (&host_timer1)
+#define TIMER2_BASE (&host_timer2)
+#define TIMER3_BASE (&host_timer3)
+#define TIMER4_BASE (&host_timer4)
+#define GPIOA_BASE (&host_gpioa)
+#define GPIOB_BASE (&host_gpiob)
+#define GPIOC_BASE (&host_gpioc)
+
+#define TIMER_CR1_CEN (1U << 0)
+#define TIMER_CR1_ARPE (1U << 7)
+#define TIMER_DIER_CC1IE (1U << 1)
+#define TIMER_CCMR1_OC1PE (1U << 3)
+#define TIMER_CCMR2_OC4PE (1U << 11)
+#define TIMER_CCER_CC1E (1U << 0)
+#define TIMER_CCER_CC1P (1U << 1)
+#define TIMER_CCER_CC4E (1U << 12)
+
+class HardwareTimer
+{
+public:
+	voidFuncPtr compare_handler[4];
+	HardwareTimer();
+	void attachCompare1Interrupt(voidFuncPtr handler);
+	void attachCompare2Interrupt(voidFuncPtr handler);
+	void attachCompare3Interrupt(voidFuncPtr handler);
+	void attachCompare4Interrupt(voidFuncPtr handler);
+};
+
+extern HardwareTimer Timer1, Timer2, Timer3, Timer4;
+
+#endif
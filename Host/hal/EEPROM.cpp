@@ -0,0 +1,76 @@
+#include"EEPROM.h"
+
+EEPROMClass EEPROM;
+
+EEPROMClass::EEPROMClass()
+{
+	format();
+	writes = 0;
+}
+
+uint16 EEPROMClass::init()
+{
+	return EEPROM_OK;
+}
+
+uint16 EEPROMClass::format()
+{
+	for(int i = 0; i < HOST_EEPROM_CELLS; i++)
+	{
+		cell[i] = EEPROM_DEFAULT_DATA;
+	}
+	return EEPROM_OK;
+}
+
+uint16 EEPROMClass::read(uint16 address)
+{
+	uint16 data;
+	read(address, &data);
+	return data;
+}
+
+uint16 EEPROMClass::read(uint16 address, uint16 *data)
+{
+	if(address >= HOST_EEPROM_CELLS)
+	{
+		*data = EEPROM_DEFAULT_DATA;
+		return EEPROM_BAD_ADDRESS;
+	}
+	*data = cell[address];
+	return EEPROM_OK;
+}
+
+uint16 EEPROMClass::write(uint16 address, uint16 data)
+{
+	if(address >= HOST_EEPROM_CELLS)
+	{
+		return EEPROM_BAD_ADDRESS;
+	}
+	cell[address] = data;
+	writes++;
+	return EEPROM_OK;
+}
+
+bool EEPROMClass::host_load(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if(!f)
+	{
+		return false;
+	}
+	bool ok = fread(cell, sizeof(cell), 1, f) == 1;
+	fclose(f);
+	return ok;
+}
+
+bool EEPROMClass::host_save(const char *path)
+{
+	FILE *f = fopen(path, "wb");
+	if(!f)
+	{
+		return false;
+	}
+	bool ok = fwrite(cell, sizeof(cell), 1, f) == 1;
+	fclose(f);
+	return ok;
+}
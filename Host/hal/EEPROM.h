@@ -0,0 +1,35 @@
+//host stand-in for the STM32 emulated EEPROM. Same interface as the arm core (16 bit cells, read() hands the value back through
+//a pointer and returns a status). Erased cells read 0xFFFF like erased flash does. host_load()/host_save() let the host keep the
+//"flash" in a file between runs.
+#ifndef _HOST_EEPROM_H_
+#define _HOST_EEPROM_H_
+
+#include"Arduino.h"
+
+#define EEPROM_OK ((uint16)0x0000)
+#define EEPROM_BAD_ADDRESS ((uint16)0x0081)
+#define EEPROM_DEFAULT_DATA 0xFFFF
+#define HOST_EEPROM_CELLS 1024
+
+class EEPROMClass
+{
+public:
+	EEPROMClass();
+	uint16 init();
+	uint16 format();
+	uint16 read(uint16 address);
+	uint16 read(uint16 address, uint16 *data);
+	uint16 write(uint16 address, uint16 data);
+
+	//host side
+	bool host_load(const char *path);
+	bool host_save(const char *path);
+	uint32_t writes;
+
+private:
+	uint16 cell[HOST_EEPROM_CELLS];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,49 @@
+#include"SPI.h"
+
+SPIClass SPI;
+
+SPIClass::SPIClass()
+{
+	device = NULL;
+	bytes = 0;
+}
+
+void SPIClass::begin()
+{
+}
+
+void SPIClass::end()
+{
+}
+
+void SPIClass::beginTransaction(SPISettings settings)
+{
+	(void)settings;
+	if(device)
+	{
+		device->select();
+	}
+}
+
+void SPIClass::endTransaction()
+{
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+	bytes++;
+	return device ? device->transfer(data) : 0xFF; //floating MISO reads as 0xFF
+}
+
+void SPIClass::transfer(uint8_t *data, size_t len)
+{
+	for(size_t i = 0; i < len; i++)
+	{
+		data[i] = transfer(data[i]);
+	}
+}
+
+void SPIClass::host_attach(SPI_DEVICE *dev)
+{
+	device = dev;
+}
@@ -0,0 +1,55 @@
+//host stand-in for the SPI library. beginTransaction() selects the attached device (OPFLOW always pairs the chip select with
+//the transaction so that is good enough) and every byte clocked out goes through SPI_DEVICE::transfer(), full duplex.
+#ifndef _HOST_SPI_H_
+#define _HOST_SPI_H_
+
+#include"Arduino.h"
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x01
+#define SPI_MODE2 0x02
+#define SPI_MODE3 0x03
+
+class SPISettings
+{
+public:
+	uint32_t clock;
+	uint8_t bitOrder, dataMode;
+	SPISettings(uint32_t clk = 1000000, uint8_t order = MSBFIRST, uint8_t mode = SPI_MODE0)
+	{
+		clock = clk;
+		bitOrder = order;
+		dataMode = mode;
+	}
+};
+
+class SPI_DEVICE
+{
+public:
+	virtual ~SPI_DEVICE() {}
+	virtual void select() {}
+	virtual uint8_t transfer(uint8_t out) = 0;
+};
+
+class SPIClass
+{
+public:
+	SPIClass();
+	void begin();
+	void end();
+	void beginTransaction(SPISettings settings);
+	void endTransaction();
+	uint8_t transfer(uint8_t data);
+	void transfer(uint8_t *data, size_t len);
+
+	//host side
+	void host_attach(SPI_DEVICE *dev);
+	uint32_t bytes;
+
+private:
+	SPI_DEVICE *device;
+};
+
+extern SPIClass SPI;
+
+#endif
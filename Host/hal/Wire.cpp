@@ -0,0 +1,209 @@
+#include"Wire.h"
+
+TwoWire Wire;
+static i2c_dev i2c1 = {NULL, 0, I2C_STATE_IDLE};
+i2c_dev *I2C1 = &i2c1;
+
+I2C_REGISTERS::I2C_REGISTERS()
+{
+	memset(reg, 0, sizeof(reg));
+}
+
+uint8_t I2C_REGISTERS::read(uint8_t address)
+{
+	return reg[address];
+}
+
+void I2C_REGISTERS::write(uint8_t address, uint8_t data)
+{
+	reg[address] = data;
+}
+
+TwoWire::TwoWire()
+{
+	for(int i = 0; i < 128; i++)
+	{
+		slave[i] = NULL;
+		pointer[i] = 0;
+	}
+	tx_address = 0;
+	tx_first = false;
+	tx_nack = false;
+	rx_length = rx_index = 0;
+	transactions = bytes = 0;
+	irq_transactions = irq_bytes = 0;
+}
+
+void TwoWire::begin()
+{
+}
+
+void TwoWire::setClock(uint32_t frequency)
+{
+	(void)frequency;
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+	tx_address = address & 0x7F;
+	tx_first = true;
+	tx_nack = slave[tx_address] == NULL;
+}
+
+void TwoWire::beginTransmission(int address)
+{
+	beginTransmission(uint8_t(address));
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+	if(tx_nack)
+	{
+		return 0;
+	}
+	bytes++;
+	if(tx_first)
+	{
+		pointer[tx_address] = data; //first byte is the register address
+		tx_first = false;
+		return 1;
+	}
+	slave[tx_address]->write(pointer[tx_address], data);
+	pointer[tx_address] = slave[tx_address]->next(pointer[tx_address]);
+	return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t len)
+{
+	size_t n = 0;
+	for(size_t i = 0; i < len; i++)
+	{
+		n += write(data[i]);
+	}
+	return n;
+}
+
+uint8_t TwoWire::endTransmission(bool stop)
+{
+	(void)stop;
+	transactions++;
+	return tx_nack ? 2 : 0; //2 = NACK on address, same as the real thing
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, int quantity)
+{
+	address &= 0x7F;
+	rx_length = rx_index = 0;
+	transactions++;
+	if(slave[address] == NULL)
+	{
+		return 0;
+	}
+	if(quantity > BUFFER_LENGTH)
+	{
+		quantity = BUFFER_LENGTH;
+	}
+	for(int i = 0; i < quantity; i++)
+	{
+		rx_buffer[i] = slave[address]->read(pointer[address]);
+		pointer[address] = slave[address]->next(pointer[address]);
+	}
+	rx_length = uint8_t(quantity);
+	bytes += rx_length;
+	return rx_length;
+}
+
+uint8_t TwoWire::requestFrom(int address, int quantity)
+{
+	return requestFrom(uint8_t(address), quantity);
+}
+
+int TwoWire::available()
+{
+	return rx_length - rx_index;
+}
+
+int TwoWire::read()
+{
+	if(rx_index >= rx_length)
+	{
+		return -1;
+	}
+	return rx_buffer[rx_index++];
+}
+
+void TwoWire::host_attach(uint8_t address, I2C_REGISTERS *device)
+{
+	slave[address & 0x7F] = device;
+}
+
+bool TwoWire::host_write(uint8_t address, const uint8_t *data, uint16_t len)
+{
+	address &= 0x7F;
+	irq_transactions++;
+	if(slave[address] == NULL)
+	{
+		return false;
+	}
+	for(uint16_t i = 0; i < len; i++)
+	{
+		if(i == 0)
+		{
+			pointer[address] = data[0];
+			continue;
+		}
+		slave[address]->write(pointer[address], data[i]);
+		pointer[address] = slave[address]->next(pointer[address]);
+	}
+	irq_bytes += len;
+	return true;
+}
+
+bool TwoWire::host_read(uint8_t address, uint8_t *data, uint16_t len)
+{
+	address &= 0x7F;
+	irq_transactions++;
+	if(slave[address] == NULL)
+	{
+		return false;
+	}
+	for(uint16_t i = 0; i < len; i++)
+	{
+		data[i] = slave[address]->read(pointer[address]);
+		pointer[address] = slave[address]->next(pointer[address]);
+	}
+	irq_bytes += len;
+	return true;
+}
+
+void i2c_enable_irq(i2c_dev *dev, uint32_t irqs)
+{
+	(void)dev;
+	(void)irqs;
+}
+
+void i2c_start_condition(i2c_dev *dev)
+{
+	//everything the interrupt would do from here on
+	bool ok = true;
+	while(ok && dev->msgs_left > 0)
+	{
+		i2c_msg *m = dev->msg;
+		ok = m->flags & I2C_MSG_READ ? Wire.host_read(uint8_t(m->addr), m->data, m->length) : Wire.host_write(uint8_t(m->addr), m->data, m->length);
+		m->xferred = ok ? m->length : 0;
+		dev->msg++;
+		dev->msgs_left--;
+	}
+	dev->state = ok ? I2C_STATE_XFER_DONE : I2C_STATE_ERROR;
+}
+
+void i2c_master_enable(i2c_dev *dev, uint32_t flags)
+{
+	(void)flags;
+	dev->state = I2C_STATE_IDLE;
+}
+
+void i2c_disable(i2c_dev *dev)
+{
+	dev->state = I2C_STATE_DISABLED;
+}
@@ -0,0 +1,105 @@
+//host stand-in for the Wire (I2C) library.
+//Every slave is a 256 byte register file (I2C_REGISTERS). The first byte written after beginTransmission() sets the register
+//pointer, everything after that is written starting at the pointer, and requestFrom() reads starting at the pointer. Both
+//auto increment, which is how the MPU and the AK8975 behave (a slave can keep the pointer where it is for a register that is a
+//queue, see next()). A host program attaches a slave at an address and pokes the register file to make the sensor "measure"
+//something.
+#ifndef _HOST_WIRE_H_
+#define _HOST_WIRE_H_
+
+#include"Arduino.h"
+
+#define BUFFER_LENGTH 32
+
+class I2C_REGISTERS
+{
+public:
+	uint8_t reg[256];
+	I2C_REGISTERS();
+	virtual ~I2C_REGISTERS() {}
+	virtual uint8_t read(uint8_t address);
+	virtual void write(uint8_t address, uint8_t data);
+	virtual uint8_t next(uint8_t address) //where the pointer goes after a byte at address
+	{
+		return uint8_t(address + 1);
+	}
+};
+
+class TwoWire
+{
+public:
+	TwoWire();
+	void begin();
+	void setClock(uint32_t frequency);
+	void beginTransmission(uint8_t address);
+	void beginTransmission(int address);
+	size_t write(uint8_t data);
+	size_t write(const uint8_t *data, size_t len);
+	uint8_t endTransmission(bool stop = true);
+	uint8_t requestFrom(uint8_t address, int quantity);
+	uint8_t requestFrom(int address, int quantity);
+	int available();
+	int read();
+
+	//host side
+	void host_attach(uint8_t address, I2C_REGISTERS *device);
+	uint32_t transactions; //how many times the bus was used. handy for checking how chatty a driver is.
+	uint32_t bytes;        //total bytes on the bus (address bytes not counted)
+	//a message of a transfer that libmaple's interrupt does (below), same slaves and pointers. Counted apart : the CPU doesn't
+	//wait for these bytes. false on a NACK
+	bool host_write(uint8_t address, const uint8_t *data, uint16_t len);
+	bool host_read(uint8_t address, uint8_t *data, uint16_t len);
+	uint32_t irq_transactions, irq_bytes;
+
+private:
+	I2C_REGISTERS *slave[128];
+	uint8_t pointer[128];
+	uint8_t tx_address;
+	bool tx_first;
+	bool tx_nack;
+	uint8_t rx_buffer[BUFFER_LENGTH];
+	uint8_t rx_length, rx_index;
+};
+
+extern TwoWire Wire;
+
+//libmaple I2C (i2c.h), what I2C_QUEUE.h uses to start a transfer without waiting for it. On the chip the event interrupt walks
+//dev->msg after i2c_start_condition(), here the whole transfer happens in i2c_start_condition() through Wire's slaves and the
+//state is XFER_DONE (or ERROR on a NACK) right away. The clock doesn't move for it, same as Wire.
+#define I2C_MSG_READ 0x1
+#define I2C_FAST_MODE 0x1
+#define I2C_IRQ_EVENT (1U << 9)
+
+struct i2c_msg
+{
+	uint16_t addr;
+	uint16_t flags;
+	uint16_t length;
+	uint16_t xferred;
+	uint8_t *data;
+};
+
+enum i2c_state
+{
+	I2C_STATE_DISABLED = 0,
+	I2C_STATE_IDLE = 1,
+	I2C_STATE_XFER_DONE = 2,
+	I2C_STATE_BUSY = 3,
+	I2C_STATE_ERROR = -1
+};
+
+struct i2c_dev
+{
+	i2c_msg *msg;
+	uint16_t msgs_left;
+	volatile i2c_state state;
+};
+
+extern i2c_dev *I2C1;
+
+void i2c_enable_irq(i2c_dev *dev, uint32_t irqs);
+void i2c_start_condition(i2c_dev *dev);
+void i2c_master_enable(i2c_dev *dev, uint32_t flags);
+void i2c_disable(i2c_dev *dev);
+
+#endif
@@ -0,0 +1,2 @@
+//the arm core's <libmaple/dma.h>. The parts of it that the car uses are in the HAL's Arduino.h
+#include"../Arduino.h"
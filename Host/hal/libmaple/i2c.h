@@ -0,0 +1,2 @@
+//the arm core's <libmaple/i2c.h>. The parts of it that I2C_QUEUE.h uses are in the HAL's Wire.h
+#include"../Wire.h"
@@ -0,0 +1,132 @@
+//runs LUCIFER.ino on the workstation. The sketch is compiled as-is, this file only plays the part of the hardware and the
+//arduino main(): set up the fake sensors, call setup() once and then loop() as many times as asked.
+//
+//usage : lucifer_host [cycles] [--realtime] [--record file] [--out file]
+//	cycles        number of loop() calls, default 4000 (10 seconds of car time)
+//	--realtime    use the workstation clock instead of the virtual one (the busy wait then really waits 2500us)
+//	--record file write a raw log of the run (RAW_LOG.h) that lucifer_replay can play back
+//	--out file    write the per tick trace (TRACE.h)
+//
+//at the end it prints how long loop() took on this machine. The sensors are static (car sitting still on a good surface,
+//no GPS) so this is a smoke test and a rough profile, not a simulation.
+#include"Arduino.h"
+#include"EEPROM.h"
+#include"SENSORS.h"
+#include<chrono>
+
+#include"LUCIFER.ino"
+#include"TRACE.h"
+#include"HOST_RUN.h"
+
+SENSORS sensors;
+RAW_LOG_WRITER recorder;
+
+static void stationary_car()
+{
+	int16_t a[3] = {0, 0, 0}; //the accel offsets soak up gravity (see accel_caliberation), so a car at rest reads the offsets
+	int16_t g[3] = {0, 0, 0};
+	int16_t m[3] = {60, 0, -40}; //~0.49 gauss after scaling, pointing roughly north
+	sensors.imu.set_motion(a, g, 0);
+	sensors.mag.set_field(m);
+	sensors.flow.set_motion(true, 0, 0, 100, 0x0200, 60);
+}
+
+int main(int argc, char **argv)
+{
+	long cycles = 4000;
+	bool realtime = false;
+	const char *record = NULL, *out = NULL;
+	for(int i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "--realtime"))
+		{
+			realtime = true;
+		}
+		else if(!strcmp(argv[i], "--record") && i + 1 < argc)
+		{
+			record = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--out") && i + 1 < argc)
+		{
+			out = argv[++i];
+		}
+		else
+		{
+			cycles = atol(argv[i]);
+		}
+	}
+	host_set_realtime(realtime);
+	if(record && !recorder.open(record))
+	{
+		fprintf(stderr, "can't write %s\n", record);
+		return 1;
+	}
+	FILE *trace = NULL;
+	if(out)
+	{
+		trace = fopen(out, "w");
+		if(!trace)
+		{
+			fprintf(stderr, "can't write %s\n", out);
+			return 1;
+		}
+		trace_header(trace);
+	}
+	Serial.log_rx = Serial1.log_rx = Serial2.log_rx = recorder.is_open();
+	sensors.attach();
+	stationary_car();
+	factory_offsets(recorder);
+	record_sample(recorder, sensors, RAW_SETUP);
+
+	setup();
+
+	double total = 0, worst = 0;
+	uint32_t start = micros();
+	for(long i = 0; i < cycles; i++)
+	{
+		record_sample(recorder, sensors, RAW_TICK);
+		uint32_t stamp = host_get_micros();
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		loop();
+		double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+		total += us;
+		worst = us > worst ? us : worst;
+		if(trace)
+		{
+			trace_row(trace, i, stamp);
+		}
+	}
+	recorder.close();
+	if(trace)
+	{
+		fclose(trace);
+	}
+	double car_seconds = (micros() - start)*1e-6;
+
+	printf("cycles          : %ld\n", cycles);
+	printf("car time        : %.3f s\n", car_seconds);
+	printf("host time       : %.3f s (%.1fx real time)\n", total*1e-6, total > 0 ? car_seconds/(total*1e-6) : 0.0);
+	printf("loop() mean     : %.2f us\n", cycles ? total/cycles : 0.0);
+	printf("loop() worst    : %.2f us\n", worst);
+	printf("MODE            : %d\n", MODE);
+	printf("X, Y            : %.3f, %.3f m\n", car.X, car.Y);
+	printf("heading         : %.2f deg\n", marg.mh);
+
+	//what the car would stream to the GCS with PROFILE_ID (virtual clock, so these are host us + bus waits, not STM32 us)
+	static const char *phase_names[NUM_PHASES] = {"sensor read", "compute_All", "optical flow", "gps", "state_update", "comms",
+		"companion", "trajectory", "driver", "cycle"};
+	printf("\n%-14s %8s %8s %8s %8s %9s %9s\n", "phase", "min us", "mean us", "max us", "p99 us", "overruns", "samples");
+	for(int i = 0; i < NUM_PHASES; i++)
+	{
+		printf("%-14s %8u %8u %8u %8u %9u %9u\n", phase_names[i], prof.samples[i] ? prof.min_us[i] : 0, prof.mean(i), prof.max_us[i],
+			prof.p99(i), prof.overruns[i], prof.samples[i]);
+	}
+
+	printf("\n%-6s %7s %7s %7s %9s %9s\n", "task", "period", "offset", "budget", "worst us", "overruns");
+	for(int i = 0; i < sched.num_tasks; i++)
+	{
+		printf("%-6d %7u %7u %7u %9u %9u\n", i, tasks[i].period, tasks[i].offset, tasks[i].budget, tasks[i].worst, tasks[i].overruns);
+	}
+	printf("ticks %u, late %u, idle %.1f%%\n", sched.tick, sched.late, car_seconds > 0 ? 100.0*sched.idle_us*1e-6/car_seconds : 0.0);
+	return 0;
+}
@@ -0,0 +1,202 @@
+//plays a raw log (RAW_LOG.h) back through LUCIFER.ino. Every tick the recorded register contents, flow burst and receiver pulses
+//are put back in the sensor models, the recorded serial bytes are queued, the virtual clock is set to the recorded stamp and
+//loop() runs. compute_All, updateOpticalFlow, state_update and driver therefore see exactly what they saw when the log was made,
+//and on the same build they produce the same numbers down to the last bit.
+//
+//usage : lucifer_replay log [--out file] [--compare file] [--truth file]
+//	--out file     write the per tick trace (TRACE.h)
+//	--compare file trace to check against (from lucifer_host --out or an earlier replay), prints the first tick that differs
+//	--truth file   lucifer_sim's --truth of the run the log is from : prints how far the estimate was from where the simulated
+//	               car really was, over the ticks it drove itself (MODE_AUTO, MODE_AUTO_LUDICROUS, MODE_NO_GPS)
+//
+//lucifer_replay_scalar is the same with the filter from before the EKF (STATE_SCALAR.h), so that
+//	lucifer_replay run.log --truth truth.csv ; lucifer_replay_scalar run.log --truth truth.csv
+//compares the two on the same sensor data. The log doesn't have to be made with the same filter, only the estimate is scored
+//and the sensors don't know what the car thought. lucifer_replay_quat does the same for marg's quaternion AHRS (AHRS.h) : the
+//heading error line is marg.mh against the simulated car's yaw.
+//
+//without --realtime and without the busy wait actually waiting, this runs as fast as the PC can go.
+#include"Arduino.h"
+#include"SENSORS.h"
+#include"RAW_LOG.h"
+#include<chrono>
+#include<vector>
+#include<math.h>
+
+#include"LUCIFER.ino"
+#include"TRACE.h"
+#include"REPLAY.h"
+
+SENSORS sensors;
+
+//returns the line number (0 = header) of the first difference, -1 if the files are the same
+static long compare_traces(FILE *a, FILE *b)
+{
+	char la[512], lb[512];
+	long line = 0;
+	for(;;)
+	{
+		char *ra = fgets(la, sizeof(la), a);
+		char *rb = fgets(lb, sizeof(lb), b);
+		if(!ra && !rb)
+		{
+			return -1;
+		}
+		if(!ra || !rb || strcmp(la, lb))
+		{
+			if(ra && rb)
+			{
+				printf("expected : %s", lb);
+				printf("replayed : %s", la);
+			}
+			return line;
+		}
+		line++;
+	}
+}
+
+//estimate against truth. The car's origin is the first good fix and the simulator's gps has a bias of its own, so the mean
+//offset is printed apart and taken out of the rms : what is left is how well the filter follows the car
+struct SCORE
+{
+	long n;
+	double ex, ey, exx, eyy, ev2, eh, ehh;
+	float max_error;
+
+	void add(const TRUTH_ROW &t)
+	{
+		float dx = car.X - t.x, dy = car.Y - t.y, dv = car.Velocity - t.vx;
+		float dh = STATE::wrap_180(marg.mh - t.yaw);
+		eh += dh;
+		ehh += double(dh)*dh;
+		n++;
+		ex += dx;
+		ey += dy;
+		exx += double(dx)*dx;
+		eyy += double(dy)*dy;
+		ev2 += double(dv)*dv;
+	}
+
+	void print() const
+	{
+		if(!n)
+		{
+			printf("position error  : no autonomous ticks to score\n");
+			return;
+		}
+		double mx = ex/n, my = ey/n;
+		double rms = sqrt((exx/n - mx*mx) + (eyy/n - my*my));
+		printf("position error  : %.3f m rms over %ld ticks (mean offset %.3f, %.3f m)\n", rms, n, mx, my);
+		printf("speed error     : %.3f m/s rms\n", sqrt(ev2/n));
+		printf("heading error   : %.2f deg rms (mean %.2f deg), marg's AHRS\n", sqrt(ehh/n), eh/n);
+	}
+};
+
+int main(int argc, char **argv)
+{
+	const char *log = NULL, *out = NULL, *reference = NULL, *truth_path = NULL;
+	for(int i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "--out") && i + 1 < argc)
+		{
+			out = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--compare") && i + 1 < argc)
+		{
+			reference = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--truth") && i + 1 < argc)
+		{
+			truth_path = argv[++i];
+		}
+		else
+		{
+			log = argv[i];
+		}
+	}
+	RAW_LOG_READER reader;
+	if(!log || !reader.open(log))
+	{
+		fprintf(stderr, "usage : lucifer_replay log [--out file] [--compare file] [--truth file]\n");
+		return 1;
+	}
+	std::vector<TRUTH_ROW> truth;
+	if(truth_path && !read_truth(truth_path, truth))
+	{
+		fprintf(stderr, "can't read %s\n", truth_path);
+		return 1;
+	}
+	SCORE score = {};
+	FILE *trace = out ? fopen(out, "w+") : (reference ? tmpfile() : NULL);
+	if((out || reference) && !trace)
+	{
+		fprintf(stderr, "can't write the trace\n");
+		return 1;
+	}
+	if(trace)
+	{
+		trace_header(trace);
+	}
+
+	long ticks = 0;
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	uint32_t first = 0, last = 0;
+	bool started = replay_log(reader, sensors, [&](long tick, uint32_t stamp)
+	{
+		first = tick ? first : stamp;
+		last = stamp;
+		if(trace)
+		{
+			trace_row(trace, tick, stamp);
+		}
+		if(size_t(tick) < truth.size() && (MODE == MODE_AUTO || MODE == MODE_AUTO_LUDICROUS || MODE == MODE_NO_GPS))
+		{
+			score.add(truth[tick]);
+		}
+		ticks = tick + 1;
+	});
+	double host_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	double car_seconds = (last - first)*1e-6;
+	if(!started)
+	{
+		fprintf(stderr, "%s has no setup record\n", log);
+		return 1;
+	}
+	printf("ticks           : %ld\n", ticks);
+	printf("car time        : %.3f s\n", car_seconds);
+	printf("host time       : %.3f s (%.1fx real time)\n", host_seconds, host_seconds > 0 ? car_seconds/host_seconds : 0.0);
+	printf("X, Y            : %.3f, %.3f m\n", car.X, car.Y);
+	printf("heading         : %.2f deg\n", marg.mh);
+	if(truth_path)
+	{
+		score.print();
+	}
+
+	int result = 0;
+	if(reference)
+	{
+		FILE *ref = fopen(reference, "r");
+		if(!ref)
+		{
+			fprintf(stderr, "can't read %s\n", reference);
+			return 1;
+		}
+		rewind(trace);
+		long line = compare_traces(trace, ref);
+		fclose(ref);
+		if(line < 0)
+		{
+			printf("trace matches %s\n", reference);
+		}
+		else
+		{
+			printf("trace differs from %s at %s %ld\n", reference, line ? "tick" : "line", line ? line - 1 : 0);
+			result = 2;
+		}
+	}
+	if(trace)
+	{
+		fclose(trace);
+	}
+	return result;
+}
@@ -0,0 +1,231 @@
+//runs LUCIFER.ino against the closed loop simulator (SIMULATOR.h) : the simulated GCS uploads a stadium shaped circuit, asks
+//for an autonomous mode and the car drives laps until it has done enough of them, runs out of time or crashes.
+//
+//usage : lucifer_sim [options]
+//	--laps n           stop after n laps (default 3)
+//	--seconds s        stop after s seconds of car time (default 300)
+//	--ludicrous        ask for LUDICROUS instead of CRUISE
+//	--companion        the JeVois sends cone localization positions too (see SIMULATOR.h)
+//	--no-gps           ask for MODE_NO_GPS, with the companion on : the gps is only there for the origin
+//	--track l,r        straight length and corner radius in m (default 10,4)
+//	--mu x             tyre friction (default DEFAULT_MU)
+//	--load x           drivetrain losses the controller has to learn (default 1.1)
+//	--crash m          distance off the centerline that ends the run (default 2)
+//	--seed n           noise seed (default 1)
+//	--mag-iron x,y,z,sx,sy,sz  hard iron (counts) and soft iron (scale) on the mag's X, Y, Z registers, for the mag calibrator
+//	--mag-stored x,y,z,gx,gy,gz  offsetM and axis_gain in the EEPROM at power on, e.g. what an earlier run's calibrator printed
+//	--quiet            only the one line summary
+//	--record file      raw log for lucifer_replay
+//	--out file         per tick trace of the car's estimate (TRACE.h)
+//	--truth file       per tick trace of the simulated car
+//
+//exit code 0 if the laps were done, 1 on a crash, 2 if time ran out first.
+#include"Arduino.h"
+#include"SENSORS.h"
+#include"SIMULATOR.h"
+#include<chrono>
+
+#include"LUCIFER.ino"
+#include"TRACE.h"
+#include"HOST_RUN.h"
+
+SENSORS sensors;
+SIMULATOR sim(sensors);
+RAW_LOG_WRITER recorder;
+
+static void truth_header(FILE *f)
+{
+	fprintf(f, "tick,micros,x,y,yaw,vx,vy,r,delta,cross_track,throttle,steering\n");
+}
+
+static void truth_row(FILE *f, long tick, uint32_t stamp)
+{
+	VEHICLE &c = sim.car;
+	fprintf(f, "%ld,%u,%.4f,%.4f,%.3f,%.3f,%.3f,%.3f,%.3f,%.4f,%.0f,%.0f\n", tick, stamp, c.x, c.y, c.yaw*RAD2DEG, c.vx, c.vy,
+		c.r*RAD2DEG, c.delta*RAD2DEG, sim.cross_track, c.throttle_pulse, c.steering_pulse);
+}
+
+static FILE *open_csv(const char *path)
+{
+	FILE *f = fopen(path, "w");
+	if(!f)
+	{
+		fprintf(stderr, "can't write %s\n", path);
+		exit(1);
+	}
+	return f;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t laps = 3;
+	float seconds = 300;
+	bool quiet = false;
+	const char *record = NULL;
+	FILE *trace = NULL, *truth = NULL;
+	float straight = 10, radius = 4;
+	int16_t mag_stored[6] = {0, 0, 0, 1000, 1000, 1000};
+	matched_vehicle(sim.car.p);
+	for(int i = 1; i < argc; i++)
+	{
+		bool more = i + 1 < argc;
+		if(!strcmp(argv[i], "--laps") && more)
+		{
+			laps = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--seconds") && more)
+		{
+			seconds = atof(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--ludicrous"))
+		{
+			sim.mode = LUDICROUS;
+		}
+		else if(!strcmp(argv[i], "--companion"))
+		{
+			sim.companion = true;
+		}
+		else if(!strcmp(argv[i], "--no-gps"))
+		{
+			sim.mode = MODE_NO_GPS;
+			sim.companion = true;
+		}
+		else if(!strcmp(argv[i], "--track") && more && sscanf(argv[i + 1], "%f,%f", &straight, &radius) == 2)
+		{
+			i++;
+		}
+		else if(!strcmp(argv[i], "--mu") && more)
+		{
+			sim.car.p.mu = atof(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--load") && more)
+		{
+			sim.car.p.load_factor = atof(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--crash") && more)
+		{
+			sim.crash_distance = atof(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--mag-iron") && more && sscanf(argv[i + 1], "%f,%f,%f,%f,%f,%f", &sim.noise.mag_offset[0],
+				&sim.noise.mag_offset[1], &sim.noise.mag_offset[2], &sim.noise.mag_scale[0], &sim.noise.mag_scale[1],
+				&sim.noise.mag_scale[2]) == 6)
+		{
+			i++;
+		}
+		else if(!strcmp(argv[i], "--mag-stored") && more && sscanf(argv[i + 1], "%hd,%hd,%hd,%hd,%hd,%hd", &mag_stored[0],
+				&mag_stored[1], &mag_stored[2], &mag_stored[3], &mag_stored[4], &mag_stored[5]) == 6)
+		{
+			i++;
+		}
+		else if(!strcmp(argv[i], "--seed") && more)
+		{
+			sim.seed(atoi(argv[++i]));
+		}
+		else if(!strcmp(argv[i], "--quiet"))
+		{
+			quiet = true;
+		}
+		else if(!strcmp(argv[i], "--record") && more)
+		{
+			record = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--out") && more)
+		{
+			trace = open_csv(argv[++i]);
+			trace_header(trace);
+		}
+		else if(!strcmp(argv[i], "--truth") && more)
+		{
+			truth = open_csv(argv[++i]);
+			truth_header(truth);
+		}
+		else
+		{
+			fprintf(stderr, "unknown option %s, see the top of lucifer_sim.cpp\n", argv[i]);
+			return 1;
+		}
+	}
+	if(record && !recorder.open(record))
+	{
+		fprintf(stderr, "can't write %s\n", record);
+		return 1;
+	}
+	Serial.log_rx = Serial1.log_rx = Serial2.log_rx = recorder.is_open();
+	sim.track.stadium(straight, radius, 4);
+
+	sim_setup(sim, sensors, recorder, mag_stored);
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	uint32_t start = host_get_micros();
+	int result = sim_drive(sim, sensors, recorder, laps, seconds, [&](long tick, uint32_t stamp)
+	{
+		if(trace)
+		{
+			trace_row(trace, tick, stamp);
+		}
+		if(truth)
+		{
+			truth_row(truth, tick, stamp);
+		}
+	});
+	double host_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	double car_seconds = (host_get_micros() - start)*1e-6;
+	recorder.close();
+	if(trace)
+	{
+		fclose(trace);
+	}
+	if(truth)
+	{
+		fclose(truth);
+	}
+
+	float best = sim_best_lap(sim.stats), mean = 0;
+	for(size_t i = 0; i < sim.stats.lap_times.size(); i++)
+	{
+		mean += sim.stats.lap_times[i];
+	}
+	mean = sim.stats.laps ? mean/sim.stats.laps : 0;
+
+	if(quiet)
+	{
+		printf("laps %u best %.3f mean %.3f cte_rms %.3f cte_max %.3f top %.2f late %u %s%s\n", sim.stats.laps, best, mean,
+			sim.cross_track_rms(), sim.stats.cross_track_max, sim.stats.top_speed, sched.late, sim.stats.crashed ? "crashed: " : "",
+			sim.stats.crash_reason);
+		return result;
+	}
+	printf("mode            : %s%s\n", sim.mode == LUDICROUS ? "LUDICROUS" : sim.mode == MODE_NO_GPS ? "NO_GPS" : "CRUISE",
+		sim.companion ? " with the companion" : "");
+	printf("track           : %.1f m (%lu waypoints)\n", sim.track.length, (unsigned long)sim.track.waypoints.size());
+	printf("car time        : %.3f s\n", car_seconds);
+	if(startup == STARTUP_READY) //the virtual clock starts at 0 on power on
+	{
+		printf("ready           : %.3f s after power on\n", ready_us*1e-6);
+	}
+	else
+	{
+		printf("ready           : never\n");
+	}
+	printf("host time       : %.3f s (%.1fx real time)\n", host_seconds, host_seconds > 0 ? car_seconds/host_seconds : 0.0);
+	printf("laps            : %u (%.0f laps per host hour)\n", sim.stats.laps, host_seconds > 0 ? sim.stats.laps*3600/host_seconds : 0.0);
+	for(size_t i = 0; i < sim.stats.lap_times.size(); i++)
+	{
+		printf("  lap %-3lu       : %.3f s\n", (unsigned long)i + 1, sim.stats.lap_times[i]);
+	}
+	printf("best lap        : %.3f s\n", best);
+	printf("cross track     : %.3f m rms, %.3f m max\n", sim.cross_track_rms(), sim.stats.cross_track_max);
+	printf("top speed       : %.2f m/s\n", sim.stats.top_speed);
+	printf("feedback_factor : %.3f (true load %.3f)\n", control.feedback_factor, sim.car.p.load_factor);
+	printf("late ticks      : %u\n", sched.late);
+	printf("mag calibration : %u fits, %u swapped in, offsetM %d %d %d axis_gain %d %d %d\n", mag_cal.fits, mag_cal.swaps,
+		marg.offsetM[0], marg.offsetM[1], marg.offsetM[2], marg.axis_gain[0], marg.axis_gain[1], marg.axis_gain[2]);
+	if(sim.companion)
+	{
+		printf("companion       : %u outliers gated\n", car.companion_outliers);
+	}
+	if(sim.stats.crashed)
+	{
+		printf("crashed         : %s at %.3f s\n", sim.stats.crash_reason, car_seconds);
+	}
+	return result;
+}
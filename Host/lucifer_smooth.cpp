@@ -0,0 +1,637 @@
+//fixed interval smoother : the best estimate of where the car was that the logged sensors allow, to score STATE against and to
+//tune it with. Every log is replayed through the sketch (like lucifer_replay) with a STATE that also writes down what it was
+//handed every tick, then off line :
+//	forward   a second STATE gets the same inputs, except that every gps fix and companion position goes in at its own epoch
+//	          instead of late against the history. x and P are kept after the prediction and after the corrections of every tick
+//	backward  Rauch-Tung-Striebel, in double : C = P(k|k) F' P(k+1|k)^-1, x_s(k) = x(k|k) + C (x_s(k+1) - x(k+1|k)),
+//	          P_s(k) = P(k|k) + C (P_s(k+1) - P(k+1|k)) C'
+//so the estimate at every tick has seen the whole run, before and after. The process model is STATE::predict() as it is, driven
+//by what MPU9150 integrated (the turn of marg's heading, the change of marg's speed) with the smoother's own accelerometer bias
+//in place of the one the car had, and F is the same 5 terms predict() uses. Only the position's process noise is the smoother's
+//own (SMOOTH_POS_NOISE) : STATE's is kept small so that the controller gets a smooth estimate, and the backward pass would take
+//every fix's correction for an error of the past and add them all up on the way back.
+//
+//usage : lucifer_smooth log[:truth.csv] ... [--jobs n] [--out dir] [--all] [--pos-noise x]
+//	log          raw logs from lucifer_host or lucifer_sim --record. With :truth.csv (lucifer_sim --truth of the same run) the
+//	             reference and the car's estimate are also scored against where the simulated car really was
+//	--jobs n     worker processes (default : number of cores). One log per process, the sketch lives in globals
+//	--out dir    where the references go (default : next to the logs), as <log>.ref.csv
+//	--all        score every tick after the first initialize(), not only the ones the car drove itself
+//	--pos-noise x  m/sqrt(s), the position's process noise (default SMOOTH_POS_NOISE, STATE has EKF_POS_NOISE)
+//
+//<log>.ref.csv has tick, micros, X, Y, Velocity, heading, AccBias and the 1 sigma of the position (m) and of the speed (m/s).
+//The report has, per log, how far the car's estimate (after each tick, what the controller drove with) was from the reference.
+#include"Arduino.h"
+#include"SENSORS.h"
+#include"RAW_LOG.h"
+#include"STATE.h"
+#include<algorithm>
+#include<chrono>
+#include<string>
+#include<vector>
+#include<math.h>
+#include<sys/mman.h>
+#include<sys/wait.h>
+#include<unistd.h>
+
+#define SMOOTH_POS_NOISE (float) 0.03f //m/sqrt(s). Over 5 simulated runs the reference comes closest to the truth around here
+
+static float pos_noise = SMOOTH_POS_NOISE;
+
+//================RECORDING================
+struct TAP_TICK
+{
+	uint32_t micros;
+	bool predicted;
+	STATE_MOTION m;
+	float V_fed, bias_fed; //car.Velocity and AccBias going into predict() : marg's speed started from the first, less the second
+	float X, Y, Velocity, heading; //the car's estimate at the end of the tick
+	uint8_t mode;
+};
+
+struct TAP_INIT
+{
+	long tick;
+	bool warm; //the 8 argument initialize(), the origin from before
+	int32_t origin_lon, origin_lat, lon, lat;
+	float Hdop;
+	float head, Vel, acc, AccBias;
+};
+
+template<typename T>
+struct TAP_MEASUREMENT
+{
+	long tick; //when it was handed over, the epoch is age earlier
+	T z;
+};
+
+static long tap_tick = -1;
+static std::vector<TAP_TICK> tap;
+static std::vector<TAP_INIT> tap_init;
+static std::vector<TAP_MEASUREMENT<STATE_FLOW>> tap_flow;
+static std::vector<TAP_MEASUREMENT<STATE_GPS>> tap_gps;
+static std::vector<TAP_MEASUREMENT<STATE_COMPANION>> tap_companion;
+
+//the sketch's car (STATE_CLASS, see LUCIFER.ino). Same filter, every call also goes in the tap
+class STATE_TAP : public STATE
+{
+public :
+	void initialize(int32_t lon, int32_t lat, float Hdop, float head, float Vel, float acc)
+	{
+		TAP_INIT i = {tap_tick, false, 0, 0, lon, lat, Hdop, head, Vel, acc, AccBias};
+		tap_init.push_back(i);
+		STATE::initialize(lon, lat, Hdop, head, Vel, acc);
+	}
+
+	void initialize(int32_t origin_lon, int32_t origin_lat, int32_t lon, int32_t lat, float Hdop, float head, float Vel, float acc)
+	{
+		TAP_INIT i = {tap_tick, true, origin_lon, origin_lat, lon, lat, Hdop, head, Vel, acc, AccBias};
+		tap_init.push_back(i);
+		STATE::initialize(origin_lon, origin_lat, lon, lat, Hdop, head, Vel, acc);
+	}
+
+	void predict(const STATE_MOTION &m)
+	{
+		TAP_TICK &t = tap[tap_tick];
+		t.predicted = true;
+		t.m = m;
+		t.V_fed = Velocity;
+		t.bias_fed = AccBias;
+		STATE::predict(m);
+	}
+
+	void correct_flow(const STATE_FLOW &f)
+	{
+		TAP_MEASUREMENT<STATE_FLOW> r = {tap_tick, f};
+		tap_flow.push_back(r);
+		STATE::correct_flow(f);
+	}
+
+	void correct_gps(const STATE_GPS &g)
+	{
+		TAP_MEASUREMENT<STATE_GPS> r = {tap_tick, g};
+		tap_gps.push_back(r);
+		STATE::correct_gps(g);
+	}
+
+	bool correct_companion(const STATE_COMPANION &c)
+	{
+		TAP_MEASUREMENT<STATE_COMPANION> r = {tap_tick, c};
+		tap_companion.push_back(r);
+		return STATE::correct_companion(c);
+	}
+};
+#define STATE_CLASS STATE_TAP
+
+#include"LUCIFER.ino"
+#include"REPLAY.h"
+
+SENSORS sensors;
+
+//================SMOOTHING================
+struct SMOOTH_ROW
+{
+	Matrix<EKF_STATES, 1, double> x;
+	Matrix<EKF_STATES, EKF_STATES, double> P;
+};
+
+struct FORWARD_ROW
+{
+	Matrix<EKF_STATES, 1> x_prior, x_post;
+	Matrix<EKF_STATES, EKF_STATES> P_prior, P_post;
+	float a, b, c, d; //F's terms, see STATE::predict(). dV/dbias is -dt
+};
+
+template<uint8_t R, uint8_t C>
+static Matrix<R, C, double> to_double(const Matrix<R, C> &m)
+{
+	Matrix<R, C, double> r;
+	for(uint8_t i = 0; i < R; i++)
+	{
+		for(uint8_t j = 0; j < C; j++)
+		{
+			r(i, j) = m(i, j);
+		}
+	}
+	return r;
+}
+
+//the tick a measurement handed over at tick with this age belongs to. Same rounding as STATE::recall(), but not limited to the history
+static long epoch(long tick, float age)
+{
+	return tick - long(age > 0 ? uint32_t(age*LOOP_FREQUENCY + 0.5f) : 0);
+}
+
+//measurements of one kind, in the order of their epochs
+template<typename T>
+struct MEASUREMENT_QUEUE
+{
+	std::vector<std::pair<long, const T*>> q;
+	size_t next;
+
+	void fill(const std::vector<TAP_MEASUREMENT<T>> &v, long first, long last, float (*age)(const T&))
+	{
+		q.clear();
+		next = 0;
+		for(size_t i = 0; i < v.size(); i++)
+		{
+			long k = epoch(v[i].tick, age(v[i].z));
+			if(k > first && k < last && v[i].tick >= first) //nothing from before the initialize() or from the previous one
+			{
+				q.push_back(std::make_pair(k, &v[i].z));
+			}
+		}
+		std::stable_sort(q.begin(), q.end(), [](const std::pair<long, const T*> &p, const std::pair<long, const T*> &r)
+		{
+			return p.first < r.first;
+		});
+	}
+
+	const T *due(long k)
+	{
+		while(next < q.size() && q[next].first < k)
+		{
+			next++;
+		}
+		return next < q.size() && q[next].first == k ? q[next++].second : NULL;
+	}
+};
+
+static float no_age(const STATE_FLOW &)
+{
+	return 0;
+}
+
+static float gps_age(const STATE_GPS &g)
+{
+	return g.age;
+}
+
+static float companion_age(const STATE_COMPANION &c)
+{
+	return c.age;
+}
+
+//smooths the ticks [init.tick, last) into out[init.tick ...]
+static void smooth_segment(const TAP_INIT &init, long last, std::vector<SMOOTH_ROW> &out)
+{
+	long first = init.tick;
+	long n = last - first;
+	if(n <= 0)
+	{
+		return;
+	}
+	std::vector<FORWARD_ROW> fwd(n);
+	static STATE f; //static, STATE is too big for some stacks
+	f.AccBias = init.AccBias; //initialize() starts the bias from there
+	if(init.warm)
+	{
+		f.initialize(init.origin_lon, init.origin_lat, init.lon, init.lat, init.Hdop, init.head, init.Vel, init.acc);
+	}
+	else
+	{
+		f.initialize(init.lon, init.lat, init.Hdop, init.head, init.Vel, init.acc);
+	}
+	f.q_pos = pos_noise*pos_noise*dt;
+	fwd[0].x_prior = fwd[0].x_post = f.x;
+	fwd[0].P_prior = fwd[0].P_post = f.P;
+	fwd[0].a = fwd[0].b = fwd[0].c = fwd[0].d = 0;
+
+	MEASUREMENT_QUEUE<STATE_FLOW> flow;
+	MEASUREMENT_QUEUE<STATE_GPS> gps_q;
+	MEASUREMENT_QUEUE<STATE_COMPANION> companion;
+	flow.fill(tap_flow, first, last, no_age);
+	gps_q.fill(tap_gps, first, last, gps_age);
+	companion.fill(tap_companion, first, last, companion_age);
+
+	//forward : the tick's prediction, then what was measured at that tick, in the order the car takes them
+	for(long k = 1; k < n; k++)
+	{
+		const TAP_TICK &t = tap[first + k];
+		FORWARD_ROW &r = fwd[k];
+		float X0 = f.X, Y0 = f.Y;
+		if(t.predicted)
+		{
+			STATE_MOTION m = t.m;
+			m.V = f.Velocity + (t.m.V - t.V_fed) + (t.bias_fed - f.AccBias)*dt; //marg's speed change, with our bias
+			f.predict(m);
+		}
+		r.x_prior = f.x;
+		r.P_prior = f.P;
+		r.a = t.predicted ? f.cos_head*dt : 0;
+		r.b = -(f.Y - Y0)*DEG2RAD;
+		r.c = t.predicted ? f.sin_head*dt : 0;
+		r.d = (f.X - X0)*DEG2RAD;
+		const STATE_FLOW *fl;
+		while((fl = flow.due(first + k)) != NULL)
+		{
+			f.correct_flow(*fl);
+		}
+		const STATE_GPS *g;
+		while((g = gps_q.due(first + k)) != NULL)
+		{
+			STATE_GPS now = *g;
+			now.age = 0; //it is at its epoch
+			f.correct_gps(now);
+		}
+		const STATE_COMPANION *c;
+		while((c = companion.due(first + k)) != NULL)
+		{
+			STATE_COMPANION now = *c;
+			now.age = 0;
+			f.correct_companion(now);
+		}
+		r.x_post = f.x;
+		r.P_post = f.P;
+	}
+
+	//backward
+	SMOOTH_ROW s = {to_double(fwd[n - 1].x_post), to_double(fwd[n - 1].P_post)};
+	out[last - 1] = s;
+	for(long k = n - 2; k >= 0; k--)
+	{
+		const FORWARD_ROW &next = fwd[k + 1];
+		Matrix<EKF_STATES, EKF_STATES, double> J; //F of the prediction from k to k + 1. Not F, Arduino.h has an F() macro
+		J.identity();
+		J(EKF_X, EKF_V) = next.a;
+		J(EKF_X, EKF_HEAD) = next.b;
+		J(EKF_Y, EKF_V) = next.c;
+		J(EKF_Y, EKF_HEAD) = next.d;
+		J(EKF_V, EKF_BIAS) = tap[first + k + 1].predicted ? -dt : 0;
+		Matrix<EKF_STATES, EKF_STATES, double> P_post = to_double(fwd[k].P_post), P_prior = to_double(next.P_prior), inv;
+		Matrix<EKF_STATES, 1, double> x_post = to_double(fwd[k].x_post);
+		if(!invert(P_prior, inv))
+		{
+			s.x = x_post; //can't happen with q > 0, but then the filter's is the best there is
+			s.P = P_post;
+		}
+		else
+		{
+			Matrix<EKF_STATES, EKF_STATES, double> C = P_post*J.transpose()*inv;
+			Matrix<EKF_STATES, 1, double> dx = s.x - to_double(next.x_prior);
+			dx(EKF_HEAD, 0) = STATE::wrap_180(float(dx(EKF_HEAD, 0)));
+			s.x = x_post + C*dx;
+			s.x(EKF_HEAD, 0) = fmod(s.x(EKF_HEAD, 0) + M_2PI_DEG, M_2PI_DEG);
+			s.P = P_post + C*(s.P - P_prior)*C.transpose();
+		}
+		out[first + k] = s;
+	}
+}
+
+//================SCORING================
+//a difference over the scored ticks. The position's is also given about its mean : the simulator's frame and the car's are
+//off by the gps bias at the origin, the mean offset says how much
+struct DIFFERENCE
+{
+	long n;
+	double ex, ey, exx, eyy, ev2, eh2;
+
+	void add(double dx, double dy, double dv, double dh)
+	{
+		n++;
+		ex += dx;
+		ey += dy;
+		exx += dx*dx;
+		eyy += dy*dy;
+		ev2 += dv*dv;
+		eh2 += dh*dh;
+	}
+
+	float position() const
+	{
+		return n ? float(sqrt((exx + eyy)/n)) : 0;
+	}
+
+	float position_about_mean() const
+	{
+		double mx = n ? ex/n : 0, my = n ? ey/n : 0;
+		return n ? float(sqrt(max(exx/n - mx*mx + eyy/n - my*my, 0.0))) : 0;
+	}
+
+	float speed() const
+	{
+		return n ? float(sqrt(ev2/n)) : 0;
+	}
+
+	float heading() const
+	{
+		return n ? float(sqrt(eh2/n)) : 0;
+	}
+};
+
+#define SMOOTH_STATUS_DIED -1
+#define SMOOTH_STATUS_OK 0
+#define SMOOTH_STATUS_NO_LOG 1
+#define SMOOTH_STATUS_NO_INIT 2
+#define SMOOTH_STATUS_NO_TRUTH 3
+#define SMOOTH_STATUS_NO_OUTPUT 4
+
+struct SMOOTH_RESULT
+{
+	int32_t status;
+	long ticks, scored;
+	float seconds; //host
+	bool truth;
+	DIFFERENCE car_reference, reference_truth, car_truth;
+};
+
+struct SMOOTH_SHARED
+{
+	SMOOTH_RESULT result[1]; //really one per log
+};
+
+struct SMOOTH_JOB
+{
+	std::string log, truth, out;
+};
+
+static bool autonomous(uint8_t mode)
+{
+	return mode == MODE_AUTO || mode == MODE_AUTO_LUDICROUS || mode == MODE_NO_GPS;
+}
+
+//one log, in a freshly forked child
+static void run(const SMOOTH_JOB &job, bool all, SMOOTH_RESULT &r)
+{
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	std::vector<TRUTH_ROW> truth;
+	if(job.truth.size() && !read_truth(job.truth.c_str(), truth))
+	{
+		r.status = SMOOTH_STATUS_NO_TRUTH;
+		return;
+	}
+	r.truth = job.truth.size();
+	RAW_LOG_READER reader;
+	if(!reader.open(job.log.c_str()))
+	{
+		r.status = SMOOTH_STATUS_NO_LOG;
+		return;
+	}
+	tap_tick = 0;
+	tap.push_back(TAP_TICK());
+	tap[0].predicted = false;
+	bool started = replay_log(reader, sensors, [&](long tick, uint32_t stamp)
+	{
+		TAP_TICK &t = tap[tick];
+		t.micros = stamp;
+		t.X = car.X;
+		t.Y = car.Y;
+		t.Velocity = car.Velocity;
+		t.heading = car.heading;
+		t.mode = MODE;
+		tap_tick = tick + 1;
+		tap.push_back(TAP_TICK());
+		tap.back().predicted = false;
+	});
+	tap.pop_back(); //the one for the tick that never came
+	if(!started || tap_init.empty())
+	{
+		r.status = SMOOTH_STATUS_NO_INIT;
+		return;
+	}
+	r.ticks = long(tap.size());
+
+	std::vector<SMOOTH_ROW> ref(tap.size());
+	for(size_t i = 0; i < tap_init.size(); i++)
+	{
+		TAP_INIT init = tap_init[i];
+		init.tick = max(init.tick, 0L); //during setup()
+		long last = i + 1 < tap_init.size() ? max(tap_init[i + 1].tick, 0L) : long(tap.size());
+		smooth_segment(init, last, ref);
+	}
+
+	FILE *f = fopen(job.out.c_str(), "w");
+	if(!f)
+	{
+		r.status = SMOOTH_STATUS_NO_OUTPUT;
+		return;
+	}
+	fprintf(f, "tick,micros,X,Y,Velocity,heading,AccBias,PosError,VelError\n");
+	long first = max(tap_init[0].tick, 0L);
+	for(long k = first; k < long(tap.size()); k++)
+	{
+		const SMOOTH_ROW &s = ref[k];
+		const TAP_TICK &t = tap[k];
+		fprintf(f, "%ld,%u,%.4f,%.4f,%.4f,%.3f,%.5f,%.4f,%.4f\n", k, t.micros, s.x(EKF_X, 0), s.x(EKF_Y, 0), s.x(EKF_V, 0),
+			s.x(EKF_HEAD, 0), s.x(EKF_BIAS, 0), sqrt(max(s.P(EKF_X, EKF_X) + s.P(EKF_Y, EKF_Y), 0.0)), sqrt(max(s.P(EKF_V, EKF_V), 0.0)));
+		if(!all && !autonomous(t.mode))
+		{
+			continue;
+		}
+		r.scored++;
+		double hx = s.x(EKF_X, 0), hy = s.x(EKF_Y, 0), hv = s.x(EKF_V, 0), hh = s.x(EKF_HEAD, 0);
+		r.car_reference.add(t.X - hx, t.Y - hy, t.Velocity - hv, STATE::wrap_180(float(t.heading - hh)));
+		if(size_t(k) < truth.size())
+		{
+			const TRUTH_ROW &tr = truth[k];
+			r.reference_truth.add(hx - tr.x, hy - tr.y, hv - tr.vx, STATE::wrap_180(float(hh - tr.yaw)));
+			r.car_truth.add(t.X - tr.x, t.Y - tr.y, t.Velocity - tr.vx, STATE::wrap_180(float(t.heading - tr.yaw)));
+		}
+	}
+	fclose(f);
+	r.seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - t0).count();
+	r.status = SMOOTH_STATUS_OK;
+}
+
+static const char *status_name(int32_t status)
+{
+	switch(status)
+	{
+	case SMOOTH_STATUS_NO_LOG:
+		return "can't read the log";
+	case SMOOTH_STATUS_NO_INIT:
+		return "no setup record, or the car was never initialized";
+	case SMOOTH_STATUS_NO_TRUTH:
+		return "can't read the truth file";
+	case SMOOTH_STATUS_NO_OUTPUT:
+		return "can't write the reference";
+	case SMOOTH_STATUS_DIED:
+		return "died";
+	}
+	return "";
+}
+
+int main(int argc, char **argv)
+{
+	int jobs = int(sysconf(_SC_NPROCESSORS_ONLN));
+	const char *out_dir = NULL;
+	bool all = false;
+	std::vector<SMOOTH_JOB> logs;
+	for(int i = 1; i < argc; i++)
+	{
+		bool more = i + 1 < argc;
+		if(!strcmp(argv[i], "--jobs") && more)
+		{
+			jobs = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--out") && more)
+		{
+			out_dir = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--all"))
+		{
+			all = true;
+		}
+		else if(!strcmp(argv[i], "--pos-noise") && more)
+		{
+			pos_noise = atof(argv[++i]);
+		}
+		else if(argv[i][0] == '-')
+		{
+			fprintf(stderr, "unknown option %s, see the top of lucifer_smooth.cpp\n", argv[i]);
+			return 1;
+		}
+		else
+		{
+			SMOOTH_JOB job;
+			job.log = argv[i];
+			size_t colon = job.log.find(':');
+			if(colon != std::string::npos)
+			{
+				job.truth = job.log.substr(colon + 1);
+				job.log = job.log.substr(0, colon);
+			}
+			logs.push_back(job);
+		}
+	}
+	if(logs.empty())
+	{
+		fprintf(stderr, "usage : lucifer_smooth log[:truth.csv] ... [--jobs n] [--out dir] [--all] [--pos-noise x]\n");
+		return 1;
+	}
+	for(size_t i = 0; i < logs.size(); i++)
+	{
+		std::string name = logs[i].log.substr(logs[i].log.find_last_of('/') + 1);
+		logs[i].out = (out_dir ? std::string(out_dir) + "/" + name : logs[i].log) + ".ref.csv";
+	}
+	jobs = constrain(jobs, 1, 64);
+
+	size_t bytes = sizeof(SMOOTH_SHARED) + (logs.size() - 1)*sizeof(SMOOTH_RESULT);
+	SMOOTH_SHARED *shared = (SMOOTH_SHARED*)mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(shared == MAP_FAILED)
+	{
+		fprintf(stderr, "can't map %lu bytes of shared memory\n", (unsigned long)bytes);
+		return 1;
+	}
+
+	//a child per log, at most jobs at a time
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	size_t next = 0, running = 0;
+	while(next < logs.size() || running)
+	{
+		if(next < logs.size() && running < size_t(jobs))
+		{
+			SMOOTH_RESULT &r = shared->result[next];
+			r.status = SMOOTH_STATUS_DIED;
+			fflush(NULL);
+			pid_t child = fork();
+			if(child == 0)
+			{
+				run(logs[next], all, r);
+				_exit(0);
+			}
+			if(child < 0)
+			{
+				if(!running)
+				{
+					run(logs[next], all, r); //no fork at all, this is the last thing this process does with the sketch
+					next++;
+				}
+				else
+				{
+					jobs = int(running); //wait for one to finish
+				}
+				continue;
+			}
+			next++;
+			running++;
+			continue;
+		}
+		if(waitpid(-1, NULL, 0) > 0)
+		{
+			running--;
+		}
+		else
+		{
+			running = 0;
+		}
+	}
+	double host_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	//================REPORT================
+	printf("%-28s %8s %8s | %-22s | %-16s %-16s\n", "", "", "", "car - reference", "reference - truth", "car - truth");
+	printf("%-28s %8s %8s | %7s %7s %6s | %8s %7s | %8s %7s\n", "log", "ticks", "scored", "pos m", "V m/s", "deg", "pos m", "V m/s",
+		"pos m", "V m/s");
+	DIFFERENCE total = {};
+	int failed = 0;
+	for(size_t i = 0; i < logs.size(); i++)
+	{
+		const SMOOTH_RESULT &r = shared->result[i];
+		std::string name = logs[i].log.substr(logs[i].log.find_last_of('/') + 1);
+		if(r.status != SMOOTH_STATUS_OK)
+		{
+			printf("%-28s %s\n", name.c_str(), status_name(r.status));
+			failed++;
+			continue;
+		}
+		printf("%-28s %8ld %8ld | %7.3f %7.3f %6.2f", name.c_str(), r.ticks, r.scored, r.car_reference.position(),
+			r.car_reference.speed(), r.car_reference.heading());
+		if(r.truth)
+		{
+			printf(" | %8.3f %7.3f | %8.3f %7.3f", r.reference_truth.position_about_mean(), r.reference_truth.speed(),
+				r.car_truth.position_about_mean(), r.car_truth.speed());
+		}
+		printf("\n");
+		total.n += r.car_reference.n;
+		total.exx += r.car_reference.exx;
+		total.eyy += r.car_reference.eyy;
+		total.ev2 += r.car_reference.ev2;
+		total.eh2 += r.car_reference.eh2;
+	}
+	if(logs.size() - failed > 1)
+	{
+		printf("%-28s %8s %8ld | %7.3f %7.3f %6.2f\n", "all", "", total.n, total.position(), total.speed(), total.heading());
+	}
+	printf("%lu logs on %d workers in %.1f s\n", (unsigned long)logs.size(), jobs, host_seconds);
+	return failed ? 1 : 0;
+}
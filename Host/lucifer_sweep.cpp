@@ -0,0 +1,494 @@
+//Monte-Carlo sweep over the tunables in TUNABLES.h : every run draws each swept parameter uniformly from its range, gets its own
+//noise seed and drives the sketch around the simulator's track (SIMULATOR.h) like lucifer_sim does. Runs are spread over all the
+//cores and the results end up in one report (lap times, cross track error, crashes, scheduler overruns, per parameter trends).
+//
+//usage : lucifer_sweep [options]
+//	--runs n           number of runs (default 200)
+//	--jobs n           worker processes (default : number of cores)
+//	--vary name=lo:hi  sweep a tunable over [lo, hi], can be given more than once. names are the ones in TUNABLES.cpp.
+//	                   without any --vary the four PARAMS.h culprits are swept over 0.5..1.5 times their default
+//	--seed n           base seed (default 1). run i uses noise seed n + i, so the results don't depend on --jobs
+//	--laps n           laps per run (default 3)
+//	--seconds s        car time limit per run (default 120)
+//	--ludicrous        ask for LUDICROUS instead of CRUISE
+//	--track l,r        straight length and corner radius in m (default 10,4)
+//	--mu x             tyre friction
+//	--top n            how many of the best runs to list (default 10)
+//	--csv file         one row per run
+//
+//the sketch lives in globals, so a run can't be repeated inside one process. Each worker process forks a fresh child per run
+//from its own untouched image and the child writes its result into shared memory. Work is handed out with work stealing : the
+//runs are dealt out to the workers in equal contiguous blocks up front, a worker takes its next run from the front of its own
+//block and when that is empty it steals the back half of whichever block has the most left. Each block is one 64 bit atomic
+//(front, back) in the shared mapping, so taking and stealing are a single compare and swap.
+#include"Arduino.h"
+#include"SENSORS.h"
+#include"SIMULATOR.h"
+#include"TUNABLES.h"
+#include<atomic>
+#include<string>
+#include<vector>
+#include<algorithm>
+#include<chrono>
+#include<random>
+#include<sys/mman.h>
+#include<sys/wait.h>
+#include<unistd.h>
+
+#include"LUCIFER.ino"
+#include"HOST_RUN.h"
+
+#define SWEEP_STATUS_DIED -1 //the child didn't come back with a result (it crashed or got killed)
+#define SWEEP_BINS 4         //per parameter table, the range is cut into this many equal slices
+
+SENSORS sensors;
+SIMULATOR sim(sensors);
+RAW_LOG_WRITER recorder; //never opened, sim_drive wants one
+
+struct SWEEP_RANGE
+{
+	const char *name;
+	float lo, hi;
+};
+
+struct SWEEP_RESULT
+{
+	float value[TUNABLE_COUNT]; //what the run used, in the order of the ranges
+	int32_t status;             //SIM_DONE, SIM_CRASHED, SIM_TIMEOUT or SWEEP_STATUS_DIED
+	uint32_t laps;
+	float best, mean, cte_rms, cte_max, top_speed, car_seconds;
+	uint32_t late, overruns;    //SCHEDULER's late ticks and the sum of the tasks' budget overruns
+	int32_t worker;
+};
+
+struct SWEEP_SHARED
+{
+	std::atomic<uint64_t> block[64]; //per worker (front << 32 | back), front == back when empty
+	std::atomic<uint32_t> steals;
+	std::atomic<uint32_t> finished;
+	SWEEP_RESULT result[1];          //really runs long
+};
+
+static uint64_t pack(uint32_t front, uint32_t back)
+{
+	return (uint64_t(front) << 32) | back;
+}
+
+//next run from the front of our own block, -1 if it is empty
+static int64_t take(std::atomic<uint64_t> &b)
+{
+	uint64_t v = b.load();
+	while(uint32_t(v >> 32) < uint32_t(v))
+	{
+		if(b.compare_exchange_weak(v, v + (uint64_t(1) << 32)))
+		{
+			return int64_t(v >> 32);
+		}
+	}
+	return -1;
+}
+
+//back half of the fullest other block goes into ours. false when there is nothing left anywhere
+static bool steal(SWEEP_SHARED *shared, int self, int workers)
+{
+	while(true)
+	{
+		int victim = -1;
+		uint32_t most = 0;
+		for(int i = 0; i < workers; i++)
+		{
+			uint64_t v = shared->block[i].load();
+			uint32_t left = uint32_t(v) - uint32_t(v >> 32);
+			if(i != self && uint32_t(v) > uint32_t(v >> 32) && left > most)
+			{
+				most = left;
+				victim = i;
+			}
+		}
+		if(victim < 0)
+		{
+			return false;
+		}
+		uint64_t v = shared->block[victim].load();
+		uint32_t front = uint32_t(v >> 32), back = uint32_t(v);
+		if(front >= back)
+		{
+			continue; //emptied under us, look again
+		}
+		uint32_t split = back - (back - front + 1)/2;
+		if(shared->block[victim].compare_exchange_strong(v, pack(front, split)))
+		{
+			//nobody steals from an empty block, so ours can simply be overwritten
+			shared->block[self].store(pack(split, back));
+			shared->steals++;
+			return true;
+		}
+	}
+}
+
+//one run, in a freshly forked child
+static void run(uint32_t index, uint32_t seed, const std::vector<SWEEP_RANGE> &ranges, uint32_t laps, float seconds,
+	SWEEP_RESULT &r)
+{
+	std::mt19937 rng(seed*2654435761u + index);
+	for(size_t i = 0; i < ranges.size(); i++)
+	{
+		r.value[i] = std::uniform_real_distribution<float>(ranges[i].lo, ranges[i].hi)(rng);
+		tunables.set(ranges[i].name, r.value[i]);
+	}
+	sim.seed(seed + index);
+	sim_setup(sim, sensors, recorder);
+	uint32_t start = host_get_micros();
+	r.status = sim_drive(sim, sensors, recorder, laps, seconds, [](long, uint32_t){});
+	r.car_seconds = (host_get_micros() - start)*1e-6f;
+	r.laps = sim.stats.laps;
+	r.best = sim_best_lap(sim.stats);
+	r.mean = 0;
+	for(size_t i = 0; i < sim.stats.lap_times.size(); i++)
+	{
+		r.mean += sim.stats.lap_times[i];
+	}
+	r.mean = r.laps ? r.mean/r.laps : 0;
+	r.cte_rms = sim.cross_track_rms();
+	r.cte_max = sim.stats.cross_track_max;
+	r.top_speed = sim.stats.top_speed;
+	r.late = sched.late;
+	r.overruns = 0;
+	for(size_t i = 0; i < sizeof(tasks)/sizeof(TASK); i++)
+	{
+		r.overruns += tasks[i].overruns;
+	}
+	for(size_t i = 0; i < sizeof(background)/sizeof(TASK); i++)
+	{
+		r.overruns += background[i].overruns;
+	}
+}
+
+static void worker(SWEEP_SHARED *shared, int self, int workers, uint32_t seed, const std::vector<SWEEP_RANGE> &ranges,
+	uint32_t laps, float seconds)
+{
+	while(true)
+	{
+		int64_t index = take(shared->block[self]);
+		if(index < 0)
+		{
+			if(!steal(shared, self, workers))
+			{
+				return;
+			}
+			continue;
+		}
+		SWEEP_RESULT &r = shared->result[index];
+		r.status = SWEEP_STATUS_DIED;
+		r.worker = self;
+		fflush(NULL);
+		pid_t child = fork();
+		if(child == 0)
+		{
+			run(uint32_t(index), seed, ranges, laps, seconds, r);
+			_exit(0);
+		}
+		int wstatus = 0;
+		if(child < 0 || waitpid(child, &wstatus, 0) != child || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0)
+		{
+			r.status = SWEEP_STATUS_DIED;
+		}
+		shared->finished++;
+	}
+}
+
+static float percentile(std::vector<float> v, float p)
+{
+	if(v.empty())
+	{
+		return 0;
+	}
+	std::sort(v.begin(), v.end());
+	return v[size_t(p*(v.size() - 1) + 0.5f)];
+}
+
+static float average(const std::vector<float> &v)
+{
+	double sum = 0;
+	for(size_t i = 0; i < v.size(); i++)
+	{
+		sum += v[i];
+	}
+	return v.size() ? float(sum/v.size()) : 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t runs = 200, seed = 1, laps = 3, top = 10;
+	int jobs = int(sysconf(_SC_NPROCESSORS_ONLN));
+	float seconds = 120, straight = 10, radius = 4;
+	const char *csv = NULL;
+	std::vector<SWEEP_RANGE> ranges;
+	std::vector<std::string> names; //keeps the strings behind ranges[].name alive
+	names.reserve(TUNABLE_COUNT);
+	matched_vehicle(sim.car.p);
+	for(int i = 1; i < argc; i++)
+	{
+		bool more = i + 1 < argc;
+		if(!strcmp(argv[i], "--runs") && more)
+		{
+			runs = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--jobs") && more)
+		{
+			jobs = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--vary") && more)
+		{
+			const char *arg = argv[++i];
+			const char *eq = strchr(arg, '=');
+			SWEEP_RANGE r;
+			if(!eq || sscanf(eq + 1, "%f:%f", &r.lo, &r.hi) != 2 || ranges.size() == TUNABLE_COUNT)
+			{
+				fprintf(stderr, "--vary wants name=lo:hi, got %s\n", arg);
+				return 1;
+			}
+			names.push_back(std::string(arg, eq - arg));
+			r.name = names.back().c_str();
+			if(isnan(tunables.get(r.name)))
+			{
+				fprintf(stderr, "no tunable called %s\n", r.name);
+				return 1;
+			}
+			ranges.push_back(r);
+		}
+		else if(!strcmp(argv[i], "--seed") && more)
+		{
+			seed = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--laps") && more)
+		{
+			laps = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--seconds") && more)
+		{
+			seconds = atof(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--ludicrous"))
+		{
+			sim.mode = LUDICROUS;
+		}
+		else if(!strcmp(argv[i], "--track") && more && sscanf(argv[i + 1], "%f,%f", &straight, &radius) == 2)
+		{
+			i++;
+		}
+		else if(!strcmp(argv[i], "--mu") && more)
+		{
+			sim.car.p.mu = atof(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--top") && more)
+		{
+			top = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--csv") && more)
+		{
+			csv = argv[++i];
+		}
+		else
+		{
+			fprintf(stderr, "unknown option %s, see the top of lucifer_sweep.cpp\n", argv[i]);
+			return 1;
+		}
+	}
+	if(ranges.empty())
+	{
+		for(int i = 0; i < 4; i++)
+		{
+			SWEEP_RANGE r;
+			r.name = TUNABLES::name(i);
+			r.lo = 0.5f*tunables.get(r.name);
+			r.hi = 1.5f*tunables.get(r.name);
+			ranges.push_back(r);
+		}
+	}
+	jobs = constrain(jobs, 1, 64);
+	if(runs == 0)
+	{
+		return 0;
+	}
+	sim.track.stadium(straight, radius, 4);
+
+	size_t bytes = sizeof(SWEEP_SHARED) + (runs - 1)*sizeof(SWEEP_RESULT);
+	SWEEP_SHARED *shared = (SWEEP_SHARED*)mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(shared == MAP_FAILED)
+	{
+		fprintf(stderr, "can't map %lu bytes of shared memory\n", (unsigned long)bytes);
+		return 1;
+	}
+	if(!shared->block[0].is_lock_free())
+	{
+		fprintf(stderr, "64 bit atomics aren't lock free here, they won't work across processes\n");
+		return 1;
+	}
+	for(int i = 0; i < jobs; i++)
+	{
+		shared->block[i].store(pack(uint32_t(uint64_t(runs)*i/jobs), uint32_t(uint64_t(runs)*(i + 1)/jobs)));
+	}
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	std::vector<pid_t> pids;
+	for(int i = 0; i < jobs; i++)
+	{
+		fflush(NULL);
+		pid_t pid = fork();
+		if(pid == 0)
+		{
+			worker(shared, i, jobs, seed, ranges, laps, seconds);
+			_exit(0);
+		}
+		if(pid < 0)
+		{
+			fprintf(stderr, "fork failed, running with %d workers\n", i);
+			break; //the runs dealt to the missing workers get stolen
+		}
+		pids.push_back(pid);
+	}
+	if(pids.empty())
+	{
+		worker(shared, 0, jobs, seed, ranges, laps, seconds);
+	}
+	uint32_t reported = 0;
+	for(size_t i = 0; i < pids.size(); i++)
+	{
+		while(waitpid(pids[i], NULL, WNOHANG) == 0)
+		{
+			uint32_t done = shared->finished.load();
+			if(done >= reported + (runs + 19)/20)
+			{
+				reported = done;
+				fprintf(stderr, "\r%u/%u runs", done, runs);
+			}
+			usleep(20000);
+		}
+	}
+	fprintf(stderr, "\r%u/%u runs\n", shared->finished.load(), runs);
+	double host_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	//================REPORT================
+	uint32_t count[4] = {0, 0, 0, 0}; //done, crashed, timeout, died
+	uint32_t late = 0, overruns = 0, late_runs = 0;
+	double car_seconds = 0;
+	std::vector<float> best, cte_rms, cte_max;
+	std::vector<uint32_t> order;
+	for(uint32_t i = 0; i < runs; i++)
+	{
+		SWEEP_RESULT &r = shared->result[i];
+		count[r.status == SWEEP_STATUS_DIED ? 3 : r.status]++;
+		if(r.status == SWEEP_STATUS_DIED)
+		{
+			continue;
+		}
+		car_seconds += r.car_seconds;
+		late += r.late;
+		overruns += r.overruns;
+		late_runs += r.late || r.overruns;
+		cte_rms.push_back(r.cte_rms);
+		cte_max.push_back(r.cte_max);
+		if(r.status == SIM_DONE)
+		{
+			best.push_back(r.best);
+			order.push_back(i);
+		}
+	}
+	printf("runs            : %u on %lu workers, %.1f s (%.1f runs/s, %.0fx real time), %u steals\n", runs,
+		(unsigned long)max(pids.size(), size_t(1)), host_seconds, runs/host_seconds, car_seconds/host_seconds,
+		shared->steals.load());
+	printf("mode            : %s, %u laps, %.0f s limit, seed %u\n", sim.mode == LUDICROUS ? "LUDICROUS" : "CRUISE", laps,
+		seconds, seed);
+	printf("outcome         : %u done, %u crashed, %u out of time, %u died\n", count[0], count[1], count[2], count[3]);
+	printf("best lap        : min %.3f  p10 %.3f  p50 %.3f  p90 %.3f s (runs that finished)\n", percentile(best, 0),
+		percentile(best, 0.1f), percentile(best, 0.5f), percentile(best, 0.9f));
+	printf("cross track rms : mean %.3f  p50 %.3f  p90 %.3f m\n", average(cte_rms), percentile(cte_rms, 0.5f),
+		percentile(cte_rms, 0.9f));
+	printf("cross track max : p50 %.3f  p90 %.3f m\n", percentile(cte_max, 0.5f), percentile(cte_max, 0.9f));
+	printf("overruns        : %u late ticks, %u task overruns, in %u runs\n", late, overruns, late_runs);
+
+	printf("\n%-16s %-19s %5s %8s %9s %9s\n", "parameter", "range", "runs", "crashed", "best lap", "cte rms");
+	for(size_t p = 0; p < ranges.size(); p++)
+	{
+		for(int b = 0; b < SWEEP_BINS; b++)
+		{
+			float lo = ranges[p].lo + (ranges[p].hi - ranges[p].lo)*b/SWEEP_BINS;
+			float hi = ranges[p].lo + (ranges[p].hi - ranges[p].lo)*(b + 1)/SWEEP_BINS;
+			uint32_t n = 0, crashed = 0;
+			std::vector<float> bin_best, bin_cte;
+			for(uint32_t i = 0; i < runs; i++)
+			{
+				SWEEP_RESULT &r = shared->result[i];
+				float v = r.value[p];
+				bool inside = v >= lo && (v < hi || (b == SWEEP_BINS - 1 && v <= hi));
+				if(r.status == SWEEP_STATUS_DIED || !inside)
+				{
+					continue;
+				}
+				n++;
+				crashed += r.status == SIM_CRASHED;
+				bin_cte.push_back(r.cte_rms);
+				if(r.status == SIM_DONE)
+				{
+					bin_best.push_back(r.best);
+				}
+			}
+			char range[32];
+			snprintf(range, sizeof(range), "%.4g..%.4g", lo, hi);
+			printf("%-16s %-19s %5u %7.0f%% %9.3f %9.3f\n", b ? "" : ranges[p].name, range, n, n ? 100.0f*crashed/n : 0.0f,
+				average(bin_best), average(bin_cte));
+		}
+	}
+
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+	{
+		return shared->result[a].best < shared->result[b].best;
+	});
+	printf("\nfastest runs that finished\n%6s %9s %8s", "run", "best lap", "cte rms");
+	for(size_t p = 0; p < ranges.size(); p++)
+	{
+		printf(" %14s", ranges[p].name);
+	}
+	printf("\n");
+	for(size_t k = 0; k < order.size() && k < top; k++)
+	{
+		SWEEP_RESULT &r = shared->result[order[k]];
+		printf("%6u %9.3f %8.3f", order[k], r.best, r.cte_rms);
+		for(size_t p = 0; p < ranges.size(); p++)
+		{
+			printf(" %14.5g", r.value[p]);
+		}
+		printf("\n");
+	}
+
+	if(csv)
+	{
+		FILE *f = fopen(csv, "w");
+		if(!f)
+		{
+			fprintf(stderr, "can't write %s\n", csv);
+			return 1;
+		}
+		fprintf(f, "run,seed,status,laps,best,mean,cte_rms,cte_max,top_speed,car_seconds,late,overruns,worker");
+		for(size_t p = 0; p < ranges.size(); p++)
+		{
+			fprintf(f, ",%s", ranges[p].name);
+		}
+		fprintf(f, "\n");
+		for(uint32_t i = 0; i < runs; i++)
+		{
+			SWEEP_RESULT &r = shared->result[i];
+			fprintf(f, "%u,%u,%d,%u,%.4f,%.4f,%.4f,%.4f,%.3f,%.3f,%u,%u,%d", i, seed + i, r.status, r.laps, r.best, r.mean,
+				r.cte_rms, r.cte_max, r.top_speed, r.car_seconds, r.late, r.overruns, r.worker);
+			for(size_t p = 0; p < ranges.size(); p++)
+			{
+				fprintf(f, ",%.6g", r.value[p]);
+			}
+			fprintf(f, "\n");
+		}
+		fclose(f);
+	}
+	munmap(shared, bytes);
+	return 0;
+}
@@ -0,0 +1,116 @@
+#ifndef _AHRS_H_
+#define _AHRS_H_
+#include"SIDMATH.h"
+#include"Arduino.h"
+
+//attitude as a quaternion, what MPU9150::compute_All runs instead of its Euler update with setAHRS(MPU_AHRS_QUATERNION).
+//The Euler update carries roll, pitch and mh as three angles, so every cycle it needs cosf/sinf of roll and pitch to couple the
+//gyro axes, my_asin on the accelerometer to correct them, and mh has to be put back in [0, 360) by hand. A quaternion takes the
+//gyro as a product, the tilt that the rest of compute_All wants (Ha, La) comes out of it as it is, and a heading correction is a
+//small turn about the vertical whatever the heading is. No cosf/sinf/atan2f in a cycle, and my_asin/my_atan2 for the angles
+//the rest of the car reads only with the mag (MAG_UPDATE_RATE, 100Hz, every 4th cycle) : every cycle mh just turns by the gyro
+//about the vertical.
+//
+//complementary filter with the gyro bias as its integral term (Mahony) :
+//	update(w, f, k, b, h)   q <- q (1, (w + AHRS_KP k e) h/2), e the turn that takes our up onto the accelerometer's, and the
+//	                        roll/pitch bias b (deg/s) walks with AHRS_KI k e. w in rad/s in the car's axes (x right, y forward,
+//	                        z up) with b already off, f the accelerometer with gravity in it (up is +). k in [0, 1] is how
+//	                        much the accelerometer is worth this cycle (1 when the car isn't accelerating)
+//	turn(d)                 d degrees about the vertical, for the mag
+//
+//q takes the car's axes to East, North, up. up() is the vertical in the car's axes : sin(pitch) = up[1] and sin(roll) = -up[0],
+//the relation compute_All's accelerometer correction has always used (pitch = asin(A[1]/g)). heading() is where the nose (y)
+//points, degrees counter clockwise from East in [0, 360), same as marg.mh.
+//
+//every step turns q by a few millidegrees, so its norm stays within 1e-5 of 1 and the normalization is the first order
+//1/sqrt(n) = (3 - n)/2, no square root.
+
+#define AHRS_KP (float) 2.0f //rad/s per unit of tilt error : a ~0.5s time constant, about where the Euler update's roll/pitch gains settle
+#define AHRS_KI (float) 0.05f //rad/s^2 per unit of tilt error, the roll and pitch gyro bias
+
+class AHRS_QUATERNION
+{
+public:
+	float q[4]; //w, x, y, z
+
+	AHRS_QUATERNION()
+	{
+		q[0] = 1;
+		q[1] = q[2] = q[3] = 0;
+	}
+
+	void initialize(float roll, float pitch, float heading) //deg. the only trig, once (Setup)
+	{
+		//heading about z (the nose is North at 90), then pitch about x, then roll about y
+		float z = 0.5f*DEG2RAD*(heading - M_PIB2_DEG), x = 0.5f*DEG2RAD*pitch, y = 0.5f*DEG2RAD*roll;
+		float qz[4] = {cosf(z), 0, 0, sinf(z)}, qx[4] = {cosf(x), sinf(x), 0, 0}, qy[4] = {cosf(y), 0, sinf(y), 0};
+		float zx[4];
+		multiply(qz, qx, zx);
+		multiply(zx, qy, q);
+	}
+
+	void update(const float w[3], const float f[3], float k, float bias[3], float h)
+	{
+		//g/|f| is taken as 1 : k is only large when |f| is close to g
+		float v[3], e[3];
+		up(v);
+		float a[3] = {f[0]*G_INVERSE, f[1]*G_INVERSE, f[2]*G_INVERSE};
+		e[0] = a[1]*v[2] - a[2]*v[1]; //a x v
+		e[1] = a[2]*v[0] - a[0]*v[2];
+		e[2] = a[0]*v[1] - a[1]*v[0];
+		float p = k*AHRS_KP, hb2 = 0.5f*h;
+		float d[3] = {(w[0] + p*e[0])*hb2, (w[1] + p*e[1])*hb2, (w[2] + p*e[2])*hb2};
+		float r[4]; //q (1, d)
+		r[0] = q[0] - q[1]*d[0] - q[2]*d[1] - q[3]*d[2];
+		r[1] = q[1] + q[0]*d[0] + q[2]*d[2] - q[3]*d[1];
+		r[2] = q[2] + q[0]*d[1] - q[1]*d[2] + q[3]*d[0];
+		r[3] = q[3] + q[0]*d[2] + q[1]*d[1] - q[2]*d[0];
+		set(r);
+		float i = RAD2DEG*k*AHRS_KI*h;
+		bias[0] -= i*e[0]; //z is the mag's (turn)
+		bias[1] -= i*e[1];
+	}
+
+	void turn(float d) //deg about the vertical
+	{
+		float t = 0.5f*DEG2RAD*d;
+		float r[4] = {q[0] - t*q[3], q[1] - t*q[2], q[2] + t*q[1], q[3] + t*q[0]}; //(1, 0, 0, t) q
+		set(r);
+	}
+
+	void up(float v[3]) const //the vertical in the car's axes, third row of the rotation matrix
+	{
+		v[0] = 2*(q[1]*q[3] - q[0]*q[2]);
+		v[1] = 2*(q[2]*q[3] + q[0]*q[1]);
+		v[2] = q[0]*q[0] - q[1]*q[1] - q[2]*q[2] + q[3]*q[3];
+	}
+
+	float heading() const
+	{
+		float east = 2*(q[1]*q[2] - q[0]*q[3]); //the nose (y) in the world, second column of the rotation matrix
+		float north = q[0]*q[0] - q[1]*q[1] + q[2]*q[2] - q[3]*q[3];
+		float head = RAD2DEG*my_atan2(north, east);
+		return head < 0 ? head + M_2PI_DEG : head;
+	}
+
+private:
+	static void multiply(const float a[4], const float b[4], float r[4])
+	{
+		r[0] = a[0]*b[0] - a[1]*b[1] - a[2]*b[2] - a[3]*b[3];
+		r[1] = a[0]*b[1] + a[1]*b[0] + a[2]*b[3] - a[3]*b[2];
+		r[2] = a[0]*b[2] - a[1]*b[3] + a[2]*b[0] + a[3]*b[1];
+		r[3] = a[0]*b[3] + a[1]*b[2] - a[2]*b[1] + a[3]*b[0];
+	}
+
+	void set(const float r[4]) //normalized
+	{
+		float n = r[0]*r[0] + r[1]*r[1] + r[2]*r[2] + r[3]*r[3];
+		float s = 0.5f*(3.0f - n);
+		for(int i = 0; i < 4; i++)
+		{
+			q[i] = r[i]*s;
+		}
+	}
+};
+
+#endif
@@ -49,8 +49,12 @@
 #define LPF_THROTTLE_FREQ (float) 1.0f
 #define LPF_GAIN_THROTTLE (float) 1.0f/64.6567 //1 Hz LPF for 200Hz sample rate.
 #define C1_THROTTLE (float) 0.969067f
-#define LPF_GAIN_10 (float) 1.0f/7.31375
-#define C1_10 (float) 0.726542
+#define LPF_GAIN_10_DEFAULT (float) 1.0f/7.31375
+#define C1_10_DEFAULT (float) 0.726542
+#ifndef PARAM_SWEEP //TUNABLES.h has them otherwise
+#define LPF_GAIN_10 LPF_GAIN_10_DEFAULT
+#define C1_10 C1_10_DEFAULT
+#endif
 #define OPEN_GAIN_INVERSE (float) (1/OPEN_GAIN) //open loop throttle gain
 #define THROTTLE_TIME_CONSTANT (float) 1/(M_2PI*LPF_THROTTLE_FREQ)
 
@@ -357,14 +361,26 @@ class controller
 	//the following function takes the required Curvature, the speed of the car, the measured yaw Rate, measured horizontal accelerations and car's MODE
 	void driver(float C[2], float braking_distance, float V, float drift_ratio, float yawRate, float Ax, float Ay, uint8_t MODE, float inputs[8]) // function to operate the servo and esc.
 	{
-		La = LPF_10(3,Ax);//10 Hz low pass filter.
-		yR = yawRate*DEG2RAD;
-		Ha = LPF_10(1,Ay);//10 Hz low pass filter
+		filter(yawRate,Ax,Ay);
 		if( millis() - stamp < CONTROL_TIME)
 		{
 			return; //maintain a defined control frequency separate from observation frequency. Only used here because synchronising the time stamps across 2 objects would be difficult(sort of. could fix. create a pull request if you want it fixed)
 		}
 		stamp = millis();
+		drive(C,braking_distance,V,drift_ratio,yawRate,Ax,Ay,MODE,inputs);
+	}
+
+	//the 10Hz low pass filters have to see every observation cycle, so they are separate from the control part. 
+	void filter(float yawRate, float Ax, float Ay)
+	{
+		La = LPF_10(3,Ax);//10 Hz low pass filter.
+		yR = yawRate*DEG2RAD;
+		Ha = LPF_10(1,Ay);//10 Hz low pass filter
+	}
+
+	//the control part of driver(), without the rate limit. call filter() every observation cycle and this at CONTROL_FREQUENCY.
+	void drive(float C[2], float braking_distance, float V, float drift_ratio, float yawRate, float Ax, float Ay, uint8_t MODE, float inputs[8])
+	{
 		float LIDAR_RANGE = (inputs[7] - 1000)*0.0045;
 		LIDAR_RANGE = LIDAR_RANGE <= 4.0f ? LIDAR_RANGE : 1e2;
 		LIDAR_RANGE = max(LIDAR_RANGE,0.1);
@@ -430,7 +446,7 @@ class controller
 				V_target = VMAX; //speed setpoint is the speed limit.
 			}
 		} 
-		else if(MODE == CRUISE)
+		else if(MODE == CRUISE || MODE == MODE_NO_GPS) //no faster without the gps, the companion's fixes come in slower
 		{
 			if(V_target>SAFE_SPEED)
 			{
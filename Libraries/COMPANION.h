@@ -5,6 +5,13 @@
 #include"Arduino.h"
 #include"PARAMS.h"
 
+//a STATE_ID message is the header and X, Y in cm. The companion can put two more int16 after them : how old the position is in
+//ms when it goes out (the frame it came from plus the time to work it out) and how far off it could be in cm. msg_len tells
+//the two apart
+#define JEVOIS_STATE_LEN 12
+#define JEVOIS_STATE_TIMED_LEN 16
+#define JEVOIS_LATENCY (float) 0.12f //s, a frame and the localization. For a companion that doesn't say
+#define JEVOIS_POS_ERROR (float) 0.3f //m, same
 
 class JEVOIS //this is the class for using jevois with Lucifer, however, we can add more classes later for other higher level agents
 {
@@ -13,7 +20,11 @@ public:
 	uint8_t mode;
 	long transmit_stamp, received_stamp,failsafe_stamp;
 	bool failsafe;
+	bool scheduled; //set when the scheduler calls check/Send_State at 10Hz (see SCHEDULER.h)
 	bool IsRecording,IsBagging;
+	uint32_t rx_stamp; //micros() when poll() saw the first byte of what is waiting in Serial2
+	uint32_t message_stamp; //rx_stamp of the message check() returned
+	bool rx_waiting;
 	
 	JEVOIS()
 	{
@@ -21,8 +32,11 @@ public:
 		mode = 0x01;
 		msg_len=0;
 		failsafe = false;
+		scheduled = false;
 		IsRecording = false;
 		IsBagging = false;
+		rx_stamp = message_stamp = micros();
+		rx_waiting = false;
 	}
 	
 	int16_t rec_status()
@@ -44,6 +58,16 @@ public:
 		return;
 	}
 
+	bool due(long &stamp) //10Hz rate limit, unless the scheduler already takes care of it
+	{
+		if(scheduled || millis() - stamp > 100)
+		{
+			stamp = millis();
+			return true;
+		}
+		return false;
+	}
+
 	void write_To_Port(int16_t a,int bytes)
 	{
 	  uint8_t b[2];
@@ -57,10 +81,9 @@ public:
 	// void send_heartbeat(); 
 	void Send_State(byte MODE, float X, float Y, float heading, float dest_X, float dest_Y, float dest_Slope, float pitch, float roll, float yawRate, float velocity)
 	{
-		if(millis() - transmit_stamp > 100)
+		if(due(transmit_stamp))
 		{
 			int16_t record = int16_t(IsBagging*2) + int16_t(IsRecording);
-			transmit_stamp = millis();
 			int16_t out[12];
 			out[0] = int16_t(X*1e2);
 			out[1] = int16_t(Y*1e2);
@@ -87,21 +110,47 @@ public:
 		}
 	}// 30 bytes
 
-	void get_data(float &X, float &Y)
+	//background. check() only looks at the port at 10Hz, a message can sit in the buffer for most of 100ms before that. The time it
+	//came in is what get_data() needs to know how old the position is
+	void poll()
+	{
+		if(!rx_waiting && Serial2.available())
+		{
+			rx_stamp = micros();
+			rx_waiting = true;
+		}
+	}
+
+	//the payload of a STATE_ID message. age is s since the frame the position came from, error in m. false if the message is
+	//too short to have a position in it
+	bool get_data(float &X, float &Y, float &age, float &error)
 	{
-		X = float(int16_t(Serial2.read()|int16_t(Serial2.read()<<8) ) )*1e-2; //coordinates transfered wrt to origin, converted 
-		Y = float(int16_t(Serial2.read()|int16_t(Serial2.read()<<8) ) )*1e-2; //coordinates transfered wrt to origin, converted 
+		bool ok = msg_len >= JEVOIS_STATE_LEN;
+		if(ok)
+		{
+			X = float(int16_t(Serial2.read()|int16_t(Serial2.read()<<8) ) )*1e-2; //coordinates transfered wrt to origin, converted 
+			Y = float(int16_t(Serial2.read()|int16_t(Serial2.read()<<8) ) )*1e-2; //coordinates transfered wrt to origin, converted 
+			age = JEVOIS_LATENCY;
+			error = JEVOIS_POS_ERROR;
+			if(msg_len >= JEVOIS_STATE_TIMED_LEN)
+			{
+				age = float(int16_t(Serial2.read()|int16_t(Serial2.read()<<8) ) )*1e-3;
+				error = float(int16_t(Serial2.read()|int16_t(Serial2.read()<<8) ) )*1e-2;
+			}
+			age += (micros() - message_stamp)*1e-6f; //plus the time it waited for us
+		}
 		int16_t n = Serial2.available();
 		for(uint8_t i = 0;i<n;i++)
 			Serial2.read(); //clear the buffer
+		rx_waiting = false;
+		return ok;
 	}
 
 	int16_t check()
 	{
 		int16_t START_ID=0x00FE,message_ID;
-		if(millis() - received_stamp > 100) //10 Hz 
+		if(due(received_stamp)) //10 Hz 
 		{
-			received_stamp = millis();
 			if(Serial2.available())
 			{
 				failsafe_stamp = millis();
@@ -111,6 +160,8 @@ public:
 					msg_len = Serial2.read()|int16_t(Serial2.read()<<8); //length of packet
 					message_ID = Serial2.read()|int16_t(Serial2.read()<<8);	
 					mode = Serial2.read()|int16_t(Serial2.read()<<8); 
+					message_stamp = rx_stamp;
+					rx_waiting = false; //anything after this message gets its own stamp
 					failsafe = false;
 					return message_ID;
 				}
@@ -120,6 +171,7 @@ public:
 					{
 						Serial2.read();
 					}
+					rx_waiting = false;
 				}
 			}
 			if(millis() - failsafe_stamp > 1000)
@@ -12,14 +12,25 @@ class GCS
 public:
 	int16_t msg_len;
 	uint8_t mode;
-	long transmit_stamp, received_stamp,failsafe_stamp;
+	long transmit_stamp, received_stamp,failsafe_stamp,profile_stamp;
 	bool failsafe = false;
+	bool scheduled = false; //set when the scheduler calls check/Send_State at 10Hz (see SCHEDULER.h)
 	GCS()
 	{
-		received_stamp = transmit_stamp = failsafe_stamp = millis();
+		received_stamp = transmit_stamp = failsafe_stamp = profile_stamp = millis();
 		mode = 0x01;
 	}
 	
+	bool due(long &stamp) //10Hz rate limit, unless the scheduler already takes care of it
+	{
+		if(scheduled || millis() - stamp > 100)
+		{
+			stamp = millis();
+			return true;
+		}
+		return false;
+	}
+
 	void write_To_Port(int32_t a,int bytes)
 	{
 	  uint8_t b[4];
@@ -30,15 +41,32 @@ public:
 	  }
 	}
 
-	bool Get_Offsets(int16_t A[3], int16_t G[3], int16_t M[3], int16_t &T,int16_t gain[3])
+	void Request_Offsets()
 	{
-		uint8_t i;
-		int16_t START_ID, message_ID, len;
-		
 		write_To_Port(START_SIGN,2);//start sign
 		write_To_Port(8,2); 		//length of payload
 		write_To_Port(OFFSET_ID,2); //tell the GCS that I want them sweet sweet offsets.
 		write_To_Port(0x01,2);
+	}
+
+	//the payload of an OFFSET_ID message, after check() returned it with msg_len == 28
+	void Read_Offsets(int16_t A[3], int16_t G[3], int16_t M[3], int16_t &T,int16_t gain[3])
+	{
+		for(uint8_t i=0;i<3;i++)
+		{
+			A[i] = Serial.read()|int16_t(Serial.read()<<8);
+			G[i] = Serial.read()|int16_t(Serial.read()<<8);
+			M[i] = Serial.read()|int16_t(Serial.read()<<8);
+			gain[i] = Serial.read()|int16_t(Serial.read()<<8);
+		}
+		T = Serial.read()|int16_t(Serial.read()<<8);
+	}
+
+	bool Get_Offsets(int16_t A[3], int16_t G[3], int16_t M[3], int16_t &T,int16_t gain[3]) //blocking, 1 second. the startup in LUCIFER.ino uses the two above instead
+	{
+		int16_t START_ID, message_ID, len;
+		
+		Request_Offsets();
 
 		delay(1000);//wait 1 second for the data to come in
 		if(Serial.available())
@@ -51,14 +79,7 @@ public:
 				Serial.read()|int16_t(Serial.read()<<8);//waste
 				if(message_ID==OFFSET_ID && len == 28)//confirm that you are getting the offsets and nothing else.
 				{
-					for(i=0;i<3;i++)//computer has offsets
-					{
-						A[i] = Serial.read()|int16_t(Serial.read()<<8);
-						G[i] = Serial.read()|int16_t(Serial.read()<<8);
-						M[i] = Serial.read()|int16_t(Serial.read()<<8);
-						gain[i] = Serial.read()|int16_t(Serial.read()<<8);
-					}
-					T = Serial.read()|int16_t(Serial.read()<<8);
+					Read_Offsets(A,G,M,T,gain);//computer has offsets
 					return 1;
 				}
 				else
@@ -155,9 +176,8 @@ public:
 
 	bool Send_WP(float X, float Y, float slope,int16_t point)
 	{
-		if(millis() - transmit_stamp > 100)
+		if(due(transmit_stamp))
 		{
-			transmit_stamp = millis();
 			int x = int16_t(X*1e2);
 			int y = int16_t(Y*1e2);
 			int m = int16_t(slope*1e2);
@@ -196,9 +216,8 @@ public:
 	// void send_heartbeat(); 
 	void Send_State(byte mode,double lon, double lat,double gps_lon, double gps_lat, float vel, float heading, float pitch, float roll,float Accel, float opError, float pError, float head_Error, float VelError, float Time, float Hdop, int16_t comp_status)//position(2), speed(1), heading(1), acceleration(1), Position Error
 	{
-		if(millis() - transmit_stamp > 100)
+		if(due(transmit_stamp))
 		{
-			transmit_stamp = millis();
 			long out[15];
 			out[0] = lon*1e7;
 			out[1] = lat*1e7;//hopefully this is correct
@@ -227,13 +246,34 @@ public:
 		}
 	}// 30 bytes
 
+	//timing of one loop phase. The phases are sent one after the other at 10Hz, so the GCS gets the whole table every second.
+	bool Send_Profile(uint8_t phase, uint16_t min_us, uint16_t mean_us, uint16_t max_us, uint16_t p99_us, uint16_t overruns, uint32_t samples)
+	{
+		if(millis() - profile_stamp > 100)
+		{
+			profile_stamp = millis();
+			write_To_Port(START_SIGN,2);
+			write_To_Port(24,2);
+			write_To_Port(PROFILE_ID,2);
+			write_To_Port(0x01,2);//mode
+			write_To_Port(phase,2);
+			write_To_Port(min_us,2);
+			write_To_Port(mean_us,2);
+			write_To_Port(max_us,2);
+			write_To_Port(p99_us,2);
+			write_To_Port(overruns,2);
+			write_To_Port(samples,4);
+			return 1;
+		}
+		return 0;
+	}// 24 bytes
+
 	uint16_t check()
 	{
 		uint16_t START_ID,message_ID;
 
-		if(millis() - received_stamp > 100) //10 Hz 
+		if(due(received_stamp)) //10 Hz 
 		{
-			received_stamp = millis();
 			if(Serial.available())
 			{
 				failsafe_stamp = millis();
@@ -0,0 +1,95 @@
+#ifndef _ENU_H_
+#define _ENU_H_
+
+#include"Arduino.h"
+#include"SIDMATH.h"
+
+//local East-North plane around an origin. Goes between lon/lat the way the receiver gives them (int32, 1e-7 deg, straight
+//out of NAV-PVT) and the X (East), Y (North) meters that everything else works in. The scales are worked out once for the
+//origin's latitude on the WGS84 ellipsoid : a degree of latitude is 110.6-111.7km depending on where you are, a degree of
+//longitude is about that times cos(latitude). After that a position is an integer subtraction and a few float multiplies,
+//no double math (the STM32F103 does doubles in software and it shows).
+//
+//a float has 24 bits, so the 1e-7 deg deltas are exact up to ~1.6 degrees from the origin and the meters are good to well
+//under a cm anywhere a car can get to. The longitude scale shrinks as you go north, that is kept to first order (leaving it
+//out is ~9cm wrong 1km east and 1km north of the origin).
+
+#define WGS84_A (double) 6378137.0 //semi-major axis, m
+#define WGS84_E2 (double) 6.69437999014e-3 //first eccentricity squared
+#define ENU_RAD (double) 1.7453292519943295e-9 //radians in 1e-7 deg
+#define ENU_RESCALE (int32_t) 100000 //1e-7 deg, ~1km. An origin moved further than this gets its scales worked out again (keeping
+                                   //them over 1km north is ~0.02% at 45 deg, a few cm where a car goes)
+
+static inline int32_t enu_round(float x)
+{
+	return int32_t(x + (x < 0 ? -0.5f : 0.5f));
+}
+
+class ENU
+{
+public:
+	int32_t lon0, lat0; //origin, 1e-7 deg
+	float east, north; //m per 1e-7 deg at the origin
+	float east_rate; //how much east shrinks for every 1e-7 deg north of the origin, relative
+	float inv_east, inv_north;
+
+	ENU()
+	{
+		set_origin(0, 0);
+	}
+
+	//the only place with trig and doubles in it. once, when the origin is set
+	void set_origin(int32_t lon, int32_t lat)
+	{
+		double phi = double(lat)*ENU_RAD;
+		double s = sin(phi), c = cos(phi);
+		double w = 1.0 - WGS84_E2*s*s;
+		double N = WGS84_A/sqrt(w); //radius of curvature along the parallel
+		double M = N*(1.0 - WGS84_E2)/w; //and along the meridian
+		north = float(M*ENU_RAD);
+		east = float(N*c*ENU_RAD);
+		east_rate = float(M*s*ENU_RAD/(N*c));
+		inv_north = 1.0f/north;
+		inv_east = 1.0f/east;
+		move_origin(lon, lat);
+	}
+
+	//same scales, different origin. The scales hardly change over the few km a car covers, so this needs no trig. Only for
+	//small moves (see near()) : from the equator's scales of the (0, 0) placeholder east would be 1/cos(lat) off
+	inline void move_origin(int32_t lon, int32_t lat)
+	{
+		lon0 = lon;
+		lat0 = lat;
+	}
+
+	//whether lon, lat is close enough to the origin for its scales to still hold, i.e. whether move_origin() will do
+	inline bool near(int32_t lon, int32_t lat)
+	{
+		return abs(lat - lat0) < ENU_RESCALE && abs(lon - lon0) < ENU_RESCALE;
+	}
+
+	inline void project(int32_t lon, int32_t lat, float &X, float &Y)
+	{
+		float dlat = float(lat - lat0);
+		Y = dlat*north;
+		X = float(lon - lon0)*east*(1.0f - dlat*east_rate);
+	}
+
+	//X, Y -> how far the point is from the origin in 1e-7 deg
+	inline void offset(float X, float Y, int32_t &dlon, int32_t &dlat)
+	{
+		float lat_delta = Y*inv_north;
+		dlat = enu_round(lat_delta);
+		dlon = enu_round(X*inv_east*(1.0f + lat_delta*east_rate));
+	}
+
+	inline void unproject(float X, float Y, int32_t &lon, int32_t &lat)
+	{
+		int32_t dlon, dlat;
+		offset(X, Y, dlon, dlat);
+		lon = lon0 + dlon;
+		lat = lat0 + dlat;
+	}
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef _FIX16_H_
+#define _FIX16_H_
+#include<stdint.h>
+
+//Q16.16 fixed point : 16 bits of integer, 16 of fraction. Range +-32768, steps of 1.5e-5. The F103 has no FPU, a soft float
+//multiply is ~80 cycles where this is a 32x32->64 multiply and a shift (a few cycles). Divide is a 64 bit divide, still cheaper
+//than the soft float one. For Matrix<R,C,FIX16> (MATRIX.h) : keep the numbers well inside the range, a covariance in m^2 of a
+//car that is 200m away from the origin already isn't.
+//No saturation, overflow wraps like the int32_t it is.
+
+#define FIX16_ONE 65536
+
+class FIX16
+{
+public:
+	int32_t v;
+
+	FIX16()
+	{
+	}
+
+	FIX16(int i) : v(int32_t(i)*FIX16_ONE)
+	{
+	}
+
+	FIX16(float f) : v(int32_t(f*FIX16_ONE + (f < 0 ? -0.5f : 0.5f)))
+	{
+	}
+
+	FIX16(double f) : v(int32_t(f*FIX16_ONE + (f < 0 ? -0.5 : 0.5)))
+	{
+	}
+
+	static FIX16 raw(int32_t r)
+	{
+		FIX16 x;
+		x.v = r;
+		return x;
+	}
+
+	explicit operator float() const
+	{
+		return float(v)*(1.0f/FIX16_ONE);
+	}
+
+	FIX16 operator-() const
+	{
+		return raw(-v);
+	}
+
+	FIX16 operator+(FIX16 b) const
+	{
+		return raw(v + b.v);
+	}
+
+	FIX16 operator-(FIX16 b) const
+	{
+		return raw(v - b.v);
+	}
+
+	FIX16 operator*(FIX16 b) const
+	{
+		return raw(int32_t((int64_t(v)*b.v + (FIX16_ONE/2)) >> 16)); //rounded
+	}
+
+	FIX16 operator/(FIX16 b) const
+	{
+		return raw(int32_t((int64_t(v) << 16)/b.v));
+	}
+
+	FIX16 &operator+=(FIX16 b)
+	{
+		v += b.v;
+		return *this;
+	}
+
+	FIX16 &operator-=(FIX16 b)
+	{
+		v -= b.v;
+		return *this;
+	}
+
+	FIX16 &operator*=(FIX16 b)
+	{
+		return *this = *this*b;
+	}
+
+	FIX16 &operator/=(FIX16 b)
+	{
+		return *this = *this/b;
+	}
+
+	bool operator<(FIX16 b) const
+	{
+		return v < b.v;
+	}
+
+	bool operator>(FIX16 b) const
+	{
+		return v > b.v;
+	}
+};
+
+#endif
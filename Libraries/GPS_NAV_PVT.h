@@ -4,8 +4,10 @@
 #include"Arduino.h"
 #include"PARAMS.h"
 #include"SIDMATH.h"
+#include"UBX.h"
 
 #define GPS_BAUD 230400
+#define GPS_NMEA_MESSAGES 20 //disableNmea()'s list
 /*
  * I call this tab the "fast_GPS" because it's faster than using the "tinyGPS" library.
  * I m using UBX-PVT protocol which, as the name suggests, gives me the POSition in Longitude,Latitude and Height
@@ -18,14 +20,12 @@
  */
 
 
-const unsigned char UBX_HEADER[] = { 0xB5, 0x62 };  //header of the incoming signal
-
-struct NAV_PVT
+struct NAV_PVT //the 4 byte fields are int32_t/uint32_t, not long, so the layout is the same on a 64 bit PC as on the STM32
 {
   unsigned char cls;  //class
   unsigned char id;   //id
   unsigned short len;  //length of packet
-  unsigned long   iTOW;       // ms       GPS time of week of the navigation epoch. See the description of iTOW for 
+  uint32_t        iTOW;       // ms       GPS time of week of the navigation epoch. See the description of iTOW for 
   unsigned short  year;       // y        Year UTC
   unsigned char   month;      // month    Month, range 1..12 UTC
   unsigned char   day;        // d        Day of month, range 1..31 UTC
@@ -33,41 +33,120 @@ struct NAV_PVT
   unsigned char   min;        // min      Minute of hour, range 0..59 UTC
   unsigned char   sec;        // s        Seconds of minute, range 0..60 UTC
   char            valid;      // -        Validity flags (see graphic below)
-  unsigned long   tAcc;       // ns       Time accuracy estimate UTC
-  long            nano;       // ns       Fraction of second, range -1e9..1e9 UTC
+  uint32_t        tAcc;       // ns       Time accuracy estimate UTC
+  int32_t         nano;       // ns       Fraction of second, range -1e9..1e9 UTC
   unsigned char   fixType;    // -        GNSSfix Type, range 0..5
   char            flags;
   char            flags2;
   unsigned char   numSV;
-  long            lon;  //1e-7
-  long            lat;  //1e-7
-  long            height; //1e-3
-  long            hMSL; //1e-3
-  unsigned long   hAcc; //1e-3
-  unsigned long   vAcc; //1e-3
-  long            velN; //1e-3
-  long            velE; //1e-3
-  long            velD; //1e-3
-  long            gSpeed; //1e-3
-  long            headMot; //1e-5
-  unsigned long   sAcc; //1e-3;
-  unsigned long   headAcc;//1e-5
+  int32_t         lon;  //1e-7
+  int32_t         lat;  //1e-7
+  int32_t         height; //1e-3
+  int32_t         hMSL; //1e-3
+  uint32_t        hAcc; //1e-3
+  uint32_t        vAcc; //1e-3
+  int32_t         velN; //1e-3
+  int32_t         velE; //1e-3
+  int32_t         velD; //1e-3
+  int32_t         gSpeed; //1e-3
+  int32_t         headMot; //1e-5
+  uint32_t        sAcc; //1e-3;
+  uint32_t        headAcc;//1e-5
   unsigned short  pDOP;//1e-2
   unsigned char   reserved1[6];
-  long            headVeh;//1e-5
+  int32_t         headVeh;//1e-5
   short           magDec; //1e-2
   unsigned short  magAcc; //1e-2
 };
+#define NAV_PVT_LENGTH 92 //payload
+
+//the other messages we ask for. same layout as NAV_PVT : class, id, length, then the payload
+struct NAV_DOP
+{
+  unsigned char cls;
+  unsigned char id;
+  unsigned short len;
+  uint32_t        iTOW; // ms
+  unsigned short  gDOP; //1e-2 geometric
+  unsigned short  pDOP; //1e-2 position
+  unsigned short  tDOP; //1e-2 time
+  unsigned short  vDOP; //1e-2 vertical
+  unsigned short  hDOP; //1e-2 horizontal
+  unsigned short  nDOP; //1e-2 northing
+  unsigned short  eDOP; //1e-2 easting
+};
+#define NAV_DOP_LENGTH 18
+
+struct NAV_VELNED
+{
+  unsigned char cls;
+  unsigned char id;
+  unsigned short len;
+  uint32_t        iTOW; // ms
+  int32_t         velN; //1e-2
+  int32_t         velE; //1e-2
+  int32_t         velD; //1e-2
+  uint32_t        speed; //1e-2 3D
+  uint32_t        gSpeed; //1e-2 ground
+  int32_t         heading; //1e-5 of motion
+  uint32_t        sAcc; //1e-2
+  uint32_t        cAcc; //1e-5 heading accuracy
+};
+#define NAV_VELNED_LENGTH 36
+
+struct NAV_STATUS
+{
+  unsigned char cls;
+  unsigned char id;
+  unsigned short len;
+  uint32_t        iTOW; // ms
+  unsigned char   gpsFix; //same as NAV_PVT::fixType
+  char            flags; //bit 0 : gpsFixOk, the fix is within the DOP and accuracy masks
+  char            fixStat;
+  char            flags2;
+  uint32_t        ttff; // ms  time to first fix
+  uint32_t        msss; // ms  since startup
+};
+#define NAV_STATUS_LENGTH 16
+
+static_assert(sizeof(NAV_PVT) == UBX_FRAME_HEADER + NAV_PVT_LENGTH, "NAV_PVT has to match the frame byte for byte");
+static_assert(sizeof(NAV_VELNED) == UBX_FRAME_HEADER + NAV_VELNED_LENGTH, "NAV_VELNED has to match the frame byte for byte");
+static_assert(sizeof(NAV_STATUS) == UBX_FRAME_HEADER + NAV_STATUS_LENGTH, "NAV_STATUS has to match the frame byte for byte");
+static_assert(sizeof(NAV_DOP) <= UBX_FRAME_SIZE, "NAV_DOP has to fit in a UBX_RX slot"); //2 bytes of padding at the end
+
+//how old a fix is when it gets to us. The receiver puts NAV-PVT out a while after its navigation epoch and the frame then takes
+//its time on the line. Only the quickest fix is assumed to be GPS_MIN_AGE old, the rest are timed against it, see sync_clock()
+#define GPS_OUTPUT_LATENCY 50000 //us from the epoch to the first byte of NAV-PVT. M8 at 10Hz, check it on the receiver you have
+#define GPS_MIN_AGE (GPS_OUTPUT_LATENCY + (NAV_PVT_LENGTH + 8)*10000000UL/GPS_BAUD) //us, with the whole frame on the line
+#define GPS_MAX_LATE 1000000 //us. a fix this much later than the quickest one means the clocks jumped (iTOW wraps every week)
+#define GPS_CLOCK_SLEW 10 //us per fix. 100ppm at 10Hz, covers the drift between our crystal and GPS time
+
 class GPS
 {
 public:
-  NAV_PVT pvt;
+  UBX_RX rx; //the port is read by DMA and framed in the background, see UBX.h
+  //newest of each message, straight out of rx's slots. each is good until the next one of its kind comes in through localizer()
+  const NAV_PVT *pvt;
+  const NAV_DOP *dop;
+  const NAV_VELNED *velned;
+  const NAV_STATUS *status;
   // long iTOW;
   float VelNED[3],Sdop,headMot,gSpeed,headVeh,headAcc;
+  float DOP[3]; //horizontal, vertical, position. the real dilutions of precision from NAV-DOP (Hdop below is hAcc in meters). STATE gates the fixes on DOP[0]
      //object of structure NAV_PVT
-  double longitude,latitude,Hdop;//,last_longitude,last_latitude,height,last_height;
+  int32_t lon,lat; //1e-7 deg, as NAV-PVT has them. ENU.h turns them into meters
+  float Hdop;//,last_longitude,last_latitude,height,last_height;
   bool tick,configured;
+  byte config_step; //the next packet configure() sends
+  bool fix_ok; //NAV-STATUS says the fix is within the receiver's DOP and accuracy masks. STATE doesn't use a fix without it
+  uint32_t pvt_us; //micros() when the newest NAV-PVT came in
+  uint32_t epoch_us; //micros() at its navigation epoch, the time the position is actually for
+  uint32_t clock_offset; //smallest (arrival - GPS time) seen, that's GPS_MIN_AGE plus the offset between the two clocks
+  bool clock_synced;
   uint8_t config_msg_PVT[11] = {0xB5, 0x62, 0x06, 0x01, 0x03, 0x00, 0x01, 0x07, 0x01, 0x13, 0x51};
+  uint8_t config_msg_DOP[11] = {0xB5, 0x62, 0x06, 0x01, 0x03, 0x00, 0x01, 0x04, 0x01, 0x10, 0x4B};
+  uint8_t config_msg_VELNED[11] = {0xB5, 0x62, 0x06, 0x01, 0x03, 0x00, 0x01, 0x12, 0x01, 0x1E, 0x67};
+  uint8_t config_msg_STATUS[11] = {0xB5, 0x62, 0x06, 0x01, 0x03, 0x00, 0x01, 0x03, 0x01, 0x0F, 0x49};
   uint8_t config_msg_rate[14] = {0xB5, 0x62, 0x06, 0x08, 0x06, 0x00, 0x64, 0x00, 0x01, 0x00, 0x01, 0x00, 0x7A, 0x12};
   uint8_t config_msg_baud[28] = {0xB5, 0x62, 0x06, 0x00, 0x14, 0x00, 0x01, 0x00, 0x00, 0x00, 0xD0, 0x08, 0x00, 0x00, 
              0x00, 0x84, 0x03, 0x00, 0x07, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x84, 0xE8};
@@ -77,8 +156,24 @@ public:
   GPS()
   {
     tick = false;
+    configured = false;
+    config_step = 0;
+    fix_ok = false;
+    lon = lat = 0;
+    pvt_us = epoch_us = clock_offset = 0;
+    clock_synced = false;
+    pvt = NULL;
+    dop = NULL;
+    velned = NULL;
+    status = NULL;
     Hdop = 10000; //initial Hdop. This helps me differentiate whether data came in from gps or if gps has not even initialized yet.
     Sdop = 10000;
+    DOP[0] = DOP[1] = DOP[2] = 99.99;
+    rx.owner = this;
+    rx.add(0x01, 0x07, NAV_PVT_LENGTH, on_pvt);
+    rx.add(0x01, 0x04, NAV_DOP_LENGTH, on_dop);
+    rx.add(0x01, 0x12, NAV_VELNED_LENGTH, on_velned);
+    rx.add(0x01, 0x03, NAV_STATUS_LENGTH, on_status);
   }
 
   void sendPacket(uint8_t *packet, byte len) //send commands to gps for configuration purposes
@@ -89,10 +184,10 @@ public:
       }
   }
 
-  void disableNmea() //diable the god awful NMEA messages. This code was copied from https://github.com/1oginov/UbxGps
+  void disableNmea(byte i) //diable the god awful NMEA messages, the i'th of them. This code was copied from https://github.com/1oginov/UbxGps
   {
       // Array of two bytes for CFG-MSG packets payload.
-      byte messages[][2] = {
+      static const byte messages[GPS_NMEA_MESSAGES][2] = {
           {0xF0, 0x0A},
           {0xF0, 0x09},
           {0xF0, 0x00},
@@ -134,102 +229,32 @@ public:
       // Offset to the place where payload starts.
       byte payloadOffset = 6;
 
-      // Iterate over the messages array.
-      for (byte i = 0; i < sizeof(messages) / sizeof(*messages); i++)
+      // Copy two bytes of payload to the packet buffer.
+      for (byte j = 0; j < sizeof(*messages); j++)
       {
-          // Copy two bytes of payload to the packet buffer.
-          for (byte j = 0; j < sizeof(*messages); j++)
-          {
-              packet[payloadOffset + j] = messages[i][j];
-          }
-
-          // Set checksum bytes to the null.
-          packet[packetSize - 2] = 0x00;
-          packet[packetSize - 1] = 0x00;
-
-          // Calculate checksum over the packet buffer excluding sync (first two) and checksum chars (last two).
-          for (byte j = 0; j < packetSize - 4; j++)
-          {
-              packet[packetSize - 2] += packet[2 + j];
-              packet[packetSize - 1] += packet[packetSize - 2];
-          }
-
-          sendPacket(packet, packetSize);
+          packet[payloadOffset + j] = messages[i][j];
       }
-  }
 
+      // Calculate checksum over the packet buffer excluding sync (first two) and checksum chars (last two).
+      for (byte j = 0; j < packetSize - 4; j++)
+      {
+          packet[packetSize - 2] += packet[2 + j];
+          packet[packetSize - 1] += packet[packetSize - 2];
+      }
 
-  void calcChecksum(unsigned char* CK)    //function to calculate expected checksum 
-  {   
-    memset(CK, 0, 2);
-    for (int i = 0; i < (int)sizeof(NAV_PVT); i++) 
-    {
-      CK[0] += ((unsigned char*)(&pvt))[i];
-      CK[1] += CK[0];
-    }
+      sendPacket(packet, packetSize);
   }
 
-bool processGPS()    //bool function to tell us whether all the data has come in or not
-  {
-    static int fpos = 0;                //variable to keep a track of where we are in the structure
-    static unsigned char checksum[2];       //variables for storing checksum given in the message
-    const int payloadSize = sizeof(NAV_PVT);     //size of payload
 
-    while ( Serial1.available() ) //while there is something on the UART/serial port. 
-    {
-      byte c = Serial1.read();  //put data read from serial port into c
-      if ( fpos < 2 )              //checking for first 2 bits of data 
-      {
-        if ( c == UBX_HEADER[fpos] )  //if the data in the first 2 bits matches up with the known standard first 2 bits, increment fpos
-          fpos++;
-        else
-          fpos = 0;
-      }
-      
-      else                            //when fpos>2 
-      {
-        if ( (fpos-2) < payloadSize )                   //when the first 2 bits of data have been read   
-        {  
-          ((unsigned char*)(&pvt))[fpos-2] = c;  //put the next bits of data into the object pvt of structure NAV_PVT by simply incrementing the position at which the data 
-        }                                           //is being written rather than mentioning the name of the data etc    
-        fpos++;                                     //i feel this should be fpos+=sizeof(c) because this didn't run properly in turbo c++
-                                                    //it could be possible that in arduino IDE, incrementing the position implicitly means going to the next variable space.
-        if ( fpos == (payloadSize+2) )  //when payload has been read, calculate the expected checksum 
-        {
-          calcChecksum(checksum);
-        }
-        else if ( fpos == (payloadSize+3) ) //compare our checksum with the given checksum
-        {
-          if ( c != checksum[0] )
-            fpos = 0;                   //if checksum fails, the data can't be trusted, hence, move fpos back to 0
-        }
-        else if ( fpos == (payloadSize+4) )   // compare given checksum with our checksum
-        {
-          fpos = 0;
-          if ( c == checksum[1] ) 
-          {
-            return true;     //data is valid, return true to indicate that we should now look at the data 
-          }
-        }
-        else if ( fpos > (payloadSize+4) )  //when the entire sentence has been parsed, move fpos back to 0 
-        {
-          fpos = 0;
-        }
-      }
-    }
-    return false;
+  //the background task. frames whatever the DMA has brought in once the line goes idle, see UBX.h
+  inline void receive()
+  {
+    rx.poll();
   }
-  inline void updategps()  //make sure that you have while(!processGPS()){} before calling this if you are relying on an update from this function
+
+  inline void set_course(int32_t heading) //1e-5 deg clockwise from north -> our convention
   {
-      longitude = double(pvt.lon)*1e-7;
-      latitude = double(pvt.lat)*1e-7;
-      Hdop= double(pvt.hAcc)*1e-3; //HAcc in meters.
-      VelNED[0] = float(pvt.velN)*1e-3;
-      VelNED[1] = float(pvt.velE)*1e-3;
-      VelNED[2] = float(pvt.velD)*1e-3;
-      Sdop = float(pvt.sAcc)*1e-2; //has been pre-multiplied by 10
-      gSpeed = fast_sqrt(VelNED[0]*VelNED[0] + VelNED[1]*VelNED[1]);
-      headMot = float(pvt.headMot)*1e-5;
+      headMot = float(heading)*1e-5;
       headMot = -headMot;
       headMot += M_PIB2_DEG;
       if(headMot >= M_2PI_DEG) // the headMot must be within [0.0,360.0]
@@ -240,125 +265,168 @@ bool processGPS()    //bool function to tell us whether all the data has come in
       {
         headMot += M_2PI_DEG;
       }
-      headAcc = float(pvt.headAcc)*1e-4; //has been pre-multiplied by 10. supposed to be 1e-5
-  }
-  void localizer() //function to figure out our original location. not inline because it is called only once
-  {
-    tick = false;//falsify tick so that we know a new message was actually received
-    if(processGPS())
-    {
-      updategps();
-      tick = true; // this tick is used to signify that new gps data has arrived.
-    }
   }
 
-  bool initialize()
+  inline void updategps()  //only after localizer() found a new pvt
   {
-    long timeout = millis();
-    while(millis()-timeout < 300)
-    {
-      localizer();
-      if(tick)
+      lon = pvt->lon;
+      lat = pvt->lat;
+      Hdop= float(pvt->hAcc)*1e-3f; //HAcc in meters.
+      VelNED[0] = float(pvt->velN)*1e-3;
+      VelNED[1] = float(pvt->velE)*1e-3;
+      VelNED[2] = float(pvt->velD)*1e-3;
+      Sdop = float(pvt->sAcc)*1e-2; //has been pre-multiplied by 10
+      gSpeed = fast_sqrt(VelNED[0]*VelNED[0] + VelNED[1]*VelNED[1]);
+      set_course(pvt->headMot);
+      headAcc = float(pvt->headAcc)*1e-4; //has been pre-multiplied by 10. supposed to be 1e-5
+      //a receiver set up by older firmware only sends NAV-PVT. Until NAV-STATUS and NAV-DOP have been seen, its own gnssFixOK
+      //and pDOP stand in for them (pDOP is never less than hDOP, so the gate only gets stricter)
+      if(status == NULL)
       {
-        break;
+        fix_ok = pvt->flags & 0x01;
+      }
+      if(dop == NULL)
+      {
+        DOP[0] = DOP[2] = float(pvt->pDOP)*1e-2;
       }
-    }
-    if(!tick)
-    {
-      Serial1.flush();
-      Serial1.begin(9600);
-      disableNmea();
-      sendPacket(config_msg_PVT,sizeof(config_msg_PVT));
-      delay(100);
-      sendPacket(config_msg_rate,sizeof(config_msg_rate));
-      delay(100);
-      sendPacket(config_msg_baud,sizeof(config_msg_baud));
-      Serial1.flush();
-      Serial1.begin(GPS_BAUD);//reset baud.
-      
-      sendPacket(config_msg_save,sizeof(config_msg_save));
-      delay(100);
-      localizer();
-    }
-    return tick;
   }
 
-  int8_t fix_type()
+  //a fix is for its navigation epoch (iTOW, plus the sub millisecond part out of nano), not for when it came in. Arrival time
+  //minus GPS time is the same for every fix apart from how late it was, so the smallest one so far belongs to a fix that
+  //was GPS_MIN_AGE old and every other fix is that plus however much later it came. integer math only
+  void sync_clock()
   {
-    while(!tick)
-    { 
-      localizer();
-      delay(5);
-    }
-    if(Hdop > 100)
+    int32_t frac = (pvt->nano % 1000000)/1000; //us past the millisecond
+    if(frac < 0)
     {
-      return 0;//not useful
+      frac += 1000;
     }
-    if(Hdop > 10)
+    if(frac >= 500) //iTOW is rounded to the nearest ms
     {
-      return 1;//meh
+      frac -= 1000;
     }
-    if(Hdop < 2.5)
+    uint32_t offset = pvt_us - (pvt->iTOW*1000 + frac);
+    clock_offset += GPS_CLOCK_SLEW;
+    int32_t late = int32_t(offset - clock_offset);
+    if(!clock_synced || late < 0 || late > GPS_MAX_LATE)
     {
-      return 2; //good enough
+      clock_offset = offset;
+      late = 0;
+      clock_synced = true;
     }
-    if(Hdop < 1.0)
-    {
-      return 3;//usefully accurate
-    }
-    if(Hdop < 0.6)
-    {
-      return 4;//very accurate
-    }
-    if(Hdop < 0.55)
+    epoch_us = pvt_us - (uint32_t(late) + GPS_MIN_AGE);
+  }
+
+  double longitude() //degrees, for the gcs
+  {
+    return double(lon)*1e-7;
+  }
+
+  double latitude()
+  {
+    return double(lat)*1e-7;
+  }
+
+  inline float age(uint32_t now) //seconds since the epoch of the newest fix
+  {
+    return float(now - epoch_us)*1e-6f;
+  }
+
+  //the handlers, in table order. localizer() calls them with the newest frame of their message
+  static void on_pvt(void *gps, const uint8_t *frame)
+  {
+    GPS &g = *(GPS*)gps;
+    g.pvt = (const NAV_PVT*)frame;
+    g.pvt_us = g.rx.received;
+    g.sync_clock();
+    g.updategps();
+    g.tick = true; // this tick is used to signify that new gps data has arrived.
+  }
+
+  static void on_dop(void *gps, const uint8_t *frame)
+  {
+    GPS &g = *(GPS*)gps;
+    g.dop = (const NAV_DOP*)frame;
+    g.DOP[0] = float(g.dop->hDOP)*1e-2;
+    g.DOP[1] = float(g.dop->vDOP)*1e-2;
+    g.DOP[2] = float(g.dop->pDOP)*1e-2;
+  }
+
+  static void on_velned(void *gps, const uint8_t *frame) //same velocity as NAV-PVT, so it can stand in for it when it's newer
+  {
+    GPS &g = *(GPS*)gps;
+    g.velned = (const NAV_VELNED*)frame;
+    if(g.pvt != NULL && int32_t(g.velned->iTOW - g.pvt->iTOW) <= 0) //the same epoch's NAV-PVT has it in mm/s, keep that
     {
-      return 5;//dead accurate
+      return;
     }
-    return -1; //out of bound kind of answer
+    g.VelNED[0] = float(g.velned->velN)*1e-2;
+    g.VelNED[1] = float(g.velned->velE)*1e-2;
+    g.VelNED[2] = float(g.velned->velD)*1e-2;
+    g.gSpeed = float(g.velned->gSpeed)*1e-2;
+    g.Sdop = float(g.velned->sAcc)*1e-1; //pre-multiplied by 10 like the NAV-PVT one
+    g.set_course(g.velned->heading);
+    g.headAcc = float(g.velned->cAcc)*1e-4;
   }
 
-  bool fix_initial_position()//get the averaged out value of position over a period of 1 second.
+  static void on_status(void *gps, const uint8_t *frame)
   {
+    GPS &g = *(GPS*)gps;
+    g.status = (const NAV_STATUS*)frame;
+    g.fix_ok = g.status->flags & 0x01;
+  }
 
-    double estimate_HDOP;
-    double estimate_lat,estimate_long;
-    double gain;
-    uint16_t timer,timeout;
+  void localizer() //hands whatever the background framing has finished to the handlers above. constant time, nothing is copied
+  {
+    tick = false;//falsify tick so that we know a new message was actually received
+    rx.dispatch();
+  }
 
+  void update() //for the blocking loops in setup(), where there is no background task yet : frame now, then pick it up
+  {
+    rx.on_idle();
     localizer();
-    timer = timeout = millis();
-    estimate_HDOP = Hdop; 
-    estimate_long = longitude;
-    estimate_lat = latitude;
-    if(Hdop>100000)
+  }
+
+  void begin() //after Serial1.begin(GPS_BAUD). NAV-PVT then comes in by itself if the receiver has been configured before
+  {
+    rx.begin(Serial1.c_dev(), GPS_BAUD);
+  }
+
+  //a receiver that's new (or lost its settings) talks NMEA at 9600. Turns that off, asks for our messages at 10Hz and 230400
+  //and saves it in the receiver, so this only has to happen once. One packet per call, true once the last one is out : the
+  //caller (startup_task, 10Hz) is what spaces them. A packet is ~12ms on the wire at 9600, so it's out of the tx buffer by the
+  //next call and the receiver gets the time it needs between commands without anything blocking
+  bool configure()
+  {
+    byte step = config_step++;
+    if(step == 0)
     {
-      return 0; //break if gps unavailable.
+      Serial1.begin(9600);
     }
-    //this process should take about 16 seconds tops after the gps fix has been received..
-    while(estimate_HDOP>0.0001) 
+    if(step < GPS_NMEA_MESSAGES)
     {
-      localizer();
-      if( millis() - timer > 1500 ) //1.5 seconds
-      {
-        timer = millis(); //reset timer 
-
-        gain = estimate_HDOP/(estimate_HDOP + 0.1*Hdop);
-
-        estimate_lat = gain*latitude + (1-gain)*estimate_lat ; //assuming the vehicle isn't moving
-        estimate_long = gain*longitude + (1-gain)*estimate_long ;
-        
-        estimate_HDOP *= (1-gain); //reduce error.
-      }
-      if( millis() - timeout > 15000 )//15 second time out.
-      {
-        return 0;
-      }
+      disableNmea(step);
+      return false;
     }
-
-    latitude = estimate_lat;
-    longitude = estimate_long;
-
-    return 1;
+    switch(step - GPS_NMEA_MESSAGES)
+    {
+      case 0: sendPacket(config_msg_PVT,sizeof(config_msg_PVT)); break;
+      case 1: sendPacket(config_msg_DOP,sizeof(config_msg_DOP)); break;
+      case 2: sendPacket(config_msg_VELNED,sizeof(config_msg_VELNED)); break;
+      case 3: sendPacket(config_msg_STATUS,sizeof(config_msg_STATUS)); break;
+      case 4: sendPacket(config_msg_rate,sizeof(config_msg_rate)); break;
+      case 5: sendPacket(config_msg_baud,sizeof(config_msg_baud)); break;
+      case 6:
+        Serial1.begin(GPS_BAUD);//reset baud. the baud packet went out a call ago
+        rx.begin(Serial1.c_dev(), GPS_BAUD);
+        break;
+      default:
+        sendPacket(config_msg_save,sizeof(config_msg_save));
+        configured = true;
+        return true;
+    }
+    return false;
   }
 };
 
@@ -0,0 +1,149 @@
+#ifndef _I2C_QUEUE_H_
+#define _I2C_QUEUE_H_
+
+#include"Arduino.h"
+#include<libmaple/i2c.h>
+
+//register reads that don't keep the CPU waiting for the bus. Wire (and I2Cdev on top of it) hands a transfer to libmaple's I2C
+//event interrupt and then spins until the interrupt says it's done : ~20us a byte at 400kHz, 300us for the IMU burst. This
+//starts the same transfer the same way (dev->msg, i2c_start_condition()) and returns, the interrupt moves the bytes while the
+//cycle computes. poll() notices the end and starts the next read in the queue, run it from a background task and before using
+//a result.
+//
+//usage :
+//	I2C_QUEUE bus;
+//	I2C_READ r; r.addr = 0x68; r.reg = 0x3B; r.len = 14; r.buf = buffer;
+//	bus.read(r); //returns at once
+//	...
+//	bus.poll(); if(r.state == I2C_READ_DONE) { use buffer }
+//
+//Wire and the queue share I2C1 : call flush() before anything that goes through Wire (initialize, the calibrations), it waits
+//until the queue is empty. A read that NACKs or takes longer than I2C_QUEUE_TIMEOUT_US ends up I2C_READ_FAILED, the peripheral
+//is reset the way Wire does it and the queue goes on with the next one.
+
+#define I2C_QUEUE_LENGTH 4
+#define I2C_QUEUE_TIMEOUT_US 4000 //the longest read we do is 8 FIFO records (MPU_FIFO_BUFFER), ~2.6ms at 400kHz. Past that with margin, the bus is stuck
+#define I2C_QUEUE_DEV I2C1
+
+enum I2C_READ_STATE
+{
+	I2C_READ_IDLE = 0, //never queued, or the result was taken
+	I2C_READ_QUEUED,
+	I2C_READ_BUSY, //on the bus
+	I2C_READ_DONE,
+	I2C_READ_FAILED
+};
+
+struct I2C_READ
+{
+	uint8_t addr, reg; //slave, first register
+	uint16_t len;
+	uint8_t *buf; //len bytes, don't touch until the state says it's done
+	volatile uint8_t state;
+};
+
+class I2C_QUEUE
+{
+public:
+	I2C_READ *queue[I2C_QUEUE_LENGTH];
+	uint8_t head, count; //queue[head] is on the bus when count > 0
+	uint32_t started; //micros() when queue[head] went on the bus
+	uint32_t bytes, failures; //moved without the CPU waiting, reads that failed
+
+	I2C_QUEUE()
+	{
+		head = count = 0;
+		started = 0;
+		bytes = failures = 0;
+	}
+
+	bool read(I2C_READ &r) //false if the queue is full, r isn't touched then
+	{
+		if(count == I2C_QUEUE_LENGTH)
+		{
+			return false;
+		}
+		r.state = I2C_READ_QUEUED;
+		queue[(head + count)%I2C_QUEUE_LENGTH] = &r;
+		count++;
+		if(count == 1)
+		{
+			start();
+		}
+		return true;
+	}
+
+	void poll()
+	{
+		if(count == 0)
+		{
+			return;
+		}
+		i2c_dev *dev = I2C_QUEUE_DEV;
+		I2C_READ &r = *queue[head];
+		if(dev->state == I2C_STATE_XFER_DONE)
+		{
+			dev->state = I2C_STATE_IDLE;
+			r.state = I2C_READ_DONE;
+			bytes += r.len + 1;
+		}
+		else if(dev->state == I2C_STATE_ERROR || micros() - started > I2C_QUEUE_TIMEOUT_US)
+		{
+			i2c_disable(dev); //what Wire does after an error
+			i2c_master_enable(dev, I2C_FAST_MODE);
+			r.state = I2C_READ_FAILED;
+			failures++;
+		}
+		else
+		{
+			return; //still on the bus
+		}
+		head = (head + 1)%I2C_QUEUE_LENGTH;
+		count--;
+		if(count > 0)
+		{
+			start();
+		}
+	}
+
+	void flush() //blocks until the queue is empty, so that Wire can have the bus
+	{
+		while(count > 0)
+		{
+			poll();
+		}
+	}
+
+	bool busy()
+	{
+		return count > 0;
+	}
+
+private:
+	i2c_msg msg[2]; //register address out, then the bytes in with a repeated start
+
+	void start() //what i2c_master_xfer() does before it starts waiting
+	{
+		I2C_READ &r = *queue[head];
+		msg[0].addr = r.addr;
+		msg[0].flags = 0;
+		msg[0].length = 1;
+		msg[0].xferred = 0;
+		msg[0].data = &r.reg;
+		msg[1].addr = r.addr;
+		msg[1].flags = I2C_MSG_READ;
+		msg[1].length = r.len;
+		msg[1].xferred = 0;
+		msg[1].data = r.buf;
+		r.state = I2C_READ_BUSY;
+		started = micros();
+		i2c_dev *dev = I2C_QUEUE_DEV;
+		dev->msg = msg;
+		dev->msgs_left = 2;
+		dev->state = I2C_STATE_BUSY;
+		i2c_enable_irq(dev, I2C_IRQ_EVENT);
+		i2c_start_condition(dev);
+	}
+};
+
+#endif
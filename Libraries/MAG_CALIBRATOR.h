@@ -0,0 +1,382 @@
+#ifndef _MAG_CALIBRATOR_H_
+#define _MAG_CALIBRATOR_H_
+
+#include"Arduino.h"
+#include"SIDMATH.h"
+
+//hard and soft iron calibration of the mag while the car drives, instead of mag_caliberation's nose-north-and-rotate ritual.
+//MPU9150 hands every mag sample to add() (setMagCal), together with the heading it was taken at. The samples go into a
+//bounded buffer binned by heading, MAG_CAL_DEPTH per MAG_CAL_SECTORS slice, the newest replacing the oldest, so that a fit
+//always has the whole circle and not the straight the car spent most of its time on.
+//
+//step() does one slice of the fit, from a background task : it never takes more than a few samples or one pivot per call.
+//Once every slice is full and MAG_CAL_FRESH of them have samples the last fit didn't see, it fits an ellipsoid with its axes on the sensor's axes (the
+//model MPU9150 applies : (m - offsetM)*1000/axis_gain) by least squares,
+//	a x^2 + b y^2 + c z^2 + d x + e y + f z = 1
+//in that many steps :
+//	MAG_CAL_MEAN        the samples' mean and spread, MAG_CAL_SLICE_MEAN at a time. The fit runs on the samples less the mean,
+//	                    scaled to ~1, so the normal equations stay well inside a float
+//	MAG_CAL_ACCUMULATE  the normal equations, MAG_CAL_SLICE at a time
+//	MAG_CAL_SOLVE       Gauss-Jordan on them, one pivot per step (they are positive definite, no pivoting needed)
+//	MAG_CAL_CHECK       center and radii out of a..f, against the last fit
+//A car on flat ground only turns about z, so z hardly changes and c, f can't be told apart from the constant. Unless the z
+//spread is MAG_CAL_MIN_TILT of the x/y spread the fit drops them (4 unknowns) and z keeps its offset. z's gain is scaled
+//by as much as x's and y's moved, so that it stays on the same scale as theirs whatever it was normalized to before.
+//
+//A fit that lands within MAG_CAL_OFFSET_TOLERANCE/MAG_CAL_GAIN_TOLERANCE of the one before it has converged. If it is also
+//that far from what the MPU has now, step() returns true and offset[]/gain[] have it : hand them to marg.setMagOffset().
+//gain[] is axis_gain scaled so that the corrected field is as strong as begin() was told the earth's is, horizontal for the
+//planar fit and total for the full one : tilt_Compensate measures against it (del, spike()), mag_caliberation's gains that
+//only add up to 3000 leave that off by whatever the soft iron scaled all axes by.
+//While a fit runs add() drops samples, the buffer has to stay what the fit is summing.
+
+#define MAG_CAL_SECTORS 12 //30 degree slices of the heading
+#define MAG_CAL_DEPTH 3 //samples per slice
+#define MAG_CAL_SAMPLES (MAG_CAL_SECTORS*MAG_CAL_DEPTH) //216 bytes
+#define MAG_CAL_FRESH 6 //slices with a sample the last fit didn't have, before the next fit : half a turn of new data
+#define MAG_CAL_SLICE_MEAN 12 //samples per step while taking the mean
+#define MAG_CAL_SLICE 3 //samples per step into the normal equations, ~30 multiply-adds each : ~110us for the full fit on the F103
+#define MAG_CAL_MIN_TILT (float) 0.3f
+#define MAG_CAL_OFFSET_TOLERANCE (float) 1.0f //counts
+#define MAG_CAL_GAIN_TOLERANCE (float) 0.02f //relative
+#define MAG_CAL_MAX_ELLIPTICITY (float) 1.5f //radii further apart than this are something magnetic next to the car, not soft iron
+
+enum MAG_CAL_PHASE
+{
+	MAG_CAL_COLLECT = 0,
+	MAG_CAL_MEAN,
+	MAG_CAL_ACCUMULATE,
+	MAG_CAL_SOLVE,
+	MAG_CAL_CHECK
+};
+
+class MAG_CALIBRATOR
+{
+public:
+	int16_t offset[3], gain[3]; //what the MPU has (begin) or the converged fit step() just handed out
+	uint16_t fits, swaps; //fits solved, fits handed out
+
+	MAG_CALIBRATOR()
+	{
+		for(int i = 0; i < 3; i++)
+		{
+			offset[i] = 0;
+			gain[i] = 1000;
+		}
+		fits = swaps = 0;
+		field[0] = field[1] = 1000;
+		clear();
+	}
+
+	//the MPU's offsetM and axis_gain, whenever they change from outside, and the earth's field in corrected counts
+	void begin(const int16_t off[3], const int16_t g[3], float horizontal, float total)
+	{
+		for(int i = 0; i < 3; i++)
+		{
+			offset[i] = off[i];
+			gain[i] = g[i];
+		}
+		field[0] = horizontal;
+		field[1] = total;
+		clear();
+	}
+
+	void add(const int16_t m[3], float heading) //raw counts (what offsetM comes off), heading in degrees [0, 360)
+	{
+		if(phase != MAG_CAL_COLLECT)
+		{
+			return;
+		}
+		uint8_t s = uint8_t(heading*(MAG_CAL_SECTORS/M_2PI_DEG));
+		if(s >= MAG_CAL_SECTORS)
+		{
+			s = 0;
+		}
+		int16_t *slot = sample[s*MAG_CAL_DEPTH + next[s]];
+		for(int i = 0; i < 3; i++)
+		{
+			slot[i] = m[i];
+		}
+		next[s] = (next[s] + 1)%MAG_CAL_DEPTH;
+		if(filled[s] < MAG_CAL_DEPTH)
+		{
+			filled[s]++;
+		}
+		fresh |= 1<<s;
+	}
+
+	bool step()
+	{
+		switch(phase)
+		{
+		case MAG_CAL_COLLECT:
+			if(count(fresh) >= MAG_CAL_FRESH && full())
+			{
+				for(int i = 0; i < 3; i++)
+				{
+					mean[i] = 0;
+					lo[i] = hi[i] = sample[0][i];
+				}
+				index = 0;
+				phase = MAG_CAL_MEAN;
+			}
+			return false;
+		case MAG_CAL_MEAN:
+			sum_mean();
+			return false;
+		case MAG_CAL_ACCUMULATE:
+			accumulate();
+			return false;
+		case MAG_CAL_SOLVE:
+			pivot();
+			return false;
+		default:
+			phase = MAG_CAL_COLLECT;
+			fresh = 0;
+			return check();
+		}
+	}
+
+	uint8_t state() const
+	{
+		return phase;
+	}
+
+private:
+	int16_t sample[MAG_CAL_SAMPLES][3];
+	uint8_t filled[MAG_CAL_SECTORS], next[MAG_CAL_SECTORS];
+	uint16_t fresh; //slices with a sample the last fit didn't have
+	uint8_t phase, index, n; //n unknowns : 4 (flat) or 6
+	float mean[3], lo[3], hi[3], scale;
+	float N[6][7]; //normal equations with the right hand side as the last column, solved in place
+	float last_center[3], last_radius[3];
+	float field[2]; //horizontal, total
+	bool have_last;
+
+	void clear()
+	{
+		for(int s = 0; s < MAG_CAL_SECTORS; s++)
+		{
+			filled[s] = next[s] = 0;
+		}
+		fresh = 0;
+		phase = MAG_CAL_COLLECT;
+		have_last = false;
+	}
+
+	static uint8_t count(uint16_t mask)
+	{
+		uint8_t c = 0;
+		for(; mask; mask >>= 1)
+		{
+			c += mask & 1;
+		}
+		return c;
+	}
+
+	bool full() const
+	{
+		for(int s = 0; s < MAG_CAL_SECTORS; s++)
+		{
+			if(filled[s] < MAG_CAL_DEPTH)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void sum_mean()
+	{
+		uint8_t end = min(index + MAG_CAL_SLICE_MEAN, MAG_CAL_SAMPLES);
+		for(; index < end; index++)
+		{
+			for(int i = 0; i < 3; i++)
+			{
+				float v = sample[index][i];
+				mean[i] += v;
+				lo[i] = min(lo[i], v);
+				hi[i] = max(hi[i], v);
+			}
+		}
+		if(index < MAG_CAL_SAMPLES)
+		{
+			return;
+		}
+		for(int i = 0; i < 3; i++)
+		{
+			mean[i] *= 1.0f/MAG_CAL_SAMPLES;
+		}
+		float spread = max(hi[0] - lo[0], hi[1] - lo[1]);
+		if(spread < 1.0f)
+		{
+			phase = MAG_CAL_COLLECT; //the car hasn't turned, the heading put everything in slices it wasn't in
+			fresh = 0;
+			return;
+		}
+		scale = 2.0f/spread;
+		n = hi[2] - lo[2] < MAG_CAL_MIN_TILT*spread ? 4 : 6;
+		for(int r = 0; r < 6; r++)
+		{
+			for(int c = 0; c < 7; c++)
+			{
+				N[r][c] = 0;
+			}
+		}
+		index = 0;
+		phase = MAG_CAL_ACCUMULATE;
+	}
+
+	void terms(const int16_t m[3], float phi[6]) const //the fit's regressors for one sample : squares first, then x, y (, z)
+	{
+		float u[3];
+		for(int i = 0; i < 3; i++)
+		{
+			u[i] = (m[i] - mean[i])*scale;
+		}
+		if(n == 4)
+		{
+			phi[0] = u[0]*u[0];
+			phi[1] = u[1]*u[1];
+			phi[2] = u[0];
+			phi[3] = u[1];
+			return;
+		}
+		for(int i = 0; i < 3; i++)
+		{
+			phi[i] = u[i]*u[i];
+			phi[i + 3] = u[i];
+		}
+	}
+
+	void accumulate()
+	{
+		uint8_t end = min(index + MAG_CAL_SLICE, MAG_CAL_SAMPLES);
+		float phi[6];
+		for(; index < end; index++)
+		{
+			terms(sample[index], phi);
+			for(uint8_t r = 0; r < n; r++)
+			{
+				for(uint8_t c = r; c < n; c++) //upper triangle, mirrored at the end
+				{
+					N[r][c] += phi[r]*phi[c];
+				}
+				N[r][n] += phi[r];
+			}
+		}
+		if(index < MAG_CAL_SAMPLES)
+		{
+			return;
+		}
+		for(uint8_t r = 1; r < n; r++)
+		{
+			for(uint8_t c = 0; c < r; c++)
+			{
+				N[r][c] = N[c][r];
+			}
+		}
+		index = 0;
+		phase = MAG_CAL_SOLVE;
+	}
+
+	void pivot() //one column of Gauss-Jordan
+	{
+		uint8_t p = index;
+		if(!(N[p][p] > 0))
+		{
+			phase = MAG_CAL_COLLECT; //not positive definite : the samples are all in a line or a plane the model can't take
+			fresh = 0;
+			return;
+		}
+		float s = 1.0f/N[p][p];
+		for(uint8_t c = p; c <= n; c++)
+		{
+			N[p][c] *= s;
+		}
+		for(uint8_t r = 0; r < n; r++)
+		{
+			if(r == p)
+			{
+				continue;
+			}
+			float f = N[r][p];
+			for(uint8_t c = p; c <= n; c++)
+			{
+				N[r][c] -= f*N[p][c];
+			}
+		}
+		if(++index == n)
+		{
+			phase = MAG_CAL_CHECK;
+		}
+	}
+
+	bool check() //the solution is in N[.][n]
+	{
+		uint8_t axes = n/2; //2 or 3
+		float k = 1.0f, center[3], radius[3];
+		for(uint8_t i = 0; i < axes; i++)
+		{
+			float a = N[i][n], d = N[i + axes][n];
+			if(!(a > 0))
+			{
+				return false; //a hyperboloid, not an ellipsoid
+			}
+			center[i] = -0.5f*d/a;
+			k += a*center[i]*center[i];
+		}
+		float r_min = 1e9f, r_max = 0;
+		for(uint8_t i = 0; i < axes; i++)
+		{
+			radius[i] = sqrtf(k/N[i][n])/scale; //once a fit, the square root can be a real one
+			center[i] = mean[i] + center[i]/scale;
+			r_min = min(r_min, radius[i]);
+			r_max = max(r_max, radius[i]);
+		}
+		fits++;
+		if(r_max > MAG_CAL_MAX_ELLIPTICITY*r_min)
+		{
+			have_last = false;
+			return false;
+		}
+		bool converged = have_last;
+		for(uint8_t i = 0; i < axes; i++)
+		{
+			converged = converged && fabs(center[i] - last_center[i]) < MAG_CAL_OFFSET_TOLERANCE &&
+						fabs(radius[i] - last_radius[i]) < MAG_CAL_GAIN_TOLERANCE*radius[i];
+			last_center[i] = center[i];
+			last_radius[i] = radius[i];
+		}
+		have_last = true;
+		if(!converged)
+		{
+			return false;
+		}
+
+		//in MPU9150's terms
+		int16_t off[3], g[3];
+		float per_count = 1000/field[axes - 2];
+		float z_scale = per_count*(radius[0] + radius[1])/float(gain[0] + gain[1]); //planar : what x and y moved by
+		bool moved = false;
+		for(uint8_t i = 0; i < 3; i++)
+		{
+			off[i] = i < axes ? int16_t(lroundf(center[i])) : offset[i];
+			g[i] = int16_t(lroundf(i < axes ? per_count*radius[i] : z_scale*gain[i]));
+			moved = moved || abs(off[i] - offset[i]) > MAG_CAL_OFFSET_TOLERANCE || abs(g[i] - gain[i]) > MAG_CAL_GAIN_TOLERANCE*gain[i];
+		}
+		if(!moved)
+		{
+			return false;
+		}
+		for(uint8_t i = 0; i < 3; i++)
+		{
+			offset[i] = off[i];
+			gain[i] = g[i];
+		}
+		swaps++;
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,310 @@
+#ifndef _MATRIX_H_
+#define _MATRIX_H_
+#include<stdint.h>
+
+//fixed size matrices for the estimators, so that a filter with a few states can be written as the textbook has it instead of
+//by hand for every term. Everything lives on the stack or in the object that owns it, there is no heap and no size checks at
+//run time : the sizes are template parameters, so a product of the wrong shapes doesn't compile.
+//
+//The loops are unrolled at compile time (MATRIX_UNROLL), so a 5x5 product is 125 multiply-adds in a row with no loop counters
+//or index math left. On the STM32 the soft float calls are what it costs anyway, see lucifer_opcount's "Matrix" cases for
+//what each operation comes to. Every element of an unrolled product is code, so keep R, C in single digits.
+//
+//T is float by default. Anything with + - * / < and a constructor from int works, FIX16.h has a Q16.16 fixed point type that
+//skips the soft float library altogether. Careful with a jacobian called F : Arduino.h has an F() macro, F(0, 2) doesn't compile.
+//
+//Covariances :
+//	propagate_covariance(F, P, Q)   F P F' + Q, only the upper triangle is computed and mirrored so P stays symmetric
+//	kalman_update(x, P, H, R, y)    gain, state and Joseph form covariance update for the innovation y = z - h(x)
+//Joseph form ((I-KH) P (I-KH)' + K R K') costs more than (I-KH) P but stays symmetric and positive with a gain that isn't
+//quite optimal or numbers that are rounded (fixed point, or a float P with errors of very different size).
+
+template<uint8_t N>
+struct MATRIX_UNROLL //calls f(0) ... f(N-1), all inlined
+{
+	template<typename F>
+	static inline void run(F &f)
+	{
+		MATRIX_UNROLL<N - 1>::run(f);
+		f(uint8_t(N - 1));
+	}
+};
+
+template<>
+struct MATRIX_UNROLL<0>
+{
+	template<typename F>
+	static inline void run(F &)
+	{
+	}
+};
+
+template<uint8_t R, uint8_t C, typename T = float>
+class Matrix
+{
+public:
+	T m[R][C];
+
+	static constexpr uint8_t rows()
+	{
+		return R;
+	}
+
+	static constexpr uint8_t cols()
+	{
+		return C;
+	}
+
+	T &operator()(uint8_t i, uint8_t j)
+	{
+		return m[i][j];
+	}
+
+	const T &operator()(uint8_t i, uint8_t j) const
+	{
+		return m[i][j];
+	}
+
+	void fill(T v)
+	{
+		auto row = [&](uint8_t i)
+		{
+			auto col = [&](uint8_t j)
+			{
+				m[i][j] = v;
+			};
+			MATRIX_UNROLL<C>::run(col);
+		};
+		MATRIX_UNROLL<R>::run(row);
+	}
+
+	void zero()
+	{
+		fill(T(0));
+	}
+
+	void identity()
+	{
+		static_assert(R == C, "identity of a matrix that isn't square");
+		zero();
+		auto diag = [&](uint8_t i)
+		{
+			m[i][i] = T(1);
+		};
+		MATRIX_UNROLL<R>::run(diag);
+	}
+
+	Matrix &operator+=(const Matrix &b)
+	{
+		auto row = [&](uint8_t i)
+		{
+			auto col = [&](uint8_t j)
+			{
+				m[i][j] += b.m[i][j];
+			};
+			MATRIX_UNROLL<C>::run(col);
+		};
+		MATRIX_UNROLL<R>::run(row);
+		return *this;
+	}
+
+	Matrix &operator-=(const Matrix &b)
+	{
+		auto row = [&](uint8_t i)
+		{
+			auto col = [&](uint8_t j)
+			{
+				m[i][j] -= b.m[i][j];
+			};
+			MATRIX_UNROLL<C>::run(col);
+		};
+		MATRIX_UNROLL<R>::run(row);
+		return *this;
+	}
+
+	Matrix &operator*=(T s)
+	{
+		auto row = [&](uint8_t i)
+		{
+			auto col = [&](uint8_t j)
+			{
+				m[i][j] *= s;
+			};
+			MATRIX_UNROLL<C>::run(col);
+		};
+		MATRIX_UNROLL<R>::run(row);
+		return *this;
+	}
+
+	Matrix operator+(const Matrix &b) const
+	{
+		Matrix r = *this;
+		return r += b;
+	}
+
+	Matrix operator-(const Matrix &b) const
+	{
+		Matrix r = *this;
+		return r -= b;
+	}
+
+	Matrix operator*(T s) const
+	{
+		Matrix r = *this;
+		return r *= s;
+	}
+
+	template<uint8_t K>
+	Matrix<R, K, T> operator*(const Matrix<C, K, T> &b) const
+	{
+		Matrix<R, K, T> r;
+		auto row = [&](uint8_t i)
+		{
+			auto col = [&](uint8_t j)
+			{
+				T sum = m[i][0]*b.m[0][j];
+				auto dot = [&](uint8_t k)
+				{
+					sum += m[i][k + 1]*b.m[k + 1][j];
+				};
+				MATRIX_UNROLL<C - 1>::run(dot);
+				r.m[i][j] = sum;
+			};
+			MATRIX_UNROLL<K>::run(col);
+		};
+		MATRIX_UNROLL<R>::run(row);
+		return r;
+	}
+
+	Matrix<C, R, T> transpose() const
+	{
+		Matrix<C, R, T> r;
+		auto row = [&](uint8_t i)
+		{
+			auto col = [&](uint8_t j)
+			{
+				r.m[j][i] = m[i][j];
+			};
+			MATRIX_UNROLL<C>::run(col);
+		};
+		MATRIX_UNROLL<R>::run(row);
+		return r;
+	}
+};
+
+//A B' for a product that is known to come out symmetric (F P F', K R K'). Does the upper triangle and mirrors it
+template<uint8_t N, uint8_t K, typename T>
+Matrix<N, N, T> symmetric_product(const Matrix<N, K, T> &A, const Matrix<N, K, T> &B)
+{
+	Matrix<N, N, T> r;
+	auto row = [&](uint8_t i)
+	{
+		auto col = [&](uint8_t j)
+		{
+			if(j < i)
+			{
+				return; //the compiler drops these, i and j are constants once unrolled
+			}
+			T sum = A.m[i][0]*B.m[j][0];
+			auto dot = [&](uint8_t k)
+			{
+				sum += A.m[i][k + 1]*B.m[j][k + 1];
+			};
+			MATRIX_UNROLL<K - 1>::run(dot);
+			r.m[i][j] = r.m[j][i] = sum;
+		};
+		MATRIX_UNROLL<N>::run(col);
+	};
+	MATRIX_UNROLL<N>::run(row);
+	return r;
+}
+
+//F P F' + Q
+template<uint8_t N, typename T>
+Matrix<N, N, T> propagate_covariance(const Matrix<N, N, T> &F, const Matrix<N, N, T> &P, const Matrix<N, N, T> &Q)
+{
+	Matrix<N, N, T> FP = F*P;
+	return symmetric_product(FP, F) += Q;
+}
+
+//inverse of a symmetric positive definite matrix (an innovation covariance) by Gauss-Jordan. No pivoting, a positive definite
+//matrix doesn't need it. false if a pivot isn't positive, inv is garbage then
+template<uint8_t N, typename T>
+bool invert(const Matrix<N, N, T> &S, Matrix<N, N, T> &inv)
+{
+	Matrix<N, N, T> a = S;
+	inv.identity();
+	bool ok = true;
+	auto pivot = [&](uint8_t p)
+	{
+		T d = a.m[p][p];
+		if(!(T(0) < d))
+		{
+			ok = false;
+			return;
+		}
+		T s = T(1)/d;
+		auto scale = [&](uint8_t j)
+		{
+			a.m[p][j] *= s;
+			inv.m[p][j] *= s;
+		};
+		MATRIX_UNROLL<N>::run(scale);
+		auto eliminate = [&](uint8_t i)
+		{
+			if(i == p)
+			{
+				return;
+			}
+			T f = a.m[i][p];
+			auto sub = [&](uint8_t j)
+			{
+				a.m[i][j] -= f*a.m[p][j];
+				inv.m[i][j] -= f*inv.m[p][j];
+			};
+			MATRIX_UNROLL<N>::run(sub);
+		};
+		MATRIX_UNROLL<N>::run(eliminate);
+	};
+	MATRIX_UNROLL<N>::run(pivot);
+	return ok;
+}
+
+template<typename T>
+bool invert(const Matrix<1, 1, T> &S, Matrix<1, 1, T> &inv) //one divide
+{
+	if(!(T(0) < S.m[0][0]))
+	{
+		return false;
+	}
+	inv.m[0][0] = T(1)/S.m[0][0];
+	return true;
+}
+
+//measurement update for N states and M measurements. y is the innovation (z - h(x)), H the measurement jacobian, R the
+//measurement covariance. x and P are updated in place. false (and nothing changes) if H P H' + R can't be inverted
+template<uint8_t N, uint8_t M, typename T>
+bool kalman_update(Matrix<N, 1, T> &x, Matrix<N, N, T> &P, const Matrix<M, N, T> &H, const Matrix<M, M, T> &R,
+				   const Matrix<M, 1, T> &y)
+{
+	Matrix<N, M, T> PHt = P*H.transpose();
+	Matrix<M, N, T> HP = PHt.transpose(); //P is symmetric
+	Matrix<M, M, T> S = symmetric_product(H, HP) + R;
+	Matrix<M, M, T> Sinv;
+	if(!invert(S, Sinv))
+	{
+		return false;
+	}
+	Matrix<N, M, T> K = PHt*Sinv;
+	x += K*y;
+	//Joseph form
+	Matrix<N, N, T> A;
+	A.identity();
+	A -= K*H;
+	Matrix<N, N, T> AP = A*P;
+	Matrix<N, M, T> KR = K*R;
+	P = symmetric_product(AP, A) += symmetric_product(KR, K);
+	return true;
+}
+
+#endif
@@ -101,4 +101,57 @@ void read_config(int16_t param[20])
 	}
 }
 
+//what the car learned last time it ran, so that the next power on doesn't start from scratch. Written at SET_ORIGIN_ID and when
+//an autonomous run ends, read once in setup().
+#define WARM_START_ADDRESS 100 //after the config
+#define WARM_START_VERSION 0x5701 //change it when WARM_START changes, old records are then ignored
+
+struct WARM_START
+{
+	int32_t lon, lat; //origin, 1e-7 deg
+	float gyro_Bias[3]; //MPU9150's running estimate, deg/s
+	float AccBias; //STATE's
+	float feedback_factor; //controller's
+};
+#define WARM_START_WORDS (sizeof(WARM_START)/2)
+
+void store_warm_start(const WARM_START &w)
+{
+	uint16_t data[WARM_START_WORDS];
+	uint16_t sum = WARM_START_VERSION;
+	uint16_t add = WARM_START_ADDRESS;
+	memcpy(data, &w, sizeof(data));
+	EEPROM.write(add, WARM_START_VERSION);
+	add += 2;
+	for(uint16_t i = 0; i < WARM_START_WORDS; i++)
+	{
+		EEPROM.write(add, data[i]);
+		sum += data[i];
+		add += 2;
+	}
+	EEPROM.write(add, sum);
+}
+
+bool read_warm_start(WARM_START &w) //false if there is no record (erased flash) or it's from another version or got mangled
+{
+	uint16_t data[WARM_START_WORDS];
+	uint16_t version, check, sum = WARM_START_VERSION;
+	uint16_t add = WARM_START_ADDRESS;
+	EEPROM.read(add, &version);
+	add += 2;
+	for(uint16_t i = 0; i < WARM_START_WORDS; i++)
+	{
+		EEPROM.read(add, &data[i]);
+		sum += data[i];
+		add += 2;
+	}
+	EEPROM.read(add, &check);
+	if(version != WARM_START_VERSION || check != sum)
+	{
+		return 0;
+	}
+	memcpy(&w, data, sizeof(data));
+	return 1;
+}
+
 #endif
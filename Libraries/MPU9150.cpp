@@ -54,10 +54,23 @@ MPU9150::MPU9150() {
     pitch_Error = 0;
     roll_Error = 0;
     heading_drift = 0;
+    imu_T = 0;
+    bus = NULL;
+    ahrs = MPU_AHRS_EULER;
+    cal = NULL;
+    mag_settle = 0;
+    yaw_Bias_start = 0;
+    count_read.state = fifo_read.state = mag_read.state = I2C_READ_IDLE;
+    fifo_fill = queued = landed = 0;
+    bus_failure = fifo_reset = mag_fresh = false;
     for(int i =0;i<4;i++)
     {
-      lastG[i] = 0;
-      gyro_Bias[i] = 0;
+      if(i<3)
+      {
+        lastG[i] = 0;
+        gyro_Bias[i] = 0;
+        dTheta[i] = dVel[i] = 0;
+      }
       for(int j=0;j<2;j++)
       {
         xA[i][j] = yA[i][j] = 0; //initializing things from 0
@@ -91,6 +104,7 @@ void MPU9150::setAddress(uint8_t address)//default constructor for initializing
  */
 bool MPU9150::initialize() //initialize the gyro with the apt scaling factors.
 {
+    sync();
     setClockSource(MPU9150_CLOCK_PLL_XGYRO);
     setFullScaleGyroRange(MPU9150_GYRO_FS_2000);
     long timeout = micros();
@@ -115,6 +129,8 @@ bool MPU9150::initialize() //initialize the gyro with the apt scaling factors.
       }
     }
     setSleepEnabled(false); // thanks to Jack Elston for pointing this one out!
+    startMag();
+    startFIFO();
     pinMode(MPU_LED,OUTPUT);
     if(error_code != 0)
     {
@@ -166,18 +182,37 @@ uint8_t MPU9150::getDeviceID() {
     return buffer[0];
 }
 
-void MPU9150::readMag()
+void MPU9150::startMag()
 {
-  byte buf[6];
-
-  I2Cdev::readBytes(0x0C, 0x03, 6, buf); // get 6 bytes of data
-  m[1] = (((int16_t)buf[1]) << 8) | buf[0]; // the mag has the X axis where the accelero has it's Y and vice-versa
-  m[0] = (((int16_t)buf[3]) << 8) | buf[2]; // so I just do this switch over so that the math appears easier to me. 
-  m[2] = (((int16_t)buf[5]) << 8) | buf[4];
-
-  I2Cdev::writeByte(devAddr,0x37,0x02);
-  I2Cdev::writeByte(0x0C, 0x0A, 0x01); //enable the magnetometer
+  //the mag used to be read through the bypass : 6 bytes from the AK8975, the bypass switched on again and the next measurement
+  //started, 3 transactions every 10ms on top of readIMU. Now the MPU's own master does that on the aux bus and puts the 6 bytes
+  //right after the gyro, so readIMU gets them in the same burst.
+  I2Cdev::writeByte(devAddr, MPU9150_RA_INT_PIN_CFG, 0x00); //bypass off, the aux bus belongs to the MPU's master
+  I2Cdev::writeByte(devAddr, MPU9150_RA_SMPLRT_DIV, MPU_SAMPLE_RATE_DIV);
+  I2Cdev::writeByte(devAddr, MPU9150_RA_I2C_MST_CTRL, MPU9150_CLOCK_DIV_400); //400kHz on the aux bus
+  //slave 0 reads HXL..HZH
+  I2Cdev::writeByte(devAddr, MPU9150_RA_I2C_SLV0_ADDR, 0x80 | MPU9150_RA_MAG_ADDRESS);
+  I2Cdev::writeByte(devAddr, MPU9150_RA_I2C_SLV0_REG, MPU9150_RA_MAG_XOUT_L);
+  I2Cdev::writeByte(devAddr, MPU9150_RA_I2C_SLV0_CTRL, 0x80 | 6);
+  //slave 1 then starts the next single measurement (CNTL = 1), it is ready by the next read
+  I2Cdev::writeByte(devAddr, MPU9150_RA_I2C_SLV1_ADDR, MPU9150_RA_MAG_ADDRESS);
+  I2Cdev::writeByte(devAddr, MPU9150_RA_I2C_SLV1_REG, 0x0A);
+  I2Cdev::writeByte(devAddr, MPU9150_RA_I2C_SLV1_DO, 0x01);
+  I2Cdev::writeByte(devAddr, MPU9150_RA_I2C_SLV1_CTRL, 0x80 | 1);
+  //both only every MAG_MST_DELAY + 1 samples
+  I2Cdev::writeByte(devAddr, MPU9150_RA_I2C_SLV4_CTRL, MAG_MST_DELAY);
+  I2Cdev::writeByte(devAddr, MPU9150_RA_I2C_MST_DELAY_CTRL, (1 << MPU9150_DELAYCTRL_I2C_SLV1_DLY_EN_BIT) | (1 << MPU9150_DELAYCTRL_I2C_SLV0_DLY_EN_BIT));
+  I2Cdev::writeBit(devAddr, MPU9150_RA_USER_CTRL, MPU9150_USERCTRL_I2C_MST_EN_BIT, true);
+  return;
+}
 
+void MPU9150::startFIFO()
+{
+  //accel, temp, gyro : the FIFO gets a sample in the same order as the registers, so a record reads like 0x3B onwards
+  I2Cdev::writeByte(devAddr, MPU9150_RA_FIFO_EN, (1 << MPU9150_TEMP_FIFO_EN_BIT) | (1 << MPU9150_XG_FIFO_EN_BIT) | (1 << MPU9150_YG_FIFO_EN_BIT) |
+                    (1 << MPU9150_ZG_FIFO_EN_BIT) | (1 << MPU9150_ACCEL_FIFO_EN_BIT));
+  I2Cdev::writeBit(devAddr, MPU9150_RA_USER_CTRL, MPU9150_USERCTRL_FIFO_EN_BIT, true);
+  I2Cdev::writeBit(devAddr, MPU9150_RA_USER_CTRL, MPU9150_USERCTRL_FIFO_RESET_BIT, true);
   return;
 }
 
@@ -186,21 +221,275 @@ void MPU9150::readIMU()
   Wire.beginTransmission(devAddr);  //begin transmission with the gyro
   Wire.write(0x3B); //start reading from high byte register for accel
   Wire.endTransmission();
-  Wire.requestFrom(devAddr,14); //request 14 bytes from mpu
-  //300us for all data to be received. 
+  Wire.requestFrom(devAddr,MPU_BURST_LENGTH); //request 20 bytes from mpu
+  for(int i=0;i<MPU_BURST_LENGTH;i++)
+  {
+    buffer[i] = Wire.read();
+  }
+  parse_Motion(buffer);
+  parse_Mag(buffer + MPU_FIFO_RECORD);
+  return;
+}
+
+void MPU9150::readMag()
+{
+  Wire.beginTransmission(devAddr);
+  Wire.write(MPU9150_RA_EXT_SENS_DATA_00);
+  Wire.endTransmission();
+  Wire.requestFrom(devAddr,6);
+  for(int i=0;i<6;i++)
+  {
+    buffer[i] = Wire.read();
+  }
+  parse_Mag(buffer);
+  return;
+}
+
+uint8_t MPU9150::readFIFO()
+{
+  I2Cdev::readBytes(devAddr, MPU9150_RA_FIFO_COUNTH, 2, buffer);
+  uint16_t count = (((uint16_t)buffer[0]) << 8) | buffer[1];
+  if(count == 0)
+  {
+    imu_T = 0; //the loop came around before the next sample. the registers have the one the last call integrated
+    return 0;
+  }
+  if(count % MPU_FIFO_RECORD != 0 || count > MPU_FIFO_MAX_RECORDS*MPU_FIFO_RECORD) //overflowed (a record got cut) or fell behind
+  {
+    I2Cdev::writeBit(devAddr, MPU9150_RA_USER_CTRL, MPU9150_USERCTRL_FIFO_RESET_BIT, true);
+    readIMU(); //the reset threw the samples away, the newest one stands in for the cycle
+    scale_Raw(A,G);
+    for(int i=0;i<3;i++)
+    {
+      dTheta[i] = G[i]*dt;
+      dVel[i] = A[i]*dt;
+    }
+    imu_T = dt;
+    return 0;
+  }
+  uint8_t n = count/MPU_FIFO_RECORD;
+  Wire.beginTransmission(devAddr);
+  Wire.write(MPU9150_RA_FIFO_R_W); //the pointer stays there, every read takes the next bytes out
+  Wire.endTransmission();
+  for(uint8_t k=0;k<n;k+=MPU_FIFO_READ)
+  {
+    uint8_t len = MPU_FIFO_RECORD*min(n-k,MPU_FIFO_READ);
+    Wire.requestFrom(devAddr,len);
+    for(uint8_t i=0;i<len;i++)
+    {
+      buffer[k*MPU_FIFO_RECORD + i] = Wire.read();
+    }
+  }
+  integrate_FIFO(buffer,n);
+  return n;
+}
+
+void MPU9150::integrate_FIFO(const uint8_t *records, uint8_t n)
+{
+  //angle and velocity increments with first order coning and sculling (Savage) : a rotation that isn't about a fixed axis, or an
+  //acceleration that turns with the car, between two samples isn't just the sum of the samples. The velocity also turns with the
+  //angle the car turned through (the 1/2 alpha x vel). Everything in the car's axes at the start of the cycle, degrees and m/s.
+  //The cross products of degrees need a DEG2RAD.
+  float alpha[3] = {0,0,0}, vel[3] = {0,0,0}, coning[3] = {0,0,0}, sculling[3] = {0,0,0};
+  for(uint8_t k=0;k<n;k++)
+  {
+    parse_Motion(records + k*MPU_FIFO_RECORD);
+    float acc[3],gyro[3],dA[3],dV[3];
+    scale_Raw(acc,gyro);
+    for(int i=0;i<3;i++)
+    {
+      dA[i] = gyro[i]*MPU_SAMPLE_TIME;
+      dV[i] = acc[i]*MPU_SAMPLE_TIME;
+    }
+    for(int i=0;i<3;i++)
+    {
+      int j = (i+1)%3, l = (i+2)%3;
+      coning[i] += alpha[j]*dA[l] - alpha[l]*dA[j];
+      sculling[i] += alpha[j]*dV[l] - alpha[l]*dV[j] + vel[j]*dA[l] - vel[l]*dA[j];
+    }
+    for(int i=0;i<3;i++)
+    {
+      alpha[i] += dA[i];
+      vel[i] += dV[i];
+    }
+  }
+  //compute_All propagates with the increments over the time they cover. A and G are the same as rates, for the corrections
+  imu_T = n*MPU_SAMPLE_TIME;
+  float inv_T = 1.0f/imu_T;
+  for(int i=0;i<3;i++)
+  {
+    int j = (i+1)%3, l = (i+2)%3;
+    dTheta[i] = alpha[i] + 0.5f*DEG2RAD*coning[i];
+    dVel[i] = vel[i] + 0.5f*DEG2RAD*(alpha[j]*vel[l] - alpha[l]*vel[j] + sculling[i]);
+    G[i] = dTheta[i]*inv_T;
+    A[i] = dVel[i]*inv_T;
+  }
+}
+
+void MPU9150::setBus(I2C_QUEUE *queue)
+{
+  sync();
+  bus = queue;
+  return;
+}
+
+void MPU9150::sync()
+{
+  if(bus == NULL)
+  {
+    return;
+  }
+  do
+  {
+    bus->flush();
+    poll(); //a count that landed queues the records
+  }
+  while(bus->busy());
+  landed = 0; //whoever wanted the bus reads the FIFO on its own now
+  fifo_reset = false;
+}
+
+void MPU9150::poll()
+{
+  if(bus == NULL)
+  {
+    return;
+  }
+  bus->poll();
+  if(count_read.state == I2C_READ_DONE)
+  {
+    count_read.state = I2C_READ_IDLE;
+    uint16_t count = (((uint16_t)count_buffer[0]) << 8) | count_buffer[1];
+    if(count % MPU_FIFO_RECORD != 0 || count > MPU_FIFO_BUFFER) //same as readFIFO, compute_All does the reset (a write, through Wire)
+    {
+      fifo_reset = true;
+    }
+    else if(count > 0)
+    {
+      queued = count/MPU_FIFO_RECORD;
+      fifo_read.addr = devAddr;
+      fifo_read.reg = MPU9150_RA_FIFO_R_W;
+      fifo_read.len = count; //all of them in one transfer, the queue doesn't have Wire's 32 byte buffer
+      fifo_read.buf = fifo_buffer[fifo_fill];
+      bus->read(fifo_read);
+    }
+  }
+  if(fifo_read.state == I2C_READ_DONE)
+  {
+    fifo_read.state = I2C_READ_IDLE;
+    landed = queued;
+    fifo_fill ^= 1; //the next read goes into the other half
+  }
+  if(mag_read.state == I2C_READ_DONE)
+  {
+    mag_read.state = I2C_READ_IDLE;
+    parse_Mag(mag_buffer);
+    mag_fresh = true;
+  }
+  if(count_read.state == I2C_READ_FAILED || fifo_read.state == I2C_READ_FAILED || mag_read.state == I2C_READ_FAILED)
+  {
+    count_read.state = fifo_read.state = mag_read.state = I2C_READ_IDLE;
+    bus_failure = true; //compute_All brings the sensor back
+  }
+}
+
+void MPU9150::read_Queued(bool mag_Read)
+{
+  poll();
+  while(count_read.state != I2C_READ_IDLE || fifo_read.state != I2C_READ_IDLE) //queued last cycle, it normally landed long ago
+  {
+    poll(); //the queue gives up on a read after I2C_QUEUE_TIMEOUT_US, this ends
+  }
+  if(fifo_reset)
+  {
+    sync();
+    I2Cdev::writeBit(devAddr, MPU9150_RA_USER_CTRL, MPU9150_USERCTRL_FIFO_RESET_BIT, true);
+  }
+  uint8_t n = landed;
+  const uint8_t *records = fifo_buffer[fifo_fill^1];
+  landed = 0;
+  //the next count goes out now, the records follow it (poll) into the other half while these get integrated
+  count_read.addr = devAddr;
+  count_read.reg = MPU9150_RA_FIFO_COUNTH;
+  count_read.len = 2;
+  count_read.buf = count_buffer;
+  bus->read(count_read);
+  if(mag_read.state == I2C_READ_IDLE) //every cycle, 6 bytes : whoever wants the mag gets one from this cycle and not one 10ms old
+  {
+    mag_read.addr = devAddr;
+    mag_read.reg = MPU9150_RA_EXT_SENS_DATA_00;
+    mag_read.len = 6;
+    mag_read.buf = mag_buffer;
+    bus->read(mag_read);
+  }
+  if(n > 0)
+  {
+    integrate_FIFO(records,n);
+  }
+  else
+  {
+    imu_T = 0; //nothing landed (no sample since the last count, a reset) : compute_All has nothing to propagate
+  }
+  for(int i=0;i<3;i++)
+  {
+    delG[i] = G[i]-lastG[i];
+    lastG[i] = G[i];
+  }
+  if(mag_Read && mag_fresh)
+  {
+    mag_fresh = false;
+    scale_Mag();
+  }
+  return;
+}
+
+void MPU9150::parse_Motion(const uint8_t *b)
+{
+  //300us for the 14 bytes of accel/gyro to be received, the mag's 6 add about 130us. 
   //each value in the mpu is stored in a "broken" form in 2 consecutive registers.(for example, acceleration along X axis has a high byte at 0x3B and low byte at 0x3C 
   //to get the actual value, all you have to do is shift the highbyte by 8 bits and bitwise add it to the low byte and you have your original value/. 
-  a[0]=Wire.read()<<8|Wire.read();  
-  a[1]=Wire.read()<<8|Wire.read(); 
-  a[2]=Wire.read()<<8|Wire.read(); 
-  t=Wire.read()<<8|Wire.read();  //this one is actually temperature but i dont need temp so why waste memory.
-  g[0]=Wire.read()<<8|Wire.read();  
-  g[1]=Wire.read()<<8|Wire.read();
-  g[2]=Wire.read()<<8|Wire.read();
+  a[0] = (((int16_t)b[0]) << 8) | b[1];
+  a[1] = (((int16_t)b[2]) << 8) | b[3];
+  a[2] = (((int16_t)b[4]) << 8) | b[5];
+  t = (((int16_t)b[6]) << 8) | b[7];  //this one is actually temperature but i dont need temp so why waste memory.
+  g[0] = (((int16_t)b[8]) << 8) | b[9];
+  g[1] = (((int16_t)b[10]) << 8) | b[11];
+  g[2] = (((int16_t)b[12]) << 8) | b[13];
+  return;
+}
+
+void MPU9150::parse_Mag(const uint8_t *buf)
+{
+  //EXT_SENS_DATA_00..05, the mag's registers as they are : little endian
+  m[1] = (((int16_t)buf[1]) << 8) | buf[0]; // the mag has the X axis where the accelero has it's Y and vice-versa
+  m[0] = (((int16_t)buf[3]) << 8) | buf[2]; // so I just do this switch over so that the math appears easier to me. 
+  m[2] = (((int16_t)buf[5]) << 8) | buf[4];
 
   return;
 }
 
+void MPU9150::scale_Raw(float acc[3], float gyro[3])
+{
+  for(int i=0;i<3;i++)
+  {
+    acc[i] = float(a[i] - offsetA[i])*ACCEL_SCALING_FACTOR;
+    gyro[i] = float(g[i] - offsetG[i])*GYRO_SCALING_FACTOR + temp_Compensation(t);
+  }
+}
+
+void MPU9150::scale_Mag()
+{
+  for(int i=0;i<3;i++)
+  {
+    M[i] = (float)(m[i] - offsetM[i]); //hard iron shit
+    M[i] *= invert_axis_gain[i];//(float(axis_gain[i])*1e-3); //soft iron shit.
+  }
+  if(cal != NULL)
+  {
+    cal->add(m,mh); //raw, the calibrator fits what offsetM and axis_gain should be
+  }
+}
+
 void MPU9150::getMotion6(int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int16_t* gy, int16_t* gz) {
     I2Cdev::readBytes(devAddr, MPU9150_RA_ACCEL_XOUT_H, 14, buffer);
     *ax = (((int16_t)buffer[0]) << 8) | buffer[1];
@@ -213,17 +502,19 @@ void MPU9150::getMotion6(int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int
 
 void MPU9150::getMotion9(int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int16_t* gy, int16_t* gz, int16_t* mx, int16_t* my, int16_t* mz) {
 
-    //get accel and gyro
-    getMotion6(ax, ay, az, gx, gy, gz);
-    I2Cdev::writeByte(devAddr, MPU9150_RA_INT_PIN_CFG, 0x02); //set i2c bypass enable pin to true to access magnetometer
-    delay(10);
-    I2Cdev::writeByte(MPU9150_RA_MAG_ADDRESS, 0x0A, 0x01); //enable the magnetometer
-    delay(10);
-    //read mag
-    I2Cdev::readBytes(MPU9150_RA_MAG_ADDRESS, MPU9150_RA_MAG_XOUT_L, 6, buffer);
-    *mx = (((uint16_t)buffer[1]) << 8) | buffer[0];
-    *my = (((uint16_t)buffer[3]) << 8) | buffer[2];
-    *mz = (((uint16_t)buffer[5]) << 8) | buffer[4];
+    //the bypass doesn't work with the MPU's master on (see startMag), the mag comes from EXT_SENS_DATA in the same burst
+    delay(MAG_UPDATE_TIME_MS); //so that every call has a new mag reading
+    uint8_t burst[MPU_BURST_LENGTH];
+    I2Cdev::readBytes(devAddr, MPU9150_RA_ACCEL_XOUT_H, MPU_BURST_LENGTH, burst);
+    *ax = (((int16_t)burst[0]) << 8) | burst[1];
+    *ay = (((int16_t)burst[2]) << 8) | burst[3];
+    *az = (((int16_t)burst[4]) << 8) | burst[5];
+    *gx = (((int16_t)burst[8]) << 8) | burst[9];
+    *gy = (((int16_t)burst[10]) << 8) | burst[11];
+    *gz = (((int16_t)burst[12]) << 8) | burst[13];
+    *mx = (((uint16_t)burst[15]) << 8) | burst[14];
+    *my = (((uint16_t)burst[17]) << 8) | burst[16];
+    *mz = (((uint16_t)burst[19]) << 8) | burst[18];
 
 }
 
@@ -243,6 +534,7 @@ void MPU9150::blink(int8_t n)
 void MPU9150::gyro_caliberation()
 {
   //just leave the car stationary. the LED will blink once when the process begins, twice when it ends.
+  sync();
   blink(1);
   float dummy[3] = {0,0,0};
   float dummyT = 0;
@@ -275,6 +567,7 @@ void MPU9150::accel_caliberation()
   float dummy[2][3] = {{0,0,0},
                        {0,0,0}};
   int i,j,k;
+  sync();
   for(k = 0;k<2;k++)
   { 
     blink(2);
@@ -306,6 +599,7 @@ void MPU9150::mag_caliberation()
   //point the nose of the car in the EW direction, rotate the car around the longitudenal axis of the car until you see
   //the MPU LED blink twice
   int16_t i,j,oldmax[3],oldmin[3];
+  sync();
   getMotion9(&a[0],&a[1],&a[2],&g[0],&g[1],&g[2],&m[1],&m[0],&m[2]);
   for(j=0;j<3;j++)
   {
@@ -359,6 +653,22 @@ void MPU9150::getOffset(int16_t offA[3],int16_t offG[3],int16_t offM[3],int16_t
   return;
 }
 
+void MPU9150::getBias(float bias[3])
+{
+  for(int i=0;i<3;i++)
+  {
+    bias[i] = gyro_Bias[i];
+  }
+}
+
+void MPU9150::setBias(const float bias[3])
+{
+  for(int i=0;i<3;i++)
+  {
+    gyro_Bias[i] = bias[i];
+  }
+}
+
 void MPU9150::setOffset(int16_t offA[3],int16_t offG[3],int16_t offM[3], int16_t &offT, int16_t gain[3])
 {
   for(int i=0;i<3;i++)
@@ -374,25 +684,18 @@ void MPU9150::setOffset(int16_t offA[3],int16_t offG[3],int16_t offM[3], int16_t
 
 void MPU9150::readAll(bool mag_Read)
 {
-  readIMU();
+  readFIFO(); //every sample since the last cycle. none : imu_T = 0, A and G stay what they were
   for(int i=0;i<3;i++)
   {
-    A[i] = float(a[i] - offsetA[i])*ACCEL_SCALING_FACTOR;
     // A[i] = LPF(i,A[i]);
-
-    G[i] = float(g[i] - offsetG[i])*GYRO_SCALING_FACTOR + temp_Compensation(t);
     // G[i] = filter_gyro(lastG[i],G[i]);
     delG[i] = G[i]-lastG[i];
     lastG[i] = G[i];
   }
   if(mag_Read)
   {
-    readMag();
-    for(int i=0;i<3;i++)
-    {
-      M[i] = (float)(m[i] - offsetM[i]); //hard iron shit
-      M[i] *= invert_axis_gain[i];//(float(axis_gain[i])*1e-3); //soft iron shit.
-    }
+    readMag(); //6 bytes from the MPU, the master got them from the mag on its own
+    scale_Mag();
   }
   return;
 }
@@ -437,18 +740,36 @@ float MPU9150::tilt_Compensate(float cosPitch,float cosRoll, float sinPitch, flo
 }//800us worst case on arduino uno 16mhz 8 bit. 800/13.85 on stm32f103c8t6
 
 void MPU9150::compute_All()
+{
+  bool mag_Read = false;
+  if(millis() - stamp>MAG_UPDATE_TIME_MS) //more than 10ms have passed since last mag read. maintain 100hz update rate for magnetometer
+  {
+    stamp = millis();
+    mag_Read = true;
+  }
+  compute_All(mag_Read);
+}
+
+void MPU9150::compute_All(bool mag_Read)
 { 
   //define all variables
   float d_Yaw_Radians;
   float Anet;
   float trust,trust_1;
-  float innovation[3];
+  float innovation[2];
   float V_mes;
-  bool mag_Read = false;
   float cosRoll,_sinRoll,cosPitch,_sinPitch;
   float gain;
 
-  testConnection() ? failure = false : failure = true; //checking for sensor failure before reading. this has a 63us penalty :'( 
+  if(bus != NULL)
+  {
+    failure = bus_failure; //a queued read that NACKed or timed out says as much, no need to ask the sensor every cycle
+    bus_failure = false;
+  }
+  else
+  {
+    testConnection() ? failure = false : failure = true; //checking for sensor failure before reading. this has a 63us penalty :'( 
+  }
   
   if(failure)
   {
@@ -456,94 +777,94 @@ void MPU9150::compute_All()
     return; //break it off right here. take a break. have a kit kat.
   }
 
-  if(millis() - stamp>MAG_UPDATE_TIME_MS) //more than 10ms have passed since last mag read. maintain 100hz update rate for magnetometer
+  bus != NULL ? read_Queued(mag_Read) : readAll(mag_Read);//read the mag if the condition is true.
+  if(imu_T == 0) //no sample since the last cycle : nothing to propagate, and A and G have been used already
   {
-    stamp = millis();
-    mag_Read = true;
+    if(mag_Read)
+    {
+      mag_Correction();
+    }
+    return;
   }
-
-  readAll(mag_Read);//read the mag if the condition is true.
-  //PREDICTION STEP (ROLL AND PITCH FIRST)
-  d_Yaw_Radians = (G[2]*dt*DEG2RAD); //change in yaw around the car's Z axis (this is not exactly the change in heading)
-  roll  += (G[1] - gyro_Bias[1])*dt - pitch*d_Yaw_Radians; // the roll is calculated first because everything else is actually dependent on the roll. 
-  cosRoll = cosf(roll*DEG2RAD); //precomputing them as they are used repetitively.
-  _sinRoll = -sinf(roll*DEG2RAD);
-  //chaning the roll doesn't change the heading. Changing the pitch can change the heading.
-  //YES there will be some error in pitch that will cause an error in the roll, that is exactly why I have a low pass filter applied to both pitch and roll for values between 2 and 5 degrees
-  pitch += dt*(G[0]*cosRoll - G[2]*_sinRoll - gyro_Bias[0]) + roll*d_Yaw_Radians; //compensates for the effect of yaw and roll on pitch
-  cosPitch = cosf(pitch*DEG2RAD);
-  _sinPitch = -sinf(pitch*DEG2RAD);
-
-  //if the car is going around a banked turn, then the change in heading is not the same as yawRate*dt. P.S: cos is an even function.
-  mh += dt*(G[2]*cosRoll +G[0]*_sinRoll - gyro_Bias[2]); //compensates for pitch and roll of gyro(roll pitch compensation to the yaw).
-  //INCREMENT ERROR
-  pitch_Error += GYRO_VARIANCE; //increment the errors each cycle
-  roll_Error += GYRO_VARIANCE;
-  mh_Error += GYRO_VARIANCE;
-
-  //CORRECTION STEP AND REDUCING THE ERROR AFTER CORRECTION IN ROLL AND PITCH
-  Anet = (A[0]*A[0] + A[1]*A[1] + (A[2]+GRAVITY)*(A[2]+GRAVITY)); //square of net acceleration. TODO : FIX THIS BITCH
-  trust = exp_spike(G_SQUARED,Anet);// spiky boi filter. Basically the farther away the net acceleration is from g,
-
-  if( fabs(A[1])<GRAVITY-1.0f ) //sanity check on accelerations so that we don't get Naans
+  d_Yaw_Radians = dTheta[2]*DEG2RAD; //change in yaw around the car's Z axis (this is not exactly the change in heading)
+  if(ahrs == MPU_AHRS_QUATERNION)
   {
-    innovation[0] = pitch; //dummy;
-    float pitch_trust = trust*pitch_Error;
-    trust_1 = (1 - pitch_trust);
-    pitch = trust_1*pitch + pitch_trust*RAD2DEG*my_asin(A[1]*G_INVERSE); //G_INVERSE = 1/9.8
-    pitch_Error *= trust_1; //reduce the error everytime you make a correction
-    innovation[0] -= pitch; //actual innovation
-    gyro_Bias[0] += pitch_trust*innovation[0]*dt; //get bias
+    quaternion_Update(cosPitch,cosRoll,_sinPitch,_sinRoll);
+    if(mag_Read)
+    {
+      quaternion_Heading(cosPitch,cosRoll,_sinPitch,_sinRoll);
+    }
   }
-  if( fabs(A[0])<GRAVITY-1.0f )
+  else
   {
-    innovation[1] = roll;
-    float roll_trust = trust*roll_Error;
-    trust_1 = (1 - roll_trust);
-    roll  = trust_1*roll  - roll_trust*RAD2DEG*my_asin(A[0]*G_INVERSE); //using the accelerometer to correct the roll and pitch.
-    roll_Error *= trust_1;
-    innovation[1] -= roll;
-    gyro_Bias[1] += roll_trust*innovation[1]*dt;
-  }
-  yawRate = G[2] - gyro_Bias[2]; // yaw_Rate.
+    //PREDICTION STEP (ROLL AND PITCH FIRST)
+    roll  += dTheta[1] - gyro_Bias[1]*imu_T - pitch*d_Yaw_Radians; // the roll is calculated first because everything else is actually dependent on the roll. 
+    cosRoll = cosf(roll*DEG2RAD); //precomputing them as they are used repetitively.
+    _sinRoll = -sinf(roll*DEG2RAD);
+    //chaning the roll doesn't change the heading. Changing the pitch can change the heading.
+    //YES there will be some error in pitch that will cause an error in the roll, that is exactly why I have a low pass filter applied to both pitch and roll for values between 2 and 5 degrees
+    pitch += dTheta[0]*cosRoll - dTheta[2]*_sinRoll - gyro_Bias[0]*imu_T + roll*d_Yaw_Radians; //compensates for the effect of yaw and roll on pitch
+    cosPitch = cosf(pitch*DEG2RAD);
+    _sinPitch = -sinf(pitch*DEG2RAD);
+
+    //if the car is going around a banked turn, then the change in heading is not the same as yawRate*dt. P.S: cos is an even function.
+    mh += dTheta[2]*cosRoll + dTheta[0]*_sinRoll - gyro_Bias[2]*imu_T; //compensates for pitch and roll of gyro(roll pitch compensation to the yaw).
+    //INCREMENT ERROR
+    pitch_Error += GYRO_VARIANCE; //increment the errors each cycle
+    roll_Error += GYRO_VARIANCE;
+    mh_Error += GYRO_VARIANCE;
+
+    //CORRECTION STEP AND REDUCING THE ERROR AFTER CORRECTION IN ROLL AND PITCH
+    Anet = (A[0]*A[0] + A[1]*A[1] + (A[2]+GRAVITY)*(A[2]+GRAVITY)); //square of net acceleration. TODO : FIX THIS BITCH
+    trust = exp_spike(G_SQUARED,Anet);// spiky boi filter. Basically the farther away the net acceleration is from g,
+
+    if( fabs(A[1])<GRAVITY-1.0f ) //sanity check on accelerations so that we don't get Naans
+    {
+      innovation[0] = pitch; //dummy;
+      float pitch_trust = trust*pitch_Error;
+      trust_1 = (1 - pitch_trust);
+      pitch = trust_1*pitch + pitch_trust*RAD2DEG*my_asin(A[1]*G_INVERSE); //G_INVERSE = 1/9.8
+      pitch_Error *= trust_1; //reduce the error everytime you make a correction
+      innovation[0] -= pitch; //actual innovation
+      gyro_Bias[0] += pitch_trust*innovation[0]*dt; //get bias
+    }
+    if( fabs(A[0])<GRAVITY-1.0f )
+    {
+      innovation[1] = roll;
+      float roll_trust = trust*roll_Error;
+      trust_1 = (1 - roll_trust);
+      roll  = trust_1*roll  - roll_trust*RAD2DEG*my_asin(A[0]*G_INVERSE); //using the accelerometer to correct the roll and pitch.
+      roll_Error *= trust_1;
+      innovation[1] -= roll;
+      gyro_Bias[1] += roll_trust*innovation[1]*dt;
+    }
+    yawRate = G[2] - gyro_Bias[2]; // yaw_Rate.
 
-  //conditional low pass filtering between 1 and 4 degrees. 100Hz LPF  
-  if(fabs(roll)>1.0f&&fabs(roll)<4.0f)
-  {
-    roll = LPF(0,roll);
-  }
-  if(fabs(pitch)>1.0f&&fabs(pitch)<4.0f)
-  {
-    pitch = LPF(1,pitch); //applying a 100 Hz LPF to these signals. 
-  }//TODO : do we need this low pass filter?
-  Sanity_Check(M_PIB2_DEG,roll); //sanity checks.
-  Sanity_Check(M_PIB2_DEG,pitch);
+    //conditional low pass filtering between 1 and 4 degrees. 100Hz LPF  
+    if(fabs(roll)>1.0f&&fabs(roll)<4.0f)
+    {
+      roll = LPF(0,roll);
+    }
+    if(fabs(pitch)>1.0f&&fabs(pitch)<4.0f)
+    {
+      pitch = LPF(1,pitch); //applying a 100 Hz LPF to these signals. 
+    }//TODO : do we need this low pass filter?
+    Sanity_Check(M_PIB2_DEG,roll); //sanity checks.
+    Sanity_Check(M_PIB2_DEG,pitch);
 
-  if(mh >= M_2PI_DEG) // the mh must be within [0.0,360.0]
-  {
-    mh -= M_2PI_DEG;
-  }
-  if(mh < 0.0f)
-  {
-    mh += M_2PI_DEG;
-  }
-  // CORRECTION OF HEADING AND REDUCING ERROR AFTER CORRECTION.
-  if( mag_Read )//check if mag has been read or not.
-  { 
-    float mag_head = tilt_Compensate(cosPitch,cosRoll,-_sinPitch,-_sinRoll); //get tilt compensated heading
-    if(fabs(mag_head - mh)>M_PI_DEG) // this happens when the heading is in the range of 5-0-355 degrees
+    if(mh >= M_2PI_DEG) // the mh must be within [0.0,360.0]
     {
-      mh = M_2PI_DEG-mh;// doing this because mag is the measured value. can't change that you know.
+      mh -= M_2PI_DEG;
+    }
+    if(mh < 0.0f)
+    {
+      mh += M_2PI_DEG;
+    }
+    // CORRECTION OF HEADING AND REDUCING ERROR AFTER CORRECTION.
+    if( mag_Read )//check if mag has been read or not.
+    { 
+      heading_Correction(cosPitch,cosRoll,_sinPitch,_sinRoll);
     }
-    innovation[2] = mh;//dummy
-    mag_gain /= max(fabs(yawRate),1.0f);
-    mag_gain *= mh_Error;//scale the gain in proportion to the mh_Error
-    Sanity_Check(0.05f,mag_gain);//just in case
-    mh = (1.0f-mag_gain)*mh + mag_gain*(mag_head);
-    innovation[2] -= mh; //actual innovation
-    mh_Error *= (1.0f-mag_gain); //reduce the error.
-    gyro_Bias[2] += mag_gain*innovation[2]*MAG_UPDATE_RATE;//adjust bias
-    heading_drift = innovation[2]; //integrate heading drift.
   }
   //Estimating speed.
   Ha = (A[1] + GRAVITY*_sinPitch)*cosPitch - bias;// world frame NOTE : due to the LPF, this can report incorrect values when you shake the car. 
@@ -563,8 +884,8 @@ void MPU9150::compute_All()
     //TODO : insert method to trust A/w less when dw/dt is large (Steering angle changing because that's why we get errors in speed bruh)
     // La -= d_Yaw_Radians*(d_Yaw_Radians + 2*yawRadians)*radius; //correction for centrifugal force.
     V_mes = -(La + d_Yaw_Radians*(d_Yaw_Radians + 2*yawRadians)*radius)/yawRadians; //measure velocity as V = A/w, since A = wr.w and wr is the speed.
-    V += Ha*dt; //propogate the state of the car through time.
-    V_Error += dt*fabs(ACCEL_VARIANCE*cosPitch + A[1]*_sinPitch*pitch_Error + 2.0f*GRAVITY*my_cos(2.0f*pitch*DEG2RAD)*pitch_Error);//expression for error. God I wish this was fixed too!
+    V += Ha*imu_T; //propogate the state of the car through time. A*imu_T is the velocity increment, sculling and all
+    V_Error += imu_T*fabs(ACCEL_VARIANCE*cosPitch + A[1]*_sinPitch*pitch_Error + 2.0f*GRAVITY*my_cos(2.0f*pitch*DEG2RAD)*pitch_Error);//expression for error. God I wish this was fixed too!
     float mes_error = max(fabs(Ha),1.0f)*CIRCULAR_VELOCITY_ERROR/(min(fabs(yawRadians2),1.0f));
     gain = V_Error/(mes_error + V_Error); //CIRCULAR VELOCITY ERROR is fixed and is defined in the header.
     V = (1.0f-gain)*V + gain*V_mes;//correction step
@@ -573,12 +894,191 @@ void MPU9150::compute_All()
   else//if the car ain't turnin 
   {
     // Ha -= (La*DIST_BW_ACCEL_AXLE*1e-3);
-    V += Ha*dt;//propogate the state through time.
-    V_Error += dt*fabs(ACCEL_VARIANCE*cosPitch + A[1]*_sinPitch*pitch_Error + 2.0f*GRAVITY*my_cos(2.0f*pitch*DEG2RAD)*pitch_Error);//expression for error
+    V += Ha*imu_T;//propogate the state through time.
+    V_Error += imu_T*fabs(ACCEL_VARIANCE*cosPitch + A[1]*_sinPitch*pitch_Error + 2.0f*GRAVITY*my_cos(2.0f*pitch*DEG2RAD)*pitch_Error);//expression for error
   }
   return;
 }//570us worst case. 
 
+void MPU9150::mag_Update()
+{
+  if(failure)
+  {
+    return; //compute_All is busy bringing the sensor back
+  }
+  if(bus != NULL)
+  {
+    poll();
+    if(!mag_fresh)
+    {
+      return; //compute_All queued it, it hasn't landed (or the last one was used already)
+    }
+    mag_fresh = false;
+  }
+  else
+  {
+    readMag(); //one read of 6 bytes, the MPU's master got them from the mag on its own
+  }
+  scale_Mag();
+  mag_Correction();
+}
+
+void MPU9150::mag_Correction()
+{
+  //roll and pitch are from the last compute_All, which runs at a higher rate than this.
+  if(ahrs == MPU_AHRS_QUATERNION)
+  {
+    float up[3],cosPitch,cosRoll,_sinPitch,_sinRoll;
+    quat.up(up);
+    quaternion_Tilt(up,cosPitch,cosRoll,_sinPitch,_sinRoll);
+    quaternion_Heading(cosPitch,cosRoll,_sinPitch,_sinRoll);
+    return;
+  }
+  heading_Correction(cosf(pitch*DEG2RAD),cosf(roll*DEG2RAD),-sinf(pitch*DEG2RAD),-sinf(roll*DEG2RAD));
+}
+
+void MPU9150::setAHRS(uint8_t mode)
+{
+  if(mode == MPU_AHRS_QUATERNION && ahrs != MPU_AHRS_QUATERNION)
+  {
+    quat.initialize(roll,pitch,mh);
+  }
+  ahrs = mode;
+}
+
+void MPU9150::setMagCal(MAG_CALIBRATOR *calibrator)
+{
+  cal = calibrator;
+  if(cal != NULL)
+  {
+    cal->begin(offsetM,axis_gain,HORIZ_EARTH_MAG,EARTH_MAG_STRENGTH/COMPASS_SCALE_FACTOR);
+  }
+}
+
+void MPU9150::setMagOffset(const int16_t offM[3], const int16_t gain[3])
+{
+  for(int i=0;i<3;i++)
+  {
+    offsetM[i] = offM[i];
+    axis_gain[i] = gain[i];
+    invert_axis_gain[i] = 1000/float(axis_gain[i]);
+  }
+  mag_settle = MAG_SWAP_SETTLE;
+  gyro_Bias[2] = yaw_Bias_start; //what the heading correction learned since Setup was against the old offsets
+}
+
+void MPU9150::quaternion_Tilt(const float up[3],float &cosPitch,float &cosRoll,float &_sinPitch,float &_sinRoll)
+{
+  _sinPitch = -up[1]; //sin(pitch) = up[1], sin(roll) = -up[0] (see AHRS.h)
+  _sinRoll = up[0];
+  cosPitch = fast_sqrt(1.0f - up[1]*up[1]);
+  cosRoll = fast_sqrt(1.0f - up[0]*up[0]);
+}
+
+void MPU9150::quaternion_Update(float &cosPitch,float &cosRoll,float &_sinPitch,float &_sinRoll)
+{
+  //PREDICTION AND CORRECTION IN ONE TURN. the quaternion takes care of how the gyro axes couple, the accelerometer counts as much
+  //as the Euler update trusts it and not at all past its sanity checks
+  pitch_Error += GYRO_VARIANCE; //same bookkeeping as the Euler update, V_Error and STATE use these
+  roll_Error += GYRO_VARIANCE;
+  mh_Error += GYRO_VARIANCE;
+  float Anet = (A[0]*A[0] + A[1]*A[1] + (A[2]+GRAVITY)*(A[2]+GRAVITY));
+  float trust = 0;
+  if( fabs(A[0])<GRAVITY-1.0f && fabs(A[1])<GRAVITY-1.0f )
+  {
+    trust = exp_spike(G_SQUARED,Anet);
+    pitch_Error *= (1 - trust*pitch_Error);
+    roll_Error *= (1 - trust*roll_Error);
+  }
+  float w[3], f[3] = {A[0], A[1], A[2]+GRAVITY};
+  for(int i=0;i<3;i++)
+  {
+    w[i] = DEG2RAD*(G[i] - gyro_Bias[i]);
+  }
+  quat.update(w,f,trust*(1.0f/exp_spike_k),gyro_Bias,imu_T); //exp_spike tops out at exp_spike_k. w*imu_T is dTheta
+  yawRate = G[2] - gyro_Bias[2];
+
+  //the tilt for Ha/La. Of the angles the rest of the car reads only mh is needed every cycle (STATE takes how much it turned),
+  //it turns by the gyro about the vertical. roll, pitch and the exact mh are worked out with the mag, MAG_UPDATE_RATE (mag_task, 100Hz) (quaternion_Heading)
+  float up[3];
+  quat.up(up);
+  quaternion_Tilt(up,cosPitch,cosRoll,_sinPitch,_sinRoll);
+  mh += RAD2DEG*imu_T*(w[0]*up[0] + w[1]*up[1] + w[2]*up[2]); //the accelerometer's part of the update is level, it doesn't turn mh
+  if(mh >= M_2PI_DEG)
+  {
+    mh -= M_2PI_DEG;
+  }
+  if(mh < 0.0f)
+  {
+    mh += M_2PI_DEG;
+  }
+}
+
+void MPU9150::quaternion_Heading(float cosPitch,float cosRoll,float _sinPitch,float _sinRoll)
+{
+  pitch = -RAD2DEG*my_asin(_sinPitch); //what compute_All leaves to the mag's rate
+  roll = -RAD2DEG*my_asin(_sinRoll);
+  mh = quat.heading(); //what the turns since added up to, give or take
+  //heading_Correction's gain, the innovation wrapped properly and put in as a turn about the vertical
+  float mag_head = tilt_Compensate(cosPitch,cosRoll,-_sinPitch,-_sinRoll);
+  float innovation = mag_head - mh;
+  if(innovation > M_PI_DEG)
+  {
+    innovation -= M_2PI_DEG;
+  }
+  if(innovation < -M_PI_DEG)
+  {
+    innovation += M_2PI_DEG;
+  }
+  if(mag_settle > 0) //see heading_Correction
+  {
+    if(--mag_settle == 0)
+    {
+      quat.turn(innovation);
+      mh = quat.heading();
+    }
+    heading_drift = 0;
+    return;
+  }
+  mag_gain /= max(fabs(yawRate),1.0f);
+  mag_gain *= mh_Error;
+  Sanity_Check(0.05f,mag_gain);
+  float turn = mag_gain*innovation;
+  quat.turn(turn);
+  mh = quat.heading();
+  mh_Error *= (1.0f-mag_gain);
+  gyro_Bias[2] -= mag_gain*turn*MAG_UPDATE_RATE; //same as heading_Correction
+  heading_drift = -turn;
+}
+
+void MPU9150::heading_Correction(float cosPitch,float cosRoll,float _sinPitch,float _sinRoll)
+{
+  float innovation;
+  float mag_head = tilt_Compensate(cosPitch,cosRoll,-_sinPitch,-_sinRoll); //get tilt compensated heading
+  if(mag_settle > 0) //new offsets (setMagOffset) : tilt_Compensate's smoothing forgets the old ones, then the heading jumps to the mag's.
+  {                  //correcting towards it would put the whole jump into gyro_Bias[2]
+    if(--mag_settle == 0)
+    {
+      mh = mag_head;
+    }
+    heading_drift = 0;
+    return;
+  }
+  if(fabs(mag_head - mh)>M_PI_DEG) // this happens when the heading is in the range of 5-0-355 degrees
+  {
+    mh = M_2PI_DEG-mh;// doing this because mag is the measured value. can't change that you know.
+  }
+  innovation = mh;//dummy
+  mag_gain /= max(fabs(yawRate),1.0f);
+  mag_gain *= mh_Error;//scale the gain in proportion to the mh_Error
+  Sanity_Check(0.05f,mag_gain);//just in case
+  mh = (1.0f-mag_gain)*mh + mag_gain*(mag_head);
+  innovation -= mh; //actual innovation
+  mh_Error *= (1.0f-mag_gain); //reduce the error.
+  gyro_Bias[2] += mag_gain*innovation*MAG_UPDATE_RATE;//adjust bias
+  heading_drift = innovation; //integrate heading drift.
+}
+
 void MPU9150::get_Rotations(float omega[3])
 {
   omega[0] = DEG2RAD*G[0];
@@ -589,6 +1089,9 @@ void MPU9150::get_Rotations(float omega[3])
 void MPU9150::Setup()//initialize the state of the marg.
 {
   for(int i=0;i<3;i++){ invert_axis_gain[i] = 1000/float(axis_gain[i]); }
+  yaw_Bias_start = gyro_Bias[2];
+  sync();
+  delay(2*MAG_UPDATE_TIME_MS); //the MPU's master has the first mag reading by its second read (see startMag)
   readAll(1); //read accel,gyro,mag 
   delay(10);
   readAll(1);
@@ -596,6 +1099,14 @@ void MPU9150::Setup()//initialize the state of the marg.
   roll  = -RAD2DEG*my_asin(A[0]*G_INVERSE);   
   mh = tilt_Compensate(cosf(pitch*DEG2RAD),cosf(roll*DEG2RAD),sinf(pitch*DEG2RAD),sinf(roll*DEG2RAD)); //find initial heading. Roll, pitch have to be in radians
   yawRate = G[2]; //initial YawRate of the car.
+  if(ahrs == MPU_AHRS_QUATERNION)
+  {
+    quat.initialize(roll,pitch,mh);
+  }
+  if(cal != NULL)
+  {
+    cal->begin(offsetM,axis_gain,HORIZ_EARTH_MAG,EARTH_MAG_STRENGTH/COMPASS_SCALE_FACTOR); //the offsets may have come from the GCS since
+  }
   stamp = millis(); //get first time stamp.
   return;
 }
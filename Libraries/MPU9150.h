@@ -52,6 +52,16 @@ marg.Setup(); //this calculates initial orientation
 loop():
 marg.compute_All();
 sanity check : marg.failure ? initialize() : do nothing
+
+with an I2C_QUEUE (after Setup) :
+marg.setBus(&bus);
+compute_All and mag_Update then take what the last queued read brought and queue the next one instead of waiting on the bus,
+call marg.poll() from a background task so that the reads move along.
+
+with a MAG_CALIBRATOR :
+marg.setMagCal(&cal);
+mag_Update hands it every mag sample, and the background task that runs cal.step() swaps in what it converges to :
+if(cal.step()) marg.setMagOffset(cal.offset, cal.gain);
 */
 
 
@@ -61,6 +71,9 @@ sanity check : marg.failure ? initialize() : do nothing
 
 #include "I2Cdev.h"
 #include<Wire.h>
+#include "I2C_QUEUE.h"
+#include "AHRS.h"
+#include "MAG_CALIBRATOR.h"
 #include "SIDMATH.h" //had to define my own library. mpu library is heavily dependent on sidmath.
 #include "PARAMS.h" // library for parameters used across the project. for example cycle time and cycle frequency
 
@@ -484,6 +497,22 @@ sanity check : marg.failure ? initialize() : do nothing
 #define MAG_UPDATE_TIME (float) 0.01f
 #define MAG_UPDATE_TIME_MS (int) (1000*MAG_UPDATE_TIME)
 #define MAG_UPDATE_RATE (float) 100.0f
+//the mag hangs off the MPU's aux bus and the MPU's own I2C master reads it, so the mag comes in with every readIMU (see startMag)
+#define MPU_SAMPLE_RATE_DIV 7 //8kHz gyro output (DLPF off) / (1 + 7) = 1kHz sample rate. The aux master runs at this rate
+#define MAG_MST_DELAY (MAG_UPDATE_TIME_MS - 1) //the aux master reads the mag every (1 + this) samples, 100Hz. The AK8975 needs up to 9ms to measure
+#define MPU_BURST_LENGTH 20 //accel, temp, gyro (14 bytes, 0x3B onwards) and the mag's 6 bytes in EXT_SENS_DATA_00..05
+//every sample also goes into the FIFO, compute_All integrates all of them since the last cycle (see readFIFO)
+#define MPU_SAMPLE_TIME (float) ((1 + MPU_SAMPLE_RATE_DIV)/8000.0f) //s
+#define MPU_FIFO_RECORD 14 //accel, temp, gyro. The mag stays out, it only changes every 10ms : readMag takes it from EXT_SENS_DATA then
+#define MPU_FIFO_READ 2 //records per read, 28 bytes. The Wire buffer has 32
+#define MPU_FIFO_MAX_RECORDS 8 //more than this waiting and the cycle fell behind (setup, calibration) : start over. 8ms of samples
+#define MPU_FIFO_BUFFER (MPU_FIFO_MAX_RECORDS*MPU_FIFO_RECORD) //112 bytes, a queued read takes them all in one go
+
+//what compute_All keeps the attitude in (setAHRS)
+#define MPU_AHRS_EULER 0 //roll, pitch and mh as angles
+#define MPU_AHRS_QUATERNION 1 //a quaternion with the gyro bias, see AHRS.h
+
+#define MAG_SWAP_SETTLE 20 //mag samples (200ms) that tilt_Compensate's smoothing gets to forget the old offsets after setMagOffset
 
 #define EARTH_MAG_STRENGTH (float) 49.0 //earth's magnetic field strength
 #define EARTH_MAG_DIP (float) 45.0 //angle of dip
@@ -512,8 +541,16 @@ class MPU9150 {
         uint8_t getFullScaleGyroRange();
         //-------------------------------------------------------------
 
-        void readMag(); //reading the magnetometer efficiently.
-        void readIMU(); //reading the acc/gyro efficiently.
+        void startMag(); //has the MPU's I2C master read the mag into EXT_SENS_DATA every 10ms. initialize() calls it
+        void startFIFO(); //every sample into the FIFO. initialize() calls it
+        void readIMU(); //reading the acc/gyro and the mag in one go. the newest sample only
+        void readMag(); //the mag alone, what the MPU's master last put in EXT_SENS_DATA
+        uint8_t readFIFO(); //all the samples since the last call, integrated into A and G. how many, 0 if there were none or it had to start over
+        void setBus(I2C_QUEUE *queue); //read through the queue from now on (compute_All, mag_Update). NULL to wait on Wire again
+        void setAHRS(uint8_t mode); //MPU_AHRS_EULER (default) or MPU_AHRS_QUATERNION. takes over the current roll, pitch and mh
+        void setMagCal(MAG_CALIBRATOR *calibrator); //mag_Update feeds it every mag sample with the heading. NULL to stop
+        void setMagOffset(const int16_t offM[3], const int16_t gain[3]); //new hard and soft iron, from the next mag sample on
+        void poll(); //moves the queued reads along : the FIFO's count, then its records. from a background task, compute_All calls it too
         void getMotion6(int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int16_t* gy, int16_t* gz);//for the sake of compatibility.
         void getMotion9(int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int16_t* gy, int16_t* gz, int16_t* mx, int16_t* my, int16_t* mz);
         
@@ -525,10 +562,14 @@ class MPU9150 {
 
         void setOffset(int16_t offA[3],int16_t offG[3],int16_t offM[3],int16_t &offT,int16_t gain[3]); //set the offsets from outside.
         void getOffset(int16_t offA[3],int16_t offG[3],int16_t offM[3],int16_t &offT,int16_t gain[3]); //get the offsets from inside.
+        void setBias(const float bias[3]); //running gyro bias estimate, for the warm start (MEMORY.h). deg/s
+        void getBias(float bias[3]);
 
         void readAll(bool mag_Read_Karu_Kya); //read all sensors and remove noise from readings
         float tilt_Compensate(float cosPitch,float cosRoll, float sinPitch, float sinRoll); //get the tilt compensated magnetometer heading, returns a number between 0/360.
-        void compute_All(); //computes the state of the marg during runtime.
+        void compute_All(); //computes the state of the marg during runtime. reads the mag every MAG_UPDATE_TIME_MS on its own.
+        void compute_All(bool mag_Read); //same thing, but the caller decides when the mag is read.
+        void mag_Update(); //read the mag and correct the heading, for when the mag runs as its own task (see SCHEDULER.h)
         void Setup(); //initialize the state of the marg.
         float temp_Compensation(int16_t temp);
         void Velocity_Update(float &velocity,float VelError, float Accbias);
@@ -576,7 +617,7 @@ class MPU9150 {
         
     private:
         uint8_t devAddr; //device address
-        uint8_t buffer[14]; //communication buffer
+        uint8_t buffer[MPU_FIFO_BUFFER]; //communication buffer
         float A[3],G[3],M[3],T; // noise and offset removed acceleration,gyration, magnetometer and temp
         int16_t a[3],g[3],m[3],t; //acceleration,gyration, magnetometer readings and temperature : RAW
         float gyro_Bias[3];
@@ -585,6 +626,32 @@ class MPU9150 {
         float CAC[2];
         float LPF(int i,float input);
         float filter_gyro(float mean, float x); //notch filter
+        void parse_Motion(const uint8_t *b); //14 bytes as the registers have them (0x3B onwards) into a, t, g
+        void parse_Mag(const uint8_t *b); //EXT_SENS_DATA_00..05 into m
+        void scale_Raw(float acc[3], float gyro[3]); //a, g, t without the offsets, in m/s*s and deg/s
+        void scale_Mag(); //m without the hard and soft iron into M, and m to the calibrator (setMagCal). once per new mag sample
+        void integrate_FIFO(const uint8_t *records, uint8_t n); //n records into dTheta, dVel, imu_T and A and G (see readFIFO)
+        float dTheta[3],dVel[3],imu_T; //angle (deg) and velocity (m/s) increments since the last compute_All and the time (s) they cover. 0 : no new sample
+        void mag_Correction(); //the heading against M, Euler or quaternion
+        //the queued reads (setBus). The FIFO's records land in one half of fifo_buffer while compute_All integrates the other
+        I2C_QUEUE *bus;
+        I2C_READ count_read, fifo_read, mag_read;
+        uint8_t count_buffer[2], mag_buffer[6];
+        uint8_t fifo_buffer[2][MPU_FIFO_BUFFER];
+        uint8_t fifo_fill; //the half the bus is filling
+        uint8_t queued, landed; //records fifo_read is fetching, records in the other half that compute_All hasn't taken yet
+        bool bus_failure, fifo_reset, mag_fresh; //mag_fresh : a mag landed in m that nobody has used
+        void sync(); //waits until nothing is queued, before anything goes through Wire
+        void read_Queued(bool mag_Read); //readAll with the queue
+        void heading_Correction(float cosPitch,float cosRoll,float _sinPitch,float _sinRoll); //mag correction of the heading
+        uint8_t ahrs; //MPU_AHRS_EULER or MPU_AHRS_QUATERNION
+        AHRS_QUATERNION quat;
+        MAG_CALIBRATOR *cal;
+        uint8_t mag_settle; //mag samples until the heading takes the mag's after setMagOffset, 0 when it's settled
+        float yaw_Bias_start; //gyro_Bias[2] at Setup (the warm start's), before the mag had a say
+        void quaternion_Update(float &cosPitch,float &cosRoll,float &_sinPitch,float &_sinRoll); //compute_All's attitude with the quaternion
+        void quaternion_Tilt(const float up[3],float &cosPitch,float &cosRoll,float &_sinPitch,float &_sinRoll); //the same cos/sin out of the quaternion's up, no trig
+        void quaternion_Heading(float cosPitch,float cosRoll,float _sinPitch,float _sinRoll); //heading_Correction as a turn of the quaternion. roll, pitch, mh from it too
         long stamp; //time stamp
 };
 
@@ -28,7 +28,7 @@ float OPFLOW::error_calc()
 void  OPFLOW::updateOpticalFlow() //ma-ma-ma-ma-moneeeeyyyy shooooooot
 {
   // Read sensor
-	uint8_t buf[6];
+	uint8_t buf[7];
 	spiRead(ADNS3080_MOTION_BURST, buf, 7);
 	uint8_t motion = buf[0];
 	if (motion & 0x01) 
@@ -85,6 +85,7 @@ void  OPFLOW::updateOpticalFlow() //ma-ma-ma-ma-moneeeeyyyy shooooooot
     V_y = LPF(3,V_y); 
   }
   V_x = LPF(2,V_x);
+  fresh = V_Error < OP_FLOW_MAX_V_ERROR;
    
 //sensor health check.
   // TODO : insert (in the main code) a method to get the sensor health for all sensors (please?)
@@ -45,8 +45,12 @@ usage :
 	obj.updateOpticalFlow(data);//get that data baby
 */
 
-#define LPF_GAIN_OPFLOW (float) 1/3.41421
-#define C1_OPFLOW (float) 0.4142
+#define LPF_GAIN_OPFLOW_DEFAULT (float) 1/3.41421
+#define C1_OPFLOW_DEFAULT (float) 0.4142
+#ifndef PARAM_SWEEP //TUNABLES.h has them otherwise
+#define LPF_GAIN_OPFLOW LPF_GAIN_OPFLOW_DEFAULT
+#define C1_OPFLOW C1_OPFLOW_DEFAULT
+#endif
 
 class OPFLOW
 {
@@ -70,6 +74,7 @@ public:
 	float xA[4][2],yA[4][2];//for low pass filter
 	int8_t health;
 	bool failure;
+	bool fresh; //the last update has a speed that can be used (the sensor saw the surface well enough)
 };
 
 #endif
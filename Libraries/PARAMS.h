@@ -61,15 +61,25 @@
 #define COMMAND_ID 0x02
 
 #define CONTROL_FREQUENCY LOOP_FREQUENCY/2
-#define FUTURE_TIME (float) 4/CONTROL_FREQUENCY //possible culprit
+#define FUTURE_TIME_DEFAULT (float) 4/CONTROL_FREQUENCY //possible culprit
 #define CONTROL_TIME (float) 1000/CONTROL_FREQUENCY //control time in ms
 #define CONTROL_TIME_SEC (float) 1/CONTROL_FREQUENCY
-#define PATH_WIDTH (float) 1.2*1.414 //width of the track.  possible culprit
-#define THE_RATIO (float) 0.35f //nsfw category XD
+#define PATH_WIDTH_DEFAULT (float) 1.2*1.414 //width of the track.  possible culprit
+#define THE_RATIO_DEFAULT (float) 0.35f //nsfw category XD
+
+#define WP_CIRCLE_DEFAULT 0.5 //1/2 meter radius around waypoint. possible culprit
+
+//the host's parameter sweep (Host/lucifer_sweep.cpp) is built with PARAM_SWEEP and sets the culprits at runtime, see Host/TUNABLES.h
+#ifdef PARAM_SWEEP
+#include"TUNABLES.h"
+#else
+#define FUTURE_TIME FUTURE_TIME_DEFAULT
+#define PATH_WIDTH PATH_WIDTH_DEFAULT
+#define THE_RATIO THE_RATIO_DEFAULT
+#define WP_CIRCLE WP_CIRCLE_DEFAULT
+#endif
 #define CONSTRUCT_LENGTH (float) PATH_WIDTH/THE_RATIO
 
-#define WP_CIRCLE 0.5 //1/2 meter radius around waypoint. possible culprit
-
 #define WP_ID 0x0005
 #define STATE_ID 0x0006
 #define MODE_ID 0x0007
@@ -81,6 +91,7 @@
 #define REC_ID_0 0x00FC
 #define REC_DEBUG_ID_1 0x000D
 #define REC_DEBUG_ID_0 0x00FD
+#define PROFILE_ID 0x000E //loop profiler, one phase per message (see PROFILER.h)
 
 
 #define GYRO_CAL 0x10
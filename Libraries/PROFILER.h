@@ -0,0 +1,189 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include"Arduino.h"
+#include"PARAMS.h"
+
+//per phase timing of loop(). Call begin_cycle() at the top of loop(), mark(phase) at the end of every phase and end_cycle() just
+//before the busy wait. The time between two marks goes to the phase named in the second mark, a phase can be marked more than once
+//in a cycle (the times add up). Phases that didn't run in a cycle don't get a sample for that cycle.
+//
+//Every phase keeps min/max/mean and a histogram from which the p99 is read. The histogram has 8us bins up to 256us and 64us
+//bins up to 2304us, the last bin takes everything above that. When a bin is about to overflow, all the bins (and the mean) of that
+//phase are halved, so old cycles slowly fade out instead of the counters wrapping around.
+//When a cycle goes over dt_micros, the phase that went the furthest above its own mean gets the blame (overruns[phase]++).
+
+#define PROFILE_BINS 64
+#define PROFILE_FINE_BINS 32
+#define PROFILE_FINE_SHIFT 3 //8us
+#define PROFILE_COARSE_SHIFT 6 //64us
+#define PROFILE_FINE_LIMIT (PROFILE_FINE_BINS<<PROFILE_FINE_SHIFT) //256us
+
+enum PROFILE_PHASE
+{
+	PHASE_SENSOR_READ,
+	PHASE_COMPUTE_ALL,
+	PHASE_OPTICAL_FLOW,
+	PHASE_GPS,
+	PHASE_STATE_UPDATE,
+	PHASE_COMMS,
+	PHASE_COMPANION,
+	PHASE_TRAJECTORY,
+	PHASE_DRIVER,
+	PHASE_CYCLE, //the whole cycle, filled in by end_cycle()
+	NUM_PHASES
+};
+
+class PROFILER
+{
+public:
+	uint16_t hist[NUM_PHASES][PROFILE_BINS];
+	uint16_t min_us[NUM_PHASES], max_us[NUM_PHASES];
+	uint32_t sum_us[NUM_PHASES], samples[NUM_PHASES];
+	uint16_t overruns[NUM_PHASES];
+	uint32_t cycle_stamp, mark_stamp;
+	uint32_t current[NUM_PHASES]; //time spent in each phase in this cycle
+	uint16_t ran; //bit per phase, set when the phase was marked in this cycle
+
+	PROFILER()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		for(uint8_t i=0;i<NUM_PHASES;i++)
+		{
+			for(uint8_t j=0;j<PROFILE_BINS;j++)
+			{
+				hist[i][j] = 0;
+			}
+			min_us[i] = 0xFFFF;
+			max_us[i] = 0;
+			sum_us[i] = samples[i] = 0;
+			overruns[i] = 0;
+			current[i] = 0;
+		}
+		ran = 0;
+		cycle_stamp = mark_stamp = micros();
+	}
+
+	inline void begin_cycle()
+	{
+		cycle_stamp = mark_stamp = micros();
+		ran = 0;
+		for(uint8_t i=0;i<NUM_PHASES;i++)
+		{
+			current[i] = 0;
+		}
+	}
+
+	inline void mark(uint8_t phase)
+	{
+		uint32_t now = micros();
+		current[phase] += now - mark_stamp;
+		mark_stamp = now;
+		ran |= 1<<phase;
+	}
+
+	//returns the length of the cycle (without the busy wait) in us.
+	uint32_t end_cycle()
+	{
+		uint32_t total = micros() - cycle_stamp;
+		current[PHASE_CYCLE] = total;
+		ran |= 1<<PHASE_CYCLE;
+		uint8_t culprit = PHASE_CYCLE;
+		int32_t worst_excess = 0;
+		for(uint8_t i=0;i<NUM_PHASES;i++)
+		{
+			if(ran & (1<<i))
+			{
+				if(i != PHASE_CYCLE && samples[i])
+				{
+					int32_t excess = int32_t(current[i]) - int32_t(sum_us[i]/samples[i]);
+					if(excess > worst_excess)
+					{
+						worst_excess = excess;
+						culprit = i;
+					}
+				}
+				record(i,current[i]);
+			}
+		}
+		if(total > dt_micros)
+		{
+			overruns[culprit]++;
+		}
+		return total;
+	}
+
+	uint16_t mean(uint8_t phase)
+	{
+		return samples[phase] ? sum_us[phase]/samples[phase] : 0;
+	}
+
+	//upper edge of the bin that holds the 99th percentile, or the slowest run if that's less (the last bin is open ended)
+	uint16_t p99(uint8_t phase)
+	{
+		uint32_t total = 0, count = 0;
+		for(uint8_t j=0;j<PROFILE_BINS;j++)
+		{
+			total += hist[phase][j];
+		}
+		uint32_t target = total - total/100;
+		for(uint8_t j=0;j<PROFILE_BINS;j++)
+		{
+			count += hist[phase][j];
+			if(count >= target && count)
+			{
+				return min(bin_edge(j), max_us[phase]);
+			}
+		}
+		return 0;
+	}
+
+private:
+	inline uint8_t bin(uint32_t us)
+	{
+		if(us < PROFILE_FINE_LIMIT)
+		{
+			return us>>PROFILE_FINE_SHIFT;
+		}
+		return PROFILE_FINE_BINS + min((us - PROFILE_FINE_LIMIT)>>PROFILE_COARSE_SHIFT, uint32_t(PROFILE_BINS - PROFILE_FINE_BINS - 1));
+	}
+
+	uint16_t bin_edge(uint8_t j)
+	{
+		if(j < PROFILE_FINE_BINS)
+		{
+			return (j+1)<<PROFILE_FINE_SHIFT;
+		}
+		if(j == PROFILE_BINS-1)
+		{
+			return 0xFFFF; //open ended, anything can be in there
+		}
+		return PROFILE_FINE_LIMIT + ((j - PROFILE_FINE_BINS + 1)<<PROFILE_COARSE_SHIFT);
+	}
+
+	void record(uint8_t phase, uint32_t us)
+	{
+		uint16_t t = min(us, uint32_t(0xFFFF));
+		uint8_t b = bin(us);
+		if(hist[phase][b] == 0xFFFF || sum_us[phase] > 0xF0000000) //fade out the old samples
+		{
+			for(uint8_t j=0;j<PROFILE_BINS;j++)
+			{
+				hist[phase][j] >>= 1;
+			}
+			sum_us[phase] >>= 1;
+			samples[phase] >>= 1;
+		}
+		hist[phase][b]++;
+		sum_us[phase] += t;
+		samples[phase]++;
+		min_us[phase] = min(min_us[phase],t);
+		max_us[phase] = max(max_us[phase],t);
+	}
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include"Arduino.h"
+#include"PARAMS.h"
+
+//rate monotonic scheduler for loop(). Time is cut into ticks of dt_micros (400Hz). Every task has a period and a phase offset
+//in ticks and runs in the ticks where tick%period == offset. Tasks run in the order of the table, so keep the table sorted
+//by period (shortest first): that is what makes it rate monotonic, the fast loops never wait behind the slow ones. The offsets
+//spread tasks with the same or related periods over different ticks so that the heavy ones don't pile up in one tick.
+//
+//Nothing is preempted, a task that runs longer than its budget just eats into the tick. The scheduler counts it against the
+//task (overruns, worst) so that you know who to blame.
+//
+//Whatever is left of the tick after the tasks goes to the background tasks. They run round robin, one at a time, and only if
+//their budget still fits in the tick. Once nothing else fits, the scheduler waits for the next tick. A background task with a
+//budget of 0 is a poll (a flag or a register to look at, next to nothing to do) : those go round again and again while it
+//waits, so whatever they look for is seen then and not a tick later.
+
+#define SCHED_TICK_US dt_micros
+#define SCHED_RATE(hz) uint16_t((LOOP_FREQUENCY)/(hz)) //period in ticks for a rate in Hz
+
+struct TASK
+{
+	void (*run)();
+	uint16_t period; //ticks. ignored for background tasks
+	uint16_t offset; //ticks, < period
+	uint16_t budget; //us. 0 for the background polls
+	uint16_t overruns; //number of times the task went over budget
+	uint16_t worst; //longest run in us
+};
+
+class SCHEDULER
+{
+public:
+	TASK *task, *background;
+	uint8_t num_tasks, num_background, next_background;
+	uint32_t tick, tick_stamp;
+	uint16_t late; //ticks in which the tasks alone took longer than the tick
+	uint32_t idle_us; //time spent waiting for the next tick since begin(), polls included
+
+	SCHEDULER()
+	{
+		task = background = NULL;
+		num_tasks = num_background = next_background = 0;
+		tick = tick_stamp = 0;
+		late = 0;
+		idle_us = 0;
+	}
+
+	void begin(TASK *t, uint8_t n, TASK *bg, uint8_t n_bg)
+	{
+		task = t;
+		num_tasks = n;
+		background = bg;
+		num_background = n_bg;
+		next_background = 0;
+		tick = 0;
+		late = 0;
+		idle_us = 0;
+		resync();
+	}
+
+	//start the current tick from now. Use after something blocked for a long time (calibration, etc) so that the scheduler
+	//doesn't report it as late and doesn't try to catch up.
+	void resync()
+	{
+		tick_stamp = micros();
+	}
+
+	inline bool due(uint8_t i)
+	{
+		return tick%task[i].period == task[i].offset;
+	}
+
+	//runs every task that is due in this tick. returns true if the tick is already over
+	bool run_tasks()
+	{
+		for(uint8_t i=0;i<num_tasks;i++)
+		{
+			if(due(i))
+			{
+				execute(task[i]);
+			}
+		}
+		if(micros() - tick_stamp > SCHED_TICK_US)
+		{
+			late++;
+			return true;
+		}
+		return false;
+	}
+
+	//background work in what is left of the tick, then wait for the next one.
+	void idle()
+	{
+		for(uint8_t k=0;k<num_background;k++)
+		{
+			TASK &b = background[next_background];
+			if(micros() - tick_stamp + b.budget > SCHED_TICK_US)
+			{
+				break; //doesn't fit, it gets the first shot in the next tick
+			}
+			execute(b);
+			next_background = (next_background+1)%num_background;
+		}
+		uint32_t wait_stamp = micros();
+		while(micros() - tick_stamp < SCHED_TICK_US)
+		{
+			for(uint8_t k=0;k<num_background;k++)
+			{
+				if(background[k].budget == 0)
+				{
+					execute(background[k]);
+				}
+			}
+		}
+		uint32_t now = micros();
+		idle_us += now - wait_stamp;
+		tick++;
+		tick_stamp += SCHED_TICK_US;
+		if(now - tick_stamp > SCHED_TICK_US) //we were late by more than a whole tick, don't try to catch up
+		{
+			tick_stamp = now;
+		}
+	}
+
+private:
+	void execute(TASK &t)
+	{
+		uint32_t start = micros();
+		t.run();
+		uint32_t took = micros() - start;
+		if(took > t.budget && t.budget) //polls have no budget, worst says how long they take
+		{
+			t.overruns++;
+		}
+		t.worst = max(t.worst,uint16_t(min(took,uint32_t(0xFFFF))));
+	}
+};
+
+#endif
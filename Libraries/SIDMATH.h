@@ -29,13 +29,13 @@
 static inline __always_inline float fast_sqrt(float x)//inversion of fast inverse square root. :P
 {
   x = fabs(x); //avoid naans.
-  long i;
+  int32_t i; //long is 32 bits on the STM32 but 64 on a PC and the trick needs exactly 32.
   float x2, y;
   const float threehalfs = 1.5f;
 
   x2 = x*0.5f;
   y  = x;
-  i  = * ( long * ) &y;                       // evil floating point bit level hacking
+  i  = * ( int32_t * ) &y;                    // evil floating point bit level hacking
   i  = 0x5f3759df - ( i >> 1 );               // what the fuck? 
   y  = * ( float * ) &i;
   y  = y * ( threehalfs - ( x2 * y * y ) );   // 1st iteration
@@ -121,6 +121,29 @@ inline __always_inline float my_sin(float a)
   return my_cos(a- M_PIB2); //I are smart.
 }//57us
 
+inline __always_inline float my_atan2(float y, float x)
+{
+  //polynomial atan on [0,1], the octant sorting does the rest. 1e-5 rad (0.0006 degrees) off at worst
+  float ax = fabs(x), ay = fabs(y);
+  if(ax == 0 && ay == 0)
+  {
+    return 0;
+  }
+  bool steep = ay > ax;
+  float t = steep ? ax/ay : ay/ax;
+  float t2 = t*t;
+  float a = t*(float(0.9998660) + t2*(float(-0.3302995) + t2*(float(0.1801410) + t2*(float(-0.0851330) + t2*float(0.0208351)))));
+  if(steep)
+  {
+    a = M_PIB2 - a;
+  }
+  if(x < 0)
+  {
+    a = float(M_PI) - a;
+  }
+  return y < 0 ? -a : a;
+}
+
 
 
 //float my_tan(float x)
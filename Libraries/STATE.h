@@ -3,355 +3,590 @@
 #include"SIDMATH.h"
 #include"PARAMS.h"
 #include"Arduino.h"
+#include"ENU.h"
+#include"MATRIX.h"
 
 #define GPS_UPDATE_RATE (float) 10.0f //gps update rate in Hz
-#define GPS_UPDATE_TIME (float) 0.1f
+#define STATE_HISTORY 120 //cycles of past estimates kept for the delayed fixes. 300ms at 400Hz : gps fixes come in ~55ms old, the companion's up to ~250ms
+#define STATE_REFRESH_CYCLES 40 //10Hz, the things predict() doesn't need every cycle. STATE_HISTORY is a multiple of it
 #define MIN_GPS_SPEED (float) 3.0f //min speed till which gps is not used for velocity correction
 #define MAX_GPS_SAcc (float) 3.0f
-#define GPS_HDOP_LIM (float) 2.5f
+#define GPS_HDOP_LIM (float) 2.5f //NAV-DOP's horizontal dilution of precision, above it the fix isn't used
 #define GPS_GLITCH_RADIUS (float) 5.0f 
-#define C1_STATE (float) 0.984414f
-#define LPF_GAIN_STATE (float) 1/128.321336f
+#define COMPANION_GATE (float) 9.21f //chi-square with 2 degrees of freedom, 99% : a position further off than this (in sigmas, squared) is an outlier
+#define COMPANION_MAX_REJECTS 10 //outliers in a row after which it's the estimate that is off, not the companion (1s at 10Hz)
 
+//the EKF's states, in this order in x and P
+#define EKF_X 0 //m East of the origin
+#define EKF_Y 1 //m North of the origin
+#define EKF_V 2 //m/s, forward speed
+#define EKF_HEAD 3 //deg, same convention as marg.mh
+#define EKF_BIAS 4 //m/s^2, accelerometer bias along the car. marg takes it off Ha
+#define EKF_STATES 5
+//the corrections a fix still has to make, see STATE::fix_pending
+#define FIX_X 1
+#define FIX_Y 2
+#define FIX_V 4
+#define FIX_HEAD 8
+//process noise, as densities : the variance added per cycle is the square times dt
+#define EKF_POS_NOISE (float) 0.005f //m/sqrt(s), what the dead reckoning doesn't explain (wheels slipping sideways, the flow's scale)
+#define EKF_ACCEL_NOISE (float) 1.0f //m/s^2/sqrt(s), on the speed marg integrates from Ha
+#define EKF_HEADING_NOISE (float) 0.5f //deg/sqrt(s), the AHRS heading drifting between the mag corrections
+#define EKF_BIAS_NOISE (float) 0.005f //m/s^2/sqrt(s), the accelerometer bias wandering with temperature
+//starting variances
+#define EKF_MAX_POS_VARIANCE (float) 1e4f //m^2. Hdop is 1e4 without a fix, that doesn't fit in a float next to 1 : the origin moves to the first good fix anyway
+#define EKF_INIT_VEL_VARIANCE (float) 0.01f
+#define EKF_INIT_HEADING_VARIANCE (float) 25.0f
+#define EKF_INIT_BIAS_VARIANCE (float) 0.0025f
+
+//what predict() and the corrections take. The sketch fills them from marg, opticalFlow, gps and jevois; STATE doesn't know about
+//those classes.
+struct STATE_MOTION //every cycle
+{
+	float mh, mh_Error; //marg's heading and its error, deg
+	float Acceleration; //marg's Ha, m/s^2
+	float V; //marg's speed, it integrated Ha with our bias taken off
+	float side, forward; //the optical flow's movement in the cycle, m. side goes in as it is, forward only for the turning correction
+	bool flow_ok; //side and forward can be believed
+	float roc; //radius of curvature from the car's model, m
+};
+
+struct STATE_FLOW //a new optical flow reading
+{
+	float V_X, V_Y; //sideways and forward speed, m/s
+	float V_Error; //m/s, OP_FLOW_MAX_V_ERROR and above when the flow can't see
+};
+
+struct STATE_GPS //a new NAV-PVT
+{
+	int32_t lon, lat; //1e-7 deg
+	float age; //s since its navigation epoch, see GPS::age()
+	float Hdop; //m, NAV-PVT's hAcc
+	float Velocity, SAcc; //ground speed and its accuracy, m/s
+	float dop; //NAV-DOP's hDOP
+	bool fix_ok; //NAV-STATUS's gpsFixOk
+};
+
+struct STATE_COMPANION //a position from the companion computer
+{
+	float X, Y; //m, in frame
+	float age; //s since the image it came from
+	float error; //m
+};
+
+struct STATE_PAST //the estimate some cycles ago, from STATE::recall()
+{
+	float X, Y, V;
+	float P[3][3]; //P's X, Y, V block then
+};
+
+/*
+the car's position, speed, heading and accelerometer bias as one extended kalman filter. The scalar filter this replaced
+(STATE_SCALAR.h, it has the long explanation of how a kalman filter works) kept one error per state and corrected each of them
+on its own; here the errors of all 5 states are in one covariance P, so a correction to one of them moves the others as much as
+they are known to go together : a gps fix that says the car is further along than we thought also says it was faster, and one
+that says it's off to the side says the heading is off.
+
+One call per sensor, each only when that sensor has something new :
+	predict()        every cycle. The car moved V*dt along the heading, plus what the flow saw it slide sideways. V is marg's (it
+	                 has integrated Ha, with our bias taken off), the heading turned by as much as marg's did. P grows by
+	                 F P F' + Q. X, Y, V go in the history for the fixes that are still on their way
+	correct_flow()   the optical flow's forward speed measures V, when the flow can be believed
+	correct_gps()    the fix is compared with what we thought at its epoch (recall()), the correction goes to the estimate now.
+	                 X, Y with Hdop, the speed with the speed accuracy if we're fast enough for the gps to know, the heading with
+	                 marg's heading error (marg's heading is only new information at the mag updates, 10Hz is about that often).
+	                 One of those per cycle, from the next predict()s on : the 4 in one cycle don't fit in it
+	correct_companion()  a position from the companion computer, delayed like a fix and older (the camera frame and the time it
+	                 took to find the cones). Gated : the innovation against what we thought then must be within COMPANION_GATE
+	                 of P + r, a cone taken for another one doesn't get in. In MODE_NO_GPS it is the only absolute position
+X, Y, Velocity ... are up to date after every call.
+
+The history keeps P's X, Y, V block along with X, Y, V : a delayed measurement is weighed against how well we knew the state
+then, not now (the dead reckoning since has only made it worse, and that isn't in the measurement).
+
+F is the identity plus 5 terms, the covariance prediction is written out for them (30 multiplies instead of the 200 of
+propagate_covariance()). Every measurement is of a single state (H is a row of the identity), so the updates are one at a
+time, one divide each and no matrix to invert.
+*/
 class STATE
 {
 public :
-	double iLat,iLon,lastLat,lastLon, latitude, longitude; 
-	float heading, Velocity, past_Velocity, last_Velocity,past_VelError, Acceleration;
-	float X, last_X, past_X, past_PosError_X, Y, last_Y, past_Y, past_PosError_Y, PosError_X, PosError_Y, VelError, PosError_tot;
+	ENU frame; //X, Y are meters East, North of its origin
+	int32_t latitude, longitude; //where the estimate is, 1e-7 deg
+	Matrix<EKF_STATES, 1> x; //X, Y, V, heading, bias, see EKF_X ... EKF_BIAS
+	Matrix<EKF_STATES, EKF_STATES> P; //covariance of x
+	float dx[EKF_STATES]; //what the last correct() did to x
+	//x and the errors as the rest of the sketch reads them, put there at the end of every call (PosError_tot at 10Hz). Velocity_Update() writes
+	//Velocity back with marg's low pass on it, it comes back in as STATE_MOTION::V
+	float X, Y, Velocity, heading, AccBias, VelError, PosError_tot;
+	float Acceleration;
+	STATE_PAST fix; //the estimate at the last fix's epoch. The corrections it still has to make go against it
 	float gps_X,gps_Y;
-	float AccBias;
+	float fix_V, fix_r, fix_r_V; //the last fix's speed, the variances of its position and speed
+	uint8_t fix_pending; //FIX_X ... FIX_HEAD, what the last fix still has to correct
+	bool fix_cycle; //predict() made one of those this cycle
 	bool position_reset;
 	float drift_Angle;
-	float xA[2][4],yA[2][4];
-	float GPS_Velocity,GPS_SAcc; //velocity from gps
-	float last_cosmh,last_sinmh;
-	float declination;
+	float last_mh, mh_Error; //marg's heading and its error last cycle, the heading is predicted by how much that turned
+	float cos_head, sin_head; //of x's heading. Turned along with it every cycle and correction, worked out again every STATE_REFRESH_CYCLES cycles
+	float q_pos, q_vel, q_head, q_bias; //the process noise added every cycle
+	float history[STATE_HISTORY][3]; //X, Y, V at the end of the last cycles, newest at history_head, less history_shift at the time
+	float history_P[STATE_HISTORY][6]; //P's X, Y, V block at the end of the same cycles : XX, XY, YY, XV, YV, VV. As it was then, the fixes since aren't in it
+	float history_shift[3]; //what the fixes corrected since the start. The history moves with the estimate without touching it
+	uint8_t history_head;
+	uint8_t companion_rejects; //outliers in a row
+	uint16_t companion_outliers; //since initialize(), for the logs
+
+	static float wrap_180(float a)
+	{
+		if(a > M_PI_DEG)
+		{
+			a -= M_2PI_DEG;
+		}
+		if(a < -M_PI_DEG)
+		{
+			a += M_2PI_DEG;
+		}
+		return a;
+	}
+
+	void heading_trig()
+	{
+		cos_head = cosf(x(EKF_HEAD, 0)*DEG2RAD);
+		sin_head = sinf(x(EKF_HEAD, 0)*DEG2RAD);
+	}
 
-    float LPF(int i,float x)
+	//cos_head, sin_head turned by a deg instead of 2 trig calls (28us). For the degree or so of a cycle or a fix, cos and sin to
+	//the second order are good to 1e-9 (1e-6 at 5 deg), and heading_trig() starts them over at 10Hz
+	void turn_trig(float a)
 	{
-	  xA[i][0] = xA[i][1]; 
-	  xA[i][1] = x*LPF_GAIN_STATE;
-	  yA[i][0] = yA[i][1]; 
-	  yA[i][1] =   (xA[i][0] + xA[i][1]) + ( C1_STATE* yA[i][0]); // first order LPF to predict new speed.
-	  return yA[i][1];
+		float t = a*DEG2RAD;
+		float h = 1.0f - 0.5f*t*t;
+		float c = cos_head*h - sin_head*t;
+		sin_head = sin_head*h + cos_head*t;
+		cos_head = c;
 	}
 
-	void initialize(double lon,double lat,double Hdop, float head, float Vel, float acc)
+	void publish()
 	{
-		iLat = lastLat = latitude = lat;
-		iLon = lastLon = longitude = lon;
-		X = last_X = gps_X = past_X = 0;
-		Y = last_Y = gps_Y = past_Y = 0;
-		PosError_X = PosError_Y = float(Hdop);
-		if(Hdop>2.5)
+		if(x(EKF_HEAD, 0) >= M_2PI_DEG) //the heading must be within [0.0,360.0]
 		{
-			position_reset = true;//iLat and iLon will need to be reset later if gps becomes available mid-mission
+			x(EKF_HEAD, 0) -= M_2PI_DEG;
 		}
-		else
+		if(x(EKF_HEAD, 0) < 0.0f)
 		{
-			position_reset = false;
+			x(EKF_HEAD, 0) += M_2PI_DEG;
 		}
-		past_PosError_X = PosError_X;
-		past_PosError_Y = PosError_Y;
-		VelError = past_VelError = 0;
-		heading = head;
-		last_cosmh = cosf(head*DEG2RAD);
-		last_sinmh = sinf(head*DEG2RAD);
-		Velocity = past_Velocity = last_Velocity = Vel;
+		X = x(EKF_X, 0);
+		Y = x(EKF_Y, 0);
+		Velocity = x(EKF_V, 0);
+		heading = x(EKF_HEAD, 0);
+		AccBias = x(EKF_BIAS, 0);
+		VelError = fast_sqrt(P(EKF_V, EKF_V));
+	}
+
+	void initialize(int32_t lon, int32_t lat, float Hdop, float head, float Vel, float acc) //lon, lat in 1e-7 deg like NAV-PVT
+	{
+		frame.set_origin(lon, lat);
+		latitude = lat;
+		longitude = lon;
+		x.zero();
+		x(EKF_V, 0) = Vel;
+		x(EKF_HEAD, 0) = head;
+		x(EKF_BIAS, 0) = AccBias; //a warm start puts the last run's bias there before this
+		P.zero();
+		P(EKF_X, EKF_X) = P(EKF_Y, EKF_Y) = min(Hdop*Hdop, EKF_MAX_POS_VARIANCE);
+		P(EKF_V, EKF_V) = EKF_INIT_VEL_VARIANCE;
+		P(EKF_HEAD, EKF_HEAD) = EKF_INIT_HEADING_VARIANCE;
+		P(EKF_BIAS, EKF_BIAS) = EKF_INIT_BIAS_VARIANCE;
+		position_reset = Hdop > GPS_HDOP_LIM; //the origin will need to be moved later if gps becomes available mid-mission
+		gps_X = gps_Y = 0;
+		fix_pending = 0;
+		fix_cycle = false;
+		last_mh = head;
+		mh_Error = 0;
+		heading_trig();
+		q_pos = EKF_POS_NOISE*EKF_POS_NOISE*dt;
+		q_vel = EKF_ACCEL_NOISE*EKF_ACCEL_NOISE*dt;
+		q_head = EKF_HEADING_NOISE*EKF_HEADING_NOISE*dt;
+		q_bias = EKF_BIAS_NOISE*EKF_BIAS_NOISE*dt;
 		Acceleration = acc; //initially acc, vel should be close to 0
-		declination = 0;
+		drift_Angle = 0;
+		history_shift[0] = history_shift[1] = history_shift[2] = 0;
+		for(history_head = 0; history_head < STATE_HISTORY; history_head++)
+		{
+			remember();
+		}
+		history_head = 0;
+		companion_rejects = 0;
+		companion_outliers = 0;
+		publish();
+		PosError_tot = fast_sqrt(P(EKF_X, EKF_X) + P(EKF_Y, EKF_Y));
 	}
 
-	void rotate_point(float &x, float &y, float gyro_drift)
+	//same, but keeps an origin from before (the warm start) and places the car where lon, lat is in it, so that waypoints laid
+	//out against that origin still line up
+	void initialize(int32_t origin_lon, int32_t origin_lat, int32_t lon, int32_t lat, float Hdop, float head, float Vel, float acc)
 	{
-		float _x = x;
-		float _y = y;
-		float th = gyro_drift*DEG2RAD;
-		float cost = cosf(th);
-		float sint = sinf(th);
-		x = _x*cost - _y*sint;
-		y = _y*cost + _x*sint;
+		initialize(origin_lon, origin_lat, Hdop, head, Vel, acc);
+		frame.project(lon, lat, x(EKF_X, 0), x(EKF_Y, 0));
+		gps_X = x(EKF_X, 0);
+		gps_Y = x(EKF_Y, 0);
+		longitude = lon;
+		latitude = lat;
+		for(history_head = 0; history_head < STATE_HISTORY; history_head++)
+		{
+			remember();
+		}
+		history_head = 0;
+		publish();
 	}
 
-	//fuse GPS, magnetometer, Acclereometer, Optical Flow
-	void state_update(double lon, double lat, bool tick,double Hdop, float GPS_Velocity, float GPS_SAcc, float gHead, float headAcc,
-					 float mh, float mh_Error, float yawRate, float mh_drift, float Acceleration,float Vacc, float VError,
-					 float OF_X, float OF_Y, float OF_V_X, float OF_V_Y, float OF_P_Error, float OF_V_Error, float model[3])
+	//this cycle's X, Y, V and P block into the history
+	void remember()
 	{
-		// mh += declination;// COMMENT
-		if(mh >= M_2PI_DEG) // the mh must be within [0.0,360.0]
-		{
-			mh -= M_2PI_DEG;
-		}
-		if(mh < 0.0f)
-		{
-			mh += M_2PI_DEG;
-		}
-		float cosmh = cosf(mh*DEG2RAD); //OPTIMIZE
-		float sinmh = sinf(mh*DEG2RAD);
-		float Xacc,Yacc,dS_y,dSError,dTheta;
-		float PosGain_Y, PosGain_X, VelGain;
-		float separation;
-		float shift_X=0,shift_Y=0,innovation=0; // added on 5/5/19
-		heading = mh;
-		float head_Innovation = 0;
-		float head_gain = 0;
-		VelError = VError; //VelError is the velocity erro in the "state." I'm transferring the velocity error from outside to the object member
-		/*
-		OVERVIEW:
-		OVERVIEW OF COMMON SENSE FILTER : (aka kalman filter)
-		imagine a 1-D case. You have 1 position measurement device and 1 speed measurement device. say the error in speed is 0.1 m/s 
-		(constant for the device)
-		Assume the position measurement error is variable(which it usually is). Assume that the velocity is also more or less constant 
-		(For the sake of simplicity)
-		lets say that the initial position was X = 0. Assume that initially, position error was = 1
-		At t = 0 the speed measurement device gave speed = 5m/s
-		at t = 1 second, the estimated position = speed*time_elapsed = 5*1 = 5 meters.
-		the error in the estimated position can be upto Previous_Error + (error_in_speed*time_elapsed) = 1 + 0.1 = 1.1 meters
-		the position measurement device gives the position as 7 meters with an error of 2.2 meters. 
-		the gain for the measurement is calculated as 
-							error in estimate 					1.1
-		gain = --------------------------------------- = 	----------- = 1/3 = 0.33
-				error in estiate + error in measurement		 2.2 + 1.1
-		
-		corrected position = meas*gain + (1-gain)*estimate (1)
-		the corrected position is = 7*0.33 + 5(1-0.33) = 5.66 meters. 
-		now that the position has been corrected, the error in the position must have also been corrected and so the new position error is
-		positionError = previous position Error * (1 - 0.33) ;
-
-		These formulas can be derived very easily. The kalman filter assumes that the distribution of the variables 
-		(estimated position and measured position)is gaussian (which is a fair assumption for most quantities). 
-		When 2 gaussian distributions are multiplied, the mean of the new gaussian distribution is calculated by formula (1) 
-		(you can try this yourself. Multiply 2 gaussian distributions and see what the final one's mean looks like)
-		and the new "variance" (which we call error here) is the estimate's error multiplied by the complement of the gain.
-		check out this website for more math http://www.bzarg.com/p/how-a-kalman-filter-works-in-pictures/
-		
-		Is the implementation here a kalman filter (or EKF)? Well, yes and no. Fundamentally, it follows the steps laid out above
-		(which btw are followed by all variations of KF. The only things that change are how you get the error in the estimates). 
-		However, the implementation avoids the use of matrices for the sake of understandability for the layman who doesn't have
-		a clue what a jacobian matrix is. You see, in almost all implementations of the KF, the logic appears to be more complicated 
-		than it actually is. This particular implementation isn't short but it is a lot easier to understand in my opinion because
-		you can see what is really happening with the errors and the estimates. In other implementations, you look at a matrix 'Q' 
-		and say oh its the covariance matrix and god only knows what's really going on with the terms inside it. Here, there is no 
-		covariance matrix. The covariance matrix essentially represents the inter dependence between the variance of the variables 
-		being tracked simultaneously (Say the inter dependence of speed and position). Here, I work with the terms that would be inside
-		that matrix without ever invoking matrix into the code (error in position is dependent on error in speed which is dependent on
-		error in acceleration.). Some part of the actual filter isn't even in this header file,
-		it is in the MPU9150 header file(for a good reason which I will not elaborate here), 
-		which is why I would suggest against copy pasting this implementation(also, why would you. 
-		The code should be sufficiently easy to understand in order for you to write
-		your own implementation of it for whatever purpose you may have).
-
-		Extended kalman filter brief : 
-		In a linear kalman filter, it is assumed that the estimate varies linearly and so does the error in the estimate
-		(the 1-D case is a perfect example). However, if you consider a case where the object is moving in 2 dimensions,
-		say moving on a curved path, then the error in the estimated position is not only due to the error in speed but also due to
-		the error in the estimated bearing. When we deal with a 1-D case, the formula for error in the estimated position is obtained 
-		from the derivative of the position, i.e., is position = V*dt, then position_Error = dV *dt, where dV is the error in speed.
-		here, the position is 2 dimensional, position_X = speed*cosf(bearing)*dt, position_Y = speed*sinf(bearing)*dt,
-		therefore error_X = (error_in_speed*cosf(bearing) - speed*sinf(bearing)*error_in_bearing)*dt and similarly you can find the formula for error_Y
-
-		Now in a standard implementation of EKF, the above thing is actually represented by a jacobian matrix 
-		(the determinant of the jacobian should result in the above equations). Here, I lay out the inner workings in plain view for all to understand.
-		(Also, note that our state transition is not linear. Let me know if I missed something!)
-
-		Also one more thing, This isn't a mathematically perfect implementation, and by perfect I mean absolutely perfect, like no discrepancies 
-		between this and theory sort of perfect. When estimating position from the optical Flow, I don't consider the error in the heading 
-		(it seems a bit dubious because the error isn't going to be integrated and the error in the optical flow readings is so small (at most 5 mm or so)
-
-		This function takes data from position, Hdop and validity from gps, takes heading, heading error, acceleration, estimated Velocity,
-		error in estimated velocity from IMU, change in position along car's X, Y axis, speed along car's X, Y axis, position Error and 
-		Velocity Error from optical flow
-		
-		WORKING: (the comments alonside the code are also a part of this section)
-		the velocity is estimated and error is integrated within the IMU code (MPU9150.cpp) itself but the corrections and bias calculations 
-		are performed here
-		The next order of business is to find the distance moved since the last cycle(2.5ms) (dS) based on the velocity estimate(V) 
-		Then we compute the estimated position based on the distance moved(but this isn't the final estimate) from the IMU (Xacc->X accelerometer)
-		then we compute the error in distance moved (dSError) and the error in the heading(well it's given already we just change the units from degrees to radians)
-		the error in the position estimate is not just the error in velocity*dt. As explained in the Extended kalman briefing, the formula here is different
-		*/
-		//POSITION ESTIMATE USING THE ACCELEROMETER (WORKING CONTINUED)
-		//Acceleration bias is removed in the MPU9250 code itself(the name of the library is 9150 but it can be used with 9250 as well).
-		//CORRECTING VELOCITY FIRST
-		// if(OF_V_Error>OP_FLOW_MAX_V_ERROR and GPS_SAcc > MAX_GPS_SAcc) //if optical flow sensor and GPS are both defunct, use the model velocity regardless of speed. 
-		// {
-		// 	model[1] = max(model[0]*10,3.0f);
-		// 	VelGain = VelError/(model[1] + VelError); //encoder_velocity[0] is speed, [1] is error
-		// 	Vacc = (1.0f - VelGain)*Vacc + VelGain*model[0]; //correction step correcting the velocity from the accelerometer section
-		// 	VelError *= (1.0f - VelGain); //TODO : CHECK THE MODEL
-		// }
+		float (&p)[EKF_STATES][EKF_STATES] = P.m;
+		float *h = history[history_head], *hp = history_P[history_head];
+		h[0] = x(EKF_X, 0) - history_shift[0];
+		h[1] = x(EKF_Y, 0) - history_shift[1];
+		h[2] = x(EKF_V, 0) - history_shift[2];
+		hp[0] = p[0][0];
+		hp[1] = p[0][1];
+		hp[2] = p[1][1];
+		hp[3] = p[0][2];
+		hp[4] = p[1][2];
+		hp[5] = p[2][2];
+	}
 
-		//The optical Flow's error skyrockets(goes from a few millimeters (normal) to 1000 meters) when the surface quality is bad or if the sensor is defunct
-		if(Velocity>OP_FLOW_MAX_SPEED) // if velocity is more than 3 m/s, accelerometer becomes reliable. In case that Optical flow error is greater than 1, accelerometer alone is used.
-		{							   //while this does mean that velocity is not corrected for these situations, it is important as during such situations the optical flow is not reliable, at least not ADNS3080
-			OF_V_Error *= 1e6;
-			OF_P_Error = OF_V_Error;
-		}	
-		VelGain = VelError/(VelError + OF_V_Error);//the reason why velocity has only one dimension is because the car's motion is constrained. While you could compute the 
-								//Velocity in the NED fashion, it would be equivalent to going on a fools errand here. If there is a constraint, exploit it.
-
-		Velocity = OF_V_Y*VelGain + (1-VelGain)*Vacc;//correcting the velocity estimate
-		VelError *= (1-VelGain);//reduce the error in the estimate.
-		//find the difference between prediction and measurement.
-		//this bias is for "tuning" the accelerometer for times when the optical flow isn't reliable
-		if(OF_V_Error<10)
-		{
-			AccBias += (Vacc - OF_V_Y)*VelGain*dt*dt;//keep adjusting bias while optical flow is trustworthy. dt is just there to make the adjustments smaller
-		}
-		//use the optical flow speed to prevent the bias from skyrocketting the fuck outta dodge.
-		//this is the covariance stuff(using the corrected estimates to correct errors in states other than the one being corrected)
-		//distance moved in last cycle
-		
-		dS_y = Velocity*dt;// + 0.5*Acceleration*dt*dt;//is this formula correct? hmm..(does it matter? seeing that the first term is 2 orders of magnitude larger than the second one under most circumstances?)
-		Xacc = X + dS_y*cosmh;//estimated X position.
-		Yacc = Y + dS_y*sinmh;//estimated Y position
-		dSError = VelError*dt;//error in instantaneous distance travelled
-		dTheta = mh_Error*DEG2RAD;//error in heading
-
-		PosError_X += fabs(dSError*cosmh - dS_y*sinmh*dTheta);//remember that thing called the "Jacobian matrix" in EKF? Yeah. These are the terms from that matrix.
-		PosError_Y += fabs(dSError*sinmh + dS_y*cosmh*dTheta);//the jacobian is simply a matrix that contains the partial derivatives.
-
-		//POSITION ESTIMATE USING BOTH THE ACCELEROMETER AND THE OPTICAL FLOW
-		//note that the optical flow error will skyrocket if it the sensor is defunct or if the surface quality is poor.
-		if(fabs(model[2]) < deadBand_ROC && fabs(model[2]) > 0.5 && OF_V_Error < OP_FLOW_MAX_V_ERROR)//make sure that the sensor readings are correct and the roc is less than deadband roc
-		{
-			OF_X += OF_Y*OP_POS/model[2]; //the '+' sign is there because there is already a '-' in the term that is subtracted.
-		}
-		X += cosmh*OF_Y; // the optical flow can measure movement along the car's X and Y directions.
-		Y += sinmh*OF_Y; //
-
-		PosGain_X = PosError_X/(PosError_X + OF_P_Error); //optical flow error is assumed to be circular
-		PosGain_Y = PosError_Y/(PosError_Y + OF_P_Error);
-		X = X*PosGain_X + (1-PosGain_X)*Xacc;//in most implementations, you would see this happening through matrix multiplication. 
-		Y = Y*PosGain_Y + (1-PosGain_Y)*Yacc;//This is partly because the problem is actually a 3 dimensional position problem for drones whereas it is a 2 dimensional problem for cars											 
-		PosError_X *= (1-PosGain_X);//and as you can see, the number of lines I would have to write for 3 dimensional fusion would be even greater than this,
-		PosError_Y *= (1-PosGain_Y);// which makes matrix multiplication methods look more attractive.
-		
-		X += sinmh*OF_X; // the body frame X axis movement has no other source of information, so therefore there can be no filtering for it.
-		Y -= cosmh*OF_X;
-
-		//rotate_point(X,Y,mh_drift);
-
-		//POSITION ESTIMATION USING GPS + ESTIMATED POSITION FROM PREVIOUS METHODS
-		if(tick && !position_reset )//if new GPS data was received and the data is useful, fuse it with the estimates(because why would you want to fuse garbage into garbage)
-		{	/*
-			We have the current estimate for the position, but the gps data corresponds to the position 100ms ago (the gps update rate is 10Hz).
-			So we have to do the data fusion in the past, find the corrected position in the past and then shift the current position estimate by
-			the difference in the corrected past position and the estimated past position.
-			so lets take a simple example to understand the code. lets say during runtime, the last position known from GPS is X=1
-			this would have been my position 200ms ago. The position I get now is say X = 3. This would have been my position 100 ms ago 
-			(the gps data lags by 100ms).The last_X = (3-1) + 1 = 3.(its possible that the 1 wasn't 1 but like 1.25 after filtering, 
-			making the actual last_X = 3.25 but we'll assume perfect case for now for the sake of simplicity).
-			lets say my current estimate for position is 5 meters and my past_X was 3.4 meters. 
-			lets say my past Error estimate is equal to the gps's Hdop(meaning both have equal error). So the filtered past_X = 3.2 meters
-			now my current position of 5 meters is predicated on the assumption that I was at 3.4 meters 100ms ago. So, in order to correct that
-			I will shift my current position by the "difference between past_X estimate and past_X filtered value", which in this case would be 
-			3.2 - 3.4 = -0.2 
-			meaning that my current position estimate is shifted to 5 + (-0.2) = 4.8 meters.
-			*/
-			gps_X = last_X = float((lon - iLon)*DEG2METER);// + last_X;//getting the last gps position 
-			gps_Y = last_Y = float((lat - iLat)*DEG2METER);// + last_Y; 
-
-			lastLon = lon;//setting lastLat, lastLon for next iteration
-			lastLat = lat; 
-			
-			separation = distancecalcy(gps_X,past_X,gps_Y,past_Y,0);
-			if(separation > GPS_GLITCH_RADIUS || (Hdop > GPS_HDOP_LIM)) 
+	//the estimate age seconds ago (to the nearest cycle)
+	void recall(float age, STATE_PAST &then)
+	{
+		uint32_t back = age > 0 ? uint32_t(age*LOOP_FREQUENCY + 0.5f) : 0;
+		if(back > STATE_HISTORY - 1) //older than we remember, the oldest one is the closest we have
+		{
+			back = STATE_HISTORY - 1;
+		}
+		uint8_t i = history_head >= back ? history_head - back : history_head + STATE_HISTORY - back;
+		const float *h = history[i], *hp = history_P[i];
+		then.X = h[0] + history_shift[0];
+		then.Y = h[1] + history_shift[1];
+		then.V = h[2] + history_shift[2];
+		then.P[0][0] = hp[0];
+		then.P[0][1] = then.P[1][0] = hp[1];
+		then.P[1][1] = hp[2];
+		then.P[0][2] = then.P[2][0] = hp[3];
+		then.P[1][2] = then.P[2][1] = hp[4];
+		then.P[2][2] = hp[5];
+	}
+
+	//measurement of state k, innovation y (measured - estimated), variance r. K = P(:,k)/(P(k,k) + r), x += K y, P -= K P(k,:)
+	void correct(uint8_t k, float y, float r)
+	{
+		float (&p)[EKF_STATES][EKF_STATES] = P.m;
+		float s = 1.0f/(p[k][k] + r);
+		float pk[EKF_STATES], K[EKF_STATES];
+		for(uint8_t i = 0; i < EKF_STATES; i++)
+		{
+			pk[i] = p[k][i];
+			K[i] = pk[i]*s;
+			dx[i] = K[i]*y;
+			x.m[i][0] += dx[i];
+		}
+		for(uint8_t i = 0; i < EKF_STATES; i++)
+		{
+			for(uint8_t j = i; j < EKF_STATES; j++)
 			{
-				position_reset = true;
-				Hdop = 1e7;
+				if(i != k && j != k)
+				{
+					p[i][j] = p[j][i] = p[i][j] - K[i]*pk[j];
+				}
+			}
+		}
+		float rs = r*s; //row k is P(k,:)*r/(P(k,k) + r). Written that way it doesn't come out as the difference of two big numbers
+		for(uint8_t j = 0; j < EKF_STATES; j++)
+		{
+			p[k][j] = p[j][k] = pk[j]*rs;
+		}
+	}
+
+	//a delayed measurement of state k (X, Y or V), the innovation y against then. State k gets the gain it would have had
+	//then, then.P(k,k)/(then.P(k,k) + r) : how well we knew it at the epoch against how good the measurement is. The rest
+	//get theirs along P(:,k) now, which has the corrections made since the epoch in it (the flow's every cycle, the
+	//companion's, the fixes) where then.P doesn't : then.P as the cross-covariance would take out more than P now has and
+	//turn it negative, after which no gate holds. P is updated for that gain in Joseph form, (I - K H) P (I - K H)' + K r K'.
+	//With K along P(:,k) that is P - P(:,k) P(k,:) g(2 - g(P(k,k) + r)), positive whatever g is and as cheap as correct().
+	//It is an approximation : the innovation is then's, but F across the delay is taken as the identity and the gain is not
+	//what re-running the cycles since would give. Host/bench/lucifer_delay holds it to such a replay (~4mm rms on its drive)
+	//What it did to the estimate now also goes into then and the history, so that the next measurement from that time (the
+	//other axis) and the next fix see it
+	void correct_past(uint8_t k, float y, float r, STATE_PAST &then)
+	{
+		float (&p)[EKF_STATES][EKF_STATES] = P.m;
+		float d = 1.0f/((then.P[k][k] + r)*p[k][k]); //one divide for both
+		float s = p[k][k]*d; //1/(then.P(k,k) + r)
+		float rs = r*s;
+		float g = then.P[k][k]*d; //K = P(:,k) g, so that K(k) is the gain at the epoch
+		float gy = g*y;
+		float w = g*(2.0f - g*(p[k][k] + r));
+		float pk[EKF_STATES], C[3];
+		for(uint8_t i = 0; i < EKF_STATES; i++)
+		{
+			pk[i] = p[k][i];
+			dx[i] = pk[i]*gy;
+			x.m[i][0] += dx[i];
+		}
+		for(uint8_t i = 0; i < EKF_STATES; i++)
+		{
+			float wi = pk[i]*w;
+			for(uint8_t j = i; j < EKF_STATES; j++)
+			{
+				p[i][j] = p[j][i] = p[i][j] - wi*pk[j];
 			}
-			// if(Hdop<GPS_HDOP_LIM)
-			// 	Hdop *= 0.2;
-			//the gps is assumed to have a circular error, meaing it's error in X direction is equal to it's error in Y direction = Hdop
-			PosGain_X = (past_PosError_X / (past_PosError_X + float(Hdop) )); //new position gain for X (East-West)
-			PosGain_Y = (past_PosError_Y / (past_PosError_Y + float(Hdop) )); //new position gain for Y (North-South)
-
-			last_X = PosGain_X*last_X + (1-PosGain_X)*past_X; // past_X,past_Y are the past Estimates for position 
-			last_Y = PosGain_Y*last_Y + (1-PosGain_Y)*past_Y; // last_X,last_Y are the past corrected position 
-															  //(I didn't create separate variables for measurement because it seemed like a waste of memory)
-			if(GPS_Velocity > MIN_GPS_SPEED && !position_reset)//explanation given in the codeblock itself.
+		}
+		for(uint8_t i = 0; i < 3; i++)
+		{
+			C[i] = then.P[k][i];
+		}
+		for(uint8_t i = 0; i < 3; i++) //then's block the same way
+		{
+			for(uint8_t j = i; j < 3; j++)
 			{
-				//the velocity error is the average of the old position estimate error and the new position estimate error multiplied by the update rate. 
-				VelGain = (past_VelError/(past_VelError + GPS_SAcc)); //find the gain to correct the past estimate
-				last_Velocity = VelGain*GPS_Velocity + (1-VelGain)*past_Velocity;//correct the last velocity.
-				
-				innovation = (last_Velocity - past_Velocity);
-				
-				Velocity += innovation;//shift the new velocity by the "innovation" 5/5/19
-				VelError *= (1-VelGain); //reduce the velocity error
-				
-				shift_X = innovation*GPS_UPDATE_TIME*(cosmh+last_cosmh)*0.5f;// I need you to get wayy off my back on the logistics of this.5/5/19
-				shift_Y = innovation*GPS_UPDATE_TIME*(sinmh+last_sinmh)*0.5f;//5/5/19
-				last_cosmh = cosmh;//5/5/19
-				last_sinmh = sinmh;
-				
-				//this is the "magical thing" about kfs that the kf boys(including myself) nut to before we sleep. 
-				//Not only is it correcting the position estimate(which is what you initially wanted), it is also correcting the velocity estimate by
-				//exploiting the relation between speed and position. Now the problem here is that if you're travelling at really slow speeds 
-				//by gps standards, i.e., less than 3m/s, this correction might actually be counter-productive.
-				
-				// if(fabs(yawRate)<10.0f)
-				// {
-				// 	head_Innovation = heading - gHead;
-				// 	if(head_Innovation >= M_PI_DEG) // the head_Innovation must be within [0.0,360.0]
-				// 	{
-				// 		head_Innovation -= M_2PI_DEG;
-				// 	}
-				// 	if(head_Innovation <= -M_PI_DEG)
-				// 	{
-				// 		head_Innovation += M_2PI_DEG;
-				// 	}
-				// 	head_gain = mh_Error/(mh_Error + headAcc);
-				// 	declination -= head_Innovation*head_gain;
-				// }
+				if(i != k && j != k)
+				{
+					then.P[i][j] = then.P[j][i] = then.P[i][j] - C[i]*C[j]*s;
+				}
 			}
+			then.P[k][i] = then.P[i][k] = C[i]*rs;
+		}
+		then.X += dx[EKF_X];
+		then.Y += dx[EKF_Y];
+		then.V += dx[EKF_V];
+		history_shift[0] += dx[EKF_X];
+		history_shift[1] += dx[EKF_Y];
+		history_shift[2] += dx[EKF_V];
+	}
+
+	//predict : what the car did this cycle. Every cycle, before the corrections
+	void predict(const STATE_MOTION &m)
+	{
+		float (&p)[EKF_STATES][EKF_STATES] = P.m;
+		float turn = wrap_180(m.mh - last_mh); //marg's heading is wrapped to [0, 360) too
+		last_mh = m.mh;
+		mh_Error = m.mh_Error;
+		Acceleration = m.Acceleration;
+		x(EKF_HEAD, 0) += turn;
+		if(history_head%STATE_REFRESH_CYCLES == 0) //10Hz
+		{
+			heading_trig(); //so that the small errors of the rotation below don't add up
+			PosError_tot = fast_sqrt(p[0][0] + p[1][1]); //only the GCS looks at it, at 10Hz
+		}
+		else
+		{
+			turn_trig(turn);
+		}
+		float V = m.V; //marg has done V += (Ha - bias)*dt from the speed we gave it last time
+		float side = m.side;
+		if(fabs(m.roc) < deadBand_ROC && fabs(m.roc) > 0.5 && m.flow_ok)//make sure that the sensor readings are correct and the roc is less than deadband roc
+		{
+			side += m.forward*OP_POS/m.roc; //the flow sensor isn't on the rear axle, it sees the car swing around when it turns
+		}
+		float dS = V*dt;
+		x(EKF_X, 0) += dS*cos_head + sin_head*side; //the flow can measure the sideways movement, nothing else can, so that is taken as it is
+		x(EKF_Y, 0) += dS*sin_head - cos_head*side;
+		x(EKF_V, 0) = V;
+		//the jacobian's terms that aren't the identity's
+		float a = cos_head*dt; //dX/dV
+		float b = -(dS*sin_head - cos_head*side)*DEG2RAD; //dX/dheading
+		float c = sin_head*dt; //dY/dV
+		float d = (dS*cos_head + sin_head*side)*DEG2RAD; //dY/dheading
+		float e = -dt; //dV/dbias
+		//F P first. Rows 3, 4 of F are the identity's, so only rows 0, 1, 2 change (and of those, only what the next step needs)
+		float r0[EKF_STATES], r1[EKF_STATES], r2[EKF_STATES];
+		for(uint8_t j = 0; j < EKF_STATES; j++)
+		{
+			r0[j] = p[0][j] + a*p[2][j] + b*p[3][j];
+		}
+		for(uint8_t j = 1; j < EKF_STATES; j++)
+		{
+			r1[j] = p[1][j] + c*p[2][j] + d*p[3][j];
+		}
+		for(uint8_t j = 2; j < EKF_STATES; j++)
+		{
+			r2[j] = p[2][j] + e*p[4][j];
+		}
+		//then (F P) F', upper triangle. Column j of F' is row j of F
+		p[0][0] = r0[0] + a*r0[2] + b*r0[3] + q_pos;
+		p[0][1] = r0[1] + c*r0[2] + d*r0[3];
+		p[1][1] = r1[1] + c*r1[2] + d*r1[3] + q_pos;
+		p[0][2] = r0[2] + e*r0[4];
+		p[1][2] = r1[2] + e*r1[4];
+		p[2][2] = r2[2] + e*r2[4] + q_vel;
+		p[0][3] = r0[3];
+		p[1][3] = r1[3];
+		p[2][3] = r2[3];
+		p[0][4] = r0[4];
+		p[1][4] = r1[4];
+		p[2][4] = r2[4];
+		p[3][3] += q_head;
+		p[4][4] += q_bias;
+		for(uint8_t i = 1; i < EKF_STATES; i++)
+		{
+			for(uint8_t j = 0; j < i; j++)
+			{
+				p[i][j] = p[j][i];
+			}
+		}
 
-			PosError_X *= (1 - PosGain_X); //reduce the position error after each correction from gps.
-			PosError_Y *= (1 - PosGain_Y); //this isn't exactly right(mathematically speaking) but then it would take too much memory 
-			past_PosError_X = PosError_X;  //to remember the position error at every instant of time and re-calculate it recursively upto the current
-			past_PosError_Y = PosError_X;  //time every correction step. (there are 40 estimate steps between each correction step)
-										   //In my estimation, this should produce decent results too.
-			past_VelError = VelError; //past Velocity error is the current velocity error now
+		fix_cycle = fix_pending != 0;
+		if(fix_cycle)
+		{
+			correct_fix();
+		}
 
-			X += (last_X - past_X) + shift_X; //some part of the shift is due to the velocity correction correcting the position. 5/5/19
-			Y += (last_Y - past_Y) + shift_Y; //shift by the difference between last corrected position and last estimated position.
+		//remember where this cycle ended up for the fixes that are still on their way
+		history_head = history_head == STATE_HISTORY - 1 ? 0 : history_head + 1;
+		remember();
+		publish();
+		frame.unproject(X, Y, longitude, latitude); //change lat and long accordingly. 
+		//note that if the location was initially wrong, moving the origin resets the lon/lat estimates without disturbing the relative position estimates 
+	}
 
-			past_X = X; //the value of X,Y,V become the "past estimates"(=last predicted velocities) for the next iteration
-			past_Y = Y;
-			past_Velocity = Velocity;
+	//a new optical flow reading. The forward speed measures V
+	void correct_flow(const STATE_FLOW &f)
+	{
+		drift_Angle = (f.V_X/Velocity); //uncomment when you have a quick atan function
+		//The optical Flow's error skyrockets(goes from a few millimeters (normal) to 1000 meters) when the surface quality is bad or if the sensor is defunct
+		//and above OP_FLOW_MAX_SPEED it can't keep up (ADNS3080), the accelerometer alone is used then
+		if(Velocity > OP_FLOW_MAX_SPEED || f.V_Error >= OP_FLOW_MAX_V_ERROR)
+		{
+			return;
 		}
-		if(position_reset && Hdop < GPS_HDOP_LIM && tick)//position reset condition is checked before using gps data to prevent jumps in position when gps error drops below 2.5m
+		if(fix_cycle) //a fix's correction and this one don't both fit in the cycle. 4 cycles in 40, the next reading measures the same speed
 		{
-			lastLat = lat;
-			lastLon = lon;
-			last_X = past_X = X;
-			last_Y = past_Y = Y;
-			past_Velocity = last_Velocity = Velocity; //initialize the "past_velocity"
-			past_VelError = VelError;
-			past_PosError_X = PosError_X;
-			past_PosError_Y = PosError_Y;
+			return;
+		}
+		correct(EKF_V, f.V_Y - x(EKF_V, 0), f.V_Error*f.V_Error);
+		remember(); //predict() has put this cycle in the history already. Only this one : the flow now says nothing about where we were before
+		publish();
+	}
 
-			iLat = lat - double(past_Y*METER2DEG);//lat lon reported by gps matches with the past value of position.
-			iLon = lon - double(past_X*METER2DEG);
+	//one of the corrections the last fix still has to make, from predict() : X, Y, V, then the heading
+	void correct_fix()
+	{
+		if(fix_pending & FIX_X)
+		{
+			fix_pending &= ~FIX_X;
+			correct_past(EKF_X, gps_X - fix.X, fix_r, fix);
+		}
+		else if(fix_pending & FIX_Y)
+		{
+			fix_pending &= ~FIX_Y;
+			correct_past(EKF_Y, gps_Y - fix.Y, fix_r, fix); //the X correction moved fix.Y too
+		}
+		else if(fix_pending & FIX_V)
+		{
+			fix_pending &= ~FIX_V;
+			correct_past(EKF_V, fix_V - fix.V, fix_r_V, fix);
+		}
+		else
+		{
+			fix_pending = 0;
+			correct(EKF_HEAD, wrap_180(last_mh - x(EKF_HEAD, 0)), mh_Error*mh_Error);
+		}
+		turn_trig(dx[EKF_HEAD]);
+	}
+
+	//a new gps fix. X, Y and the speed are compared with what we thought at its epoch, marg's heading goes in with it. Only the
+	//checks here, the corrections are made by the next 4 predict()s
+	void correct_gps(const STATE_GPS &g)
+	{
+		recall(g.age, fix); //what we thought at the fix's epoch
+		fix_pending = 0; //whatever the last fix had left, this one is newer
+		bool good = g.fix_ok && g.dop < GPS_HDOP_LIM; //within the receiver's own masks, and the satellites aren't all in a line
+		if(!position_reset)//if the data is useful, fuse it with the estimates(because why would you want to fuse garbage into garbage)
+		{
+			frame.project(g.lon, g.lat, gps_X, gps_Y);//getting the last gps position 
+			float ex = gps_X - fix.X, ey = gps_Y - fix.Y;
+			if(ex*ex + ey*ey > GPS_GLITCH_RADIUS*GPS_GLITCH_RADIUS || !good) //squared, no sqrt
+			{
+				position_reset = true;
+				good = false; //not now, the origin moves at the next good fix
+			}
+			else
+			{
+				//the gps is assumed to have a circular error, meaing it's error in X direction is equal to it's error in Y direction = Hdop
+				fix_r = g.Hdop*g.Hdop;
+				fix_V = g.Velocity;
+				fix_r_V = g.SAcc*g.SAcc;
+				fix_pending = FIX_X | FIX_Y | FIX_HEAD;
+				if(g.Velocity > MIN_GPS_SPEED)//if you're travelling at really slow speeds by gps standards, i.e., less than 3m/s, this correction might actually be counter-productive.
+				{
+					fix_pending |= FIX_V;
+				}
+			}
+		}
+		if(position_reset && good)//position reset condition is checked before using gps data to prevent jumps in position when gps error drops below 2.5m
+		{
+			int32_t dlon, dlat;
+			if(!frame.near(g.lon, g.lat))//still on the placeholder origin (cold start) or a long way off : the scales are for somewhere else
+			{
+				frame.set_origin(g.lon, g.lat);//the trig, once
+			}
+			frame.offset(fix.X, fix.Y, dlon, dlat);
+			frame.move_origin(g.lon - dlon, g.lat - dlat);//lat lon reported by gps matches with the past value of position.
 
 			position_reset = false;//prevent this code block from being re-executed
 		}
+	}
 
-		latitude = iLat + double(Y*METER2DEG); //change lat and long accordingly. 
-		longitude = iLon + double(X*METER2DEG);
-		//note that if the location was initially wrong, resetting the iLat resets the lon/lat estimates without disturbing the relative position estimates 
-		PosError_tot = distancecalcy(0,PosError_X,0,PosError_Y,0);//OPTIMIZE
-		drift_Angle = (OF_V_X/Velocity); //uncomment when you have a quick atan function
-		// LPF(0,Velocity); //use this if you have a really noisy accelerometer but avoid at all costs.
-		return ;
-		//----------LOCALIZATION ENDS-------------------------------------
-	}//on an STM32F103C8T6 running at 128MHz clock speed, this function takes 60.61 us to execute and 44 bytes of extra memory for local variables.
+	//the fix still being corrected was compared with the estimate before the last correct_past(). It moves along with the
+	//history, else its next corrections would make this one a second time
+	void carry_fix()
+	{
+		if(fix_pending)
+		{
+			fix.X += dx[EKF_X];
+			fix.Y += dx[EKF_Y];
+			fix.V += dx[EKF_V];
+		}
+	}
 
+	//a position from the companion computer, in the same frame as X, Y. false if it was gated out
+	bool correct_companion(const STATE_COMPANION &c)
+	{
+		float (&p)[EKF_STATES][EKF_STATES] = P.m;
+		STATE_PAST then;
+		recall(c.age, then); //what we thought when the camera took the frame
+		float r = c.error*c.error;
+		float yx = c.X - then.X, yy = c.Y - then.Y;
+		//squared mahalanobis distance of the innovation, y' S^-1 y with S = P(X:Y,X:Y) + r as it was then, times det(S) so that
+		//there is no divide
+		float sxx = then.P[0][0] + r, syy = then.P[1][1] + r, sxy = then.P[0][1];
+		float det = sxx*syy - sxy*sxy;
+		if(syy*yx*yx - 2*sxy*yx*yy + sxx*yy*yy > COMPANION_GATE*det)
+		{
+			companion_outliers++;
+			if(++companion_rejects < COMPANION_MAX_REJECTS)
+			{
+				return false;
+			}
+			//the companion has been saying the same thing for a while, we're the ones who are lost. Open up the position so
+			//that this one gets in
+			p[0][0] += yx*yx;
+			p[1][1] += yy*yy;
+			then.P[0][0] += yx*yx;
+			then.P[1][1] += yy*yy;
+		}
+		companion_rejects = 0;
+		correct_past(EKF_X, yx, r, then);
+		carry_fix();
+		correct_past(EKF_Y, c.Y - then.Y, r, then); //the X correction moved then.Y too
+		carry_fix();
+		publish();
+		return true;
+	}
 };
-//this class takes 80 bytes in variables
+//this class takes 340 bytes in variables (P is 100 of them), plus 4320 bytes of history
 
 
 
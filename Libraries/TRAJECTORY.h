@@ -4,26 +4,25 @@
 #include"Arduino.h"
 #include"SIDMATH.h"
 #include"PARAMS.h"
+#include"ENU.h"
 
 class coordinates //for storing multiple coordinates as we further progress to multiple waypoint trajectories instead of just 1 waypoint
 {                               //this will become the main point of focus once the basic tasks are complete
 public:
-	double longitude,latitude;
+	int32_t longitude,latitude; //1e-7 deg
 	float X,Y;
 	float slope;
 	float next_gap;
 	float next_Kappa;
 	float next_X_max;
 	float next_Y_max;
-	void calcXY(double iLon, double iLat)
+	void calcXY(ENU &frame)
 	{
-		X = float(DEG2METER*(longitude - iLon));
-		Y = float(DEG2METER*(latitude - iLat));
+		frame.project(longitude, latitude, X, Y);
 	}
-	void calcLatLon(double iLon, double iLat)
+	void calcLatLon(ENU &frame)
 	{
-		longitude = iLon + double(METER2DEG*X);
-		latitude  = iLat + double(METER2DEG*Y);
+		frame.unproject(X, Y, longitude, latitude);
 	}
 	void copy(coordinates c)
 	{
@@ -0,0 +1,289 @@
+#ifndef _UBX_H_
+#define _UBX_H_
+
+#include"Arduino.h"
+#include<libmaple/dma.h>
+#include<libmaple/usart.h>
+
+//UBX receiver for the GPS port. USART1's RX goes to a DMA channel that drops every byte into a circular buffer by itself, so
+//nothing in loop() reads the port byte by byte any more. Once the line goes idle the framer walks whatever came in.
+//
+//Messages are table driven : add() registers a class/id, its payload length (or the range of them) and a handler. Every registered message has three
+//slots of its own, and the framer stores a frame straight into a free slot of its message as soon as the header says which one
+//it is. dispatch() then hands the newest complete frame of every message to its handler by pointer (class, id, length,
+//payload, laid out like the structs in GPS_NAV_PVT.h), so the handler reads the fields in place. It's constant time : one
+//check per registered message, and the framer never writes into the slot a handler got last time. Messages that aren't in
+//the table are checksummed and skipped, so turning on another message on the receiver doesn't break anything.
+//
+//The framer works a byte at a time : the Fletcher checksum (CK_A/CK_B over class, id, length and payload) is kept up to date
+//as the bytes go by, so there is no second pass over the frame at the end. The declared length is checked against the table's
+//bounds (or against UBX_MAX_SKIP for the ones we skip) before any payload is stored. A handler whose message can be longer
+//than its struct finds the length in the frame, bytes 2 and 3.
+//
+//libmaple's USART1 interrupt only knows about RXNE, so the idle line is spotted in software: poll() sees that the DMA count
+//hasn't moved since the last poll. Call it once a tick from a background task. A tick of silence is ~57 characters at
+//230400 baud, a UBX message never has a gap that long in it. poll() and dispatch() both run in loop(), nothing here is
+//touched from an interrupt.
+//
+//Every frame is stamped with the micros() its last byte came in at. The framer runs a tick or two after that, so the stamp
+//is worked back from the last poll that saw the DMA move and the number of bytes that came in after the frame. Handlers
+//find the stamp of the frame they are given in received.
+
+#define UBX_RX_BUFFER 512 //bytes, power of 2. ~22ms at 230400 baud, poll() has to run at least that often
+#define UBX_MAX_PAYLOAD 92 //NAV-PVT, the longest message we ask for. No message's max_len can be more
+#define UBX_MAX_SKIP 256 //a message we don't know that says it's longer than this is taken as a corrupted length
+#define UBX_FRAME_HEADER 4 //class, id, length
+#define UBX_FRAME_SIZE (UBX_FRAME_HEADER + UBX_MAX_PAYLOAD) //everything between the sync chars and the checksum
+#define UBX_MAX_MESSAGES 4
+#define UBX_SLOTS 3
+#define UBX_SKIP 0xFF //current message when the frame isn't one of ours
+#define UBX_RX_DMA DMA1
+#define UBX_RX_DMA_CHANNEL DMA_CH5 //USART1_RX
+
+const unsigned char UBX_HEADER[] = { 0xB5, 0x62 };  //header of the incoming signal
+
+typedef void (*UBX_HANDLER)(void *owner, const uint8_t *frame);
+
+struct UBX_MESSAGE
+{
+	uint8_t cls, id;
+	uint16_t len, max_len; //payload. frames shorter than len or longer than max_len are thrown away
+	UBX_HANDLER handler;
+	uint8_t slot[UBX_SLOTS][UBX_FRAME_SIZE] __attribute__((aligned(4))); //so that a slot can be read as one of the structs
+	uint8_t writing, ready, reading; //slots : being framed, newest complete one, held by the handler
+	bool fresh; //ready hasn't been dispatched yet
+	uint32_t frames; //complete frames
+	uint32_t stamp[UBX_SLOTS]; //micros() when the last byte of the frame in the slot came in
+};
+
+class UBX_RX
+{
+public:
+	uint8_t ring[UBX_RX_BUFFER]; //the DMA writes here
+	UBX_MESSAGE msg[UBX_MAX_MESSAGES];
+	uint8_t num_messages;
+	void *owner; //handed to the handlers
+	uint16_t tail; //next byte in the ring that the framer hasn't looked at
+	uint16_t last_head; //where the DMA was at the last poll
+	uint16_t fpos; //where we are in the current frame, counting the sync chars
+	uint16_t len; //payload length of the current frame
+	uint8_t header[UBX_FRAME_HEADER]; //of the current frame, until we know which message it is
+	uint8_t current; //index in msg of the current frame, UBX_SKIP if it isn't one of ours
+	uint8_t CK[2]; //running checksum of the current frame
+	uint32_t skipped, errors; //good frames that aren't in the table, bad checksums and lengths
+	uint32_t byte_ns; //time one character takes on the line
+	uint32_t moved_us; //micros() of the last poll that saw the DMA move, the byte before last_head came in just before it
+	uint32_t received; //stamp of the frame the handler being called was given
+
+	UBX_RX()
+	{
+		num_messages = 0;
+		owner = NULL;
+		tail = last_head = fpos = len = 0;
+		current = UBX_SKIP;
+		skipped = errors = 0;
+		byte_ns = 0;
+		moved_us = received = 0;
+	}
+
+	//false if the table is full or the message doesn't fit in a slot. max_length is for the messages that can come in longer
+	//(newer protocol versions add fields at the end, some have repeated blocks), 0 if it's always payload_length
+	bool add(uint8_t cls, uint8_t id, uint16_t payload_length, UBX_HANDLER handler, uint16_t max_length = 0)
+	{
+		if(max_length < payload_length)
+		{
+			max_length = payload_length;
+		}
+		if(num_messages == UBX_MAX_MESSAGES || max_length > UBX_MAX_PAYLOAD)
+		{
+			return false;
+		}
+		UBX_MESSAGE &m = msg[num_messages++];
+		m.cls = cls;
+		m.id = id;
+		m.len = payload_length;
+		m.max_len = max_length;
+		m.handler = handler;
+		m.writing = 0;
+		m.ready = 1;
+		m.reading = 2;
+		m.fresh = false;
+		m.frames = 0;
+		memset(m.stamp, 0, sizeof(m.stamp));
+		return true;
+	}
+
+	//call after Serial1.begin(), every time : begin() gives the port back to the core's interrupt
+	void begin(usart_dev *usart, uint32_t baud)
+	{
+		byte_ns = 10000000000ULL/baud; //start, 8 data bits, stop
+		dma_init(UBX_RX_DMA);
+		dma_disable(UBX_RX_DMA, UBX_RX_DMA_CHANNEL);
+		dma_setup_transfer(UBX_RX_DMA, UBX_RX_DMA_CHANNEL, &usart->regs->DR, DMA_SIZE_8BITS, ring, DMA_SIZE_8BITS,
+						   DMA_MINC_MODE | DMA_CIRC_MODE);
+		dma_set_num_transfers(UBX_RX_DMA, UBX_RX_DMA_CHANNEL, UBX_RX_BUFFER);
+		dma_enable(UBX_RX_DMA, UBX_RX_DMA_CHANNEL);
+		usart->regs->CR1 &= ~USART_CR1_RXNEIE; //otherwise the core's interrupt reads DR before the DMA gets to it
+		usart->regs->CR3 |= USART_CR3_DMAR;
+		tail = last_head = head();
+		moved_us = micros();
+		fpos = len = 0;
+	}
+
+	inline uint16_t head() //where the DMA writes next
+	{
+		return (UBX_RX_BUFFER - dma_get_count(UBX_RX_DMA, UBX_RX_DMA_CHANNEL)) & (UBX_RX_BUFFER - 1);
+	}
+
+	//once a tick. frames what came in once the line has gone quiet (or the ring is half full anyway). true if it did
+	bool poll()
+	{
+		uint32_t now = micros();
+		uint16_t h = head();
+		uint16_t pending = (h - tail) & (UBX_RX_BUFFER - 1);
+		bool idle = h == last_head;
+		if(!idle)
+		{
+			last_head = h;
+			moved_us = now;
+		}
+		if(!pending || (!idle && pending < UBX_RX_BUFFER/2))
+		{
+			return false;
+		}
+		frame_all();
+		return true;
+	}
+
+	//frames everything the DMA has written so far
+	void on_idle()
+	{
+		last_head = head();
+		moved_us = micros();
+		frame_all();
+	}
+
+	//newest complete frame of message i, or NULL if nothing new came in since the last take(i). The pointer stays good until
+	//the next take(i)
+	const uint8_t *take(uint8_t i)
+	{
+		UBX_MESSAGE &m = msg[i];
+		if(!m.fresh)
+		{
+			return NULL;
+		}
+		uint8_t t = m.reading;
+		m.reading = m.ready;
+		m.ready = t;
+		m.fresh = false;
+		return m.slot[m.reading];
+	}
+
+	//calls the handler of every message that came in since the last dispatch() with its newest frame. returns how many
+	uint8_t dispatch()
+	{
+		uint8_t n = 0;
+		for(uint8_t i = 0; i < num_messages; i++)
+		{
+			const uint8_t *frame = take(i);
+			if(frame)
+			{
+				received = msg[i].stamp[msg[i].reading];
+				msg[i].handler(owner, frame);
+				n++;
+			}
+		}
+		return n;
+	}
+
+private:
+	void frame_all() //up to last_head
+	{
+		while(tail != last_head)
+		{
+			feed(ring[tail]);
+			tail = (tail + 1) & (UBX_RX_BUFFER - 1);
+		}
+	}
+
+	void publish(UBX_MESSAGE &m) //on the last byte of the frame, which is ring[tail]
+	{
+		uint16_t after = (last_head - tail - 1) & (UBX_RX_BUFFER - 1); //bytes that came in after it
+		m.stamp[m.writing] = moved_us - after*byte_ns/1000;
+		uint8_t t = m.ready;
+		m.ready = m.writing;
+		m.writing = t;
+		m.fresh = true;
+		m.frames++;
+	}
+
+	//class, id and length are in. find the message and check the length
+	bool identify()
+	{
+		len = header[2] | (uint16_t(header[3]) << 8);
+		current = UBX_SKIP;
+		for(uint8_t i = 0; i < num_messages; i++)
+		{
+			if(msg[i].cls == header[0] && msg[i].id == header[1])
+			{
+				current = i;
+				memcpy(msg[i].slot[msg[i].writing], header, UBX_FRAME_HEADER);
+				return len >= msg[i].len && len <= msg[i].max_len;
+			}
+		}
+		return len <= UBX_MAX_SKIP;
+	}
+
+	void feed(uint8_t c)
+	{
+		if(fpos < 2) //checking for the 2 sync chars. a 0xB5 where the 0x62 should be may be the start of the real header
+		{
+			fpos = c == UBX_HEADER[fpos] ? fpos + 1 : (c == UBX_HEADER[0] ? 1 : 0);
+			CK[0] = CK[1] = 0;
+			len = 0;
+			return;
+		}
+		uint16_t n = fpos - 2; //position in the frame
+		if(n < UBX_FRAME_HEADER + len) //class, id, length, payload : store and checksum
+		{
+			if(n < UBX_FRAME_HEADER)
+			{
+				header[n] = c;
+			}
+			else if(current != UBX_SKIP)
+			{
+				msg[current].slot[msg[current].writing][n] = c;
+			}
+			CK[0] += c;
+			CK[1] += CK[0];
+			fpos++;
+			if(n == UBX_FRAME_HEADER - 1 && !identify()) //wrong length for the message, or the length itself got corrupted
+			{
+				errors++;
+				fpos = 0;
+			}
+			return;
+		}
+		if(n == UBX_FRAME_HEADER + len && c == CK[0])
+		{
+			fpos++;
+			return;
+		}
+		fpos = 0;
+		if(n == UBX_FRAME_HEADER + len + 1 && c == CK[1])
+		{
+			if(current == UBX_SKIP)
+			{
+				skipped++;
+			}
+			else
+			{
+				publish(msg[current]);
+			}
+			return;
+		}
+		errors++; //the data can't be trusted, look for the next header
+	}
+};
+
+#endif
@@ -17,21 +17,41 @@
 #include"SIDMATH.h"
 #include"COMS.h"
 #include"STATE.h"
+#ifdef STATE_SCALAR_FILTER
+#include"STATE_SCALAR.h" //the filter from before the EKF, for comparing the two
+#endif
 #include"CAR.h"
 #include"PARAMS.h"
 #include"TRAJECTORY.h"
 #include"COMPANION.h"//CHANGED
+#include"PROFILER.h"
+#ifndef MARG_AHRS
+#define MARG_AHRS MPU_AHRS_EULER //MPU_AHRS_QUATERNION for the quaternion AHRS (AHRS.h), lucifer_replay_quat flies it on the host
+#endif
+#include"SCHEDULER.h"
+#include"I2C_QUEUE.h"
+#include"MAG_CALIBRATOR.h"
 
 MPU9150 marg;
+I2C_QUEUE i2c_bus; //the MPU's reads go through here once it is set up, imu_rx moves them along
+MAG_CALIBRATOR mag_cal; //fits the mag's hard and soft iron from what it sees while driving, mag_cal_step swaps the result in
+uint16_t mag_cal_stored = 0; //mag_cal.swaps that are in the memory already
 OPFLOW opticalFlow;
 GPS gps;
+#ifdef STATE_SCALAR_FILTER
+STATE_SCALAR car;
+#elif defined(STATE_CLASS)
+STATE_CLASS car; //a host tool's STATE that also writes down what it is handed (lucifer_smooth)
+#else
 STATE car;
+#endif
 GCS gcs;
 trajectory track;
 controller control;
 JEVOIS jevois; //CHANGED
+PROFILER prof; //per phase timing of loop()
+SCHEDULER sched; //runs the tasks at the end of this file
 
-bool GPS_FIX;
 byte MODE = MODE_STANDBY;
 byte message;
 float inputs[8];
@@ -43,6 +63,36 @@ bool car_ready = false;
 float dest_X,dest_Y,slope;
 
 coordinates *c;
+void start_scheduler(); //bottom of the file, next to the task table
+
+//startup. setup() only does what takes no time, then the scheduler is running and startup_task walks these stages while the
+//400Hz loop is already up. The car stays in MODE_STANDBY until it gets to STARTUP_READY.
+#define STARTUP_OFFSETS 0 //no offsets in the EEPROM, asking the GCS for them
+#define STARTUP_CALIB 1   //the GCS doesn't have them either, calibrating
+#define STARTUP_GPS 2     //waiting for the first NAV-PVT, configures the receiver if it doesn't come
+#define STARTUP_FIX 3     //waiting for a fix good enough to put the car on the map
+#define STARTUP_READY 4
+#define STARTUP_RECALIB 5 //the GCS asked for the gyro and accel offsets again (CALIB_ID). back to the stage it came from after
+#define STARTUP_GPS_WAIT 3000 //ms without a NAV-PVT before the receiver is configured. A configured M8 talks well within that of power on
+#define STARTUP_OFFSETS_WAIT 10000 //ms of asking the GCS for offsets before calibrating
+#define STARTUP_CALIB_WAIT 2000 //ms for the GCS to tell the user what to do with the car before each calibration step
+#define WARM_ORIGIN_RADIUS 1000 //m. further than this from the stored origin and the car has been moved to another place
+
+byte startup;
+uint32_t startup_stamp; //millis() when the current stage (or calibration step) started
+uint8_t calib_step = 0;
+byte recalib_return; //the stage STARTUP_RECALIB goes back to
+uint32_t offset_request = 0; //millis() of the last offset request
+uint32_t ready_us = 0; //micros() when the car got to STARTUP_READY
+WARM_START warm; //last origin and learned biases, from the EEPROM
+bool warm_valid = false;
+bool was_autonomous = false;
+
+void next_stage(byte stage)
+{
+  startup = stage;
+  startup_stamp = millis();
+}
 
 void setup() 
 {
@@ -53,98 +103,89 @@ void setup()
   SPI.begin();
   Wire.begin();
   Wire.setClock(400000);  //start initializing driver code
-  delay(1000);
+  delay(100); //the MPU and the flow sensor need ~100ms after power on
   IO_init();
   set_Outputs(0,0);
   
   marg.initialize();
   opticalFlow.initialize();
   opticalFlow.caliberation(ride_height,0.0f ); //ride_height is stored in the param's header
-  gps.initialize();
+  gps.begin(); //if the receiver has been configured before, NAV-PVT just starts coming in
 
   int16_t A[3],G[3],M[3],T,gain[3];
-  if(!check_memory()) //if there are no offsets in the memory
-  {
-    bool avail = false;
-    long check_time = millis();
-    while(!avail)
-    {
-      avail = gcs.Get_Offsets(marg.offsetA, marg.offsetG, marg.offsetM, marg.offsetT,marg.axis_gain);
-      if(avail || millis()-check_time>10000)
-      {
-        break;
-      }
-    }
-    if(avail)//if GCS already has offsets
-    {
-      marg.getOffset(A,G,M,T,gain);
-      store_memory(0, A,G,M,T,gain);
-    }
-    //if GCS has no offsets and we don't have the offsets
-    else
-    {
-      gcs.Send_Calib_Command(1); //let GCS know we are doing calib
-      delay(2000);
-      marg.gyro_caliberation();
-      //keep the car still, rotate it 180, keep the car still again, rotate 180.
-      gcs.Send_Calib_Command(2);
-      delay(2000);
-      marg.accel_caliberation();
-
-      gcs.Send_Calib_Command(3);
-      delay(2000);
-      marg.mag_caliberation();
-
-      gcs.Send_Calib_Command(4);
-      
-      marg.getOffset(A,G,M,T,gain);
-      store_memory(0, A,G,M,T,gain);
-      
-      gcs.Send_Offsets(marg.offsetA, marg.offsetG, marg.offsetM, marg.offsetT, marg.axis_gain); //send new found offsets to GCS
-    }
-  }
-  else
+  if(check_memory()) //offsets in the memory
   {
     read_memory(0, A,G,M,T,gain);
     marg.setOffset(A,G,M,T,gain);
     gcs.Send_Offsets(marg.offsetA, marg.offsetG, marg.offsetM, marg.offsetT, marg.axis_gain); //send new found offsets to GCS
+    next_stage(STARTUP_GPS);
   }
-  marg.Setup();
-  
-  gps.localizer();//get initial location
-  long timeout = millis();
-  do //wait till we get a GPS fix
+  else
   {
-    gcs.Send_State(MODE, gps.latitude, gps.longitude,gps.latitude,gps.longitude, marg.V, marg.mh, marg.pitch, marg.roll, marg.Ha, opticalFlow.P_Error, 0, marg.mh_Error, marg.V_Error, 0,gps.Hdop,0);
-    if(gps.Hdop>1000)//if gps is unavailable, skip.
-    {
-      delay(100);
-      break;
-    }
+    next_stage(STARTUP_OFFSETS); //ask the GCS, calibrate if it doesn't have them. startup_task does it
   }
-  while(gps.fix_type()<2 && millis() - timeout < FIX_TIMEOUT );
-//  if(gps.fix_initial_position()&&0) //get initial coordinates
-  if(0)
+
+  warm_valid = read_warm_start(warm);
+  if(warm_valid) //start from what was learned last time instead of from scratch
   {
-    GPS_FIX = 1;
+    marg.setBias(warm.gyro_Bias);
+    car.AccBias = warm.AccBias;
+    control.feedback_factor = warm.feedback_factor;
   }
   else
   {
-    GPS_FIX = 0;
-    delay(100);
-    gps.localizer(); //use latest position from gps as a starting point.
+    memset(&warm, 0, sizeof(warm));
   }
+  marg.setAHRS(MARG_AHRS);
+  marg.Setup();
+  marg.setBus(&i2c_bus); //from here on compute_All takes the samples imu_rx fetched during the last tick instead of waiting on Wire
+  marg.setMagCal(&mag_cal);
+  car.initialize(warm.lon, warm.lat, gps.Hdop, marg.mh, 0, marg.Ha); //until there is a fix. Hdop is still the "no gps" value, so the origin moves to the first good fix
+  start_scheduler();
+}
 
-  car.initialize(gps.longitude, gps.latitude, gps.Hdop, marg.mh, 0, marg.Ha);
-  
+void save_warm_start()
+{
+  warm.lon = car.frame.lon0;
+  warm.lat = car.frame.lat0;
+  marg.getBias(warm.gyro_Bias);
+  warm.AccBias = car.AccBias;
+  warm.feedback_factor = control.feedback_factor;
+  store_warm_start(warm);
+  if(mag_cal.swaps != mag_cal_stored) //the next power on starts from the mag's offsets the car found on its own
+  {
+    int16_t A[3],G[3],M[3],gain[3],T;
+    marg.getOffset(A,G,M,T,gain);
+    store_memory(0, A,G,M,T,gain);
+    mag_cal_stored = mag_cal.swaps;
+  }
+  warm_valid = true;
+  sched.resync(); //flash writes take a while
 }
 
-unsigned long timer,time_it;
-unsigned long T,benchmark;
+void place_car() //the fix is in (or we gave up on it)
+{
+  if(warm_valid && gps.fix_ok && gps.DOP[0] < GPS_HDOP_LIM)
+  {
+    float X, Y;
+    ENU origin;
+    origin.set_origin(warm.lon, warm.lat);
+    origin.project(gps.lon, gps.lat, X, Y);
+    if(X*X + Y*Y < float(WARM_ORIGIN_RADIUS)*WARM_ORIGIN_RADIUS) //same place as last time, keep the origin the waypoints were laid out in
+    {
+      car.initialize(warm.lon, warm.lat, gps.lon, gps.lat, gps.Hdop, marg.mh, 0, marg.Ha);
+      return;
+    }
+  }
+  car.initialize(gps.lon, gps.lat, gps.Hdop, marg.mh, 0, marg.Ha);
+}
+
+uint8_t profile_phase = 0; //phase whose timing goes to the GCS next
+uint16_t reported_late = 0; //overruns already reported to the GCS
 bool reflect_WP = false;
 float dummy;
 int16_t jevois_message;
-float jevois_X,jevois_Y;
+float jevois_X,jevois_Y,jevois_age,jevois_error;
 
 void clear_wp()
 {
@@ -156,55 +197,63 @@ void clear_wp()
   delete[] c; //clear all waypoints
 }
 
-void loop() 
+//================TASKS================
+//loop() is cut into tasks that the scheduler runs at their own rates, see the task table below and SCHEDULER.h.
+//one tick = dt_micros = 2500us.
+
+void imu_task() //400Hz
 {
-  timer = micros();//this is to ensure that the cycle time remains constant at 2500us. How do I know it's not exceeding that limit? 
-                    //I unit test each of the functions to check how much time they take to execute.
   //================GET SENSOR DATA================
   control.get_model(marg.encoder_velocity); //comment out if not using output throttle signal as a rough speed estimate
-  marg.compute_All(); //get AHRS (and Velocity as well) from IMU. 980us, has failsafe in case sensor is reset somehow
+  prof.mark(PHASE_SENSOR_READ);
+  marg.compute_All(false); //get AHRS (and Velocity as well) from IMU, every sample the bus brought in from the MPU's FIFO during the last tick. the mag has its own task. has failsafe in case sensor is reset somehow
+  prof.mark(PHASE_COMPUTE_ALL);
   
   marg.get_Rotations(opticalFlow.omega); //transfer rates of rotation
   opticalFlow.updateOpticalFlow(); //update optical flow 150us
   if(opticalFlow.failure)
   {
-    timer = micros();
+    sched.resync();
   }
-  gps.localizer(); //update gps. 12us
-  //till here it takes 180us, total at 1170us
+  prof.mark(PHASE_OPTICAL_FLOW);
+  gps.localizer(); //pick up a NAV-PVT if gps_rx has framed one. constant time, the port is read by DMA
+  prof.mark(PHASE_GPS);
   //================SENSOR FUSION===================
-  car.state_update(gps.longitude, gps.latitude, gps.tick, gps.Hdop, gps.gSpeed, gps.Sdop, gps.headMot, gps.headAcc,
+  //I know i could've just passed the gps, marg and optical flow objects but then the state library would become dependent on these
+  //libraries and for some unkown reason I want to keep it a bit more generic
+#ifdef STATE_SCALAR_FILTER
+  car.state_update(gps.lon, gps.lat, gps.tick, gps.age(sched.tick_stamp), gps.Hdop, gps.gSpeed, gps.Sdop, gps.headMot, gps.headAcc,
                   marg.mh, marg.mh_Error, marg.yawRate, marg.heading_drift, marg.Ha, marg.V, marg.V_Error,
-                  opticalFlow.X, opticalFlow.Y, opticalFlow.V_x, opticalFlow.V_y, opticalFlow.P_Error, opticalFlow.V_Error,marg.encoder_velocity); //I know i could've just passed the gps, marg and optical
-                              //flow objects but then the state library would become dependent on these libraries and for some unkown reason I want to keep it a bit more generic
-  marg.Velocity_Update(car.Velocity,car.VelError,car.AccBias);//pass the corrected velocity back to marg where it gets low pass filtered too.
-  
-  control.feedback(car.Velocity,car.VelError,opticalFlow.V_Error);//giving feedback to the car's model for making the machine learn the parameter(s) of the model
-//transfer the bias. this is pretty much the reason why the update function does not take arguments by reference
-  //till here it takes 120us, total at 1330us
-  //================HANDLE COMMUNICATIONS================
-
-  message = gcs.check();//automatically regulates itself at 10Hz, don't worry about it
-  if(reflect_WP)//if waypoints are to be sent back, this remains true
+                  opticalFlow.X, opticalFlow.Y, opticalFlow.V_x, opticalFlow.V_y, opticalFlow.P_Error, opticalFlow.V_Error,marg.encoder_velocity);
+#else
+  STATE_MOTION motion = {marg.mh, marg.mh_Error, marg.Ha, marg.V, opticalFlow.X, opticalFlow.Y, opticalFlow.fresh, marg.encoder_velocity[2]};
+  car.predict(motion);
+  if(opticalFlow.fresh)
   {
-    reflect_WP = !(gcs.Send_WP(c[point].X,c[point].Y,c[point].slope,point)); //this function will return true when waypoints have been sent back
-  }
-  else //this is for the general case
-  {
-//    gcs.Send_State(MODE, double(car.X), double(car.Y),gps.longitude, gps.latitude, car.Velocity, marg.mh, marg.pitch, marg.roll, 
-//                  inputs[7], opticalFlow.SQ, car.PosError_tot , marg.mh_Error, car.VelError, T,gps.Hdop); //also regulated at 10Hz
-//      gcs.Send_State(MODE, double(car.X), double(car.Y),double(track.X_max),double(track.Y_max),track.C[1],track.braking_distance,marg.mh,0,
-//                    car.Velocity, opticalFlow.SQ, car.PosError_tot , marg.mh_Error, 3.15, benchmark,gps.Hdop);
-//    gcs.Send_State(MODE, double(gps.VelNED[1]),double(gps.VelNED[0]) ,gps.longitude, gps.latitude, gps.gSpeed, marg.mh, marg.pitch, marg.roll, 
-//                  gps.headVeh, gps.headMot, car.PosError_tot , marg.mh_Error, 3.16, T,gps.Hdop); //also regulated at 10Hz
-    gcs.Send_State(MODE, double(car.X), double(car.Y),gps.longitude, gps.latitude, car.Velocity, marg.mh, marg.pitch, marg.roll, 
-                  marg.heading_drift, opticalFlow.SQ, car.PosError_tot , marg.mh_Error, car.VelError, T,gps.Hdop, jevois.rec_status()); //also regulated at 10Hz
+    STATE_FLOW flow = {opticalFlow.V_x, opticalFlow.V_y, opticalFlow.V_Error};
+    car.correct_flow(flow);
   }
-  if(gcs.get_Mode()!=255)//255 is condition for no message received yet.
+  if(gps.tick && MODE != MODE_NO_GPS) //GPS denied, the companion's positions are all we go by
   {
-    MODE = gcs.get_Mode();
+    STATE_GPS fix = {gps.lon, gps.lat, gps.age(sched.tick_stamp), gps.Hdop, gps.gSpeed, gps.Sdop, gps.DOP[0], gps.fix_ok};
+    car.correct_gps(fix);
   }
+#endif
+  marg.Velocity_Update(car.Velocity,car.VelError,car.AccBias);//pass the corrected velocity back to marg where it gets low pass filtered too.
   
+  control.feedback(car.Velocity,car.VelError,opticalFlow.V_Error);//giving feedback to the car's model for making the machine learn the parameter(s) of the model
+  control.filter(marg.yawRate, marg.La, marg.Ha); //the driver's low pass filters run at the observation rate
+  prof.mark(PHASE_STATE_UPDATE);
+}
+
+void mag_task() //100Hz
+{
+  marg.mag_Update(); //the 6 bytes queued by the last call, and queues the next ones. the MPU's master got the mag on its own
+  prof.mark(PHASE_COMPUTE_ALL);
+}
+
+void control_task() //200Hz
+{
   get_Inputs(inputs); //get inputs from r/c receiver
   if(gcs.failsafe)//if gcs has shutdown for some reason, fallback on the transmitter.
   {
@@ -225,27 +274,112 @@ void loop()
       MODE = MODE_STANDBY;
     }
   }
+  if(startup != STARTUP_READY)//not calibrated or not on the map yet
+  {
+    MODE = MODE_STANDBY;
+  }
 
-  if(message == SET_ORIGIN_ID)//this is for resetting the position
+  if( distancecalcy(car.Y, dest_Y, car.X, dest_X,0) <= WP_CIRCLE && num_waypoints!=0 && car_ready)//checking if waypoint has been reached
+  {
+    sentinel++;
+    if(circuit)
+    {
+      sentinel = sentinel%num_waypoints;
+      dest_X = c[sentinel].X; //TODO : maybe just pass the object of the coordinate instead of transfering all the values manually.
+      dest_Y = c[sentinel].Y;
+      slope = c[sentinel].slope; 
+    }
+    else
+    {
+      sentinel = min(sentinel,num_waypoints-1);
+      if(sentinel == num_waypoints-1)
+      {
+        clear_wp();
+      }
+      else
+      {
+        dest_X = c[sentinel].X; //TODO : maybe just pass the object of the coordinate instead of transfering all the values manually.
+        dest_Y = c[sentinel].Y;
+        slope = c[sentinel].slope; 
+      }
+    }
+
+  }
+
+  if(opticalFlow.failure)
+  {
+    MODE = MODE_STOP; //this is to ensure the car does not rocket itself into a wall due to an electronic failure on the optical flow's end, which is not highly likely but has happened some times.
+  }
+  prof.mark(PHASE_TRAJECTORY); //waypoint bookkeeping, the curvature calculation below adds to this
+  if( (MODE == CRUISE || MODE == LUDICROUS || MODE == MODE_NO_GPS) && point == num_waypoints-1 && num_waypoints!=0 )//autonomous modes. The paranthesis are important! the conditions need to be clubbed together
+  {
+    track.calculate_Curvatures(car.Velocity, car.X, car.Y, car.heading, dest_X, dest_Y, slope ); 
+    track.confirm_maxima_priority(c[sentinel], track.X_max, track.Y_max, track.C[1], track.braking_distance);
+    prof.mark(PHASE_TRAJECTORY);
+    control.drive(track.C, track.braking_distance, car.Velocity,car.drift_Angle, marg.yawRate, marg.La, marg.Ha, MODE, inputs); //send data to driver code.
+    dummy = track.braking_distance;
+  }
+  else if(MODE == MODE_PARTIAL || MODE == MODE_MANUAL || MODE == MODE_STOP || MODE == MODE_STANDBY || MODE==MODE_CONTROL_CHECK)//manual modes
+  {
+    float dum[] = {0.0,0.0};//dummy
+    control.drive(dum, 1000, car.Velocity,car.drift_Angle, marg.yawRate, marg.La, marg.Ha, MODE, inputs);
+  }
+  else
+  {
+    float dum[] = {0.0001,0.0001};//dummy
+    MODE = MODE_STANDBY;
+    control.drive(dum, 1000, car.Velocity,car.drift_Angle, marg.yawRate, marg.La, marg.Ha, MODE, inputs);
+  }
+  prof.mark(PHASE_DRIVER);
+}
+
+void telemetry_task() //10Hz
+{
+  //================HANDLE COMMUNICATIONS================
+  message = gcs.check();
+  if(reflect_WP)//if waypoints are to be sent back, this remains true
+  {
+    reflect_WP = !(gcs.Send_WP(c[point].X,c[point].Y,c[point].slope,point)); //this function will return true when waypoints have been sent back
+  }
+  else //this is for the general case
+  {
+//    gcs.Send_State(MODE, double(car.X), double(car.Y),gps.longitude, gps.latitude, car.Velocity, marg.mh, marg.pitch, marg.roll, 
+//                  inputs[7], opticalFlow.SQ, car.PosError_tot , marg.mh_Error, car.VelError, T,gps.Hdop); //also regulated at 10Hz
+//      gcs.Send_State(MODE, double(car.X), double(car.Y),double(track.X_max),double(track.Y_max),track.C[1],track.braking_distance,marg.mh,0,
+//                    car.Velocity, opticalFlow.SQ, car.PosError_tot , marg.mh_Error, 3.15, benchmark,gps.Hdop);
+//    gcs.Send_State(MODE, double(gps.VelNED[1]),double(gps.VelNED[0]) ,gps.longitude, gps.latitude, gps.gSpeed, marg.mh, marg.pitch, marg.roll, 
+//                  gps.headVeh, gps.headMot, car.PosError_tot , marg.mh_Error, 3.16, T,gps.Hdop); //also regulated at 10Hz
+    gcs.Send_State(MODE, double(car.X), double(car.Y),gps.longitude(), gps.latitude(), car.Velocity, marg.mh, marg.pitch, marg.roll, 
+                  marg.heading_drift, opticalFlow.SQ, car.PosError_tot , marg.mh_Error, car.VelError, prof.max_us[PHASE_CYCLE],gps.Hdop, jevois.rec_status()); //also regulated at 10Hz
+  }
+  if(gcs.get_Mode()!=255)//255 is condition for no message received yet.
   {
-    car.initialize(gps.longitude, gps.latitude, gps.Hdop, marg.mh, 0, marg.Ha);
+    MODE = gcs.get_Mode();
   }
   
-  if(message == CALIB_ID)//recalculate offsets
+  if(message == SET_ORIGIN_ID)//this is for resetting the position
+  {
+    car.initialize(gps.lon, gps.lat, gps.Hdop, marg.mh, 0, marg.Ha);
+    save_warm_start(); //the next power on starts in this origin
+  }
+
+  if(message == OFFSET_ID && startup == STARTUP_OFFSETS && gcs.msg_len == 28)//the GCS answered the offset request
   {
     int16_t A[3],G[3],M[3],gain[3],T;
-    gcs.Send_Calib_Command(1); //let GCS know we are doing calib
-    delay(2000);
-    marg.gyro_caliberation();//keep the car still, rotate it 180, keep the car still again, rotate 180.
-    gcs.Send_Calib_Command(2);
-    delay(2000);
-    marg.accel_caliberation();
-    
+    gcs.Read_Offsets(marg.offsetA, marg.offsetG, marg.offsetM, marg.offsetT, marg.axis_gain);
     marg.getOffset(A,G,M,T,gain);
     store_memory(0, A,G,M,T,gain);
-    
-    gcs.Send_Offsets(marg.offsetA, marg.offsetG, marg.offsetM, marg.offsetT,marg.axis_gain); //send new found offsets to GCS
-    timer = micros(); //reset timer  
+    marg.Setup();
+    sched.resync();
+    next_stage(STARTUP_GPS);
+  }
+  
+  if(message == CALIB_ID && startup != STARTUP_CALIB && startup != STARTUP_RECALIB)//recalculate offsets. startup_task does it
+  {
+    gcs.Send_Calib_Command(1); //let GCS know we are doing calib
+    calib_step = 1;
+    recalib_return = startup;
+    next_stage(STARTUP_RECALIB);
   }
 
   if(message == WP_ID)//if waypoint message is received
@@ -264,7 +398,7 @@ void loop()
       c[point].X = dummy_X;
       c[point].Y = dummy_Y;
       c[point].slope = dummy_Slope;
-      c[point].calcLatLon(car.iLon, car.iLat); // calculate lat lon just in case
+      c[point].calcLatLon(car.frame); // calculate lat lon just in case
       if(point == num_waypoints-1)
       {
         if( check_loop(c[0],c[point]) ) //check if first and last points are within 1/2 a meter range
@@ -279,7 +413,7 @@ void loop()
         slope  = c[0].slope;
         car_ready = true;
         sentinel = 0;
-        timer = micros();
+        sched.resync();
       }
     }
     else
@@ -291,72 +425,210 @@ void loop()
   {
     clear_wp();
   }
+  prof.mark(PHASE_COMMS);
   //========COMPANION CODE HERE=========
   jevois_message = jevois.check();
-  if(jevois_message==STATE_ID)
+  if(jevois_message==STATE_ID && jevois.get_data(jevois_X,jevois_Y,jevois_age,jevois_error)) //cone localization or visual odometry, in the waypoints' frame
   {
-    jevois.get_data(jevois_X,jevois_Y);
+#ifndef STATE_SCALAR_FILTER
+    STATE_COMPANION position = {jevois_X, jevois_Y, jevois_age, jevois_error};
+    car.correct_companion(position); //gated, an outlier doesn't get in
+#endif
   }
   jevois.handle_Recording(message); //check if the message asks to start/stop recording and then handle it
   jevois.Send_State(MODE, car.X, car.Y, marg.mh, dest_X, dest_Y, slope, marg.pitch, marg.roll, marg.yawRate, car.Velocity);//CHANGED
-  //====================================
-  
-  if( distancecalcy(car.Y, dest_Y, car.X, dest_X,0) <= WP_CIRCLE && num_waypoints!=0 && car_ready)//checking if waypoint has been reached
+  prof.mark(PHASE_COMPANION);
+}
+
+void startup_task() //10Hz, see the stages above setup()
+{
+  if(startup == STARTUP_OFFSETS)
   {
-    sentinel++;
-    if(circuit)
+    if(millis() - offset_request >= 1000)
     {
-      sentinel = sentinel%num_waypoints;
-      dest_X = c[sentinel].X; //TODO : maybe just pass the object of the coordinate instead of transfering all the values manually.
-      dest_Y = c[sentinel].Y;
-      slope = c[sentinel].slope; 
+      gcs.Request_Offsets(); //the answer is picked up in telemetry_task
+      offset_request = millis();
     }
-    else
+    if(millis() - startup_stamp > STARTUP_OFFSETS_WAIT)//GCS has no offsets either
     {
-      sentinel = min(sentinel,num_waypoints-1);
-      if(sentinel == num_waypoints-1)
+      calib_step = 0;
+      next_stage(STARTUP_CALIB);
+    }
+  }
+  else if(startup == STARTUP_CALIB)
+  {
+    //one step per call. the steps themselves block (the car has to sit still through them), the waits in between don't
+    if(calib_step == 0 || millis() - startup_stamp > STARTUP_CALIB_WAIT)
+    {
+      if(calib_step == 1)
       {
-        clear_wp();
+        marg.gyro_caliberation();
+      }
+      else if(calib_step == 2)
+      {
+        marg.accel_caliberation(); //keep the car still, rotate it 180, keep the car still again, rotate 180.
+      }
+      else if(calib_step == 3)
+      {
+        marg.mag_caliberation();
+      }
+      calib_step++;
+      gcs.Send_Calib_Command(calib_step); //let GCS know which step we are on, 4 is done
+      startup_stamp = millis();
+      if(calib_step == 4)
+      {
+        int16_t A[3],G[3],M[3],gain[3],T;
+        marg.getOffset(A,G,M,T,gain);
+        store_memory(0, A,G,M,T,gain);
+        gcs.Send_Offsets(marg.offsetA, marg.offsetG, marg.offsetM, marg.offsetT, marg.axis_gain); //send new found offsets to GCS
+        marg.Setup();
+        next_stage(STARTUP_GPS);
+      }
+      sched.resync();
+    }
+  }
+  else if(startup == STARTUP_RECALIB)
+  {
+    //the gyro and accel steps of STARTUP_CALIB, with the same waits
+    if(millis() - startup_stamp > STARTUP_CALIB_WAIT)
+    {
+      if(calib_step == 1)
+      {
+        marg.gyro_caliberation();
+        calib_step = 2;
+        gcs.Send_Calib_Command(calib_step);
+        startup_stamp = millis();
       }
       else
       {
-        dest_X = c[sentinel].X; //TODO : maybe just pass the object of the coordinate instead of transfering all the values manually.
-        dest_Y = c[sentinel].Y;
-        slope = c[sentinel].slope; 
+        marg.accel_caliberation(); //keep the car still, rotate it 180, keep the car still again, rotate 180.
+        int16_t A[3],G[3],M[3],gain[3],T;
+        marg.getOffset(A,G,M,T,gain);
+        store_memory(0, A,G,M,T,gain);
+        gcs.Send_Offsets(marg.offsetA, marg.offsetG, marg.offsetM, marg.offsetT, marg.axis_gain); //send new found offsets to GCS
+        next_stage(recalib_return);
       }
+      sched.resync();
     }
-
   }
-
-  if(opticalFlow.failure)
+  else if(startup == STARTUP_GPS)
   {
-    MODE = MODE_STOP; //this is to ensure the car does not rocket itself into a wall due to an electronic failure on the optical flow's end, which is not highly likely but has happened some times.
+    if(gps.pvt != NULL)//a NAV-PVT came in, fix or not
+    {
+      next_stage(STARTUP_FIX);
+    }
+    else if(gps.config_step > 0 && !gps.configured)//configuring, a packet per call
+    {
+      if(gps.configure())
+      {
+        next_stage(STARTUP_GPS); //and wait for NAV-PVT again
+      }
+    }
+    else if(millis() - startup_stamp > STARTUP_GPS_WAIT)
+    {
+      if(!gps.configured)//receiver still talks NMEA at 9600 (new, or lost its settings)
+      {
+        gps.configure();
+      }
+      else //no gps. drive on the other sensors, the origin moves to the first good fix if one ever comes
+      {
+        ready_us = micros();
+        next_stage(STARTUP_READY);
+      }
+    }
   }
-  if( (MODE == CRUISE || MODE == LUDICROUS) && point == num_waypoints-1 && num_waypoints!=0 )//autonomous modes. The paranthesis are important! the conditions need to be clubbed together
+  else if(startup == STARTUP_FIX)
   {
-    time_it = micros();
-    track.calculate_Curvatures(car.Velocity, car.X, car.Y, car.heading, dest_X, dest_Y, slope ); 
-    track.confirm_maxima_priority(c[sentinel], track.X_max, track.Y_max, track.C[1], track.braking_distance);
-    benchmark = micros()-time_it;
-    control.driver(track.C, track.braking_distance, car.Velocity,car.drift_Angle, marg.yawRate, marg.La, marg.Ha, MODE, inputs); //send data to driver code. automatically maintains a separate control frequency.
-    dummy = track.braking_distance;
+    if((gps.fix_ok && gps.DOP[0] < GPS_HDOP_LIM) || millis() - startup_stamp > FIX_TIMEOUT)
+    {
+      place_car();
+      ready_us = micros();
+      next_stage(STARTUP_READY);
+    }
   }
-  else if(MODE == MODE_PARTIAL || MODE == MODE_MANUAL || MODE == MODE_STOP || MODE == MODE_STANDBY || MODE==MODE_CONTROL_CHECK)//manual modes
+  prof.mark(PHASE_COMMS);
+}
+
+void housekeeping_task() //1Hz
+{
+  if(sched.late != reported_late)//some ticks ran over dt_micros in the last second. prof.overruns says which phase did it
   {
-    float dum[] = {0.0,0.0};//dummy
-    control.driver(dum, 1000, car.Velocity,car.drift_Angle, marg.yawRate, marg.La, marg.Ha, MODE, inputs);
+    reported_late = sched.late;
+    gcs.Send_Calib_Command(5);
   }
-  else
+  bool autonomous = MODE == CRUISE || MODE == LUDICROUS || MODE == MODE_NO_GPS;
+  if(was_autonomous && !autonomous)//run's over, keep what the car learned in it
   {
-    float dum[] = {0.0001,0.0001};//dummy
-    MODE = MODE_STANDBY;
-    control.driver(dum, 1000, car.Velocity,car.drift_Angle, marg.yawRate, marg.La, marg.Ha, MODE, inputs);
+    save_warm_start();
   }
-  if(micros()-timer > dt_micros)//in case the execution time exceeds loop time limit
+  was_autonomous = autonomous;
+  prof.mark(PHASE_COMMS);
+}
+
+void imu_rx() //background. when the FIFO's count lands, queues the read of its records. the I2C interrupt moves the bytes
+{
+  marg.poll();
+}
+
+void gps_rx() //background. frames the GPS bytes that the DMA brought in, once the line goes idle
+{
+  gps.receive();
+}
+
+void jevois_rx() //background. notes when a companion message came in, check() only gets to it at 10Hz
+{
+  jevois.poll();
+}
+
+void mag_cal_step() //background. one slice of the mag's ellipsoid fit, a converged fit replaces offsetM and axis_gain
+{
+  if(mag_cal.step())
   {
-    gcs.Send_Calib_Command(5);
+    marg.setMagOffset(mag_cal.offset, mag_cal.gain);
   }
-  
-  T = max(micros()-timer,T);
-  while(micros()-timer < dt_micros ); //dt_micros is defined in PARAMS.h
+}
+
+void profile_log() //background
+{
+  if(gcs.Send_Profile(profile_phase, prof.min_us[profile_phase], prof.mean(profile_phase), prof.max_us[profile_phase], prof.p99(profile_phase),
+                      prof.overruns[profile_phase], prof.samples[profile_phase])) //rate limited to 10Hz, one phase at a time
+  {
+    profile_phase = (profile_phase+1)%NUM_PHASES;
+  }
+}
+
+//highest rate first. The offsets keep the mag, telemetry, housekeeping and startup off the even ticks (control) and off each other,
+//so the worst tick is imu + control. budgets are in us on the STM32 @128MHz.
+TASK tasks[] = {
+//  run                 period                           offset  budget  overruns  worst
+  { imu_task,           1,                               0,      1400,   0,        0 },
+  { control_task,       SCHED_RATE(CONTROL_FREQUENCY),   0,      700,    0,        0 },
+  { mag_task,           SCHED_RATE(MAG_UPDATE_RATE),     1,      300,    0,        0 },
+  { telemetry_task,     SCHED_RATE(GPS_UPDATE_RATE),     3,      800,    0,        0 },
+  { housekeeping_task,  SCHED_RATE(1),                   7,      100,    0,        0 },
+  { startup_task,       SCHED_RATE(GPS_UPDATE_RATE),     23,     200,    0,        0 },
+};
+
+//budget 0 : polls, they also go round while the scheduler waits for the next tick
+TASK background[] = {
+  { imu_rx,             0,                               0,      0,      0,        0 },
+  { gps_rx,             0,                               0,      150,    0,        0 },
+  { jevois_rx,          0,                               0,      0,      0,        0 },
+  { mag_cal_step,       0,                               0,      150,    0,        0 },
+  { profile_log,        0,                               0,      300,    0,        0 },
+};
+
+void start_scheduler()
+{
+  gcs.scheduled = true; //the 10Hz rate comes from the task table now
+  jevois.scheduled = true;
+  sched.begin(tasks, sizeof(tasks)/sizeof(TASK), background, sizeof(background)/sizeof(TASK));
+}
+
+void loop() 
+{
+  prof.begin_cycle();
+  sched.run_tasks(); //everything that is due in this tick, highest rate first
+  prof.end_cycle(); //prof.overruns keeps count of which phase was to blame for each overrun
+  sched.idle(); //background work in whatever is left of the tick, then wait for the next one. dt_micros is defined in PARAMS.h
 }